@@ -88,6 +88,32 @@ class ByteType(Enum):
     checksum = 3
 
 
+class CoilState:
+    '''
+    Packet assembly state of one coil.
+    '''
+
+    def __init__(self):
+        self.packet = None
+        self.last_packet_start_time = None
+        self.last_packet_end_time = None
+
+        self.last_packet_byte = ByteType.unknown
+        self.next_packet_byte = ByteType.header
+        self.last_packet_byte_start_time = None
+        self.last_packet_byte_end_time = None
+
+        self.remaining_message_bytes = 0
+
+        self.packet_bytes = []
+
+    def compute_checksum(self):
+        checksum = 0
+        for val in self.packet_bytes:
+            checksum = checksum ^ val
+        return checksum
+
+
 # High level analyzers must subclass the HighLevelAnalyzer class.
 class Hla(HighLevelAnalyzer):
     # List of settings that a user can set for this High Level Analyzer.
@@ -109,6 +135,9 @@ class Hla(HighLevelAnalyzer):
         },
         'unknown': {
             'format': 'Unknown ({{data.value}})'
+        },
+        'repeat': {
+            'format': 'Repeated: {{data.value}}'
         }
     }
 
@@ -122,24 +151,16 @@ class Hla(HighLevelAnalyzer):
         # print("Settings:", self.my_string_setting,
         #       self.my_number_setting, self.my_choices_setting)
 
-        self.packet = None
-        self.last_packet_start_time = None
-        self.last_packet_end_time = None
+        # The LLA decodes each coil of a multi-coil transmitter on its own, and their bytes interleave; frames from a
+        # single coil have no 'coil' field.
+        self.coils = {}
 
-        self.last_packet_byte = ByteType.unknown
-        self.next_packet_byte = ByteType.header
-        self.last_packet_byte_start_time = None
-        self.last_packet_byte_end_time = None
-
-        self.remaining_message_bytes = 0
-
-        self.packet_bytes = []
-    
-    def compute_checksum(self):
-        checksum = 0
-        for val in self.packet_bytes:
-            checksum = checksum ^ val
-        return checksum
+    def frame_data(self, frame, value):
+        # Keep the coil of a multi-coil capture, so that the coils' packets can be told apart
+        data = {'value': value}
+        if 'coil' in frame.data:
+            data['coil'] = frame.data['coil']
+        return data
 
     def decode(self, frame: AnalyzerFrame):
         '''
@@ -148,6 +169,22 @@ class Hla(HighLevelAnalyzer):
         The type and data values in `frame` will depend on the input analyzer.
         '''
 
+        coil = int(frame.data['coil']) if 'coil' in frame.data else 0
+        if coil not in self.coils:
+            self.coils[coil] = CoilState()
+        state = self.coils[coil]
+
+        # With repeated packets collapsed, the LLA emits a single 'repeat' frame for a run of them, and no 'data' frames.
+        if frame.type == 'repeat':
+            state.next_packet_byte = ByteType.header
+            state.packet = None
+            state.last_packet_byte_end_time = frame.end_time
+            return AnalyzerFrame('repeat', frame.start_time, frame.end_time, self.frame_data(frame, frame.data['packets']))
+
+        # The LLA also emits 'packet' frames that are already decoded; the HLA builds its own from the 'data' frames.
+        if frame.type != 'data':
+            return None
+
         packet = int(frame.data['packet'])
         payload = int.from_bytes(frame.data['payload'], 'big')
         packet_byte = int.from_bytes(frame.data['packet_byte'], 'big')
@@ -160,58 +197,56 @@ class Hla(HighLevelAnalyzer):
 
         display_val = "0x{:02x}".format(data_val)
 
-        if self.last_packet_byte_end_time is not None:
-            gap = frame.start_time - self.last_packet_byte_end_time
+        if state.last_packet_byte_end_time is not None:
+            gap = frame.start_time - state.last_packet_byte_end_time
             if gap > GraphTimeDelta(millisecond=1):  # 1mS
-                self.next_packet_byte = ByteType.header
-                self.packet = None
-                self.last_packet_end_time = self.last_packet_byte_end_time
+                state.next_packet_byte = ByteType.header
+                state.packet = None
+                state.last_packet_end_time = state.last_packet_byte_end_time
 
-        curr_packet_byte = self.next_packet_byte
+        curr_packet_byte = state.next_packet_byte
         if curr_packet_byte == ByteType.header:
             if data_val in Packet._value2member_map_:
-                self.packet = Packet(data_val)
-                self.last_packet_start_time = frame.start_time
-                self.last_packet_end_time = None
+                state.packet = Packet(data_val)
+                state.last_packet_start_time = frame.start_time
+                state.last_packet_end_time = None
 
-                self.remaining_message_bytes = self.packet.size
-                self.packet_bytes = [data_val]
+                state.remaining_message_bytes = state.packet.size
+                state.packet_bytes = [data_val]
 
-                display_val = str(self.packet)
+                display_val = str(state.packet)
 
-                self.next_packet_byte = ByteType.message
+                state.next_packet_byte = ByteType.message
             else:
-                self.packet = None
-                self.last_packet_start_time = frame.start_time
-                self.last_packet_end_time = frame.end_time
+                state.packet = None
+                state.last_packet_start_time = frame.start_time
+                state.last_packet_end_time = frame.end_time
 
-                self.remaining_message_bytes = 0
+                state.remaining_message_bytes = 0
 
-                self.next_packet_byte = ByteType.header
+                state.next_packet_byte = ByteType.header
                 curr_packet_byte = ByteType.unknown
         elif curr_packet_byte == ByteType.message:
-            self.packet_bytes.append(data_val)
+            state.packet_bytes.append(data_val)
 
-            self.remaining_message_bytes = self.remaining_message_bytes - 1
-            if self.remaining_message_bytes == 0:
-                self.next_packet_byte = ByteType.checksum
+            state.remaining_message_bytes = state.remaining_message_bytes - 1
+            if state.remaining_message_bytes == 0:
+                state.next_packet_byte = ByteType.checksum
         elif curr_packet_byte == ByteType.checksum:
-            self.next_packet_byte = ByteType.header
+            state.next_packet_byte = ByteType.header
 
-            self.last_packet_end_time = frame.end_time
+            state.last_packet_end_time = frame.end_time
 
-            checksum = self.compute_checksum()
+            checksum = state.compute_checksum()
             if checksum == data_val:
                 display_val = f'OK: {display_val}'
             else:
                 display_checksum = "0x{:02x}".format(checksum)
                 display_val = f'CHECKSUM ERROR: {display_val} != {display_checksum}'
 
-        self.last_packet_byte = curr_packet_byte
-        self.last_packet_byte_start_time = frame.start_time
-        self.last_packet_byte_end_time = frame.end_time
+        state.last_packet_byte = curr_packet_byte
+        state.last_packet_byte_start_time = frame.start_time
+        state.last_packet_byte_end_time = frame.end_time
 
         # Return the data frame itself
-        return AnalyzerFrame(curr_packet_byte.name, frame.start_time, frame.end_time, {
-            'value': display_val
-        })
+        return AnalyzerFrame(curr_packet_byte.name, frame.start_time, frame.end_time, self.frame_data(frame, display_val))
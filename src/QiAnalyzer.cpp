@@ -1,36 +1,42 @@
 #include <sstream>
 #include <ios>
 #include <algorithm>
+#include <memory>
+#include <vector>
 
 #include "QiAnalyzer.h"
-#include "QiAnalyzerSettings.h"
+#include "QiChannelEdgeSource.h"
+#include "QiRecordFile.h"
 #include <AnalyzerChannelData.h>
 
 
-#define CLAMP_MIN(VAL, MIN_VAL)     ((VAL) < (MIN_VAL) ? (MIN_VAL) : (VAL))
-
-
 static const U32 kBitRate = 2000;
 
+// Results are committed at the end of every packet, and at the latest after this many frames or milliseconds.
+static const U32 kCommitMaxPendingFrames = 256;
+static const U32 kCommitMaxDelayMs       = 50;
+// Progress is reported at most once per this fraction of a second of capture.
+static const U32 kProgressStridesPerSecond = 10;
+
 
 QiAnalyzer::QiAnalyzer()
     : Analyzer2()
     , mSettings(new QiAnalyzerSettings())
-    , mQi(nullptr)
     , mSimulationInitilized(false)
     , mSampleRateHz(0)
-    , mTLong(0)
-    , mTShort(0)
-    , mTLongMinError(0)
-    , mTLongMaxError(0)
-    , mTShortMinError(0)
-    , mTShortMaxError(0)
-    , mPacketByteCount(0)
-    , mSynchronized(false) {
+    , mCoilCount(0)
+    , mStatsInterval(0) {
     SetAnalyzerSettings(mSettings.get());
     UseFrameV2();
 
-    mPreambleEdges.reserve(64);
+    for (U32 i = 0; i < kQiMaxCoils; i++) {
+        mCoils[i].mListener.mAnalyzer          = this;
+        mCoils[i].mListener.mCoil              = i;
+        mCoils[i].mCollapsedListener.mAnalyzer = this;
+        mCoils[i].mCollapsedListener.mCoil     = i;
+    }
+    mCarrierListener.mAnalyzer = this;
+    mFskDecoder.SetListener(&mCarrierListener);
 }
 
 QiAnalyzer::~QiAnalyzer() {
@@ -40,298 +46,623 @@ QiAnalyzer::~QiAnalyzer() {
 void QiAnalyzer::SetupResults() {
     mResults.reset(new QiAnalyzerResults(this, mSettings.get()));
     SetAnalyzerResults(mResults.get());
-    mResults->AddChannelBubblesWillAppearOn(mSettings->mInputChannel);
+
+    Channel coils[kQiMaxCoils];
+    U32     coil_count = mSettings->GetCoilChannels(coils);
+    for (U32 i = 0; i < coil_count; i++)
+        mResults->AddChannelBubblesWillAppearOn(coils[i]);
 }
 
 void QiAnalyzer::WorkerThread() {
     mSampleRateHz = GetSampleRate();
 
-    mQi = GetAnalyzerChannelData(mSettings->mInputChannel);
+    mCommitScheduler.Reset(mSampleRateHz / kProgressStridesPerSecond, kCommitMaxPendingFrames, kCommitMaxDelayMs);
+    mStatsInterval = U64(mSettings->mStatsIntervalS) * mSampleRateHz;
+    mStartTime     = std::chrono::steady_clock::now();
+
+    Channel channels[kQiMaxCoils];
+    {
+        std::lock_guard<std::mutex> lock(mSessionStatsMutex);
+        mCoilCount = mSettings->GetCoilChannels(channels);
+        for (U32 i = 0; i < mCoilCount; i++)
+            mCoils[i].mSessionStats.Reset(mSampleRateHz);
+    }
+
+    // The patterns were checked when the settings were applied
+    std::string search_error;
+    mSearchPatterns.Compile(mSettings->mSearch.c_str(), search_error);
+    mSearchMatches.resize(mSearchPatterns.GetPatternCount());
+
+    U64 min_pulse_width = U64(mSettings->mGlitchFilterUs) * mSampleRateHz / 1000000;
+    std::vector<std::unique_ptr<QiChannelEdgeSource>>  channel_sources;
+    std::vector<std::unique_ptr<QiDeglitchEdgeSource>> sources;
+    for (U32 i = 0; i < mCoilCount; i++) {
+        channel_sources.emplace_back(new QiChannelEdgeSource(this, GetAnalyzerChannelData(channels[i])));
+        sources.emplace_back(new QiDeglitchEdgeSource(*channel_sources.back(), min_pulse_width));
+
+        Coil& coil                      = mCoils[i];
+        coil.mChannel                   = channels[i];
+        coil.mDeglitch                  = sources.back().get();
+        coil.mRejectedEdgesAtLastPacket = 0;
+        coil.mNextStatsSample           = mStatsInterval;
+        coil.mPacketCount               = 0;
+        coil.mChecksumErrorCount        = 0;
+        coil.mPacketAssembler.Reset();
+
+        coil.mTimingChecker.Reset(mSampleRateHz);
+        for (U32 rule = 0; rule < kQiTimingRuleCount; rule++)
+            coil.mTimingChecker.SetLimits(rule, mSettings->mTimingMin[rule], mSettings->mTimingMax[rule]);
+        coil.mSearch.Reset(&mSearchPatterns);
+
+        coil.mCollapser.Reset(mSettings->mRepeatCeTolerance, &coil.mCollapsedListener);
+    }
 
-    double period = 1.0 / double(kBitRate);
-    double half_period = period / 2.0;
-    // Period is 500uS
-    mTLong = U32(mSampleRateHz * period);
-    // Half a period, 250uS
-    mTShort = U32(mSampleRateHz * half_period);
-    // Pulse tolerances (long / short pulses)
-    // 2:  50%          (250 / 125)
-    // 3:  33.33%       (166 /  83)
-    // 4:  25%          (125 /  62)
-    // 5:  20%          (100 /  50)
-    // 6:  16.67%       ( 83 /  41)
-    // 8:  12.5%        ( 62 /  31)
-    // 10: 10%          ( 50 /  25)
-    mTLongMinError = CLAMP_MIN(mTLong / 4, 3);
-    mTLongMaxError = CLAMP_MIN(mTLong / 4, 3);
-    // Short min/max are only used for the initial pulse of a 1-bit; Long min/max are used for the whole bit
-    mTShortMinError = CLAMP_MIN(mTShort / 2, 3);
-    mTShortMaxError = CLAMP_MIN(mTShort / 2, 3);
+    mCarrierChannel = mSettings->mCarrierChannel;
+    mFskDecoder.Reset(mSampleRateHz);
+    mCarrierSource.reset();
+    if (mCarrierChannel != UNDEFINED_CHANNEL) {
+        mCarrierSource.reset(new QiChannelEdgeSource(this, GetAnalyzerChannelData(mCarrierChannel)));
+        mCarrierEdges.resize(kQiFskBatchSize);
+    }
 
-    Invalidate();
-    mQi->AdvanceToNextEdge();
+    if (mCoilCount == 1) {
+        mDecoder.SetListener(&mCoils[0].mListener);
+        mDecoder.Reset(mSampleRateHz);
+        mDecoder.SetTrackingTolerance(mSettings->mTrackingTolerance);
+        mCoils[0].mDecoder = &mDecoder;
 
-    for (;;) {
-        SynchronizeQiData();
-        ProcessQiData();
+        mDecoder.Run(*sources[0]);
+        return;
+    }
 
-        CheckIfThreadShouldExit();
-    }
-}
-
-void QiAnalyzer::Invalidate() {
-    mSynchronized    = false;
-    mPacketByteCount = 0;
-    mPreambleEdges.clear();
-    mBitsForNextByte.clear();
-}
-
-U64 QiAnalyzer::AdvanceToNextEdge(U64 edge_location, U64* p_next_edge_location, U64* p_next_edge_distance) {
-    U64 starting_edge_location = edge_location;
-
-    mQi->AdvanceToNextEdge();
-    U64 next_edge_location = mQi->GetSampleNumber();
-
-    U64 next_edge_distance = next_edge_location - edge_location;
-
-    while (((next_edge_distance <= (mTShort - mTShortMinError)) ||
-            (next_edge_distance >= (mTShort + mTShortMaxError)))
-                &&
-           ((next_edge_distance <= (mTLong - mTLongMinError)) ||
-            (next_edge_distance >= (mTLong + mTLongMaxError)))) {
-        // We need two glitch edges as this is a differential signal, so the signal should bounce back to our expected state
-        // mQi->AdvanceToNextEdge();
-        // edge_location = mQi->GetSampleNumber();
-
-        edge_location = next_edge_location;
-
-        mQi->AdvanceToNextEdge();
-        next_edge_location = mQi->GetSampleNumber();
-
-        next_edge_distance = next_edge_location - edge_location;
-    }
-
-    *p_next_edge_location = next_edge_location;
-    *p_next_edge_distance = next_edge_distance;
-
-    return edge_location - starting_edge_location;
-}
-
-void QiAnalyzer::SynchronizeQiData() {
-    while (mSynchronized == false) {
-        CheckIfThreadShouldExit();
-
-        U64 edge_location = mQi->GetSampleNumber();
-
-        U64 next_edge_location, next_edge_distance;
-        U64 skipped = AdvanceToNextEdge(edge_location, &next_edge_location, &next_edge_distance);
-        // if (skipped > 0) {
-        //     mResults->AddMarker(edge_location, AnalyzerResults::UpArrow, mSettings->mInputChannel);
-        // }
-        edge_location += skipped;
-
-		// BitState next_bit_state = mQi->GetBitState();
-		// BitState bit_state = (next_bit_state == BIT_LOW) ? BIT_HIGH : BIT_LOW;
-
-		// if (bit_state == BIT_HIGH) {
-			if ((next_edge_distance > (mTShort - mTShortMinError)) && (next_edge_distance < (mTShort + mTShortMaxError))) {
-				// short
-				U64 next_next_edge_location, next_next_edge_distance;
-				skipped = AdvanceToNextEdge(next_edge_location, &next_next_edge_location, &next_next_edge_distance);
-                // if (skipped > 0) {
-                //     mResults->AddMarker(next_edge_location, AnalyzerResults::UpArrow, mSettings->mInputChannel);
-                // }
-                next_edge_location += skipped;
-                next_edge_distance += skipped;
-
-				if (((next_edge_distance + next_next_edge_distance) > (mTLong - mTLongMinError)) && ((next_edge_distance + next_next_edge_distance) < (mTLong + mTLongMaxError))) {
-					// short again -> 1-bit
-					mPreambleEdges.push_back(edge_location);
-					mPreambleEdges.push_back(next_next_edge_location);
-
-					mResults->AddMarker(edge_location, AnalyzerResults::Dot, mSettings->mInputChannel);
-                } else if ((next_next_edge_distance > (mTLong - mTLongMinError)) && (next_next_edge_distance < (mTLong + mTLongMaxError))) {
-    				// long -> 0-bit, so we must've synched on the second pulse of the 1-bits
-                    size_t count = mPreambleEdges.size() / 2;
-                    if ((count >= 11) && (count <= 25)) {
-                        mSynchronized = true;
-
-                        // The end of the preamble marks the start of a new packet
-                        mPacketByteCount = 0;
-
-                        // for (U32 i = 0; i < count; ++i) {
-                        //     U32 idx = i * 2;
-                        //     SaveBit(mPreambleEdges[idx], 1);
-                        // }
-
-                        // TODO: Use the preamble for synchronization of the clock edges, low-time/high-time, and rise-time/fall-time!
-
-                        // Mark the mis-synched edge as bad
-                        mResults->AddMarker(next_edge_location, AnalyzerResults::ErrorDot, mSettings->mInputChannel);
-
-                        // Record the second bit (the start bit). ProcessQuData() will continue from the edge of the first data bit.
-                        SaveBit(next_edge_location, next_next_edge_location, 0);
-                    } else {
-                        // back to idle.
-                        mResults->AddMarker(edge_location, AnalyzerResults::ErrorDot, mSettings->mInputChannel);
-                        Invalidate();
-                    }
-				} else {
-                    // back to idle.
-                    mResults->AddMarker(edge_location, AnalyzerResults::ErrorDot, mSettings->mInputChannel);
-                    Invalidate();
-				}
-			} else if ((next_edge_distance > (mTLong - mTLongMinError)) && (next_edge_distance < (mTLong + mTLongMaxError))) {
-				// long -> 0-bit
-				size_t count = mPreambleEdges.size() / 2;
-				if ((count >= 11) && (count <= 25)) {
-					mSynchronized = true;
-
-					// The end of the preamble marks the start of a new packet
-					mPacketByteCount = 0;
-
-					// for (U32 i = 0; i < count; ++i) {
-					//     U32 idx = i * 2;
-					//     SaveBit(mPreambleEdges[idx], 1);
-					// }
-
-					// TODO: Use the preamble for synchronization of the clock edges, low-time/high-time, and rise-time/fall-time!
-
-					// Record the first bit (the start bit). ProcessQuData() will continue from the edge of the first data bit.
-					SaveBit(edge_location, next_edge_location, 0);
-				} else {
-					// back to idle.
-					mResults->AddMarker(edge_location, AnalyzerResults::ErrorX, mSettings->mInputChannel);
-					Invalidate();
-				}
-
-				break;
-			} else {
-				// back to idle.
-				mResults->AddMarker(edge_location, AnalyzerResults::ErrorSquare, mSettings->mInputChannel);
-				Invalidate();
-			}
-		// } else {
-		// 	// the first edge is always low->high, so we ignore any high->low transitions while synchronizing
-		// 	mResults->AddMarker(edge_location, AnalyzerResults::DownArrow, mSettings->mInputChannel);
-		// 	Invalidate();
-		// }
-    }
-}
-
-void QiAnalyzer::ProcessQiData() {
-    if (mSynchronized == true) {
-        // We're on the clock edge of a data, parity, or stop bit, as the start bit is recorded by SynchronizeQiData().
-        U64 edge_location = mQi->GetSampleNumber();
-
-        U64 next_edge_location, next_edge_distance;
-        U64 skipped = AdvanceToNextEdge(edge_location, &next_edge_location, &next_edge_distance);
-        next_edge_distance += skipped;
-
-        if ((next_edge_distance > (mTShort - mTShortMinError)) && (next_edge_distance < (mTShort + mTShortMaxError))) {
-            // short
-            U64 next_next_edge_location, next_next_edge_distance;
-            skipped = AdvanceToNextEdge(next_edge_location, &next_next_edge_location, &next_next_edge_distance);
-            next_edge_location += skipped;
-            next_edge_distance += skipped;
-
-            if (((next_edge_distance + next_next_edge_distance) > (mTLong - mTLongMinError)) && ((next_edge_distance + next_next_edge_distance) < (mTLong + mTLongMaxError))) {
-                // short again -> 1-bit
-                SaveBit(edge_location, next_next_edge_location, 1);
-            } else {
-                // not synced anymore.
-                mResults->AddMarker(edge_location, AnalyzerResults::ErrorDot, mSettings->mInputChannel);
-                Invalidate();
-                return;
-            }
-        } else if ((next_edge_distance > (mTLong - mTLongMinError)) && (next_edge_distance < (mTLong + mTLongMaxError))) {
-            // long -> 0-bit
-            SaveBit(edge_location, next_edge_location, 0);
-        } else {
-            // not synced anymore.
-            mResults->AddMarker(edge_location, AnalyzerResults::ErrorSquare, mSettings->mInputChannel);
-            Invalidate();
-            return;
-        }
+    // The coils are decoded on this thread, and their results added in time order
+    mMultiChannelDecoder.Reset(mSampleRateHz);
+    mMultiChannelDecoder.SetTrackingTolerance(mSettings->mTrackingTolerance);
+    for (U32 i = 0; i < mCoilCount; i++) {
+        mMultiChannelDecoder.AddChannel(sources[i].get(), &mCoils[i].mListener);
+        mCoils[i].mDecoder = &mMultiChannelDecoder.GetDecoder(i);
     }
+
+    mMultiChannelDecoder.Run();
 }
 
-void QiAnalyzer::SaveBit(U64 location_start, U64 location_end, U32 value) {
-    BitInfo info;
-    info.start = location_start;
-    info.end = location_end;
-    info.value = value;
-    mBitsForNextByte.push_back(info);
+void QiAnalyzer::OnMarker(U32 coil, U64 location, QiMarkerType marker) {
+    if ((mSettings->mRepeatMode == QiRepeatsCollapsed) && mCoils[coil].mCollapser.HoldMarker(location, marker))
+        return;
 
-    const U32 bit_count = 11;
-    if (mBitsForNextByte.size() == bit_count) {
-        U64 packet = 0;
-        for (U32 i = 0; i < mBitsForNextByte.size(); i++) {
-            BitInfo& bit = mBitsForNextByte[i];
+    AddMarkerResult(coil, location, marker);
+    if (mCommitScheduler.ResultsAdded(0) == true)
+        CommitPendingResults(location);
+}
 
-            U64 value = bit.value;
-            packet |= value << i;
-        }
+void QiAnalyzer::AddMarkerResult(U32 coil, U64 location, QiMarkerType marker) {
+    if (mSettings->mMarkerDensity == QiMarkersNone)
+        return;
+    if ((marker == QiMarkerDot) && (mSettings->mMarkerDensity == QiMarkersErrorsOnly))
+        return;
+
+    AnalyzerResults::MarkerType marker_type;
+    switch (marker) {
+    case QiMarkerDot:
+        marker_type = AnalyzerResults::Dot;
+        break;
+    case QiMarkerErrorDot:
+        marker_type = AnalyzerResults::ErrorDot;
+        break;
+    case QiMarkerErrorSquare:
+        marker_type = AnalyzerResults::ErrorSquare;
+        break;
+    case QiMarkerErrorX:
+    default:
+        marker_type = AnalyzerResults::ErrorX;
+        break;
+    }
+    mResults->AddMarker(location, marker_type, mCoils[coil].mChannel);
+}
 
-        // Remove the start, parity, and stop bits so that we're left with just the data bits
-        BitInfo& start_bit = mBitsForNextByte.front();
-        mBitsForNextByte.pop_front();
-        BitInfo& stop_bit = mBitsForNextByte.back();
-        mBitsForNextByte.pop_back();
-        BitInfo& parity_bit = mBitsForNextByte.back();
-        mBitsForNextByte.pop_back();
+void QiAnalyzer::AddBitMarkers(Channel& channel, const QiByte& byte) {
+    const U32 bit_count = 11;
+    for (U32 i = 0; i < bit_count; i++) {
+        U64 location = byte.mBitEdges[i] + (byte.mBitEdges[i + 1] - byte.mBitEdges[i]) / 2;
+
+        AnalyzerResults::MarkerType marker;
+        if (i == 0)
+            marker = AnalyzerResults::Start;
+        else if (i == 9)
+            marker = byte.mParityValid ? AnalyzerResults::X : AnalyzerResults::ErrorX;
+        else if (i == 10)
+            marker = byte.mStopValid ? AnalyzerResults::Stop : AnalyzerResults::ErrorX;
+        else
+            marker = (((byte.mPacket >> i) & 0x1) == 0) ? AnalyzerResults::Zero : AnalyzerResults::One;
+        mResults->AddMarker(location, marker, channel);
+    }
+}
 
-        U8 byte = 0;
-        for (U32 i = 0; i < mBitsForNextByte.size(); i++) {
-            BitInfo& bit = mBitsForNextByte[i];
+void QiAnalyzer::AddBitErrorMarkers(Channel& channel, const QiByte& byte) {
+    const U32 parity_bit = 9;
+    const U32 stop_bit   = 10;
+    if (byte.mParityValid == false) {
+        U64 location = byte.mBitEdges[parity_bit] + (byte.mBitEdges[parity_bit + 1] - byte.mBitEdges[parity_bit]) / 2;
+        mResults->AddMarker(location, AnalyzerResults::ErrorX, channel);
+    }
+    if (byte.mStopValid == false) {
+        U64 location = byte.mBitEdges[stop_bit] + (byte.mBitEdges[stop_bit + 1] - byte.mBitEdges[stop_bit]) / 2;
+        mResults->AddMarker(location, AnalyzerResults::ErrorX, channel);
+    }
+}
 
-            U8 value = U8(bit.value);
-            byte |= value << i;
-        }
+void QiAnalyzer::AddByteResults(U32 coil_index, const QiByte& byte) {
+    const U32 bit_count = 11;
+    Coil&     coil      = mCoils[coil_index];
+
+    if (mSettings->mMarkerDensity == QiMarkersFull)
+        AddBitMarkers(coil.mChannel, byte);
+    else if (mSettings->mMarkerDensity == QiMarkersErrorsOnly)
+        AddBitErrorMarkers(coil.mChannel, byte);
+
+    // The frames of different coils overlap, so SDK packets only group the bytes of a single coil
+    bool v1_frames   = (mSettings->mFrameFormat == QiFramesV1AndV2);
+    bool sdk_packets = v1_frames && (mCoilCount == 1);
+
+    Frame   frame;
+    FrameV2 frame_v2;
+    frame.mStartingSampleInclusive = byte.mBitEdges[0];
+    frame.mEndingSampleInclusive   = byte.mBitEdges[bit_count] - 1;  // -1 as bits share an edge and the frame start/end ranges are inclusive and cannot overlap between frames
+    frame.mData1                   = byte.mPacket;
+    frame.mData2                   = byte.mPacketByte;
+    frame.mType                    = U8(coil_index);
+    frame.mFlags                   = QiGetByteFlags(byte);
+    if (frame.mFlags != 0)
+        frame.mFlags |= DISPLAY_AS_ERROR_FLAG;
+    if (v1_frames) {
+        // The V1 frames of a packet are grouped into an SDK packet; frames of incomplete packets are left ungrouped
+        if (sdk_packets && (byte.mPacketByte == 0))
+            mResults->CancelPacketAndStartNewPacket();
+        mResults->AddFrame(frame);
+    }
+    frame_v2.AddInteger("packet", byte.mPacket);
+    frame_v2.AddByte("payload", byte.mPayload);
+    frame_v2.AddByte("packet_byte", byte.mPacketByte);
+    if (mCoilCount > 1)
+        frame_v2.AddInteger("coil", coil_index);
+    mResults->AddFrameV2(frame_v2, "data", frame.mStartingSampleInclusive, frame.mEndingSampleInclusive);
+}
 
-        U64 ones = 0;
-        for (U32 i = 0; i < mBitsForNextByte.size(); i++) {
-            BitInfo& bit = mBitsForNextByte[i];
+void QiAnalyzer::OnByte(U32 coil_index, const QiByte& byte) {
+    const U32 bit_count = 11;
+    Coil&     coil      = mCoils[coil_index];
 
-            U64 value = bit.value;
-            ones += value;
-        }
-        U32 parity = 1 - (ones % 2);
+    // The transmitter's packets before this byte go first
+    DecodeCarrierUntil(byte.mBitEdges[0]);
 
-        mResults->AddMarker(start_bit.start + (start_bit.end - start_bit.start) / 2, AnalyzerResults::Start, mSettings->mInputChannel);
+    // A byte after a long gap starts a new session; the summary of the previous one goes right after its last packet
+    bool session_ended;
+    {
+        std::lock_guard<std::mutex> lock(mSessionStatsMutex);
+        session_ended = coil.mSessionStats.AddByte(byte);
+    }
+    if (session_ended) {
+        coil.mCollapser.EndRun();
+        coil.mCollapser.ClearReferences();
 
-        for (U32 i = 0; i < mBitsForNextByte.size(); i++) {
-            BitInfo& bit = mBitsForNextByte[i];
+        const std::vector<QiSessionSummary>& sessions = coil.mSessionStats.GetSessions();
+        AddSessionFrame(coil_index, "session", U32(sessions.size() - 1), sessions.back(), sessions.back().mEnd);
+    }
 
-            U64 value    = bit.value;
-            U64 location = bit.start + (bit.end - bit.start) / 2;
+    bool collapse    = (mSettings->mRepeatMode == QiRepeatsCollapsed);
+    bool sdk_packets = (mSettings->mFrameFormat == QiFramesV1AndV2) && (mCoilCount == 1);
+    bool commit_now  = false;
+    if (collapse) {
+        // Held back until its packet is complete
+        coil.mCollapser.HoldByte(byte);
+    } else {
+        AddByteResults(coil_index, byte);
+        commit_now = mCommitScheduler.ResultsAdded(1);
+    }
 
-            AnalyzerResults::MarkerType marker = (value == 0) ? AnalyzerResults::Zero : AnalyzerResults::One;
-            mResults->AddMarker(location, marker, mSettings->mInputChannel);
+    U64 byte_end = byte.mBitEdges[bit_count];
+    if (coil.mPacketAssembler.AddByte(byte) == true) {
+        const QiPacket& packet = coil.mPacketAssembler.GetPacket();
+        bool            shown  = AddPacket(coil_index, packet);
+        bool            stats  = (mStatsInterval > 0) && (packet.mEnd >= coil.mNextStatsSample);
+        if (stats)
+            AddStatsFrame(coil_index, packet.mEnd);
+        if (sdk_packets && shown)
+            mResults->CommitPacketAndStartNewPacket();
+        else if (sdk_packets)
+            mResults->CancelPacketAndStartNewPacket();
+        // A repeat adds no results unless a frame ended its run
+        commit_now = shown || stats || mCommitScheduler.HasPendingResults();
+    } else if (coil.mPacketAssembler.IsInPacket() == false) {
+        // Not part of a packet, so not part of a repeat either
+        if (collapse) {
+            coil.mCollapser.ShowPending();
+            commit_now = mCommitScheduler.ResultsAdded(0);
         }
+        if (sdk_packets)
+            mResults->CancelPacketAndStartNewPacket();
+    }
 
-        AnalyzerResults::MarkerType parity_marker = (parity_bit.value == parity) ? AnalyzerResults::X : AnalyzerResults::ErrorX;
-        mResults->AddMarker(parity_bit.start + (parity_bit.end - parity_bit.start) / 2, parity_marker, mSettings->mInputChannel);
-        AnalyzerResults::MarkerType stop_marker = (stop_bit.value == 1) ? AnalyzerResults::Stop : AnalyzerResults::ErrorX;
-        mResults->AddMarker(stop_bit.start + (stop_bit.end - stop_bit.start) / 2, stop_marker, mSettings->mInputChannel);
-
-        Frame   frame;
-        FrameV2 frame_v2;
-        frame.mStartingSampleInclusive = start_bit.start;
-        frame.mEndingSampleInclusive   = stop_bit.end - 1;  // -1 as bits share an edge and the frame start/end ranges are inclusive and cannot overlap between frames
-        frame.mData1                   = packet;
-        frame.mData2                   = mPacketByteCount;
-        mResults->AddFrame(frame);
-        frame_v2.AddInteger("packet", packet);
-        frame_v2.AddByte("payload", byte);
-        frame_v2.AddByte("packet_byte", U8(mPacketByteCount));
-        mResults->AddFrameV2(frame_v2, "data", frame.mStartingSampleInclusive, frame.mEndingSampleInclusive);
+    if (commit_now == true)
+        CommitPendingResults(byte_end);
+    else if (mCommitScheduler.ShouldReportProgress(byte_end) == true)
+        ReportProgress(byte_end);
+}
+
+void QiAnalyzer::OnSyncLost(U32 coil) {
+    // The bytes of a packet that was cut short are shown in full; without any, this is the end of a packet
+    if ((mSettings->mRepeatMode == QiRepeatsCollapsed) && mCoils[coil].mCollapser.HasPendingBytes())
+        mCoils[coil].mCollapser.ShowPending();
+
+    if (mCoilCount == 1)
+        mResults->CancelPacketAndStartNewPacket();
+
+    // Flush everything decoded up to the resync
+    if (mCommitScheduler.HasPendingResults() == true) {
         mResults->CommitResults();
-        ReportProgress(mQi->GetSampleNumber());
+        mCommitScheduler.Committed();
+    }
+}
+
+void QiAnalyzer::DecodeCarrierUntil(U64 location) {
+    if (mCarrierSource == nullptr)
+        return;
+
+    U32 count;
+    while ((count = mCarrierSource->ReadEdgesBefore(location, mCarrierEdges.data(), kQiFskBatchSize)) > 0)
+        mFskDecoder.ProcessEdges(mCarrierEdges.data(), count);
+
+    // The channels are captured together, so the carrier has no edge up to the location; if it stopped, e.g. as the
+    // transmitter removed power, that ends its modulation
+    mFskDecoder.ProcessSilence(location);
+}
+
+void QiAnalyzer::DecodeCarrierBefore(U64 sample_number) {
+    if (mCarrierSource == nullptr)
+        return;
+
+    U64 location;
+    if (mCoilCount == 1)
+        location = std::min(mDecoder.GetEarliestPendingEvent(sample_number), sample_number);
+    else
+        location = mMultiChannelDecoder.GetEarliestPendingEvent(sample_number);
+    DecodeCarrierUntil(location);
+}
+
+void QiAnalyzer::OnFskByte(const QiByte& byte) {
+    const U32 bit_count = 11;
+
+    if (mSettings->mMarkerDensity == QiMarkersFull)
+        AddBitMarkers(mCarrierChannel, byte);
+    else if (mSettings->mMarkerDensity == QiMarkersErrorsOnly)
+        AddBitErrorMarkers(mCarrierChannel, byte);
+
+    // The transmitter's packets are a change in the traffic
+    EndRepeats();
+
+    // V2 only: the V1 frames and their exports are the receiver's bytes
+    FrameV2 frame_v2;
+    frame_v2.AddInteger("packet", byte.mPacket);
+    frame_v2.AddByte("payload", byte.mPayload);
+    frame_v2.AddByte("packet_byte", byte.mPacketByte);
+    frame_v2.AddBoolean("parity_ok", byte.mParityValid);
+    frame_v2.AddBoolean("stop_ok", byte.mStopValid);
+    mResults->AddFrameV2(frame_v2, "fsk", byte.mBitEdges[0], byte.mBitEdges[bit_count] - 1);
+
+    mCommitScheduler.ResultsAdded(1);
+}
+
+void QiAnalyzer::OnFskResponse(U64 start, U64 end, U8 pattern) {
+    const char* name = QiFskResponseName(pattern);
+    EndRepeats();
+
+    FrameV2 frame_v2;
+    frame_v2.AddByte("pattern", pattern);
+    frame_v2.AddString("response", (name != nullptr) ? name : "?");
+    mResults->AddFrameV2(frame_v2, "fsk_response", start, end - 1);
+
+    // A response ends the transmitter's turn, like the end of a packet
+    mCommitScheduler.ResultsAdded(1);
+    CommitPendingResults(end);
+}
+
+bool QiAnalyzer::HasPendingResults() const {
+    if (mCommitScheduler.HasPendingResults())
+        return true;
+    for (U32 i = 0; i < mCoilCount; i++) {
+        if (mCoils[i].mCollapser.HasRun())
+            return true;
+    }
+    return false;
+}
+
+bool QiAnalyzer::HasHeldResults() const {
+    for (U32 i = 0; i < mCoilCount; i++) {
+        if (mCoils[i].mCollapser.HasRun())
+            return true;
+    }
+    if (mCommitScheduler.HasPendingResults() == false)
+        return false;
+    for (U32 i = 0; i < mCoilCount; i++) {
+        if (mCoils[i].mPacketAssembler.IsInPacket())
+            return false;
+    }
+    return true;
+}
+
+void QiAnalyzer::CommitBeforeWaiting(U64 sample_number) {
+    DecodeCarrierBefore(sample_number);
+    if (HasPendingResults() == false)
+        return;
 
-        mPacketByteCount++;
-        mBitsForNextByte.clear();
+    for (U32 i = 0; i < mCoilCount; i++)
+        mCoils[i].mCollapser.EndRun();
+    CommitPendingResults(sample_number);
+}
+
+void QiAnalyzer::CommitPendingResults(U64 sample_number) {
+    mResults->CommitResults();
+    mCommitScheduler.Committed();
+    ReportProgress(sample_number);
+}
+
+bool QiAnalyzer::AddPacket(U32 coil_index, const QiPacket& packet) {
+    Coil& coil = mCoils[coil_index];
+    coil.mPacketCount++;
+    if (packet.mChecksumValid == false)
+        coil.mChecksumErrorCount++;
+
+    bool session_ended;
+    {
+        std::lock_guard<std::mutex> lock(mSessionStatsMutex);
+        session_ended = coil.mSessionStats.AddPacket(packet);
+    }
+
+    // Edges removed by the glitch filter since the coil's previous packet
+    U64 rejected_edges              = coil.mDeglitch->GetRejectedEdgeCount();
+    U64 glitches                    = rejected_edges - coil.mRejectedEdgesAtLastPacket;
+    coil.mRejectedEdgesAtLastPacket = rejected_edges;
+
+    QiTimingViolation violations[kQiTimingRuleCount];
+    U32               violation_count = coil.mTimingChecker.AddPacket(packet, violations);
+    U32               match_count     = coil.mSearch.AddPacket(packet, mSearchMatches.data());
+
+    // Errors, timing violations, matches and the end of a session are always shown in full
+    bool show = (violation_count > 0) || (match_count > 0) || session_ended;
+    if ((mSettings->mRepeatMode == QiRepeatsCollapsed) && (coil.mCollapser.AddPacket(packet, glitches, show) == false))
+        return false;
+
+    AddPacketFrame(coil_index, packet, glitches);
+    for (U32 i = 0; i < violation_count; i++)
+        AddTimingFrame(coil_index, violations[i]);
+    for (U32 i = 0; i < match_count; i++)
+        AddMatchFrame(coil_index, packet, mSearchMatches[i]);
+
+    // An End Power Transfer packet ends its session
+    if (session_ended) {
+        const std::vector<QiSessionSummary>& sessions = coil.mSessionStats.GetSessions();
+        AddSessionFrame(coil_index, "session", U32(sessions.size() - 1), sessions.back(), packet.mEnd);
+        coil.mCollapser.ClearReferences();
     }
+    return true;
+}
+
+void QiAnalyzer::AddPacketFrame(U32 coil_index, const QiPacket& packet, U64 glitches) {
+    FrameV2 frame_v2;
+    frame_v2.AddByte("header", packet.mHeader);
+    frame_v2.AddString("mnemonic", (packet.mInfo != nullptr) ? packet.mInfo->mMnemonic : "?");
+    frame_v2.AddByteArray("message", packet.mMessage, packet.mSize);
+    frame_v2.AddByte("checksum", packet.mChecksum);
+    frame_v2.AddBoolean("checksum_ok", packet.mChecksumValid);
+    frame_v2.AddBoolean("bit_errors", packet.mBitErrors);
+    if (mCoilCount > 1)
+        frame_v2.AddInteger("coil", coil_index);
+
+    frame_v2.AddInteger("glitches", S64(glitches));
+
+    switch (packet.mHeader) {
+    case QiHeaderSignalStrength:
+        frame_v2.AddInteger("signal_strength", packet.mMessage[0]);
+        break;
+    case QiHeaderEndPowerTransfer:
+        frame_v2.AddInteger("reason", packet.mMessage[0]);
+        frame_v2.AddString("reason_text", QiEndPowerTransferReason(packet.mMessage[0]));
+        break;
+    case QiHeaderControlError:
+        frame_v2.AddInteger("control_error", QiControlError(packet));
+        break;
+    case QiHeaderReceivedPower8:
+        frame_v2.AddInteger("received_power", QiReceivedPower(packet));
+        break;
+    case QiHeaderReceivedPower16:
+        frame_v2.AddInteger("mode", QiReceivedPowerMode(packet));
+        frame_v2.AddInteger("received_power", QiReceivedPower(packet));
+        break;
+    case QiHeaderIdentification: {
+        QiIdentification identification;
+        QiDecodeIdentification(packet, &identification);
+        frame_v2.AddInteger("version_major", identification.mVersionMajor);
+        frame_v2.AddInteger("version_minor", identification.mVersionMinor);
+        frame_v2.AddInteger("manufacturer", identification.mManufacturer);
+        frame_v2.AddBoolean("extended", identification.mExtended);
+        frame_v2.AddInteger("device_id", identification.mDeviceId);
+        break;
+    }
+    case QiHeaderExtendedIdentification:
+        frame_v2.AddByteArray("extended_id", packet.mMessage, packet.mSize);
+        break;
+    default:
+        break;
+    }
+
+    // The packet frame spans the byte frames from the header to the checksum.
+    mResults->AddFrameV2(frame_v2, "packet", packet.mStart, packet.mEnd - 1);
+}
+
+void QiAnalyzer::AddRepeatFrame(U32 coil_index, const QiPacketRepeats& repeats) {
+    // The packets that the run repeats and how often, e.g. "CE x12, RP8 x3", over the run's span
+    const QiPacketRun& run            = repeats.GetRun();
+    const QiPacket*    repeated       = nullptr;
+    U32                repeated_count = 0;
+    std::ostringstream packets;
+    for (U32 i = 0; i < kQiRepeatReferences; i++) {
+        if (repeats.GetRepeatCount(i) == 0)
+            continue;
+        repeated = &repeats.GetReference(i);
+        repeated_count++;
+        if (repeated_count > 1)
+            packets << ", ";
+        packets << ((repeated->mInfo != nullptr) ? repeated->mInfo->mMnemonic : "?") << " x" << repeats.GetRepeatCount(i);
+    }
+
+    FrameV2 frame_v2;
+    frame_v2.AddInteger("count", run.mCount);
+    frame_v2.AddString("packets", packets.str().c_str());
+    if (repeated_count == 1) {
+        frame_v2.AddByte("header", repeated->mHeader);
+        frame_v2.AddByteArray("message", repeated->mMessage, repeated->mSize);
+    }
+    if (run.mControlErrors > 0) {
+        frame_v2.AddInteger("control_error_min", run.mControlErrorMin);
+        frame_v2.AddInteger("control_error_max", run.mControlErrorMax);
+    }
+    frame_v2.AddInteger("glitches", S64(run.mGlitches));
+    if (mCoilCount > 1)
+        frame_v2.AddInteger("coil", coil_index);
+    mResults->AddFrameV2(frame_v2, "repeat", run.mStart, run.mEnd - 1);
+    mCommitScheduler.ResultsAdded(1);
+}
+
+void QiAnalyzer::EndRepeats() {
+    for (U32 i = 0; i < mCoilCount; i++) {
+        mCoils[i].mCollapser.EndRun();
+        mCoils[i].mCollapser.ClearReferences();
+    }
+}
+
+void QiAnalyzer::AddStatsFrame(U32 coil_index, U64 location) {
+    // Counters of the coil since the start of the analysis. wall_ns_per_edge is the wall time since the analysis started
+    // over the coil's edges: it includes waiting for a live capture and, with several coils or a carrier, decoding them
+    // too, so it is only the decode speed for a complete capture of a single coil.
+    Coil&                 coil    = mCoils[coil_index];
+    const QiDecoderStats& stats   = coil.mDecoder->GetStats();
+    double                elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - mStartTime).count();
+
+    // The run of repeats up to here goes first
+    coil.mCollapser.EndRun();
+
+    FrameV2 frame_v2;
+    if (mCoilCount > 1)
+        frame_v2.AddInteger("coil", coil_index);
+    frame_v2.AddInteger("edges", S64(stats.mEdges));
+    frame_v2.AddInteger("glitches_filtered", S64(coil.mDeglitch->GetRejectedEdgeCount()));
+    frame_v2.AddInteger("idle_skips", S64(stats.mIdleSkips));
+    frame_v2.AddInteger("glitch_edges", S64(stats.mGlitchEdges));
+    frame_v2.AddInteger("sync_attempts", S64(stats.mSyncAttempts));
+    frame_v2.AddInteger("syncs", S64(stats.mSyncs));
+    frame_v2.AddInteger("bytes", S64(stats.mBytes));
+    frame_v2.AddInteger("parity_errors", S64(stats.mParityErrors));
+    frame_v2.AddInteger("stop_errors", S64(stats.mStopErrors));
+    frame_v2.AddInteger("packets", S64(coil.mPacketCount));
+    frame_v2.AddInteger("checksum_errors", S64(coil.mChecksumErrorCount));
+    frame_v2.AddDouble("wall_ns_per_edge", (stats.mEdges > 0) ? elapsed * 1e9 / double(stats.mEdges) : 0.0);
+    if ((coil_index == 0) && (mCarrierSource != nullptr)) {
+        const QiFskStats& fsk_stats = mFskDecoder.GetStats();
+        frame_v2.AddInteger("fsk_edges", S64(fsk_stats.mEdges));
+        frame_v2.AddInteger("fsk_frequency_steps", S64(fsk_stats.mFrequencySteps));
+        frame_v2.AddInteger("fsk_bit_errors", S64(fsk_stats.mBitErrors));
+        frame_v2.AddInteger("fsk_bytes", S64(fsk_stats.mBytes));
+        frame_v2.AddInteger("fsk_responses", S64(fsk_stats.mResponses));
+    }
+
+    // A single sample right after the packet frame, before the next preamble
+    mResults->AddFrameV2(frame_v2, "stats", location, location);
+    coil.mNextStatsSample = location + mStatsInterval;
+
+    // The session so far, unless the packet ended it
+    const QiSessionSummary& session = coil.mSessionStats.GetSession();
+    if (session.mPackets > 0)
+        AddSessionFrame(coil_index, "summary", U32(coil.mSessionStats.GetSessions().size()), session, location);
+}
+
+void QiAnalyzer::AddTimingFrame(U32 coil_index, const QiTimingViolation& violation) {
+    const QiTimingRule& rule = QiGetTimingRule(violation.mRule);
+
+    FrameV2 frame_v2;
+    if (mCoilCount > 1)
+        frame_v2.AddInteger("coil", coil_index);
+    frame_v2.AddString("rule", rule.mName);
+    frame_v2.AddInteger("value", S64(violation.mValue));
+    frame_v2.AddInteger(violation.mAboveMax ? "max" : "min", violation.mLimit);
+    frame_v2.AddString("unit", rule.mUnit);
+
+    // Spans what was measured, e.g. the gap between two packets
+    U64 end = (violation.mEnd > violation.mStart) ? violation.mEnd - 1 : violation.mStart;
+    mResults->AddFrameV2(frame_v2, "timing", violation.mStart, end);
+}
+
+void QiAnalyzer::AddMatchFrame(U32 coil_index, const QiPacket& packet, const QiSearchMatch& match) {
+    FrameV2 frame_v2;
+    if (mCoilCount > 1)
+        frame_v2.AddInteger("coil", coil_index);
+    frame_v2.AddString("pattern", mSearchPatterns.GetPatternName(match.mPattern));
+    frame_v2.AddInteger("packets", match.mPackets);
+    frame_v2.AddByte("header", packet.mHeader);
+    frame_v2.AddByteArray("message", packet.mMessage, packet.mSize);
+
+    // Spans the packets that matched; the header and message are those of the last one
+    mResults->AddFrameV2(frame_v2, "match", match.mStart, match.mEnd - 1);
+}
+
+void QiAnalyzer::AddSessionFrame(U32                     coil_index,
+                                 const char*             type,
+                                 U32                     session_index,
+                                 const QiSessionSummary& session,
+                                 U64                     location) {
+    double sample_period = 1.0 / double(mSampleRateHz);
+
+    FrameV2 frame_v2;
+    if (mCoilCount > 1)
+        frame_v2.AddInteger("coil", coil_index);
+    frame_v2.AddInteger("session", session_index);
+    frame_v2.AddDouble("duration", double(session.mEnd - session.mStart) * sample_period);
+    frame_v2.AddInteger("bytes", S64(session.mBytes));
+    frame_v2.AddInteger("parity_errors", S64(session.mParityErrors));
+    frame_v2.AddInteger("stop_errors", S64(session.mStopErrors));
+    frame_v2.AddInteger("packets", S64(session.mPackets));
+    frame_v2.AddInteger("checksum_errors", S64(session.mChecksumErrors));
+    frame_v2.AddDouble("parity_error_rate", (session.mBytes > 0) ? double(session.mParityErrors) / double(session.mBytes) : 0.0);
+    frame_v2.AddDouble("checksum_error_rate",
+                       (session.mPackets > 0) ? double(session.mChecksumErrors) / double(session.mPackets) : 0.0);
+    frame_v2.AddInteger("ce_packets", S64(session.mControlErrors));
+    if (session.mControlErrors > 0) {
+        frame_v2.AddInteger("ce_min", session.mControlErrorMin);
+        frame_v2.AddInteger("ce_max", session.mControlErrorMax);
+        frame_v2.AddDouble("ce_mean", double(session.mControlErrorSum) / double(session.mControlErrors));
+    }
+    if (session.mCeIntervals > 0) {
+        frame_v2.AddDouble("ce_interval_mean_ms", 1000.0 * double(session.mCeIntervalSum) / double(session.mCeIntervals) * sample_period);
+        frame_v2.AddDouble("ce_interval_max_ms", 1000.0 * double(session.mCeIntervalMax) * sample_period);
+    }
+    frame_v2.AddInteger("rp_packets", S64(session.mReceivedPowers));
+    if (session.mReceivedPowers > 0) {
+        frame_v2.AddInteger("rp_min", session.mReceivedPowerMin);
+        frame_v2.AddInteger("rp_max", session.mReceivedPowerMax);
+        frame_v2.AddDouble("rp_mean", double(session.mReceivedPowerSum) / double(session.mReceivedPowers));
+    }
+    if (session.mEndPowerTransfer)
+        frame_v2.AddString("end_reason", QiEndPowerTransferReason(session.mEndReason));
+
+    mResults->AddFrameV2(frame_v2, type, location, location);
+}
+
+bool QiAnalyzer::ExportSessionStats(const char* file) {
+    std::lock_guard<std::mutex> lock(mSessionStatsMutex);
+
+    const QiSessionStats* coils[kQiMaxCoils];
+    for (U32 i = 0; i < mCoilCount; i++)
+        coils[i] = &mCoils[i].mSessionStats;
+    return QiWriteSessionStats(file, GetTriggerSample(), coils, mCoilCount);
 }
 
 bool QiAnalyzer::NeedsRerun() {
@@ -350,7 +681,9 @@ U32 QiAnalyzer::GenerateSimulationData(U64                           minimum_sam
 }
 
 U32 QiAnalyzer::GetMinimumSampleRateHz() {
-    return kBitRate * 2 * 10;   // 10% error of a half period (for the short pulse of a 1-bit)
+    // 10 samples per short pulse of a 1-bit. The decoder keeps the bit period to 1/256 sample, so at this rate only
+    // the +/- 1 sample of the edges themselves counts against the tolerance.
+    return kBitRate * 2 * 10;
 }
 
 const char* QiAnalyzer::GetAnalyzerName() const {
@@ -1,13 +1,25 @@
 #ifndef QI_ANALYZER_H
 #define QI_ANALYZER_H
 
-#include <deque>
-
 #include <Analyzer.h>
+#include <chrono>
+#include <mutex>
+#include <vector>
 #include "QiAnalyzerResults.h"
+#include "QiAnalyzerSettings.h"
+#include "QiCommitScheduler.h"
+#include "QiDecoder.h"
+#include "QiDeglitch.h"
+#include "QiFskDecoder.h"
+#include "QiMultiChannelDecoder.h"
+#include "QiPacket.h"
+#include "QiPacketRepeats.h"
+#include "QiPacketSearch.h"
+#include "QiSessionStats.h"
 #include "QiSimulationDataGenerator.h"
+#include "QiTimingChecker.h"
 
-class QiAnalyzerSettings;
+class QiChannelEdgeSource;
 
 class ANALYZER_EXPORT QiAnalyzer : public Analyzer2 {
   public:
@@ -23,39 +35,152 @@ class ANALYZER_EXPORT QiAnalyzer : public Analyzer2 {
     virtual const char* GetAnalyzerName() const;
     virtual bool        NeedsRerun();
 
+    bool HasPendingResults() const;
+
+    // Pending results that only waiting for more data would commit: repeat runs, and results while no coil is within
+    // a packet, whose end commits them.
+    bool HasHeldResults() const;
+    void CommitPendingResults(U64 sample_number);
+
+    // Before waiting for more of the capture: decodes the carrier up to sample_number, and also shows the runs of
+    // repeated packets so far, so that a capture that ends in a run shows it.
+    void CommitBeforeWaiting(U64 sample_number);
+
+    // Decodes the carrier channel up to sample_number, or up to the earliest result that a coil can still add, so that
+    // the frames stay in time order. Besides each byte of the coils, the coils' sources call it while they wait for
+    // data or skip silence, so that the transmitter's frames do not wait for the receiver's next byte.
+    bool HasCarrier() const { return mCarrierSource != nullptr; }
+    void DecodeCarrierBefore(U64 sample_number);
+
+    // With a single coil, its decoder reads the channel itself, which waits for the next edge once it runs out of
+    // captured data. Before that wait, QiChannelEdgeSource ends a pending stop bit (see QiDecoder::IsStopBitPending())
+    // once the capture is past the segment gap without an edge, so that the packet is not held until the next one.
+    bool IsStopBitPending() const { return (mCoilCount == 1) && mDecoder.IsStopBitPending(); }
+    U64  GetSegmentGap() const { return mDecoder.GetSegmentGap(); }
+    void ProcessSilence(U64 location) { mDecoder.ProcessSilence(location); }
+
+    // Writes the session aggregates of all coils (see QiWriteSessionStats()); may be called while the analysis runs.
+    bool ExportSessionStats(const char* file);
+
   private:
-    struct BitInfo {
-        U64 start;
-        U64 end;
-        U32 value;
+    // Passes the decoder events of one coil on to the analyzer.
+    class CoilListener : public QiDecoderListener {
+      public:
+        CoilListener() : mAnalyzer(nullptr), mCoil(0) {}
+
+        virtual void OnMarker(U64 location, QiMarkerType marker) { mAnalyzer->OnMarker(mCoil, location, marker); }
+        virtual void OnByte(const QiByte& byte) { mAnalyzer->OnByte(mCoil, byte); }
+        virtual void OnSyncLost() { mAnalyzer->OnSyncLost(mCoil); }
+
+        QiAnalyzer* mAnalyzer;
+        U32         mCoil;
+    };
+
+    // Passes the FSK decoder events on to the analyzer.
+    class CarrierListener : public QiFskListener {
+      public:
+        CarrierListener() : mAnalyzer(nullptr) {}
+
+        virtual void OnFskByte(const QiByte& byte) { mAnalyzer->OnFskByte(byte); }
+        virtual void OnFskResponse(U64 start, U64 end, U8 pattern) { mAnalyzer->OnFskResponse(start, end, pattern); }
+
+        QiAnalyzer* mAnalyzer;
+    };
+
+    // Shows what the collapser of one coil does not hold back or drop.
+    class CollapsedListener : public QiCollapsedListener {
+      public:
+        CollapsedListener() : mAnalyzer(nullptr), mCoil(0) {}
+
+        virtual void OnMarker(U64 location, QiMarkerType marker) { mAnalyzer->AddMarkerResult(mCoil, location, marker); }
+        virtual void OnByte(const QiByte& byte) {
+            mAnalyzer->AddByteResults(mCoil, byte);
+            mAnalyzer->mCommitScheduler.ResultsAdded(1);
+        }
+        virtual void OnRun(const QiPacketRepeats& repeats) { mAnalyzer->AddRepeatFrame(mCoil, repeats); }
+
+        QiAnalyzer* mAnalyzer;
+        U32         mCoil;
+    };
+
+    // State of one input channel. A single coil is decoded by mDecoder, several by mMultiChannelDecoder.
+    struct Coil {
+        Channel               mChannel;
+        CoilListener          mListener;
+        const QiDecoder*      mDecoder;
+        QiPacketAssembler     mPacketAssembler;
+        QiDeglitchEdgeSource* mDeglitch;
+        U64                   mRejectedEdgesAtLastPacket;
+
+        // Counters for the stats frames, besides those of the decoder
+        U64 mNextStatsSample;
+        U64 mPacketCount;
+        U64 mChecksumErrorCount;
+
+        QiSessionStats  mSessionStats;    // guarded by mSessionStatsMutex
+        QiTimingChecker mTimingChecker;
+        QiPacketSearch  mSearch;
+
+        // With repeated packets collapsed, the markers and bytes since the coil's last packet are held back until it
+        // is known whether they are part of a repeat
+        QiRepeatCollapser mCollapser;
+        CollapsedListener mCollapsedListener;
     };
 
+  private:
     std::unique_ptr<QiAnalyzerSettings> mSettings;
     std::unique_ptr<QiAnalyzerResults>  mResults;
-    AnalyzerChannelData*                mQi;
 
     QiSimulationDataGenerator mSimulationDataGenerator;
     bool                      mSimulationInitilized;
 
     U32 mSampleRateHz;
 
-    U32                       mTLong;
-    U32                       mTShort;
-    U32                       mTLongMinError;
-    U32                       mTLongMaxError;
-    U32                       mTShortMinError;
-    U32                       mTShortMaxError;
-    std::deque<BitInfo>       mBitsForNextByte;    // value, location
-    std::vector<U64>          mPreambleEdges;
-    U32                       mPacketByteCount;
-    bool                      mSynchronized;
+    QiDecoder             mDecoder;
+    QiMultiChannelDecoder mMultiChannelDecoder;
+    QiCommitScheduler     mCommitScheduler;
+
+    Coil mCoils[kQiMaxCoils];
+    U32  mCoilCount;
+
+    U64                                   mStatsInterval;    // samples; 0 if disabled
+    std::chrono::steady_clock::time_point mStartTime;
+
+    // The carrier is read in batches up to each byte of the coils and up to where they wait or are idle
+    Channel                              mCarrierChannel;
+    std::unique_ptr<QiChannelEdgeSource> mCarrierSource;    // null if there is no carrier channel
+    CarrierListener                      mCarrierListener;
+    QiFskDecoder                         mFskDecoder;
+    std::vector<U64>                     mCarrierEdges;
+
+    // The worker thread updates the session stats, which an export can read at the same time
+    std::mutex mSessionStatsMutex;
+
+    // Compiled from the Search setting; every coil searches its own packets
+    QiSearchPatterns           mSearchPatterns;
+    std::vector<QiSearchMatch> mSearchMatches;
 
   private:
-    void Invalidate();
-	  U64 AdvanceToNextEdge(U64 edge_location, U64* p_next_edge_location, U64* p_next_edge_distance);
-    void ProcessQiData();
-    void SynchronizeQiData();
-    void SaveBit(U64 location_start, U64 location_end, U32 value);
+    void AddBitMarkers(Channel& channel, const QiByte& byte);
+    void AddBitErrorMarkers(Channel& channel, const QiByte& byte);
+    void AddByteResults(U32 coil, const QiByte& byte);
+    bool AddPacket(U32 coil, const QiPacket& packet);
+    void AddPacketFrame(U32 coil, const QiPacket& packet, U64 glitches);
+    void AddMarkerResult(U32 coil, U64 location, QiMarkerType marker);
+    void AddRepeatFrame(U32 coil, const QiPacketRepeats& repeats);
+    void EndRepeats();
+    void AddStatsFrame(U32 coil, U64 location);
+    void AddTimingFrame(U32 coil, const QiTimingViolation& violation);
+    void AddMatchFrame(U32 coil, const QiPacket& packet, const QiSearchMatch& match);
+    void AddSessionFrame(U32 coil, const char* type, U32 session_index, const QiSessionSummary& session, U64 location);
+
+    void OnMarker(U32 coil, U64 location, QiMarkerType marker);
+    void OnByte(U32 coil, const QiByte& byte);
+    void OnSyncLost(U32 coil);
+
+    void DecodeCarrierUntil(U64 location);
+    void OnFskByte(const QiByte& byte);
+    void OnFskResponse(U64 start, U64 end, U8 pattern);
 };
 
 extern "C" ANALYZER_EXPORT const char* __cdecl GetAnalyzerName();
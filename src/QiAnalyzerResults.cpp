@@ -2,8 +2,14 @@
 #include <AnalyzerHelpers.h>
 #include "QiAnalyzer.h"
 #include "QiAnalyzerSettings.h"
+#include "QiPacketExport.h"
+#include "QiRecordFile.h"
+#include <cstdio>
 #include <iostream>
 #include <fstream>
+#include <vector>
+
+static const U32 kExportBufferSize = 1 << 20;
 
 static U64 reverseDataByteBits(U64 data) {
     const U32 bit_count = 11;
@@ -29,6 +35,12 @@ void QiAnalyzerResults::GenerateBubbleText(U64 frame_index, Channel& channel, Di
     ClearResultStrings();
     Frame frame = GetFrame(frame_index);
 
+    // A byte's bubble only appears on the channel of its coil
+    Channel coils[kQiMaxCoils];
+    U32     coil_count = mSettings->GetCoilChannels(coils);
+    if ((frame.mType < coil_count) && (coils[frame.mType] != channel))
+        return;
+
     U64  byte = reverseDataByteBits(frame.mData1);
     char number_str[32];
     AnalyzerHelpers::GetNumberString(byte, display_base, 11, number_str, 32);
@@ -41,29 +53,58 @@ void QiAnalyzerResults::GenerateBubbleText(U64 frame_index, Channel& channel, Di
 }
 
 void QiAnalyzerResults::GenerateExportFile(const char* file, DisplayBase display_base, U32 export_type_user_id) {
-    std::ofstream file_stream(file, std::ios::out);
+    switch (export_type_user_id) {
+    case kExportRecords:
+        ExportRecords(file);
+        break;
+    case kExportPackets:
+        ExportPackets(file, false);
+        break;
+    case kExportPacketsIndexed:
+        ExportPackets(file, true);
+        break;
+    case kExportSessionStats:
+        mAnalyzer->ExportSessionStats(file);
+        break;
+    default:
+        ExportText(file, display_base);
+        break;
+    }
+}
+
+void QiAnalyzerResults::ExportText(const char* file, DisplayBase display_base) {
+    // Written through a large buffer; the times are formatted directly rather than through GetTimeString()
+    std::vector<char> buffer(kExportBufferSize);
+    std::ofstream     file_stream;
+    file_stream.rdbuf()->pubsetbuf(&buffer[0], buffer.size());
+    file_stream.open(file, std::ios::out);
 
-    U64 trigger_sample = mAnalyzer->GetTriggerSample();
-    U32 sample_rate    = mAnalyzer->GetSampleRate();
+    U64    trigger_sample = mAnalyzer->GetTriggerSample();
+    double sample_period  = 1.0 / double(mAnalyzer->GetSampleRate());
 
-    file_stream << "Time [s],Value,Packet Byte" << std::endl;
+    Channel coils[kQiMaxCoils];
+    bool    multi_coil = (mSettings->GetCoilChannels(coils) > 1);
+    file_stream << (multi_coil ? "Time [s],Value,Packet Byte,Coil\n" : "Time [s],Value,Packet Byte\n");
 
     U64 num_frames = GetNumFrames();
     for (U32 i = 0; i < num_frames; i++) {
         Frame frame = GetFrame(i);
 
-        char time_str[128];
-        AnalyzerHelpers::GetTimeString(frame.mStartingSampleInclusive, trigger_sample, sample_rate, time_str, 128);
+        char   time_str[32];
+        double time = double(S64(frame.mStartingSampleInclusive - trigger_sample)) * sample_period;
+        snprintf(time_str, sizeof(time_str), "%.9f", time);
 
         U64  byte = reverseDataByteBits(frame.mData1);
         char number_str[32];
         AnalyzerHelpers::GetNumberString(byte, display_base, 11, number_str, 32);
 
-        U64  packet_byte = frame.mData2;
         char packet_byte_str[16];
-        AnalyzerHelpers::GetNumberString(packet_byte, Decimal, 8, packet_byte_str, 16);
+        snprintf(packet_byte_str, sizeof(packet_byte_str), "%u", U32(frame.mData2));
 
-        file_stream << time_str << "," << number_str << "," << packet_byte_str << std::endl;
+        file_stream << time_str << ',' << number_str << ',' << packet_byte_str;
+        if (multi_coil)
+            file_stream << ',' << U32(frame.mType);
+        file_stream << '\n';
 
         if (UpdateExportProgressAndCheckForCancel(i, num_frames) == true) {
             file_stream.close();
@@ -74,6 +115,120 @@ void QiAnalyzerResults::GenerateExportFile(const char* file, DisplayBase display
     file_stream.close();
 }
 
+void QiAnalyzerResults::ExportRecords(const char* file) {
+    QiRecordWriter writer;
+    if (writer.Open(file, mAnalyzer->GetSampleRate(), mAnalyzer->GetTriggerSample()) == false)
+        return;
+
+    U64 num_frames = GetNumFrames();
+    for (U32 i = 0; i < num_frames; i++) {
+        Frame frame = GetFrame(i);
+
+        U16 packet = U16(frame.mData1);
+        writer.Write(frame.mStartingSampleInclusive,
+                     packet,
+                     U8(packet >> 1),
+                     U8(frame.mData2),
+                     U8(frame.mFlags & (QiByteParityError | QiByteStopError)),
+                     frame.mType);
+
+        if (UpdateExportProgressAndCheckForCancel(i, num_frames) == true)
+            break;
+    }
+
+    writer.Close();
+}
+
+void QiAnalyzerResults::ExportPackets(const char* file, bool write_index) {
+    std::string       index_path = std::string(file) + ".idx";
+    Channel           coils[kQiMaxCoils];
+    U32               coil_count = mSettings->GetCoilChannels(coils);
+    QiPacketCsvWriter writer;
+    bool              opened = writer.Open(file,
+                                           write_index ? index_path.c_str() : nullptr,
+                                           mAnalyzer->GetSampleRate(),
+                                           mAnalyzer->GetTriggerSample(),
+                                           coil_count > 1);
+    if (opened == false)
+        return;
+
+    if (coil_count > 1) {
+        ExportCoilPackets(writer, coil_count);
+        writer.Close();
+        return;
+    }
+
+    U64 num_packets = GetNumPackets();
+    for (U64 i = 0; i < num_packets; i++) {
+        QiPacket packet;
+        if (DecodePacket(i, &packet) == true)
+            writer.Write(packet);
+
+        if (UpdateExportProgressAndCheckForCancel(i, num_packets) == true)
+            break;
+    }
+
+    writer.Close();
+}
+
+void QiAnalyzerResults::ExportCoilPackets(QiPacketCsvWriter& writer, U32 coil_count) {
+    std::vector<QiPacketAssembler> assemblers(coil_count);
+
+    U64 num_frames = GetNumFrames();
+    for (U64 i = 0; i < num_frames; i++) {
+        Frame frame = GetFrame(i);
+        if (frame.mType >= coil_count)
+            continue;
+
+        // Only the fields that the assembler uses
+        QiByte byte;
+        byte.mBitEdges[0]  = frame.mStartingSampleInclusive;
+        byte.mBitEdges[11] = frame.mEndingSampleInclusive + 1;
+        byte.mPacket       = U16(frame.mData1);
+        byte.mPayload      = U8(frame.mData1 >> 1);
+        byte.mPacketByte   = U8(frame.mData2);
+        byte.mPreambleBits = 0;
+        byte.mParityValid  = (frame.mFlags & QiByteParityError) == 0;
+        byte.mStopValid    = (frame.mFlags & QiByteStopError) == 0;
+        if (assemblers[frame.mType].AddByte(byte) == true)
+            writer.Write(assemblers[frame.mType].GetPacket(), frame.mType);
+
+        if (UpdateExportProgressAndCheckForCancel(i, num_frames) == true)
+            break;
+    }
+}
+
+bool QiAnalyzerResults::DecodePacket(U64 packet_id, QiPacket* packet) {
+    U64 first_frame;
+    U64 last_frame;
+    GetFramesContainedInPacket(packet_id, &first_frame, &last_frame);
+    if ((last_frame < first_frame + 1) || (last_frame - first_frame - 1 > kQiMaxPacketSize))
+        return false;
+
+    // header, message, checksum
+    Frame header   = GetFrame(first_frame);
+    Frame checksum = GetFrame(last_frame);
+
+    packet->mStart     = header.mStartingSampleInclusive;
+    packet->mEnd       = checksum.mEndingSampleInclusive + 1;
+    packet->mHeader    = U8(header.mData1 >> 1);
+    packet->mInfo      = QiLookupPacket(packet->mHeader);
+    packet->mSize      = U8(last_frame - first_frame - 1);
+    packet->mChecksum  = U8(checksum.mData1 >> 1);
+    packet->mBitErrors = ((header.mFlags | checksum.mFlags) & (QiByteParityError | QiByteStopError)) != 0;
+
+    U8 sum = packet->mHeader;
+    for (U32 i = 0; i < packet->mSize; i++) {
+        Frame frame          = GetFrame(first_frame + 1 + i);
+        packet->mMessage[i]  = U8(frame.mData1 >> 1);
+        packet->mBitErrors   = packet->mBitErrors || ((frame.mFlags & (QiByteParityError | QiByteStopError)) != 0);
+        sum ^= packet->mMessage[i];
+    }
+    packet->mChecksumValid = (sum == packet->mChecksum);
+
+    return true;
+}
+
 void QiAnalyzerResults::GenerateFrameTabularText(U64 frame_index, DisplayBase display_base) {
 #ifdef SUPPORTS_PROTOCOL_SEARCH
     Frame frame = GetFrame(frame_index);
@@ -92,7 +247,21 @@ void QiAnalyzerResults::GenerateFrameTabularText(U64 frame_index, DisplayBase di
 }
 
 void QiAnalyzerResults::GeneratePacketTabularText(U64 packet_id, DisplayBase display_base) {
-    // not supported
+    ClearTabularText();
+
+    QiPacket packet;
+    if (DecodePacket(packet_id, &packet) == false)
+        return;
+
+    char text[128];
+    snprintf(text,
+             sizeof(text),
+             "%s (0x%02X), %u bytes, checksum %s",
+             (packet.mInfo != nullptr) ? packet.mInfo->mMnemonic : "?",
+             packet.mHeader,
+             packet.mSize,
+             packet.mChecksumValid ? "ok" : "error");
+    AddTabularText(text);
 }
 
 void QiAnalyzerResults::GenerateTransactionTabularText(U64 transaction_id, DisplayBase display_base) {
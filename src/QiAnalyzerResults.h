@@ -2,12 +2,23 @@
 #define QI_ANALYZER_RESULTS
 
 #include <AnalyzerResults.h>
+#include "QiPacket.h"
 
 class QiAnalyzer;
+class QiPacketCsvWriter;
 class QiAnalyzerSettings;
 
 class QiAnalyzerResults : public AnalyzerResults {
   public:
+    // Export types registered by QiAnalyzerSettings.
+    enum ExportType {
+        kExportText    = 0,
+        kExportRecords = 1,    // QiRecordFile.h
+        kExportPackets = 2,    // QiPacketExport.h
+        kExportPacketsIndexed = 3,
+        kExportSessionStats   = 4,    // QiSessionStats.h
+    };
+
     QiAnalyzerResults(QiAnalyzer* analyzer, QiAnalyzerSettings* settings);
     virtual ~QiAnalyzerResults();
 
@@ -19,6 +30,16 @@ class QiAnalyzerResults : public AnalyzerResults {
     virtual void GenerateTransactionTabularText(U64 transaction_id, DisplayBase display_base);
 
   protected:    // functions
+    void ExportText(const char* file, DisplayBase display_base);
+    void ExportRecords(const char* file);
+    void ExportPackets(const char* file, bool write_index);
+
+    // Rebuilds a Qi packet from the V1 frames of an SDK packet.
+    bool DecodePacket(U64 packet_id, QiPacket* packet);
+
+    // Multi-coil captures have no SDK packets; their packets are reassembled from the V1 frames of each coil.
+    void ExportCoilPackets(QiPacketCsvWriter& writer, U32 coil_count);
+
   protected:    // vars
     QiAnalyzerSettings* mSettings;
     QiAnalyzer*         mAnalyzer;
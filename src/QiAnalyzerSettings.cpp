@@ -1,28 +1,230 @@
 #include "QiAnalyzerSettings.h"
 #include <AnalyzerHelpers.h>
+#include "QiPacketSearch.h"
 
-QiAnalyzerSettings::QiAnalyzerSettings() : mInputChannel(UNDEFINED_CHANNEL) {
+#include <cstdio>
+#include <cstring>
+
+QiAnalyzerSettings::QiAnalyzerSettings()
+    : mInputChannel(UNDEFINED_CHANNEL)
+    , mTrackingTolerance(4)
+    , mGlitchFilterUs(40)
+    , mMarkerDensity(QiMarkersFull)
+    , mFrameFormat(QiFramesV1AndV2)
+    , mStatsIntervalS(10)
+    , mRepeatMode(QiRepeatsShown)
+    , mRepeatCeTolerance(0) {
     mInputChannelInterface.reset(new AnalyzerSettingInterfaceChannel());
     mInputChannelInterface->SetTitleAndTooltip("Qi", "WPC Qi");
     mInputChannelInterface->SetChannel(mInputChannel);
 
+    for (U32 i = 0; i < kQiMaxCoils - 1; i++) {
+        char title[32];
+        snprintf(title, sizeof(title), "Qi Coil %u", i + 1);
+
+        mCoilChannels[i] = UNDEFINED_CHANNEL;
+        mCoilChannelInterfaces[i].reset(new AnalyzerSettingInterfaceChannel());
+        mCoilChannelInterfaces[i]->SetTitleAndTooltip(title, "Another coil of a multi-coil transmitter, decoded on its own");
+        mCoilChannelInterfaces[i]->SetChannel(mCoilChannels[i]);
+        mCoilChannelInterfaces[i]->SetSelectionOfNoneIsAllowed(true);
+    }
+
+    mCarrierChannel = UNDEFINED_CHANNEL;
+    mCarrierChannelInterface.reset(new AnalyzerSettingInterfaceChannel());
+    mCarrierChannelInterface->SetTitleAndTooltip(
+        "Carrier (FSK)", "Power carrier of the Qi coil, for the transmitter's FSK packets; sample at 10 MHz or more");
+    mCarrierChannelInterface->SetChannel(mCarrierChannel);
+    mCarrierChannelInterface->SetSelectionOfNoneIsAllowed(true);
+
+    mTrackingToleranceInterface.reset(new AnalyzerSettingInterfaceNumberList());
+    mTrackingToleranceInterface->SetTitleAndTooltip(
+        "Bit Tolerance", "Timing tolerance around the bit period measured from the preamble");
+    mTrackingToleranceInterface->AddNumber(4, "+/- 25%", "Same as the preamble search");
+    mTrackingToleranceInterface->AddNumber(5, "+/- 20%", "");
+    mTrackingToleranceInterface->AddNumber(6, "+/- 16.7%", "");
+    mTrackingToleranceInterface->AddNumber(8, "+/- 12.5%", "Rejects more noise, but is less tolerant of jitter");
+    mTrackingToleranceInterface->SetNumber(mTrackingTolerance);
+
+    mGlitchFilterInterface.reset(new AnalyzerSettingInterfaceInteger());
+    mGlitchFilterInterface->SetTitleAndTooltip(
+        "Glitch Filter (us)", "Pulses shorter than this are removed along with both of their edges; 0 disables the filter");
+    mGlitchFilterInterface->SetMax(125);    // half of a half-bit
+    mGlitchFilterInterface->SetMin(0);
+    mGlitchFilterInterface->SetInteger(mGlitchFilterUs);
+
+    // Long captures produce a lot of result data; these trade detail for memory and speed
+    mMarkerDensityInterface.reset(new AnalyzerSettingInterfaceNumberList());
+    mMarkerDensityInterface->SetTitleAndTooltip("Markers", "Markers shown on the channel");
+    mMarkerDensityInterface->AddNumber(QiMarkersFull, "All", "Every bit, and every preamble bit");
+    mMarkerDensityInterface->AddNumber(QiMarkersErrorsOnly, "Errors only", "Sync, parity and stop bit errors");
+    mMarkerDensityInterface->AddNumber(QiMarkersNone, "None", "");
+    mMarkerDensityInterface->SetNumber(mMarkerDensity);
+
+    mFrameFormatInterface.reset(new AnalyzerSettingInterfaceNumberList());
+    mFrameFormatInterface->SetTitleAndTooltip("Frames", "Frame types that each byte is stored as");
+    mFrameFormatInterface->AddNumber(QiFramesV1AndV2, "V1 and V2", "Required by every export but the session statistics");
+    mFrameFormatInterface->AddNumber(
+        QiFramesV2Only, "V2 only", "Halves the memory used per byte; the text/csv, record and packet exports come out empty");
+    mFrameFormatInterface->SetNumber(mFrameFormat);
+
+    mStatsIntervalInterface.reset(new AnalyzerSettingInterfaceInteger());
+    mStatsIntervalInterface->SetTitleAndTooltip(
+        "Stats Interval (s)", "Seconds of capture between the stats and session summary frames; 0 disables them");
+    mStatsIntervalInterface->SetMax(3600);
+    mStatsIntervalInterface->SetMin(0);
+    mStatsIntervalInterface->SetInteger(mStatsIntervalS);
+
+    mRepeatModeInterface.reset(new AnalyzerSettingInterfaceNumberList());
+    mRepeatModeInterface->SetTitleAndTooltip("Repeated Packets", "Packets that repeat the last packet shown in full");
+    mRepeatModeInterface->AddNumber(QiRepeatsShown, "Show all", "");
+    mRepeatModeInterface->AddNumber(
+        QiRepeatsCollapsed, "Collapse", "One repeat frame per run, without bytes or markers; errors are always shown in full");
+    mRepeatModeInterface->SetNumber(mRepeatMode);
+
+    mRepeatCeToleranceInterface.reset(new AnalyzerSettingInterfaceInteger());
+    mRepeatCeToleranceInterface->SetTitleAndTooltip(
+        "Repeat CE Tolerance", "Control Error packets within this of the one shown in full are collapsed as repeats");
+    mRepeatCeToleranceInterface->SetMax(127);
+    mRepeatCeToleranceInterface->SetMin(0);
+    mRepeatCeToleranceInterface->SetInteger(mRepeatCeTolerance);
+
+    mSearchInterface.reset(new AnalyzerSettingInterfaceText());
+    mSearchInterface->SetTitleAndTooltip(
+        "Search", "Packets to add match frames for, separated by ';', e.g. ept: 02 08; ce_high: 03 14-7F; id_cfg: 71 > 51");
+    mSearchInterface->SetText(mSearch.c_str());
+
+    // One pair of limits per rule of the timing checker's table
+    for (U32 i = 0; i < kQiTimingRuleCount; i++) {
+        const QiTimingRule& rule = QiGetTimingRule(i);
+        U32                 max  = (strcmp(rule.mUnit, "bits") == 0) ? 64 : 10000000;
+        char                title[64];
+
+        mTimingMin[i] = rule.mDefaultMin;
+        mTimingMax[i] = rule.mDefaultMax;
+
+        snprintf(title, sizeof(title), "%s Min (%s)", rule.mTitle, rule.mUnit);
+        mTimingMinInterfaces[i].reset(new AnalyzerSettingInterfaceInteger());
+        mTimingMinInterfaces[i]->SetTitleAndTooltip(title, "Shorter is reported as a timing violation; 0 is not checked");
+        mTimingMinInterfaces[i]->SetMax(max);
+        mTimingMinInterfaces[i]->SetMin(0);
+        mTimingMinInterfaces[i]->SetInteger(mTimingMin[i]);
+
+        snprintf(title, sizeof(title), "%s Max (%s)", rule.mTitle, rule.mUnit);
+        mTimingMaxInterfaces[i].reset(new AnalyzerSettingInterfaceInteger());
+        mTimingMaxInterfaces[i]->SetTitleAndTooltip(title, "Longer is reported as a timing violation; 0 is not checked");
+        mTimingMaxInterfaces[i]->SetMax(max);
+        mTimingMaxInterfaces[i]->SetMin(0);
+        mTimingMaxInterfaces[i]->SetInteger(mTimingMax[i]);
+    }
+
     AddInterface(mInputChannelInterface.get());
+    for (U32 i = 0; i < kQiMaxCoils - 1; i++)
+        AddInterface(mCoilChannelInterfaces[i].get());
+    AddInterface(mCarrierChannelInterface.get());
+    AddInterface(mTrackingToleranceInterface.get());
+    AddInterface(mGlitchFilterInterface.get());
+    AddInterface(mMarkerDensityInterface.get());
+    AddInterface(mFrameFormatInterface.get());
+    AddInterface(mStatsIntervalInterface.get());
+    AddInterface(mRepeatModeInterface.get());
+    AddInterface(mRepeatCeToleranceInterface.get());
+    AddInterface(mSearchInterface.get());
+    for (U32 i = 0; i < kQiTimingRuleCount; i++) {
+        AddInterface(mTimingMinInterfaces[i].get());
+        AddInterface(mTimingMaxInterfaces[i].get());
+    }
 
     AddExportOption(0, "Export as text/csv file");
     AddExportExtension(0, "text", "txt");
     AddExportExtension(0, "csv", "csv");
+    AddExportOption(1, "Export as binary records");
+    AddExportExtension(1, "Qi records", "qirec");
+    AddExportOption(2, "Export packets as csv file");
+    AddExportExtension(2, "csv", "csv");
+    AddExportOption(3, "Export packets as csv file with seek index (.idx)");
+    AddExportExtension(3, "csv", "csv");
+    AddExportOption(4, "Export session statistics as csv file");
+    AddExportExtension(4, "csv", "csv");
 
-    ClearChannels();
-    AddChannel(mInputChannel, "Qi", false);
+    UpdateChannels(false);
 }
 
 QiAnalyzerSettings::~QiAnalyzerSettings() {}
 
-bool QiAnalyzerSettings::SetSettingsFromInterfaces() {
-    mInputChannel = mInputChannelInterface->GetChannel();
+U32 QiAnalyzerSettings::GetCoilChannels(Channel* coils) const {
+    U32 count      = 0;
+    coils[count++] = mInputChannel;
+    for (U32 i = 0; (i < kQiMaxCoils - 1) && (mCoilChannels[i] != UNDEFINED_CHANNEL); i++)
+        coils[count++] = mCoilChannels[i];
+    return count;
+}
+
+void QiAnalyzerSettings::UpdateChannels(bool is_used) {
+    Channel coils[kQiMaxCoils];
+    U32     count = GetCoilChannels(coils);
 
     ClearChannels();
-    AddChannel(mInputChannel, "Qi", true);
+    AddChannel(mInputChannel, "Qi", is_used);
+    for (U32 i = 1; i < count; i++) {
+        char label[32];
+        snprintf(label, sizeof(label), "Qi Coil %u", i);
+        AddChannel(coils[i], label, is_used);
+    }
+    if (mCarrierChannel != UNDEFINED_CHANNEL)
+        AddChannel(mCarrierChannel, "Carrier", is_used);
+}
+
+bool QiAnalyzerSettings::SetSettingsFromInterfaces() {
+    Channel coils[kQiMaxCoils];
+    coils[0] = mInputChannelInterface->GetChannel();
+    for (U32 i = 0; i < kQiMaxCoils - 1; i++)
+        coils[i + 1] = mCoilChannelInterfaces[i]->GetChannel();
+    for (U32 i = 1; i < kQiMaxCoils; i++) {
+        // Coils are numbered by their setting, so they are assigned in order
+        if ((coils[i] != UNDEFINED_CHANNEL) && (coils[i - 1] == UNDEFINED_CHANNEL)) {
+            SetErrorText("Assign the coils in order, starting with Qi Coil 1.");
+            return false;
+        }
+        for (U32 j = 0; (coils[i] != UNDEFINED_CHANNEL) && (j < i); j++) {
+            if (coils[i] == coils[j]) {
+                SetErrorText("Each coil needs a channel of its own.");
+                return false;
+            }
+        }
+    }
+    Channel carrier = mCarrierChannelInterface->GetChannel();
+    for (U32 i = 0; (carrier != UNDEFINED_CHANNEL) && (i < kQiMaxCoils); i++) {
+        if (carrier == coils[i]) {
+            SetErrorText("The carrier needs a channel of its own.");
+            return false;
+        }
+    }
+
+    QiSearchPatterns search;
+    std::string      search_error;
+    if (search.Compile(mSearchInterface->GetText(), search_error) == false) {
+        SetErrorText(("Search: " + search_error).c_str());
+        return false;
+    }
+
+    mInputChannel = coils[0];
+    for (U32 i = 0; i < kQiMaxCoils - 1; i++)
+        mCoilChannels[i] = coils[i + 1];
+    mCarrierChannel    = carrier;
+    mTrackingTolerance = U32(mTrackingToleranceInterface->GetNumber());
+    mGlitchFilterUs    = U32(mGlitchFilterInterface->GetInteger());
+    mMarkerDensity     = QiMarkerDensity(U32(mMarkerDensityInterface->GetNumber()));
+    mFrameFormat       = QiFrameFormat(U32(mFrameFormatInterface->GetNumber()));
+    mStatsIntervalS    = U32(mStatsIntervalInterface->GetInteger());
+    mRepeatMode        = QiRepeatMode(U32(mRepeatModeInterface->GetNumber()));
+    mRepeatCeTolerance = U32(mRepeatCeToleranceInterface->GetInteger());
+    mSearch            = mSearchInterface->GetText();
+    for (U32 i = 0; i < kQiTimingRuleCount; i++) {
+        mTimingMin[i] = U32(mTimingMinInterfaces[i]->GetInteger());
+        mTimingMax[i] = U32(mTimingMaxInterfaces[i]->GetInteger());
+    }
+
+    UpdateChannels(true);
 
     return true;
 }
@@ -38,8 +240,50 @@ void QiAnalyzerSettings::LoadSettings(const char* settings) {
 
     text_archive >> mInputChannel;
 
-    ClearChannels();
-    AddChannel(mInputChannel, "Qi", true);
+    // added later; keep the default when loading older settings
+    U32 tracking_tolerance;
+    if (text_archive >> tracking_tolerance)
+        mTrackingTolerance = tracking_tolerance;
+    U32 glitch_filter_us;
+    if (text_archive >> glitch_filter_us)
+        mGlitchFilterUs = glitch_filter_us;
+    U32 marker_density;
+    if (text_archive >> marker_density)
+        mMarkerDensity = QiMarkerDensity(marker_density);
+    U32 frame_format;
+    if (text_archive >> frame_format)
+        mFrameFormat = QiFrameFormat(frame_format);
+    U32 stats_interval_s;
+    if (text_archive >> stats_interval_s)
+        mStatsIntervalS = stats_interval_s;
+    for (U32 i = 0; i < kQiMaxCoils - 1; i++) {
+        Channel coil;
+        if ((text_archive >> coil) == false)
+            break;
+        mCoilChannels[i] = coil;
+    }
+    for (U32 i = 0; i < kQiTimingRuleCount; i++) {
+        U32 min;
+        U32 max;
+        if (((text_archive >> min) == false) || ((text_archive >> max) == false))
+            break;
+        mTimingMin[i] = min;
+        mTimingMax[i] = max;
+    }
+    Channel carrier;
+    if (text_archive >> carrier)
+        mCarrierChannel = carrier;
+    U32 repeat_mode;
+    U32 repeat_ce_tolerance;
+    if ((text_archive >> repeat_mode) && (text_archive >> repeat_ce_tolerance)) {
+        mRepeatMode        = QiRepeatMode(repeat_mode);
+        mRepeatCeTolerance = repeat_ce_tolerance;
+    }
+    const char* search;
+    if (text_archive >> &search)
+        mSearch = search;
+
+    UpdateChannels(true);
 
     UpdateInterfacesFromSettings();
 }
@@ -49,10 +293,40 @@ const char* QiAnalyzerSettings::SaveSettings() {
 
     text_archive << "QiAnalyzer";
     text_archive << mInputChannel;
+    text_archive << mTrackingTolerance;
+    text_archive << mGlitchFilterUs;
+    text_archive << U32(mMarkerDensity);
+    text_archive << U32(mFrameFormat);
+    text_archive << mStatsIntervalS;
+    for (U32 i = 0; i < kQiMaxCoils - 1; i++)
+        text_archive << mCoilChannels[i];
+    for (U32 i = 0; i < kQiTimingRuleCount; i++) {
+        text_archive << mTimingMin[i];
+        text_archive << mTimingMax[i];
+    }
+    text_archive << mCarrierChannel;
+    text_archive << U32(mRepeatMode);
+    text_archive << mRepeatCeTolerance;
+    text_archive << mSearch.c_str();
 
     return SetReturnString(text_archive.GetString());
 }
 
 void QiAnalyzerSettings::UpdateInterfacesFromSettings() {
     mInputChannelInterface->SetChannel(mInputChannel);
+    mTrackingToleranceInterface->SetNumber(mTrackingTolerance);
+    mGlitchFilterInterface->SetInteger(mGlitchFilterUs);
+    mMarkerDensityInterface->SetNumber(mMarkerDensity);
+    mFrameFormatInterface->SetNumber(mFrameFormat);
+    mStatsIntervalInterface->SetInteger(mStatsIntervalS);
+    for (U32 i = 0; i < kQiMaxCoils - 1; i++)
+        mCoilChannelInterfaces[i]->SetChannel(mCoilChannels[i]);
+    mCarrierChannelInterface->SetChannel(mCarrierChannel);
+    mRepeatModeInterface->SetNumber(mRepeatMode);
+    mRepeatCeToleranceInterface->SetInteger(mRepeatCeTolerance);
+    mSearchInterface->SetText(mSearch.c_str());
+    for (U32 i = 0; i < kQiTimingRuleCount; i++) {
+        mTimingMinInterfaces[i]->SetInteger(mTimingMin[i]);
+        mTimingMaxInterfaces[i]->SetInteger(mTimingMax[i]);
+    }
 }
@@ -3,6 +3,31 @@
 
 #include <AnalyzerSettings.h>
 #include <AnalyzerTypes.h>
+#include <string>
+#include "QiTimingChecker.h"
+
+// How many markers are added to the channel.
+enum QiMarkerDensity {
+    QiMarkersFull       = 0,    // every bit and preamble bit
+    QiMarkersErrorsOnly = 1,    // only sync, parity and stop bit errors
+    QiMarkersNone       = 2,
+};
+
+// Channels of one analyzer: the Qi channel (coil 0), plus the other coils of a multi-coil transmitter, each decoded on
+// its own. MP-A designs have three coils and free-positioning arrays often more.
+static const U32 kQiMaxCoils = 6;
+
+// Which frame types each byte is stored as.
+enum QiFrameFormat {
+    QiFramesV1AndV2 = 0,    // the V1 frames feed the bubble text and the text/csv export
+    QiFramesV2Only  = 1,
+};
+
+// Whether packets that repeat the previous one are shown in full.
+enum QiRepeatMode {
+    QiRepeatsShown     = 0,
+    QiRepeatsCollapsed = 1,    // merged into "repeat" frames, see QiPacketRepeats.h
+};
 
 class QiAnalyzerSettings : public AnalyzerSettings {
   public:
@@ -15,10 +40,44 @@ class QiAnalyzerSettings : public AnalyzerSettings {
 
     void UpdateInterfacesFromSettings();
 
+    // Fills coils with the channels that are decoded, the Qi channel first; the index into it is the coil of a frame.
+    // Returns the number of coils.
+    U32 GetCoilChannels(Channel* coils) const;
+
     Channel mInputChannel;
+    Channel mCoilChannels[kQiMaxCoils - 1];    // "Qi Coil 1" and up, assigned in order; UNDEFINED_CHANNEL if unused
+    Channel mCarrierChannel;                   // power carrier for the FSK decoder; UNDEFINED_CHANNEL if unused
+    U32     mTrackingTolerance;    // QiDecoder::SetTrackingTolerance() divisor
+    U32     mGlitchFilterUs;       // minimum pulse width in microseconds; 0 disables the filter
+
+    QiMarkerDensity mMarkerDensity;
+    QiFrameFormat   mFrameFormat;
+    U32             mStatsIntervalS;       // seconds of capture between "stats" frames; 0 disables them
+    QiRepeatMode    mRepeatMode;
+    U32             mRepeatCeTolerance;    // Control Error values within this of the shown packet's are repeats
+    std::string     mSearch;               // patterns to add "match" frames for, see QiPacketSearch.h; empty if none
+
+    // Limits of the QiTimingChecker rules, in the rule's unit; 0 is not checked
+    U32 mTimingMin[kQiTimingRuleCount];
+    U32 mTimingMax[kQiTimingRuleCount];
+
+  protected:
+    void UpdateChannels(bool is_used);
 
   protected:
-    std::unique_ptr<AnalyzerSettingInterfaceChannel> mInputChannelInterface;
+    std::unique_ptr<AnalyzerSettingInterfaceChannel>    mInputChannelInterface;
+    std::unique_ptr<AnalyzerSettingInterfaceChannel>    mCoilChannelInterfaces[kQiMaxCoils - 1];
+    std::unique_ptr<AnalyzerSettingInterfaceChannel>    mCarrierChannelInterface;
+    std::unique_ptr<AnalyzerSettingInterfaceNumberList> mTrackingToleranceInterface;
+    std::unique_ptr<AnalyzerSettingInterfaceInteger>    mGlitchFilterInterface;
+    std::unique_ptr<AnalyzerSettingInterfaceNumberList> mMarkerDensityInterface;
+    std::unique_ptr<AnalyzerSettingInterfaceNumberList> mFrameFormatInterface;
+    std::unique_ptr<AnalyzerSettingInterfaceInteger>    mStatsIntervalInterface;
+    std::unique_ptr<AnalyzerSettingInterfaceNumberList> mRepeatModeInterface;
+    std::unique_ptr<AnalyzerSettingInterfaceInteger>    mRepeatCeToleranceInterface;
+    std::unique_ptr<AnalyzerSettingInterfaceText>       mSearchInterface;
+    std::unique_ptr<AnalyzerSettingInterfaceInteger>    mTimingMinInterfaces[kQiTimingRuleCount];
+    std::unique_ptr<AnalyzerSettingInterfaceInteger>    mTimingMaxInterfaces[kQiTimingRuleCount];
 };
 
 #endif    // QI_ANALYZER_SETTINGS
@@ -0,0 +1,30 @@
+#ifndef QI_BYTE_ORDER_H
+#define QI_BYTE_ORDER_H
+
+#include "QiTypes.h"
+
+// Little-endian integers in the binary files (records, packet index, checkpoint journal), independent of the byte order
+// and alignment of the machine.
+inline void QiPutU16(U8* p, U16 value) {
+    p[0] = U8(value);
+    p[1] = U8(value >> 8);
+}
+
+inline void QiPutU32(U8* p, U32 value) {
+    for (U32 i = 0; i < 4; i++)
+        p[i] = U8(value >> (i * 8));
+}
+
+inline void QiPutU64(U8* p, U64 value) {
+    for (U32 i = 0; i < 8; i++)
+        p[i] = U8(value >> (i * 8));
+}
+
+inline U32 QiGetU32(const U8* p) {
+    U32 value = 0;
+    for (U32 i = 0; i < 4; i++)
+        value |= U32(p[i]) << (i * 8);
+    return value;
+}
+
+#endif    // QI_BYTE_ORDER_H
@@ -0,0 +1,129 @@
+#include "QiChannelEdgeSource.h"
+#include "QiAnalyzer.h"
+
+// The exit and commit checks are SDK calls that cost about as much as decoding an edge, so AdvanceToNextEdge() only
+// makes them every this many edges, unless results are held that no later edge of a packet would commit.
+static const U32 kEdgesPerCheck = 64;
+
+// With a carrier channel, silence on an idle coil is skipped in steps of this many of the decoder's minimum intervals
+// (about 12 ms), and the carrier is decoded up to each one.
+static const U64 kCarrierStepIntervals = 64;
+
+QiChannelEdgeSource::QiChannelEdgeSource(QiAnalyzer* analyzer, AnalyzerChannelData* channel)
+    : mAnalyzer(analyzer), mChannel(channel), mEdgesUntilCheck(kEdgesPerCheck) {}
+
+QiChannelEdgeSource::~QiChannelEdgeSource() {}
+
+void QiChannelEdgeSource::CommitBeforeWaiting() {
+    // Logic 2 blocks until more data is captured, so the channel never runs out of edges. Decode the carrier and commit
+    // any batched results before waiting, so that they are not held back at the end of a capture or during a live
+    // capture.
+    if ((mAnalyzer->HasPendingResults() || mAnalyzer->HasCarrier()) && (mChannel->DoMoreTransitionsExistInCurrentData() == false))
+        mAnalyzer->CommitBeforeWaiting(mChannel->GetSampleNumber());
+}
+
+void QiChannelEdgeSource::EndStopBitBeforeWaiting() {
+    // The last stop bit of a packet with an even number of bytes is ended by the gap after it, not by an edge. Rather
+    // than wait for the next packet's first edge, wait until the capture has reached the end of the gap, and end the
+    // packet there if it has no edge before.
+    if (mChannel->DoMoreTransitionsExistInCurrentData())
+        return;
+
+    mAnalyzer->CheckIfThreadShouldExit();
+    CommitBeforeWaiting();
+    U64 gap_end = mAnalyzer->GetSegmentGap() + 1;
+    if (mChannel->WouldAdvancingCauseTransition(U32(gap_end)))
+        return;
+
+    mAnalyzer->ProcessSilence(mChannel->GetSampleNumber() + gap_end);
+    CommitBeforeWaiting();
+}
+
+bool QiChannelEdgeSource::AdvanceToNextEdge() {
+    if ((--mEdgesUntilCheck == 0) || mAnalyzer->HasHeldResults()) {
+        mEdgesUntilCheck = kEdgesPerCheck;
+        mAnalyzer->CheckIfThreadShouldExit();
+        CommitBeforeWaiting();
+    }
+    if (mAnalyzer->IsStopBitPending())
+        EndStopBitBeforeWaiting();
+
+    mChannel->AdvanceToNextEdge();
+    return true;
+}
+
+bool QiChannelEdgeSource::AdvanceToNextIdleEdge(U64 min_interval, bool* skipped) {
+    *skipped = false;
+
+    // Carrier noise: while there is another edge within min_interval samples, none of the edges in between can start
+    // a bit, so step over them in half-intervals without visiting them one by one. Once the signal is quiet for a
+    // whole interval, the last edge of the burst lies within the final step. The channel can not move back to it, so
+    // stop on the first edge after the quiet interval instead, and let the decoder restart from there: a sample in
+    // between would make the first interval of a packet that follows the burst look shorter than it is.
+    U32 window = U32(min_interval - 1);
+    U64 step   = min_interval / 2;
+    if ((step == 0) || (mChannel->WouldAdvancingCauseTransition(window) == false)) {
+        // Silence is skipped by the channel itself; with a carrier, in steps, so that the transmitter's frames are
+        // decoded while the coil is idle rather than at its next byte
+        U64 carrier_step = min_interval * kCarrierStepIntervals;
+        while ((carrier_step > 0) && mAnalyzer->HasCarrier() &&
+               (mChannel->WouldAdvancingCauseTransition(U32(carrier_step)) == false)) {
+            mAnalyzer->CheckIfThreadShouldExit();
+            mChannel->AdvanceToAbsPosition(mChannel->GetSampleNumber() + carrier_step);
+            mAnalyzer->DecodeCarrierBefore(mChannel->GetSampleNumber());
+            CommitBeforeWaiting();
+        }
+        return AdvanceToNextEdge();
+    }
+
+    do {
+        mAnalyzer->CheckIfThreadShouldExit();
+        CommitBeforeWaiting();
+
+        mChannel->AdvanceToAbsPosition(mChannel->GetSampleNumber() + step);
+    } while (mChannel->WouldAdvancingCauseTransition(window));
+
+    CommitBeforeWaiting();
+    mChannel->AdvanceToNextEdge();
+    *skipped = true;
+    return true;
+}
+
+U64 QiChannelEdgeSource::GetSampleNumber() {
+    return mChannel->GetSampleNumber();
+}
+
+bool QiChannelEdgeSource::IsNextEdgeWithin(U64 distance) {
+    return (distance > 1) && mChannel->WouldAdvancingCauseTransition(U32(distance - 1));
+}
+
+bool QiChannelEdgeSource::PeekNextEdge(U64* location) {
+    mAnalyzer->CheckIfThreadShouldExit();
+    if (mChannel->DoMoreTransitionsExistInCurrentData() == false)
+        return false;
+
+    *location = mChannel->GetSampleOfNextEdge();
+    return true;
+}
+
+U32 QiChannelEdgeSource::ReadEdgesBefore(U64 location, U64* edges, U32 max_count) {
+    mAnalyzer->CheckIfThreadShouldExit();
+
+    U32 count = 0;
+    while ((count < max_count) && mChannel->DoMoreTransitionsExistInCurrentData() &&
+           (mChannel->GetSampleOfNextEdge() < location)) {
+        mChannel->AdvanceToNextEdge();
+        edges[count++] = mChannel->GetSampleNumber();
+    }
+    return count;
+}
+
+bool QiChannelEdgeSource::WaitForData(U64 location) {
+    mAnalyzer->CheckIfThreadShouldExit();
+    CommitBeforeWaiting();
+
+    // Blocks until the capture has reached the location; the channel stays where it is
+    if (location > mChannel->GetSampleNumber())
+        mChannel->WouldAdvancingToAbsPositionCauseTransition(location);
+    return true;
+}
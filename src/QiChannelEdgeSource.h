@@ -0,0 +1,37 @@
+#ifndef QI_CHANNEL_EDGE_SOURCE_H
+#define QI_CHANNEL_EDGE_SOURCE_H
+
+#include <AnalyzerChannelData.h>
+#include "QiDecoder.h"
+
+class QiAnalyzer;
+
+// Feeds the edges of a Logic 2 channel to the decoder core.
+class QiChannelEdgeSource : public QiEdgeSource {
+  public:
+    QiChannelEdgeSource(QiAnalyzer* analyzer, AnalyzerChannelData* channel);
+    virtual ~QiChannelEdgeSource();
+
+    virtual bool AdvanceToNextEdge();
+    virtual U64  GetSampleNumber();
+    virtual bool IsNextEdgeWithin(U64 distance);
+    virtual bool AdvanceToNextIdleEdge(U64 min_interval, bool* skipped);
+    virtual bool PeekNextEdge(U64* location);
+    virtual bool WaitForData(U64 location);
+
+    // Copies the locations of up to max_count of the next edges before location, advancing past them, and returns their
+    // number. Only edges already captured are read, so it does not wait for data; for the carrier channel, which is
+    // read up to where the Qi channel has been decoded.
+    U32 ReadEdgesBefore(U64 location, U64* edges, U32 max_count);
+
+  protected:
+    void CommitBeforeWaiting();
+    void EndStopBitBeforeWaiting();
+
+  protected:
+    QiAnalyzer*          mAnalyzer;
+    AnalyzerChannelData* mChannel;
+    U32                  mEdgesUntilCheck;    // edges until the next exit and commit check in AdvanceToNextEdge()
+};
+
+#endif    // QI_CHANNEL_EDGE_SOURCE_H
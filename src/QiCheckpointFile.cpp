@@ -0,0 +1,123 @@
+#include "QiCheckpointFile.h"
+#include "QiByteOrder.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+static const char kMagic[8] = { 'Q', 'I', 'C', 'K', 'P', 'T', 'J', 'L' };
+
+bool QiSeekFile(FILE* file, U64 offset, int origin) {
+#ifdef _WIN32
+    return _fseeki64(file, S64(offset), origin) == 0;
+#else
+    return fseeko(file, off_t(offset), origin) == 0;
+#endif
+}
+
+U64 QiTellFile(FILE* file) {
+#ifdef _WIN32
+    return U64(_ftelli64(file));
+#else
+    return U64(ftello(file));
+#endif
+}
+
+static bool TruncateTo(FILE* file, U64 size) {
+    if (fflush(file) != 0)
+        return false;
+#ifdef _WIN32
+    return _chsize_s(_fileno(file), S64(size)) == 0;
+#else
+    return ftruncate(fileno(file), off_t(size)) == 0;
+#endif
+}
+
+FILE* QiOpenFileAt(const char* path, U64 size) {
+    FILE* file = fopen(path, "r+b");
+    if (file == nullptr)
+        return nullptr;
+
+    if ((QiSeekFile(file, 0, SEEK_END) == false) || (QiTellFile(file) < size) ||
+        ((QiTellFile(file) > size) && (TruncateTo(file, size) == false)) || (QiSeekFile(file, size, SEEK_SET) == false)) {
+        fclose(file);
+        return nullptr;
+    }
+    return file;
+}
+
+QiCheckpointJournal::QiCheckpointJournal() : mFile(nullptr) {}
+
+QiCheckpointJournal::~QiCheckpointJournal() {
+    Close();
+}
+
+bool QiCheckpointJournal::Open(const char* path, std::string& error) {
+    Close();
+    mCheckpoints.clear();
+
+    U8 header[kQiCheckpointHeaderSize];
+    mFile = fopen(path, "r+b");
+    if (mFile == nullptr) {
+        mFile = fopen(path, "w+b");
+        if (mFile == nullptr) {
+            error = std::string("cannot create ") + path;
+            return false;
+        }
+
+        memset(header, 0, sizeof(header));
+        memcpy(header, kMagic, sizeof(kMagic));
+        QiPutU32(header + 8, kQiCheckpointVersion);
+        QiPutU32(header + 12, U32(sizeof(QiCheckpoint)));
+        if ((fwrite(header, 1, sizeof(header), mFile) != sizeof(header)) || (fflush(mFile) != 0)) {
+            error = std::string("cannot write ") + path;
+            return false;
+        }
+        return true;
+    }
+
+    if ((fread(header, 1, sizeof(header), mFile) != sizeof(header)) || (memcmp(header, kMagic, sizeof(kMagic)) != 0)) {
+        error = std::string(path) + " is not a checkpoint journal";
+        return false;
+    }
+    if ((QiGetU32(header + 8) != kQiCheckpointVersion) || (QiGetU32(header + 12) != sizeof(QiCheckpoint))) {
+        error = std::string(path) + " was written by another version";
+        return false;
+    }
+
+    // A record cut short by a crash while it was appended is dropped
+    QiCheckpoint checkpoint;
+    while (fread(&checkpoint, 1, sizeof(checkpoint), mFile) == sizeof(checkpoint))
+        mCheckpoints.push_back(checkpoint);
+    return Truncate(GetCount());
+}
+
+bool QiCheckpointJournal::Truncate(U32 index) {
+    if (index < GetCount())
+        mCheckpoints.resize(index);
+    return (mFile != nullptr) && TruncateTo(mFile, kQiCheckpointHeaderSize + U64(index) * sizeof(QiCheckpoint)) &&
+           QiSeekFile(mFile, 0, SEEK_END);
+}
+
+bool QiCheckpointJournal::Append(const QiCheckpoint& checkpoint) {
+    if ((mFile == nullptr) || (fwrite(&checkpoint, 1, sizeof(checkpoint), mFile) != sizeof(checkpoint)) ||
+        (fflush(mFile) != 0))
+        return false;
+
+    mCheckpoints.push_back(checkpoint);
+    return true;
+}
+
+bool QiCheckpointJournal::Close() {
+    if (mFile == nullptr)
+        return true;
+
+    bool ok = (fclose(mFile) == 0);
+    mFile   = nullptr;
+    return ok;
+}
@@ -0,0 +1,81 @@
+#ifndef QI_CHECKPOINT_FILE_H
+#define QI_CHECKPOINT_FILE_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "QiDecoder.h"
+
+// Journal of the checkpoints of an incremental decode (qi-decode -C), for captures that are still being written.
+// Each checkpoint is taken at a packet boundary and holds everything needed to continue from there: where reading the
+// capture continues, the decoder's state, the counters, and the sizes of the output files. The outputs are cut back
+// to those sizes when decoding continues, so that they end up the same as if the whole capture had been decoded at
+// once, also after a crash part way through a run.
+//
+// Header:
+//   0  char[8]  "QICKPTJL"
+//   8  U32      format version (kQiCheckpointVersion)
+//  12  U32      record size (sizeof(QiCheckpoint))
+//
+// Records follow at kQiCheckpointHeaderSize, oldest first. They are stored in the layout of the build that wrote them;
+// a journal with another record size is rejected, and decoding then has to start over.
+static const U32 kQiCheckpointVersion    = 2;
+static const U32 kQiCheckpointHeaderSize = 16;
+
+// Output files whose size a checkpoint records.
+enum QiCheckpointOutput {
+    QiCheckpointBytes,      // byte csv
+    QiCheckpointRecords,    // binary records
+    QiCheckpointPackets,    // packet csv
+    kQiCheckpointOutputCount,
+};
+
+struct QiCheckpoint {
+    // Settings of the decode; a checkpoint is only continued with the same ones
+    U32 mFormat;    // QiEdgeFileFormat
+    U32 mSampleRateHz;
+    U64 mMinPulseWidth;
+
+    U64 mInputOffset;                              // byte offset in the capture after the last edge
+    U64 mOutputSizes[kQiCheckpointOutputCount];    // 0 for outputs that are not written
+    U64 mByteCount;
+    U64 mPacketCount;
+    U64 mChecksumErrorCount;
+
+    QiDecoderCheckpoint mDecoder;
+};
+
+class QiCheckpointJournal {
+  public:
+    QiCheckpointJournal();
+    ~QiCheckpointJournal();
+
+    // Opens the journal and reads its checkpoints, or creates it if it does not exist.
+    bool Open(const char* path, std::string& error);
+
+    U32                 GetCount() const { return U32(mCheckpoints.size()); }
+    const QiCheckpoint& Get(U32 index) const { return mCheckpoints[index]; }
+
+    // Drops the checkpoints from index on, to continue from an earlier one.
+    bool Truncate(U32 index);
+
+    // Appends a checkpoint and flushes it to the file; the outputs it refers to must have been flushed first.
+    bool Append(const QiCheckpoint& checkpoint);
+
+    bool Close();
+
+  private:
+    FILE*                     mFile;
+    std::vector<QiCheckpoint> mCheckpoints;
+};
+
+// Opens an existing file to continue writing at `size`, dropping whatever was written after it. Returns nullptr if the
+// file can not be opened or is shorter than that.
+FILE* QiOpenFileAt(const char* path, U64 size);
+
+// fseek() and ftell() with 64-bit offsets, which long is not on Windows.
+bool QiSeekFile(FILE* file, U64 offset, int origin);
+U64  QiTellFile(FILE* file);
+
+#endif    // QI_CHECKPOINT_FILE_H
@@ -0,0 +1,44 @@
+#include "QiCommitScheduler.h"
+
+QiCommitScheduler::QiCommitScheduler()
+    : mPending(false)
+    , mPendingFrames(0)
+    , mMaxPendingFrames(1)
+    , mMaxDelay(Clock::duration::zero())
+    , mProgressStride(1)
+    , mNextProgress(0) {}
+
+QiCommitScheduler::~QiCommitScheduler() {}
+
+void QiCommitScheduler::Reset(U64 progress_stride, U32 max_pending_frames, U32 max_delay_ms) {
+    mPending          = false;
+    mPendingFrames    = 0;
+    mMaxPendingFrames = (max_pending_frames > 0) ? max_pending_frames : 1;
+    mMaxDelay         = std::chrono::milliseconds(max_delay_ms);
+    mProgressStride   = (progress_stride > 0) ? progress_stride : 1;
+    mNextProgress     = 0;
+}
+
+bool QiCommitScheduler::ResultsAdded(U32 frame_count) {
+    Clock::time_point now = Clock::now();
+    if (mPending == false) {
+        mPending      = true;
+        mFirstPending = now;
+    }
+    mPendingFrames += frame_count;
+
+    return (mPendingFrames >= mMaxPendingFrames) || ((now - mFirstPending) >= mMaxDelay);
+}
+
+void QiCommitScheduler::Committed() {
+    mPending       = false;
+    mPendingFrames = 0;
+}
+
+bool QiCommitScheduler::ShouldReportProgress(U64 sample_number) {
+    if (sample_number < mNextProgress)
+        return false;
+
+    mNextProgress = sample_number + mProgressStride;
+    return true;
+}
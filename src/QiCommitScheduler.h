@@ -0,0 +1,40 @@
+#ifndef QI_COMMIT_SCHEDULER_H
+#define QI_COMMIT_SCHEDULER_H
+
+#include <chrono>
+
+#include "QiTypes.h"
+
+// Decides when the plugin commits its results to Logic 2 and reports progress. Both synchronize with the UI, so
+// doing them for every byte makes their cost proportional to the byte count. Results are instead committed when a
+// packet ends (by the caller), once enough frames are pending, or once the oldest pending result has waited for the
+// time budget; the caller also commits on a loss of sync and before waiting for more data.
+class QiCommitScheduler {
+  public:
+    QiCommitScheduler();
+    ~QiCommitScheduler();
+
+    void Reset(U64 progress_stride, U32 max_pending_frames, U32 max_delay_ms);
+
+    // Records newly added results (frame_count may be 0 for markers). Returns true when they should be committed now.
+    bool ResultsAdded(U32 frame_count);
+    void Committed();
+    bool HasPendingResults() const { return mPending; }
+
+    // Returns true when progress should be reported for the sample, at most once per progress stride.
+    bool ShouldReportProgress(U64 sample_number);
+
+  private:
+    typedef std::chrono::steady_clock Clock;
+
+    bool              mPending;
+    U32               mPendingFrames;
+    Clock::time_point mFirstPending;
+    U32               mMaxPendingFrames;
+    Clock::duration   mMaxDelay;
+
+    U64 mProgressStride;
+    U64 mNextProgress;
+};
+
+#endif    // QI_COMMIT_SCHEDULER_H
@@ -0,0 +1,609 @@
+#include "QiDecoder.h"
+
+#include <cstring>
+
+
+#define CLAMP_MIN(VAL, MIN_VAL)     ((VAL) < (MIN_VAL) ? (MIN_VAL) : (VAL))
+#define CLAMP_MAX(VAL, MAX_VAL)     ((VAL) > (MAX_VAL) ? (MAX_VAL) : (VAL))
+
+
+static const U32 kBitRate = 2000;
+
+// Window tolerances are a fraction of the bit period. The preamble is searched for at the nominal bit rate; once the
+// receiver's actual bit period has been measured from it, the windows are centered on the tracked period instead.
+static const U32 kAcquisitionToleranceDivisor = 4;
+
+// The tracked bit period moves 1/8th of the way towards each measured bit.
+static const U32 kPeriodFilterShift = 3;
+
+// Bit periods are kept in fixed point with this many fractional bits, so that at low sample rates the windows are not
+// off by the truncation of a period that is not a whole number of samples (e.g. 31.25 at 62.5 kS/s).
+static const U32 kPeriodFractionBits = 8;
+static const U32 kPeriodOne          = 1 << kPeriodFractionBits;
+
+// Number of intervals that Run() over an array classifies at a time while idle.
+static const U64 kClassBlockSize = 4096;
+
+// Bits of a received byte: start bit, 8 data bits (LSB first), odd parity, stop bit.
+static const U32 kBitsPerByte = 11;
+static const U32 kParityBit   = 9;
+static const U32 kStopBit     = 10;
+
+// Parity of each 4-bit value, packed into one word; bit n is set if n has an odd number of ones.
+static const U32 kNibbleParity = 0x6996;
+
+static U32 ParityOf(U32 value) {
+    value ^= value >> 4;
+    return (kNibbleParity >> (value & 0x0F)) & 1;
+}
+
+// Window of the whole-sample distances strictly within error of the center, both in fixed point.
+static void SetWindow(U32 center, U32 error, U64* low, U64* width) {
+    if (center < error) {
+        // the window would wrap below zero; never accept anything
+        *low   = 0;
+        *width = 0;
+        return;
+    }
+    U64 first = ((center - error) >> kPeriodFractionBits) + 1;
+    U64 last  = ((U64(center) + error + kPeriodOne - 1) >> kPeriodFractionBits) - 1;
+    *low      = first;
+    *width    = (last >= first) ? last - first + 1 : 0;
+}
+
+
+QiDecoder::QiDecoder()
+    : mListener(nullptr)
+    , mSampleRateHz(0)
+    , mTNominal(0)
+    , mSegmentGap(0)
+    , mTrackingToleranceDivisor(kAcquisitionToleranceDivisor)
+    , mPeriod(0)
+    , mTLong(0)
+    , mTShort(0)
+    , mWindowGeneration(0)
+    , mBitRegister(0)
+    , mBitCount(0)
+    , mPreambleCount(0)
+    , mPreambleTime(0)
+    , mPeriodFilter(0)
+    , mPacketByteCount(0)
+    , mSynchronized(false)
+    , mIdle(true)
+    , mIdleEdgeCount(0)
+    , mIdleRunLength(0)
+    , mState(StateSync)
+    , mPrevEdge(0)
+    , mBitStart(0)
+    , mStarted(false) {
+    memset(&mWindows, 0, sizeof(mWindows));
+    memset(&mByte, 0, sizeof(mByte));
+    memset(&mStats, 0, sizeof(mStats));
+}
+
+QiDecoder::~QiDecoder() {}
+
+void QiDecoder::SetListener(QiDecoderListener* listener) {
+    mListener = listener;
+}
+
+void QiDecoder::Reset(U32 sample_rate_hz) {
+    mSampleRateHz = sample_rate_hz;
+
+    // 500 us, rounded to 1/256th of a sample
+    mTNominal   = U32(((U64(mSampleRateHz) << kPeriodFractionBits) + kBitRate / 2) / kBitRate);
+    mSegmentGap = (U64(mTNominal) * kQiSegmentGapBits) >> kPeriodFractionBits;
+
+    Invalidate();
+    memset(&mStats, 0, sizeof(mStats));
+    mStarted = false;
+}
+
+void QiDecoder::SaveCheckpoint(QiDecoderCheckpoint* checkpoint) const {
+    memset(checkpoint, 0, sizeof(*checkpoint));
+    checkpoint->mSampleRateHz             = mSampleRateHz;
+    checkpoint->mTrackingToleranceDivisor = mTrackingToleranceDivisor;
+    checkpoint->mPeriod                   = mPeriod;
+    checkpoint->mTLong                    = mTLong;
+    checkpoint->mTShort                   = mTShort;
+    checkpoint->mWindows                  = mWindows;
+    checkpoint->mPeriodFilter             = mPeriodFilter;
+    checkpoint->mByte                     = mByte;
+    checkpoint->mBitRegister              = mBitRegister;
+    checkpoint->mBitCount                 = mBitCount;
+    checkpoint->mPreambleCount            = mPreambleCount;
+    checkpoint->mPreambleTime             = mPreambleTime;
+    checkpoint->mPacketByteCount          = mPacketByteCount;
+    checkpoint->mSynchronized             = mSynchronized;
+    checkpoint->mState                    = U32(mState);
+    checkpoint->mIdle                     = mIdle;
+    memcpy(checkpoint->mIdleEdges, mIdleEdges, sizeof(mIdleEdges));
+    checkpoint->mIdleEdgeCount = mIdleEdgeCount;
+    checkpoint->mIdleRunLength = mIdleRunLength;
+    checkpoint->mPrevEdge      = mPrevEdge;
+    checkpoint->mBitStart      = mBitStart;
+    checkpoint->mStarted       = mStarted;
+    checkpoint->mStats         = mStats;
+}
+
+bool QiDecoder::RestoreCheckpoint(const QiDecoderCheckpoint& checkpoint) {
+    if ((checkpoint.mSampleRateHz != mSampleRateHz) || (checkpoint.mTrackingToleranceDivisor != mTrackingToleranceDivisor))
+        return false;
+
+    mPeriod          = checkpoint.mPeriod;
+    mTLong           = checkpoint.mTLong;
+    mTShort          = checkpoint.mTShort;
+    mWindows         = checkpoint.mWindows;
+    mPeriodFilter    = checkpoint.mPeriodFilter;
+    mByte            = checkpoint.mByte;
+    mBitRegister     = checkpoint.mBitRegister;
+    mBitCount        = checkpoint.mBitCount;
+    mPreambleCount   = checkpoint.mPreambleCount;
+    mPreambleTime    = checkpoint.mPreambleTime;
+    mPacketByteCount = checkpoint.mPacketByteCount;
+    mSynchronized    = checkpoint.mSynchronized;
+    mState           = State(checkpoint.mState);
+    mIdle            = checkpoint.mIdle;
+    memcpy(mIdleEdges, checkpoint.mIdleEdges, sizeof(mIdleEdges));
+    mIdleEdgeCount = checkpoint.mIdleEdgeCount;
+    mIdleRunLength = checkpoint.mIdleRunLength;
+    mPrevEdge      = checkpoint.mPrevEdge;
+    mBitStart      = checkpoint.mBitStart;
+    mStarted       = checkpoint.mStarted;
+    mStats         = checkpoint.mStats;
+    mWindowGeneration++;
+    return true;
+}
+
+void QiDecoder::SetTrackingTolerance(U32 tolerance_divisor) {
+    mTrackingToleranceDivisor = CLAMP_MIN(tolerance_divisor, kAcquisitionToleranceDivisor);
+}
+
+void QiDecoder::SetBitPeriod(U32 period, U32 tolerance_divisor) {
+    mPeriod = period;
+    mTLong  = (period + kPeriodOne / 2) >> kPeriodFractionBits;
+    mTShort = (period / 2 + kPeriodOne / 2) >> kPeriodFractionBits;
+
+    // Pulse tolerances, a fraction of the whole bit for both windows (at 1 MS/s, long / short pulses)
+    // 4:  25%          (125 / 125 of 500 / 250)
+    // 6:  16.67%       ( 83 /  83)
+    // 8:  12.5%        ( 62 /  62)
+    // 10: 10%          ( 50 /  50)
+    // Both edges of a measured distance are rounded down to a sample, so it is up to a sample off the actual one;
+    // the windows are widened by that, but never past 3/4 of a bit, where the short and the long window meet.
+    U32 error = period / tolerance_divisor + kPeriodOne;
+    error     = CLAMP_MAX(error, period / 4);
+
+    QiIntervalWindows windows;
+    SetWindow(period, error, &windows.mLongLow, &windows.mLongWidth);
+    SetWindow(period / 2, error, &windows.mShortLow, &windows.mShortWidth);
+
+    if (memcmp(&windows, &mWindows, sizeof(windows)) != 0) {
+        mWindows = windows;
+        mWindowGeneration++;
+    }
+}
+
+void QiDecoder::TrackBitPeriod(U64 bit_period) {
+    // First-order filter, so that a single noisy bit cannot pull the windows off the receiver's clock
+    const U32 round = 1 << (kPeriodFilterShift - 1);
+    mPeriodFilter   = mPeriodFilter - ((mPeriodFilter + round) >> kPeriodFilterShift) + (U32(bit_period) << kPeriodFractionBits);
+    SetBitPeriod((mPeriodFilter + round) >> kPeriodFilterShift, mTrackingToleranceDivisor);
+}
+
+void QiDecoder::Start(U64 edge_location) {
+    mPrevEdge      = edge_location;
+    mBitStart      = edge_location;
+    mIdleEdgeCount = 0;
+    mIdleRunLength = 0;
+}
+
+void QiDecoder::Run(QiEdgeSource& source) {
+    if (source.AdvanceToNextEdge() == false)
+        return;
+    mStats.mEdges++;
+    Start(source.GetSampleNumber());
+
+    // The same as calling Step() until it returns false, kept as one loop as it is the plugin's hot path
+    for (;;) {
+        if (mIdle && (mIdleRunLength == 0)) {
+            // Edges closer together than a half-bit can not start a preamble
+            bool skipped = false;
+            if (source.AdvanceToNextIdleEdge(mWindows.mShortLow, &skipped) == false)
+                break;
+            if (skipped) {
+                mStats.mIdleSkips++;
+                Start(source.GetSampleNumber());
+                continue;
+            }
+        } else if (source.AdvanceToNextEdge() == false) {
+            break;
+        }
+
+        mStats.mEdges++;
+        ProcessEdge(source.GetSampleNumber());
+    }
+    EndOfEdges();
+}
+
+bool QiDecoder::Step(QiEdgeSource& source) {
+    if (mStarted == false) {
+        if (source.AdvanceToNextEdge() == false)
+            return false;
+        mStarted = true;
+        mStats.mEdges++;
+        Start(source.GetSampleNumber());
+        return true;
+    }
+
+    if (mIdle && (mIdleRunLength == 0)) {
+        bool skipped = false;
+        if (source.AdvanceToNextIdleEdge(mWindows.mShortLow, &skipped) == false) {
+            EndOfEdges();
+            return false;
+        }
+        if (skipped) {
+            mStats.mIdleSkips++;
+            Start(source.GetSampleNumber());
+            return true;
+        }
+    } else if (source.AdvanceToNextEdge() == false) {
+        EndOfEdges();
+        return false;
+    }
+
+    mStats.mEdges++;
+    ProcessEdge(source.GetSampleNumber());
+    return true;
+}
+
+void QiDecoder::ProcessSilence(U64 location) {
+    if ((mIdle == false) && (location - mPrevEdge > mSegmentGap))
+        EndAfterGap();
+}
+
+bool QiDecoder::IsStopBitPending() const {
+    return (mState == StateDataShort) && (mBitCount == kStopBit);
+}
+
+void QiDecoder::EndOfEdges() {
+    // As if the capture went on without edges: the stop bit of a packet with an even number of bytes is complete
+    ProcessSilence(~U64(0));
+}
+
+U64 QiDecoder::GetEarliestPendingEvent(U64 next_edge_bound) const {
+    if (mIdle) {
+        if (mIdleRunLength > 0)
+            return mIdleEdges[0];    // a replayed run reports from its first edge
+
+        // A run can only start on the previous edge if the next edge is a half-bit after it
+        U64 short_end = mWindows.mShortLow + mWindows.mShortWidth;
+        return (next_edge_bound - mPrevEdge >= short_end) ? next_edge_bound : mPrevEdge;
+    }
+
+    U64 earliest = CLAMP_MAX(mPrevEdge, mBitStart);
+    if (mBitCount > 0)
+        earliest = CLAMP_MAX(earliest, mByte.mBitEdges[0]);
+    return earliest;
+}
+
+// Classifies the intervals before edges[start] onwards into a new block.
+static void ClassifyBlock(const U64* edges, U64 count, U64 start, const QiIntervalWindows& windows, U8* classes,
+                          U64* block_start, U64* block_end) {
+    *block_start = start;
+    *block_end   = CLAMP_MAX(start + kClassBlockSize, count);
+    QiClassifyIntervals(edges + start, *block_end - start, edges[start - 1], windows, classes);
+}
+
+void QiDecoder::Run(const U64* edges, U64 count) {
+    if (count == 0)
+        return;
+    mStats.mEdges += count;
+    Start(edges[0]);
+
+    // classes[n - block_start] is the class of edges[n] against block_windows, for block_start <= n < block_end
+    U8                classes[kClassBlockSize];
+    U64               block_start      = 1;
+    U64               block_end        = 1;
+    QiIntervalWindows block_windows    = mWindows;
+    U32               block_generation = mWindowGeneration;
+
+    U64 i = 1;
+    while (i < count) {
+        if (mIdle == false) {
+            // Tracking moves the windows on almost every bit, so edges within a packet are classified one at a time
+            ProcessEdge(edges[i++]);
+            continue;
+        }
+
+        // While idle the windows are the nominal ones, so a block usually stays valid from one packet to the next
+        if (block_generation != mWindowGeneration) {
+            if (memcmp(&block_windows, &mWindows, sizeof(mWindows)) != 0)
+                block_end = block_start;
+            block_windows    = mWindows;
+            block_generation = mWindowGeneration;
+        }
+        if ((i < block_start) || (i >= block_end))
+            ClassifyBlock(edges, count, i, mWindows, classes, &block_start, &block_end);
+
+        if (mIdleRunLength == 0) {
+            // With no run in progress, only a half-bit interval can start one, and only if the edge is not skipped as
+            // in QiArrayEdgeSource::AdvanceToNextIdleEdge(), i.e. not followed by another edge within a half-bit.
+            // Every edge before it just becomes the previous edge.
+            U64 next = i;
+            for (;;) {
+                if ((next + 1 < count) && (next + 1 >= block_end))
+                    ClassifyBlock(edges, count, next, mWindows, classes, &block_start, &block_end);
+                if (((classes[next - block_start] & QiIntervalShort) != 0) &&
+                    ((next + 1 == count) || ((classes[next + 1 - block_start] & QiIntervalBelowShort) == 0)))
+                    break;
+                if (++next == count)
+                    break;
+            }
+
+            if (next > i)
+                Start(edges[next - 1]);
+            if (next == count)
+                break;
+            i = next;
+        }
+
+        ProcessClassifiedEdge(edges[i], classes[i - block_start]);
+        i++;
+    }
+    EndOfEdges();
+}
+
+void QiDecoder::Invalidate() {
+    bool was_synchronized = mSynchronized;
+
+    mSynchronized    = false;
+    mPacketByteCount = 0;
+    mPreambleCount   = 0;
+    mPreambleTime    = 0;
+    mBitRegister     = 0;
+    mBitCount        = 0;
+    mState           = StateSync;
+    mIdle            = true;
+    mIdleEdgeCount   = 0;
+    mIdleRunLength   = 0;
+
+    // Search for the next preamble at the nominal bit rate
+    SetBitPeriod(mTNominal, kAcquisitionToleranceDivisor);
+
+    if (was_synchronized && (mListener != nullptr))
+        mListener->OnSyncLost();
+}
+
+void QiDecoder::ProcessIdleEdge(U64 edge_location, U32 interval_class) {
+    U64 anchor = mPrevEdge;
+    mPrevEdge  = edge_location;
+
+    if ((interval_class & QiIntervalBelowShort) != 0) {
+        // A glitch; the full decoder re-anchors on it, so keep it in the run
+        if (mIdleRunLength > 0) {
+            if (mIdleEdgeCount < kQiIdleReplaySize)
+                mIdleEdges[mIdleEdgeCount++] = edge_location;
+            else
+                mIdleRunLength = 0;    // too noisy to be a preamble
+        }
+        return;
+    }
+
+    if (((interval_class & QiIntervalShort) == 0) || ((mIdleRunLength > 0) && (mIdleEdgeCount == kQiIdleReplaySize))) {
+        mIdleRunLength = 0;
+        return;
+    }
+
+    if (mIdleRunLength == 0) {
+        mIdleEdges[0]  = anchor;
+        mIdleEdgeCount = 1;
+    }
+    mIdleEdges[mIdleEdgeCount++] = edge_location;
+    mIdleRunLength++;
+
+    if (mIdleRunLength == kQiIdleRunLength) {
+        // Looks like a preamble: run the full preamble search from the first edge of the run
+        mStats.mSyncAttempts++;
+        U32 count = mIdleEdgeCount;
+        mIdle     = false;
+        Start(mIdleEdges[0]);
+        for (U32 i = 1; i < count; i++)
+            ProcessEdge(mIdleEdges[i]);
+    }
+}
+
+void QiDecoder::RestartAfterGap(U64 edge_location) {
+    EndAfterGap();
+    Start(edge_location);
+}
+
+void QiDecoder::EndAfterGap() {
+    // Mark the bit that was cut short, as the state machine would on the next edge
+    switch (mState) {
+    case StateSync:
+        break;
+    case StateSyncShort:
+        AddMarker(mBitStart, QiMarkerErrorDot);
+        break;
+    case StateDataShort:
+        // A packet with an even number of bytes is back at the unmodulated level after the middle of its last stop
+        // bit, so no edge ends that bit; it is complete once the gap has started.
+        if (mBitCount == kStopBit) {
+            SaveBit(mBitStart, mBitStart + mTLong, 1);
+            break;
+        }
+        AddMarker(mBitStart, QiMarkerErrorDot);
+        break;
+    case StateData:
+        AddMarker(mBitStart, QiMarkerErrorSquare);
+        break;
+    }
+
+    Invalidate();
+}
+
+void QiDecoder::ProcessEdge(U64 edge_location) {
+    ProcessClassifiedEdge(edge_location, QiClassifyInterval(edge_location - mPrevEdge, mWindows));
+}
+
+void QiDecoder::ProcessClassifiedEdge(U64 edge_location, U32 interval_class) {
+    if (mIdle) {
+        ProcessIdleEdge(edge_location, interval_class);
+        return;
+    }
+
+    U64 anchor = mPrevEdge;
+    if (edge_location - anchor > mSegmentGap) {
+        RestartAfterGap(edge_location);
+        return;
+    }
+
+    bool is_short = (interval_class & QiIntervalShort) != 0;
+    bool is_long  = (interval_class & QiIntervalLong) != 0;
+    mPrevEdge     = edge_location;
+
+    // Glitch filtering: an edge that is neither a short nor a long pulse after the previous edge becomes the new
+    // reference edge. Within a bit, the glitch time is absorbed into the bit as its start edge does not move.
+    if ((is_short == false) && (is_long == false)) {
+        mStats.mGlitchEdges++;
+        return;
+    }
+
+    switch (mState) {
+    case StateSync:
+        if (is_short) {
+            mBitStart = anchor;
+            mState    = StateSyncShort;
+        } else {
+            // long -> 0-bit
+            if (SynchronizeOnStartBit(anchor, edge_location) == false) {
+                // back to idle.
+                AddMarker(anchor, QiMarkerErrorX);
+                Invalidate();
+            }
+        }
+        break;
+
+    case StateSyncShort:
+        if (IsLong(edge_location - mBitStart)) {
+            // short again -> 1-bit
+            // Center the windows on the average preamble bit so far
+            U64 count = ++mPreambleCount;
+            mPreambleTime += edge_location - mBitStart;
+            SetBitPeriod(U32(((mPreambleTime << kPeriodFractionBits) + count / 2) / count), kAcquisitionToleranceDivisor);
+
+            AddMarker(mBitStart, QiMarkerDot);
+            mState = StateSync;
+        } else if (is_long) {
+            // long -> 0-bit, so we must've synched on the second pulse of the 1-bits
+            if (SynchronizeOnStartBit(anchor, edge_location) == true) {
+                // Mark the mis-synched edge as bad
+                AddMarker(anchor, QiMarkerErrorDot);
+            } else {
+                // back to idle.
+                AddMarker(mBitStart, QiMarkerErrorDot);
+                Invalidate();
+            }
+        } else {
+            // back to idle.
+            AddMarker(mBitStart, QiMarkerErrorDot);
+            Invalidate();
+        }
+        break;
+
+    case StateData:
+        // The bit is measured from its clock edge, including any glitches that were skipped.
+        if (IsShort(edge_location - mBitStart)) {
+            // short
+            mState = StateDataShort;
+        } else if (IsLong(edge_location - mBitStart)) {
+            // long -> 0-bit
+            TrackBitPeriod(edge_location - mBitStart);
+            SaveBit(mBitStart, edge_location, 0);
+        } else {
+            // not synced anymore.
+            AddMarker(mBitStart, QiMarkerErrorSquare);
+            Invalidate();
+        }
+        break;
+
+    case StateDataShort:
+        if (IsLong(edge_location - mBitStart)) {
+            // short again -> 1-bit
+            mState = StateData;
+            TrackBitPeriod(edge_location - mBitStart);
+            SaveBit(mBitStart, edge_location, 1);
+        } else {
+            // not synced anymore.
+            AddMarker(mBitStart, QiMarkerErrorDot);
+            Invalidate();
+        }
+        break;
+    }
+}
+
+bool QiDecoder::SynchronizeOnStartBit(U64 location_start, U64 location_end) {
+    U32 count = mPreambleCount;
+    if ((count < kQiMinPreambleBits) || (count > kQiMaxPreambleBits))
+        return false;
+
+    mSynchronized = true;
+    mState        = StateData;
+    mStats.mSyncs++;
+
+    // The end of the preamble marks the start of a new packet
+    mPacketByteCount = 0;
+
+    // Lock onto the receiver's bit period as measured over the preamble, and track it from here on
+    U32 period    = U32(((mPreambleTime << kPeriodFractionBits) + count / 2) / count);
+    mPeriodFilter = period << kPeriodFilterShift;
+    SetBitPeriod(period, mTrackingToleranceDivisor);
+
+    // TODO: Use the preamble to measure low-time/high-time and rise-time/fall-time!
+
+    // Record the start bit; decoding continues from the clock edge of the first data bit.
+    SaveBit(location_start, location_end, 0);
+    return true;
+}
+
+void QiDecoder::AddMarker(U64 location, QiMarkerType marker) {
+    if (mListener != nullptr)
+        mListener->OnMarker(location, marker);
+}
+
+void QiDecoder::SaveBit(U64 location_start, U64 location_end, U32 value) {
+    // The next bit starts on this bit's last edge
+    mBitStart = location_end;
+
+    mByte.mBitEdges[mBitCount] = location_start;
+    mBitRegister |= value << mBitCount;
+    mBitCount++;
+
+    if (mBitCount == kBitsPerByte) {
+        mByte.mBitEdges[kBitsPerByte] = location_end;
+
+        U32 data   = (mBitRegister >> 1) & 0xFF;
+        U32 parity = (mBitRegister >> kParityBit) & 1;
+
+        mByte.mPacket       = U16(mBitRegister);
+        mByte.mPayload      = U8(data);
+        mByte.mPacketByte   = U8(mPacketByteCount);
+        mByte.mPreambleBits = (mPacketByteCount == 0) ? U8(mPreambleCount) : 0;
+        mByte.mParityValid  = ((ParityOf(data) ^ parity) == 1);
+        mByte.mStopValid    = (((mBitRegister >> kStopBit) & 1) == 1);
+
+        mStats.mBytes++;
+        if (mByte.mParityValid == false)
+            mStats.mParityErrors++;
+        if (mByte.mStopValid == false)
+            mStats.mStopErrors++;
+
+        mPacketByteCount++;
+        mBitRegister = 0;
+        mBitCount    = 0;
+
+        if (mListener != nullptr)
+            mListener->OnByte(mByte);
+    }
+}
@@ -0,0 +1,259 @@
+#ifndef QI_DECODER_H
+#define QI_DECODER_H
+
+#include "QiIntervalClassifier.h"
+#include "QiTypes.h"
+
+// Decoder events that the Logic 2 plugin shows as markers. The names mirror AnalyzerResults::MarkerType.
+enum QiMarkerType {
+    QiMarkerDot,            // preamble 1-bit
+    QiMarkerErrorDot,       // bad half-bit, or the mis-synched edge at the end of the preamble
+    QiMarkerErrorSquare,    // data bit that is neither short nor long
+    QiMarkerErrorX,         // preamble with the wrong number of 1-bits
+};
+
+// Preambles that the decoder locks onto. Runs of up to 10 1-bits also occur within the bytes of a packet, so shorter
+// ones are never taken for a preamble; longer ones than the WPC maximum of 25 are, and the timing checker reports them.
+static const U32 kQiMinPreambleBits = 11;
+static const U32 kQiMaxPreambleBits = 255;    // QiByte::mPreambleBits
+
+// Number of consecutive half-bit intervals that end the idle state; a preamble has at least 22 of them.
+static const U32 kQiIdleRunLength = 4;
+
+// Edges of such a run that are kept for the full decoder, including glitches within the run.
+static const U32 kQiIdleReplaySize = 16;
+
+// An interval longer than this many nominal bit periods can not be within a packet. It ends any packet in progress and
+// the decoder restarts from the edge after it, so a capture can be decoded in independent segments split at such gaps.
+static const U32 kQiSegmentGapBits = 3;
+
+// One received 11-bit byte: start bit, 8 data bits (LSB first), odd parity, stop bit.
+struct QiByte {
+    U64  mBitEdges[12];    // bit i spans [mBitEdges[i], mBitEdges[i + 1]]
+    U16  mPacket;          // the 11 raw bits, start bit in bit 0
+    U8   mPayload;
+    U8   mPacketByte;      // index of the byte within its packet (0 is the header)
+    U8   mPreambleBits;    // number of preamble 1-bits before the header; 0 for the other bytes
+    bool mParityValid;
+    bool mStopValid;
+};
+
+// Counters of a decoder run, to find captures that decode slowly or lose packets. They are updated on paths that the
+// decoder takes anyway, so keeping them costs next to nothing.
+struct QiDecoderStats {
+    U64 mEdges;           // edges taken from the source, not counting those that a source skips in bulk while idle
+    U64 mIdleSkips;       // bursts of edges too close together to start a bit, skipped in bulk by the source
+    U64 mGlitchEdges;     // edges within a preamble or packet that were neither a short nor a long interval
+    U64 mSyncAttempts;    // runs of half-bit intervals that were checked for a preamble
+    U64 mSyncs;           // preambles that the decoder locked onto
+    U64 mBytes;
+    U64 mParityErrors;
+    U64 mStopErrors;
+};
+
+// Complete state of a QiDecoder between two edges, to continue decoding later or in another process (see
+// QiCheckpointFile.h). It holds no pointers, so it can be stored as it is; the layout is that of the build.
+struct QiDecoderCheckpoint {
+    U32 mSampleRateHz;
+    U32 mTrackingToleranceDivisor;
+
+    // Clock tracking
+    U32               mPeriod;
+    U32               mTLong;
+    U32               mTShort;
+    QiIntervalWindows mWindows;
+    U32               mPeriodFilter;
+
+    // Sync state and the partial byte
+    QiByte mByte;
+    U32    mBitRegister;
+    U32    mBitCount;
+    U32    mPreambleCount;
+    U64    mPreambleTime;
+    U32    mPacketByteCount;
+    bool   mSynchronized;
+    U32    mState;
+
+    bool mIdle;
+    U64  mIdleEdges[kQiIdleReplaySize];
+    U32  mIdleEdgeCount;
+    U32  mIdleRunLength;
+
+    // Edge position
+    U64  mPrevEdge;
+    U64  mBitStart;
+    bool mStarted;
+
+    QiDecoderStats mStats;
+};
+
+class QiDecoderListener {
+  public:
+    virtual ~QiDecoderListener() {}
+
+    virtual void OnMarker(U64 location, QiMarkerType marker) = 0;
+    virtual void OnByte(const QiByte& byte)                  = 0;
+
+    // The decoder was synchronized and has gone back to searching for a preamble.
+    virtual void OnSyncLost() {}
+};
+
+// Source of edge locations (in samples) for QiDecoder::Run().
+class QiEdgeSource {
+  public:
+    virtual ~QiEdgeSource() {}
+
+    // Moves to the next edge. Returns false when there are no more edges.
+    virtual bool AdvanceToNextEdge() = 0;
+    virtual U64  GetSampleNumber()   = 0;
+
+    // Returns true if the next edge is less than `distance` samples after the current position, without moving to it.
+    virtual bool IsNextEdgeWithin(U64 distance) = 0;
+
+    // Used instead of AdvanceToNextEdge() while the decoder is idle. An edge that is followed by another edge within
+    // min_interval samples can not start a bit, so sources may skip such edges in bulk. If they do, *skipped is set
+    // and the source stops on the next edge that can start a bit, or, for sources that skip without visiting every
+    // edge, on the first edge after it. The decoder restarts from there.
+    virtual bool AdvanceToNextIdleEdge(U64 /*min_interval*/, bool* skipped) {
+        *skipped = false;
+        return AdvanceToNextEdge();
+    }
+
+    // For decoding several sources in time order (see QiMultiChannelDecoder). If it is known without waiting for more
+    // data, sets *location to the next edge, or to a sample that the next edge can not come before, and returns true.
+    virtual bool PeekNextEdge(U64* /*location*/) { return false; }
+
+    // Waits until the source has data up to `location`, for sources that are still being captured. Returns false if
+    // there is nothing to wait for, e.g. for a source that is read from memory.
+    virtual bool WaitForData(U64 /*location*/) { return false; }
+};
+
+// Bi-phase decoder for the receiver-to-transmitter (ASK) backchannel. It is fed the location of every edge of the
+// demodulated signal and reports bytes and sync errors to a QiDecoderListener; it has no dependency on the Saleae SDK.
+class QiDecoder {
+  public:
+    QiDecoder();
+    ~QiDecoder();
+
+    void SetListener(QiDecoderListener* listener);
+
+    // Computes the bit timing for the sample rate and drops any partially decoded data.
+    void Reset(U32 sample_rate_hz);
+
+    // Once locked onto a preamble, bits are accepted within +/- 1/tolerance_divisor of the tracked bit period
+    // (4: 25%, the same as while searching for the preamble; 8: 12.5%).
+    void SetTrackingTolerance(U32 tolerance_divisor);
+
+    // Sets the first edge of the stream; every following edge is passed to ProcessEdge(). While idle, this can also be
+    // used to restart from an edge that does not follow the previous one.
+    void Start(U64 edge_location);
+    void ProcessEdge(U64 edge_location);
+
+    // Decodes every edge of the source. A packet still in progress after the last edge is ended as if the capture went
+    // on without edges, so that a packet with an even number of bytes, whose stop bit no edge ends, is not lost.
+    void Run(QiEdgeSource& source);
+
+    // Takes the next edge from the source and decodes it, as one iteration of Run(QiEdgeSource&). Returns false when
+    // the source has no more edges, after ending a packet in progress as Run() does.
+    bool Step(QiEdgeSource& source);
+
+    // Tells the decoder that the source has no edge before `location`. A packet that the segment gap has cut off by
+    // then is ended as if the next edge had arrived, so that its last byte does not wait for that edge.
+    void ProcessSilence(U64 location);
+
+    // On the second half of a stop bit, which the next edge ends, or the segment gap after the last byte of a packet with
+    // an even number of bytes; a source that would have to wait for that edge can call ProcessSilence() first.
+    bool IsStopBitPending() const;
+
+    // Earliest location that a marker or byte still to be reported can have, given that the next edge is not before
+    // next_edge_bound; QiMultiChannelDecoder holds back the other channels' events up to it.
+    U64 GetEarliestPendingEvent(U64 next_edge_bound) const;
+
+    // Decodes an in-memory capture, including the end of a packet in progress as above; the result is the same as Run()
+    // with a QiArrayEdgeSource over the edges. While idle, the intervals are classified in blocks with
+    // QiClassifyIntervals() and skipped until one can start a run.
+    void Run(const U64* edges, U64 count);
+
+    // Counters since the last Reset().
+    const QiDecoderStats& GetStats() const { return mStats; }
+
+    // Saves the state after the last edge. Restoring it, after Reset() and SetTrackingTolerance() with the same
+    // values, continues with the edge after that one as if decoding had never stopped; returns false if the sample
+    // rate or the tolerance differ.
+    void SaveCheckpoint(QiDecoderCheckpoint* checkpoint) const;
+    bool RestoreCheckpoint(const QiDecoderCheckpoint& checkpoint);
+
+    U32  GetSampleRateHz() const { return mSampleRateHz; }
+    U64  GetSegmentGap() const { return mSegmentGap; }    // in samples; see kQiSegmentGapBits
+    bool IsSynchronized() const { return mSynchronized; }
+
+    // Searching for the start of a preamble. Edges are only checked for a run of half-bit intervals, without markers.
+    bool IsIdle() const { return mIdle; }
+
+    // Bit period (in samples, rounded) that the current windows are centered on: the nominal period while searching
+    // for a preamble, then the period recovered from the preamble and tracked over the packet's bits.
+    U32 GetBitPeriod() const { return mTLong; }
+
+  private:
+    enum State {
+        StateSync,         // waiting for the first half of a preamble bit
+        StateSyncShort,    // first half of a preamble 1-bit seen
+        StateData,         // on the clock edge of a data, parity, or stop bit
+        StateDataShort,    // first half of a 1-bit seen
+    };
+
+    QiDecoderListener* mListener;
+
+    U32 mSampleRateHz;
+    U32 mTNominal;    // nominal bit period, in 1/256 samples
+    U64 mSegmentGap;
+    U32 mTrackingToleranceDivisor;
+
+    U32 mPeriod;    // bit period that the windows are centered on, in 1/256 samples
+    U32 mTLong;     // mPeriod and half of it, rounded to whole samples
+    U32 mTShort;
+
+    QiIntervalWindows mWindows;
+    U32               mWindowGeneration;    // incremented whenever mWindows changes
+
+    QiByte mByte;             // byte being received; its bit edges are filled in as the bits arrive
+    U32    mBitRegister;      // bits of the byte so far, first bit in bit 0
+    U32    mBitCount;         // number of bits in mBitRegister
+    U32    mPreambleCount;    // number of preamble 1-bits
+    U64    mPreambleTime;     // sum of the preamble bit periods
+    U32    mPeriodFilter;     // tracked mPeriod, scaled by 2^kPeriodFilterShift
+    U32    mPacketByteCount;
+    bool   mSynchronized;
+
+    bool mIdle;
+    U64  mIdleEdges[kQiIdleReplaySize];    // the current run of half-bit intervals, replayed when it is long enough
+    U32  mIdleEdgeCount;
+    U32  mIdleRunLength;                   // number of half-bit intervals in mIdleEdges
+
+    State mState;
+    U64   mPrevEdge;    // the last edge; a glitch re-anchors it
+    U64   mBitStart;    // start of the current bit (the clock edge once synchronized)
+
+    QiDecoderStats mStats;
+    bool           mStarted;    // Step() has taken the first edge
+
+  private:
+    bool IsShort(U64 distance) const { return (distance - mWindows.mShortLow) < mWindows.mShortWidth; }
+    bool IsLong(U64 distance) const { return (distance - mWindows.mLongLow) < mWindows.mLongWidth; }
+
+    void SetBitPeriod(U32 period, U32 tolerance_divisor);
+    void TrackBitPeriod(U64 bit_period);
+
+    // interval_class is the QiIntervalClass bits of the interval from the previous edge
+    void ProcessClassifiedEdge(U64 edge_location, U32 interval_class);
+    void ProcessIdleEdge(U64 edge_location, U32 interval_class);
+    void RestartAfterGap(U64 edge_location);
+    void EndAfterGap();
+    void EndOfEdges();
+    void Invalidate();
+    bool SynchronizeOnStartBit(U64 location_start, U64 location_end);
+    void AddMarker(U64 location, QiMarkerType marker);
+    void SaveBit(U64 location_start, U64 location_end, U32 value);
+};
+
+#endif    // QI_DECODER_H
@@ -0,0 +1,153 @@
+#include "QiDeglitch.h"
+
+QiDeglitchEdgeSource::QiDeglitchEdgeSource(QiEdgeSource& source, U64 min_pulse_width)
+    : mSource(source)
+    , mMinPulseWidth(min_pulse_width)
+    , mRejectedEdgeCount(0)
+    , mCurrent(0)
+    , mNext(0)
+    , mHasNext(false)
+    , mAtEnd(false) {}
+
+QiDeglitchEdgeSource::~QiDeglitchEdgeSource() {}
+
+bool QiDeglitchEdgeSource::DropGlitches() {
+    // While the current edge starts a pulse that is too short, drop it and the edge that ends the pulse
+    while ((mMinPulseWidth > 0) && mSource.IsNextEdgeWithin(mMinPulseWidth)) {
+        if (mSource.AdvanceToNextEdge() == false)
+            return false;
+        mRejectedEdgeCount++;
+
+        if (mSource.AdvanceToNextEdge() == false)
+            return false;
+        mRejectedEdgeCount++;
+    }
+    return true;
+}
+
+bool QiDeglitchEdgeSource::TakeSourceEdge() {
+    if (mSource.AdvanceToNextEdge() == false) {
+        mAtEnd = true;
+        return false;
+    }
+
+    if ((mMinPulseWidth > 0) && mSource.IsNextEdgeWithin(mMinPulseWidth)) {
+        // drop the edge together with the one that ends the pulse
+        mSource.AdvanceToNextEdge();
+        mRejectedEdgeCount += 2;
+        return true;
+    }
+
+    mNext    = mSource.GetSampleNumber();
+    mHasNext = true;
+    return true;
+}
+
+bool QiDeglitchEdgeSource::FindNextEdge() {
+    while (mHasNext == false) {
+        if (mAtEnd || (TakeSourceEdge() == false))
+            return false;
+    }
+    return true;
+}
+
+bool QiDeglitchEdgeSource::AdvanceToNextEdge() {
+    if (FindNextEdge() == false)
+        return false;
+
+    mCurrent = mNext;
+    mHasNext = false;
+    return true;
+}
+
+U64 QiDeglitchEdgeSource::GetSampleNumber() {
+    return mCurrent;
+}
+
+bool QiDeglitchEdgeSource::IsNextEdgeWithin(U64 distance) {
+    while (mHasNext == false) {
+        if (mAtEnd)
+            return false;
+
+        // Only look as far ahead as the distance; the source may be past mCurrent on the end of a dropped pulse
+        U64 position = mSource.GetSampleNumber();
+        if ((position - mCurrent >= distance) || (mSource.IsNextEdgeWithin(distance - (position - mCurrent)) == false))
+            return false;
+        TakeSourceEdge();
+    }
+    return (mNext - mCurrent) < distance;
+}
+
+bool QiDeglitchEdgeSource::PeekNextEdge(U64* location) {
+    U64 edge;
+    while (mHasNext == false) {
+        if (mAtEnd || (mSource.PeekNextEdge(&edge) == false))
+            return false;
+        TakeSourceEdge();
+    }
+
+    *location = mNext;
+    return true;
+}
+
+bool QiDeglitchEdgeSource::WaitForData(U64 location) {
+    return (mAtEnd == false) && mSource.WaitForData(location);
+}
+
+bool QiDeglitchEdgeSource::AdvanceToNextIdleEdge(U64 min_interval, bool* skipped) {
+    *skipped = false;
+    if (AdvanceToNextEdge() == false)
+        return false;
+
+    // Stop on the first filtered edge that is not followed by another within min_interval, as QiArrayEdgeSource does
+    for (U32 i = 0; IsNextEdgeWithin(min_interval); i++) {
+        *skipped = true;
+        if (i == kQiDeglitchExactSkipEdges) {
+            // Carrier noise rather than a few glitches; the source can skip the rest faster, unless the burst already
+            // ends on the next edge
+            if (mSource.IsNextEdgeWithin(min_interval) == false) {
+                AdvanceToNextEdge();
+                return true;
+            }
+
+            bool bulk_skipped = false;
+            mHasNext          = false;
+            if (mSource.AdvanceToNextIdleEdge(min_interval, &bulk_skipped) == false) {
+                mAtEnd = true;
+                return false;
+            }
+
+            if (DropGlitches() == false) {
+                mAtEnd = true;
+                return false;
+            }
+            mCurrent = mSource.GetSampleNumber();
+            return true;
+        }
+        AdvanceToNextEdge();
+    }
+    return true;
+}
+
+U64 QiDeglitchEdges(std::vector<U64>& edges, U64 min_pulse_width, std::vector<U64>* tags) {
+    if (min_pulse_width == 0)
+        return 0;
+
+    U64 count = edges.size();
+    U64 kept  = 0;
+    for (U64 i = 0; i < count;) {
+        if ((i + 1 < count) && ((edges[i + 1] - edges[i]) < min_pulse_width)) {
+            // drop both edges of the pulse
+            i += 2;
+            continue;
+        }
+        if (tags != nullptr)
+            (*tags)[kept] = (*tags)[i];
+        edges[kept++] = edges[i++];
+    }
+
+    edges.resize(kept);
+    if (tags != nullptr)
+        tags->resize(kept);
+    return count - kept;
+}
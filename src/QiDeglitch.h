@@ -0,0 +1,58 @@
+#ifndef QI_DEGLITCH_H
+#define QI_DEGLITCH_H
+
+#include <vector>
+
+#include "QiDecoder.h"
+
+// Edges that QiDeglitchEdgeSource skips one by one while idle, before it lets its source skip the rest of the burst.
+static const U32 kQiDeglitchExactSkipEdges = 64;
+
+// Removes glitches from an edge stream before it reaches the decoder. A pulse shorter than the minimum width is
+// dropped together with both of its edges, so that the level on either side of it is kept and the edges of the real
+// bits are passed on untouched; a burst of glitches is dropped pair by pair.
+//
+// While the decoder is idle, the source looks one filtered edge ahead to skip edges that can not start a bit, so that
+// the result is the same as QiDeglitchEdges() followed by QiDecoder::Run() over the array. Only a burst of more than
+// kQiDeglitchExactSkipEdges such edges is handed to the underlying source to skip in bulk.
+//
+// Waits for the underlying source are bounded by the distance that is asked about, and PeekNextEdge() only resolves
+// glitches that the source has data for, so that a quiet channel does not hold up QiMultiChannelDecoder.
+class QiDeglitchEdgeSource : public QiEdgeSource {
+  public:
+    // A min_pulse_width of 0 passes every edge through.
+    QiDeglitchEdgeSource(QiEdgeSource& source, U64 min_pulse_width);
+    virtual ~QiDeglitchEdgeSource();
+
+    virtual bool AdvanceToNextEdge();
+    virtual U64  GetSampleNumber();
+    virtual bool IsNextEdgeWithin(U64 distance);
+    virtual bool AdvanceToNextIdleEdge(U64 min_interval, bool* skipped);
+    virtual bool PeekNextEdge(U64* location);
+    virtual bool WaitForData(U64 location);
+
+    // Number of edges dropped so far. Edges that the source skips while the decoder is idle are not included.
+    U64 GetRejectedEdgeCount() const { return mRejectedEdgeCount; }
+
+  protected:
+    bool DropGlitches();
+    bool TakeSourceEdge();    // moves the underlying source over its next edge, or over the next pulse it drops
+    bool FindNextEdge();      // moves the underlying source to the filtered edge after mCurrent
+
+  protected:
+    QiEdgeSource& mSource;
+    U64           mMinPulseWidth;
+    U64           mRejectedEdgeCount;
+
+    U64  mCurrent;
+    U64  mNext;       // valid if mHasNext; the underlying source is on this edge, else on mCurrent or a dropped edge
+    bool mHasNext;
+    bool mAtEnd;      // the underlying source has no more edges after mCurrent
+};
+
+// Removes the glitches from an in-memory capture, pair by pair like QiDeglitchEdgeSource, before it is passed to
+// QiDecoder::Run(). Returns the number of edges removed. If tags is not nullptr, it holds a value per edge (e.g. the
+// file offset of QiReadEdgeFileTail()) and is compacted along with the edges.
+U64 QiDeglitchEdges(std::vector<U64>& edges, U64 min_pulse_width, std::vector<U64>* tags = nullptr);
+
+#endif    // QI_DEGLITCH_H
@@ -0,0 +1,355 @@
+#include "QiEdgeFile.h"
+
+#include "QiSaleaeFile.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static const size_t kReadChunkSize  = 1 << 20;
+static const size_t kWriteChunkSize = 1 << 20;
+static const size_t kMaxEdgeLength  = 21;    // 20 digits and a newline
+
+bool QiParseEdgeFileFormat(const char* name, QiEdgeFileFormat* format) {
+    if (strcmp(name, "text") == 0)
+        *format = QiEdgeFileText;
+    else if (strcmp(name, "binary") == 0)
+        *format = QiEdgeFileBinary;
+    else if (strcmp(name, "samples") == 0)
+        *format = QiEdgeFileSamples;
+    else if (strcmp(name, "saleae") == 0)
+        *format = QiEdgeFileSaleae;
+    else
+        return false;
+
+    return true;
+}
+
+static void ParseText(const char* p, std::vector<U64>& edges) {
+    while (*p != '\0') {
+        if (*p == '#') {
+            while ((*p != '\0') && (*p != '\n'))
+                p++;
+        } else if ((*p >= '0') && (*p <= '9')) {
+            char* end;
+            edges.push_back(strtoull(p, &end, 10));
+            p = end;
+        } else {
+            p++;
+        }
+    }
+}
+
+static bool ReadText(FILE* file, std::vector<U64>& edges) {
+    std::vector<char> chunk(kReadChunkSize);
+    std::string       text;
+
+    for (;;) {
+        size_t read = fread(chunk.data(), 1, chunk.size(), file);
+        text.append(chunk.data(), read);
+        if (read < chunk.size())
+            break;
+
+        // Parse whole lines only; the partial line at the end is kept for the next chunk.
+        size_t last_newline = text.rfind('\n');
+        if (last_newline == std::string::npos)
+            continue;
+        text[last_newline] = '\0';
+        ParseText(text.c_str(), edges);
+        text.erase(0, last_newline + 1);
+    }
+    ParseText(text.c_str(), edges);
+
+    return ferror(file) == 0;
+}
+
+static bool ReadBinary(FILE* file, std::vector<U64>& edges) {
+    std::vector<U8> chunk(kReadChunkSize);
+    for (;;) {
+        size_t read = fread(chunk.data(), 1, chunk.size(), file);
+        for (size_t i = 0; i + 8 <= read; i += 8) {
+            U64 edge = 0;
+            for (U32 b = 0; b < 8; b++)
+                edge |= U64(chunk[i + b]) << (b * 8);
+            edges.push_back(edge);
+        }
+        if (read < chunk.size())
+            break;
+    }
+
+    return ferror(file) == 0;
+}
+
+static bool ReadSamples(FILE* file, U32 sample_bit, std::vector<U64>& edges) {
+    std::vector<U8> chunk(kReadChunkSize);
+    U64             sample_number = 0;
+    U8              mask          = U8(1u << sample_bit);
+    U8              state         = 0;
+
+    for (;;) {
+        size_t read = fread(chunk.data(), 1, chunk.size(), file);
+        for (size_t i = 0; i < read; i++, sample_number++) {
+            U8 bit = chunk[i] & mask;
+            if ((bit != state) && (sample_number > 0))
+                edges.push_back(sample_number);
+            state = bit;
+        }
+        if (read < chunk.size())
+            break;
+    }
+
+    return ferror(file) == 0;
+}
+
+static bool ReadSaleae(const char* path, U32 sample_rate_hz, std::vector<U64>& edges, std::string& error) {
+    QiSaleaeEdgeSource source;
+    if (source.Open(path, sample_rate_hz, 0, error) == false)
+        return false;
+
+    edges.reserve(edges.size() + source.GetHeader().mTransitionCount);
+    while (source.AdvanceToNextEdge())
+        edges.push_back(source.GetSampleNumber());
+
+    if (source.HasError()) {
+        error = std::string("cannot read ") + path;
+        return false;
+    }
+    return true;
+}
+
+bool QiReadEdgeFile(const char* path, QiEdgeFileFormat format, U32 sample_bit, U32 sample_rate_hz, std::vector<U64>& edges,
+                    std::string& error) {
+    // Mapped rather than read
+    if (format == QiEdgeFileSaleae)
+        return ReadSaleae(path, sample_rate_hz, edges, error);
+
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+        error = std::string("cannot open ") + path;
+        return false;
+    }
+
+    bool ok = false;
+    switch (format) {
+    case QiEdgeFileText:
+        ok = ReadText(file, edges);
+        break;
+    case QiEdgeFileBinary:
+        ok = ReadBinary(file, edges);
+        break;
+    case QiEdgeFileSamples:
+        ok = (sample_bit < 8) && ReadSamples(file, sample_bit, edges);
+        break;
+    case QiEdgeFileSaleae:
+        break;
+    }
+    fclose(file);
+
+    if (ok == false)
+        error = std::string("cannot read ") + path;
+    return ok;
+}
+
+// Parses the whole lines of text[0, length), which starts at offset in the file.
+static void ParseTextTail(const char* text, size_t length, U64 offset, std::vector<U64>& edges, std::vector<U64>& ends) {
+    const char* p   = text;
+    const char* end = text + length;
+    while (p < end) {
+        if (*p == '#') {
+            while ((p < end) && (*p != '\n'))
+                p++;
+        } else if ((*p >= '0') && (*p <= '9')) {
+            U64 edge = 0;
+            while ((p < end) && (*p >= '0') && (*p <= '9'))
+                edge = edge * 10 + U64(*p++ - '0');
+            edges.push_back(edge);
+            ends.push_back(offset + U64(p - text));
+        } else {
+            p++;
+        }
+    }
+}
+
+bool QiReadEdgeFileTail(const char* path, QiEdgeFileFormat format, U64 offset, std::vector<U64>& edges,
+                        std::vector<U64>& ends, std::string& error) {
+    if ((format != QiEdgeFileText) && (format != QiEdgeFileBinary)) {
+        error = "only text and binary captures can be read incrementally";
+        return false;
+    }
+
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+        error = std::string("cannot open ") + path;
+        return false;
+    }
+#ifdef _WIN32
+    int seek = _fseeki64(file, S64(offset), SEEK_SET);
+#else
+    int seek = fseeko(file, off_t(offset), SEEK_SET);
+#endif
+    if (seek != 0) {
+        fclose(file);
+        error = std::string("cannot seek in ") + path;
+        return false;
+    }
+
+    // Chunks end on whole lines or records; the rest is carried over to the next chunk
+    std::vector<char> chunk(kReadChunkSize);
+    size_t            carried = 0;
+    for (;;) {
+        size_t read = fread(chunk.data() + carried, 1, chunk.size() - carried, file);
+        size_t size = carried + read;
+
+        size_t whole;
+        if (format == QiEdgeFileBinary) {
+            whole = size - size % 8;
+            for (size_t i = 0; i < whole; i += 8) {
+                U64 edge = 0;
+                for (U32 b = 0; b < 8; b++)
+                    edge |= U64(U8(chunk[i + b])) << (b * 8);
+                edges.push_back(edge);
+                ends.push_back(offset + i + 8);
+            }
+        } else {
+            whole = size;
+            while ((whole > 0) && (chunk[whole - 1] != '\n'))
+                whole--;
+            ParseTextTail(chunk.data(), whole, offset, edges, ends);
+            if ((whole == 0) && (size == chunk.size())) {
+                fclose(file);
+                error = std::string("line too long in ") + path;
+                return false;
+            }
+        }
+
+        offset += whole;
+        carried = size - whole;
+        memmove(chunk.data(), chunk.data() + whole, carried);
+        if (read == 0)
+            break;
+    }
+
+    bool ok = (ferror(file) == 0);
+    fclose(file);
+    if (ok == false)
+        error = std::string("cannot read ") + path;
+    return ok;
+}
+
+QiEdgeFileWriter::QiEdgeFileWriter()
+    : mFile(nullptr), mFormat(QiEdgeFileBinary), mBuffer(kWriteChunkSize), mBufferUsed(0), mFailed(false) {}
+
+QiEdgeFileWriter::~QiEdgeFileWriter() {
+    Close();
+}
+
+bool QiEdgeFileWriter::Open(const char* path, QiEdgeFileFormat format) {
+    Close();
+
+    if ((format != QiEdgeFileText) && (format != QiEdgeFileBinary))
+        return false;
+
+    mFile = (strcmp(path, "-") == 0) ? stdout : fopen(path, "wb");
+    if (mFile == nullptr)
+        return false;
+
+    mFormat     = format;
+    mBufferUsed = 0;
+    mFailed     = false;
+    return true;
+}
+
+void QiEdgeFileWriter::Write(const U64* edges, U64 count) {
+    if (mFile == nullptr)
+        return;
+
+    for (U64 i = 0; i < count; i++) {
+        if (mBufferUsed + kMaxEdgeLength > mBuffer.size())
+            Flush();
+
+        char* p    = &mBuffer[mBufferUsed];
+        U64   edge = edges[i];
+        if (mFormat == QiEdgeFileBinary) {
+            for (U32 b = 0; b < 8; b++)
+                p[b] = char(U8(edge >> (b * 8)));
+            mBufferUsed += 8;
+        } else {
+            // Digits are produced from the last one, which is faster than printf on large files
+            char  digits[20];
+            char* d = digits + sizeof(digits);
+            do {
+                *--d = char('0' + edge % 10);
+                edge /= 10;
+            } while (edge != 0);
+
+            size_t length = digits + sizeof(digits) - d;
+            memcpy(p, d, length);
+            p[length] = '\n';
+            mBufferUsed += length + 1;
+        }
+    }
+}
+
+void QiEdgeFileWriter::Flush() {
+    if ((mBufferUsed > 0) && (fwrite(&mBuffer[0], 1, mBufferUsed, mFile) != mBufferUsed))
+        mFailed = true;
+    mBufferUsed = 0;
+}
+
+bool QiEdgeFileWriter::Close() {
+    if (mFile == nullptr)
+        return (mFailed == false);
+
+    Flush();
+    if (mFile == stdout) {
+        if (fflush(mFile) != 0)
+            mFailed = true;
+    } else if (fclose(mFile) != 0) {
+        mFailed = true;
+    }
+    mFile = nullptr;
+
+    return (mFailed == false);
+}
+
+QiArrayEdgeSource::QiArrayEdgeSource(const U64* edges, U64 count) : mEdges(edges), mCount(count), mIndex(0) {}
+
+QiArrayEdgeSource::~QiArrayEdgeSource() {}
+
+bool QiArrayEdgeSource::AdvanceToNextEdge() {
+    if (mIndex >= mCount)
+        return false;
+
+    mIndex++;
+    return true;
+}
+
+bool QiArrayEdgeSource::IsNextEdgeWithin(U64 distance) {
+    return (mIndex < mCount) && ((mEdges[mIndex] - GetSampleNumber()) < distance);
+}
+
+bool QiArrayEdgeSource::AdvanceToNextIdleEdge(U64 min_interval, bool* skipped) {
+    *skipped = false;
+    if (mIndex >= mCount)
+        return false;
+
+    // Stop on the first edge that is not followed by another within min_interval
+    mIndex++;
+    while ((mIndex < mCount) && ((mEdges[mIndex] - mEdges[mIndex - 1]) < min_interval)) {
+        mIndex++;
+        *skipped = true;
+    }
+    return true;
+}
+
+U64 QiArrayEdgeSource::GetSampleNumber() {
+    return (mIndex == 0) ? 0 : mEdges[mIndex - 1];
+}
+
+bool QiArrayEdgeSource::PeekNextEdge(U64* location) {
+    if (mIndex >= mCount)
+        return false;
+
+    *location = mEdges[mIndex];
+    return true;
+}
@@ -0,0 +1,77 @@
+#ifndef QI_EDGE_FILE_H
+#define QI_EDGE_FILE_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "QiDecoder.h"
+
+// Offline capture formats understood by the command-line tools.
+enum QiEdgeFileFormat {
+    QiEdgeFileText,       // one edge sample number per line, '#' starts a comment
+    QiEdgeFileBinary,     // little-endian U64 edge sample numbers
+    QiEdgeFileSamples,    // raw samples, one byte per sample; the Qi signal is one bit of each byte
+    QiEdgeFileSaleae,     // Logic 2 binary export of a digital channel (see QiSaleaeFile.h)
+};
+
+bool QiParseEdgeFileFormat(const char* name, QiEdgeFileFormat* format);
+
+// Reads every edge of a capture into `edges`. For QiEdgeFileSamples, `sample_bit` selects the bit that holds the Qi signal;
+// for QiEdgeFileSaleae, the transition times are converted to sample numbers at sample_rate_hz.
+bool QiReadEdgeFile(const char* path, QiEdgeFileFormat format, U32 sample_bit, U32 sample_rate_hz, std::vector<U64>& edges,
+                    std::string& error);
+
+// Reads the edges of a text or binary capture that is still being written, from the byte offset `offset` on. Only
+// whole lines or records are read, so a partial one at the end is left for the next call. ends[i] is the offset just
+// after edges[i], from which a later call continues with edges[i + 1].
+bool QiReadEdgeFileTail(const char* path, QiEdgeFileFormat format, U64 offset, std::vector<U64>& edges,
+                        std::vector<U64>& ends, std::string& error);
+
+// Buffered writer of text or binary edge files, for captures that are generated rather than recorded.
+class QiEdgeFileWriter {
+  public:
+    QiEdgeFileWriter();
+    ~QiEdgeFileWriter();
+
+    // Creates the file; "-" writes to stdout. Only QiEdgeFileText and QiEdgeFileBinary can be written.
+    bool Open(const char* path, QiEdgeFileFormat format);
+
+    void Write(const U64* edges, U64 count);
+
+    // Returns false if any write failed.
+    bool Close();
+
+  private:
+    void Flush();
+
+  private:
+    FILE*             mFile;
+    QiEdgeFileFormat  mFormat;
+    std::vector<char> mBuffer;
+    size_t            mBufferUsed;
+    bool              mFailed;
+};
+
+// Edge source over an in-memory array of edge sample numbers.
+class QiArrayEdgeSource : public QiEdgeSource {
+  public:
+    QiArrayEdgeSource(const U64* edges, U64 count);
+    virtual ~QiArrayEdgeSource();
+
+    virtual bool AdvanceToNextEdge();
+    virtual U64  GetSampleNumber();
+    virtual bool IsNextEdgeWithin(U64 distance);
+    virtual bool AdvanceToNextIdleEdge(U64 min_interval, bool* skipped);
+    virtual bool PeekNextEdge(U64* location);
+
+    // Number of edges taken so far; the current edge is the one before it.
+    U64 GetIndex() const { return mIndex; }
+
+  protected:
+    const U64* mEdges;
+    U64        mCount;
+    U64        mIndex;    // index of the current edge plus one; 0 before the first edge
+};
+
+#endif    // QI_EDGE_FILE_H
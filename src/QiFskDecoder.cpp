@@ -0,0 +1,245 @@
+#include "QiFskDecoder.h"
+
+#include <cstring>
+
+static const U32 kBitsPerByte  = 11;
+static const U32 kResponseBits = 8;
+static const U32 kWindowEdges  = 2 * kQiFskWindowCycles;
+
+// A shift of more than 1/512 (about 0.2%) of the carrier period from the baseline is a transition; the modulation
+// depths of the power profiles are at least twice that. Half of it ends the shift, so that the jitter of the edges
+// does not make the average chatter at the crossing.
+static const U32 kThresholdShift = 9;
+// The baseline follows the operating frequency with a time constant of 1024 edges, about one bit.
+static const U32 kBaselineShift = 10;
+
+// Intervals between transitions, in carrier cycles: half a bit and a whole bit, +/- 25%.
+static const U32 kHalfBitLow  = kQiFskCyclesPerBit / 2 - kQiFskCyclesPerBit / 8;
+static const U32 kHalfBitHigh = kQiFskCyclesPerBit / 2 + kQiFskCyclesPerBit / 8;
+static const U32 kBitLow      = kQiFskCyclesPerBit - kQiFskCyclesPerBit / 4;
+static const U32 kBitHigh     = kQiFskCyclesPerBit + kQiFskCyclesPerBit / 4;
+
+static U32 ParityOf(U32 data) {
+    data ^= data >> 4;
+    data ^= data >> 2;
+    data ^= data >> 1;
+    return data & 1;
+}
+
+const char* QiFskResponseName(U8 pattern) {
+    switch (pattern) {
+    case QiFskResponseAck:
+        return "ACK";
+    case QiFskResponseNak:
+        return "NAK";
+    case QiFskResponseNotDefined:
+        return "ND";
+    default:
+        return nullptr;
+    }
+}
+
+QiFskDecoder::QiFskDecoder() : mListener(nullptr) {
+    Reset(0);
+}
+
+QiFskDecoder::~QiFskDecoder() {}
+
+void QiFskDecoder::SetListener(QiFskListener* listener) {
+    mListener = listener;
+}
+
+void QiFskDecoder::Reset(U32 sample_rate_hz) {
+    mSampleRateHz = sample_rate_hz;
+
+    memset(mWindow, 0, sizeof(mWindow));
+    mEdgeCount = 0;
+    mBaseline  = 0;
+    mModulated = false;
+
+    mState            = StateIdle;
+    mLastTransition   = 0;
+    mBitStart         = 0;
+    mBitStartLocation = 0;
+    mBitRegister      = 0;
+    mBitCount         = 0;
+    mSequenceBits     = 0;
+    mPacketByteCount  = 0;
+    memset(mBitEdges, 0, sizeof(mBitEdges));
+    memset(&mStats, 0, sizeof(mStats));
+}
+
+void QiFskDecoder::ProcessEdges(const U64* edges, U32 count) {
+    mStats.mEdges += count;
+
+    for (U32 i = 0; i < count; i++) {
+        U64 edge   = edges[i];
+        U32 slot   = U32(mEdgeCount & (kWindowEdges - 1));
+        U64 oldest = mWindow[slot];
+        mWindow[slot] = edge;
+        mEdgeCount++;
+        if (mEdgeCount <= kWindowEdges)
+            continue;
+
+        // The window spans kQiFskWindowCycles whole cycles whatever the polarity of the current edge
+        U64 span = (edge - oldest) << 8;
+        if (mBaseline == 0) {
+            mBaseline = span;
+            continue;
+        }
+
+        U64  threshold = mBaseline >> kThresholdShift;
+        U64  deviation = (span > mBaseline) ? span - mBaseline : mBaseline - span;
+        bool modulated = mModulated ? (deviation > threshold / 2) : (deviation > threshold);
+
+        // The average crosses the threshold about half a window after the frequency changed
+        U64 cycle = mEdgeCount / 2 - kQiFskWindowCycles / 2;
+        if (modulated != mModulated) {
+            mModulated = modulated;
+            mStats.mTransitions++;
+            ProcessTransition(cycle, edge - ((edge - oldest) >> 1));
+        } else if ((modulated == false) && (deviation < threshold / 2)) {
+            mBaseline = mBaseline - (mBaseline >> kBaselineShift) + (span >> kBaselineShift);
+        }
+
+        if ((mState != StateIdle) && (cycle - mLastTransition >= kBitHigh)) {
+            if (mModulated) {
+                // Stuck at another frequency: the transmitter moved its operating point; start over from there
+                mStats.mFrequencySteps++;
+                mModulated = false;
+                mBaseline  = span;
+            }
+            EndSequence();
+        }
+    }
+}
+
+void QiFskDecoder::ProcessTransition(U64 cycle, U64 location) {
+    U64  distance   = cycle - mBitStart;
+    bool half       = (distance - kHalfBitLow) < (kHalfBitHigh - kHalfBitLow);
+    bool whole      = (distance - kBitLow) < (kBitHigh - kBitLow);
+    mLastTransition = cycle;
+
+    switch (mState) {
+    case StateIdle:
+        mState            = StateBit;
+        mBitStart         = cycle;
+        mBitStartLocation = location;
+        mBitRegister      = 0;
+        mBitCount         = 0;
+        mSequenceBits     = 0;
+        mPacketByteCount  = 0;
+        break;
+
+    case StateBit:
+        if (half) {
+            mState = StateBitHalf;
+        } else if (whole) {
+            SaveBit(location, 0);
+            mBitStart = cycle;
+        } else {
+            mStats.mBitErrors++;
+            mState = StateDiscard;
+        }
+        break;
+
+    case StateBitHalf:
+        if (whole) {
+            SaveBit(location, 1);
+            mBitStart = cycle;
+            mState    = StateBit;
+        } else {
+            mStats.mBitErrors++;
+            mState = StateDiscard;
+        }
+        break;
+
+    case StateDiscard:
+        break;
+    }
+}
+
+void QiFskDecoder::SaveBit(U64 end_location, U32 value) {
+    mBitEdges[mBitCount] = mBitStartLocation;
+    mBitStartLocation    = end_location;
+    mBitRegister |= value << mBitCount;
+    mBitCount++;
+    mSequenceBits++;
+
+    if (mBitCount < kBitsPerByte)
+        return;
+
+    mBitEdges[kBitsPerByte] = end_location;
+    if ((mBitRegister & 1) != 0) {
+        // Not a start bit, so these are not bytes
+        mStats.mBitErrors++;
+        mState = StateDiscard;
+        return;
+    }
+
+    QiByte byte;
+    U32    data = (mBitRegister >> 1) & 0xFF;
+    memcpy(byte.mBitEdges, mBitEdges, sizeof(byte.mBitEdges));
+    byte.mPacket       = U16(mBitRegister);
+    byte.mPayload      = U8(data);
+    byte.mPacketByte   = U8(mPacketByteCount);
+    byte.mPreambleBits = 0;
+    byte.mParityValid  = ((ParityOf(data) ^ ((mBitRegister >> 9) & 1)) == 1);
+    byte.mStopValid    = (((mBitRegister >> 10) & 1) == 1);
+
+    mStats.mBytes++;
+    mPacketByteCount++;
+    mBitRegister = 0;
+    mBitCount    = 0;
+
+    if (mListener != nullptr)
+        mListener->OnFskByte(byte);
+}
+
+void QiFskDecoder::EndSequence() {
+    if ((mState == StateBit) || (mState == StateBitHalf)) {
+        // The modulation ends on the operating frequency, so the last bit may have no transition at its end; then
+        // only the bit counts tell it from a transition back to the operating frequency after the last bit.
+        bool response = (mPacketByteCount == 0) && (mSequenceBits + 1 == kResponseBits);
+        if (response || (mBitCount + 1 == kBitsPerByte)) {
+            U64 bit_samples = (mBaseline * kQiFskCyclesPerBit / kQiFskWindowCycles) >> 8;
+            SaveBit(mBitStartLocation + bit_samples, (mState == StateBitHalf) ? 1 : 0);
+        }
+    }
+
+    if ((mState != StateDiscard) && (mPacketByteCount == 0) && (mSequenceBits == kResponseBits)) {
+        // Sent first bit first; the patterns are written that way in the specification
+        U8 pattern = 0;
+        for (U32 i = 0; i < kResponseBits; i++)
+            pattern |= U8(((mBitRegister >> i) & 1) << (kResponseBits - 1 - i));
+
+        mStats.mResponses++;
+        if (mListener != nullptr)
+            mListener->OnFskResponse(mBitEdges[0], mBitStartLocation, pattern);
+    }
+
+    mState        = StateIdle;
+    mBitRegister  = 0;
+    mBitCount     = 0;
+    mSequenceBits = 0;
+}
+
+void QiFskDecoder::Flush() {
+    if (mState != StateIdle)
+        EndSequence();
+}
+
+void QiFskDecoder::ProcessSilence(U64 location) {
+    if ((mEdgeCount == 0) || (mBaseline == 0))
+        return;
+
+    U64 last_edge   = mWindow[(mEdgeCount - 1) & (kWindowEdges - 1)];
+    U64 bit_samples = (mBaseline * kBitHigh / kQiFskWindowCycles) >> 8;
+    if ((location <= last_edge) || (location - last_edge < bit_samples))
+        return;
+
+    Flush();
+    mEdgeCount = 0;
+    mBaseline  = 0;
+    mModulated = false;
+}
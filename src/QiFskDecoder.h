@@ -0,0 +1,110 @@
+#ifndef QI_FSK_DECODER_H
+#define QI_FSK_DECODER_H
+
+#include "QiDecoder.h"
+
+// The transmitter-to-receiver channel of the newer WPC power profiles shifts the power carrier between its operating
+// frequency and a modulation frequency. Bits are differential bi-phase over kQiFskCyclesPerBit carrier cycles, like the
+// receiver's ASK bits: a transition at the start of every bit, and another one half-way through a 1-bit.
+static const U32 kQiFskCyclesPerBit = 512;
+
+// The carrier period is averaged over this many cycles (a power of two); at a 100-200 kHz carrier and a few MHz of
+// sample rate, that resolves the smallest modulation depth.
+static const U32 kQiFskWindowCycles = 32;
+
+// Edges that callers collect before passing them to ProcessEdges(); the decoder itself keeps no edge buffer but its
+// averaging window.
+static const U32 kQiFskBatchSize = 4096;
+
+// Patterns of the 8-bit responses, which are sent without start, parity and stop bits.
+enum QiFskResponse {
+    QiFskResponseAck        = 0xFF,
+    QiFskResponseNak        = 0x00,
+    QiFskResponseNotDefined = 0x55,
+};
+
+const char* QiFskResponseName(U8 pattern);    // "ACK", "NAK", "ND", or nullptr for other patterns
+
+// Counters since the last Reset().
+struct QiFskStats {
+    U64 mEdges;
+    U64 mTransitions;      // changes between the operating and the modulation frequency
+    U64 mFrequencySteps;   // shifts that were not followed by a bit, i.e. the transmitter changing its frequency
+    U64 mBitErrors;        // intervals between transitions that were neither a half nor a whole bit
+    U64 mBytes;
+    U64 mResponses;
+};
+
+class QiFskListener {
+  public:
+    virtual ~QiFskListener() {}
+
+    // A byte of a transmitter packet; mPacketByte counts the bytes since the modulation started.
+    virtual void OnFskByte(const QiByte& byte) = 0;
+
+    // An 8-bit response, from its first to its last bit edge.
+    virtual void OnFskResponse(U64 start, U64 end, U8 pattern) = 0;
+};
+
+// Streaming demodulator for the carrier channel. It is fed the location of every carrier edge, in batches, and tracks
+// the carrier period as the distance between the current edge and the edge kQiFskWindowCycles cycles earlier, so the
+// average costs one subtraction per edge and is exact to a sample however long the window is. A slowly adapting
+// baseline of the unmodulated period sets the threshold; the crossings of the threshold are the bit transitions.
+class QiFskDecoder {
+  public:
+    QiFskDecoder();
+    ~QiFskDecoder();
+
+    void SetListener(QiFskListener* listener);
+    void Reset(U32 sample_rate_hz);
+
+    // Edges of either polarity, in time order.
+    void ProcessEdges(const U64* edges, U32 count);
+
+    // Ends the bits in progress, e.g. at the end of the capture.
+    void Flush();
+
+    // Tells the decoder that the carrier has no edge before `location`. If it has stopped for longer than a bit, e.g.
+    // because the transmitter removed power, the bits in progress are ended as by Flush(), and the period is measured
+    // anew once the carrier is back.
+    void ProcessSilence(U64 location);
+
+    const QiFskStats& GetStats() const { return mStats; }
+
+  private:
+    enum State {
+        StateIdle,        // no modulation
+        StateBit,         // in the first half of a bit
+        StateBitHalf,     // a transition half-way through the bit was seen: a 1-bit
+        StateDiscard,     // the bits did not form bytes; waiting for the modulation to end
+    };
+
+    void ProcessTransition(U64 cycle, U64 location);
+    void SaveBit(U64 end_location, U32 value);
+    void EndSequence();
+
+  private:
+    QiFskListener* mListener;
+    U32            mSampleRateHz;
+
+    // Period estimator
+    U64  mWindow[2 * kQiFskWindowCycles];    // the last edges; one cycle is two edges
+    U64  mEdgeCount;
+    U64  mBaseline;     // span of kQiFskWindowCycles unmodulated cycles, in 1/256 samples; 0 until known
+    bool mModulated;
+
+    // Bit decoder, in carrier cycles
+    State mState;
+    U64   mLastTransition;      // cycle of the last transition
+    U64   mBitStart;            // cycle of the start of the current bit
+    U64   mBitStartLocation;    // sample location of the start of the current bit
+    U64   mBitEdges[12];        // sample locations of the bit starts of the current byte
+    U32   mBitRegister;         // bits of the current byte so far, first bit in bit 0
+    U32   mBitCount;            // bits of the current byte
+    U32   mSequenceBits;        // bits since the modulation started
+    U32   mPacketByteCount;
+
+    QiFskStats mStats;
+};
+
+#endif    // QI_FSK_DECODER_H
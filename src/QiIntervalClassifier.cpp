@@ -0,0 +1,226 @@
+#include "QiIntervalClassifier.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define QI_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(QI_X86) && (defined(__GNUC__) || defined(__clang__))
+#define QI_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define QI_TARGET_AVX2
+#endif
+
+void QiClassifyIntervalsScalar(const U64* edges, U64 count, U64 previous_edge, const QiIntervalWindows& windows, U8* classes) {
+    for (U64 i = 0; i < count; i++) {
+        classes[i]    = QiClassifyInterval(edges[i] - previous_edge, windows);
+        previous_edge = edges[i];
+    }
+}
+
+#ifdef QI_X86
+
+// Both kernels compare the windows as [low, high) with high = low + width. The SSE2 kernel compares in 32 bits, so it
+// is only used when every bound fits; an interval that does not fit in 32 bits is above all of the windows.
+static bool WindowsFitIn32Bits(const QiIntervalWindows& windows) {
+    const U64 limit = 0x7FFFFFFF;
+    return (windows.mShortLow + windows.mShortWidth <= limit) && (windows.mLongLow + windows.mLongWidth <= limit);
+}
+
+// A window with a width of 0 becomes the empty range [low, low), so it still never matches.
+static void ClassifyIntervalsSse2(const U64* edges, U64 count, U64 previous_edge, const QiIntervalWindows& windows, U8* classes) {
+    // Signed 32-bit compares are exact here, as the bounds and the (32-bit) intervals are below 2^31
+    const __m128i short_low  = _mm_set1_epi32(int(windows.mShortLow));
+    const __m128i short_high = _mm_set1_epi32(int(windows.mShortLow + windows.mShortWidth));
+    const __m128i long_low   = _mm_set1_epi32(int(windows.mLongLow));
+    const __m128i long_high  = _mm_set1_epi32(int(windows.mLongLow + windows.mLongWidth));
+    const __m128i limit      = _mm_set1_epi32(0x7FFFFFFF);
+
+    U64 i = 0;
+    for (; i + 4 <= count; i += 4) {
+        // four 64-bit intervals
+        __m128i current_01  = _mm_loadu_si128((const __m128i*)(edges + i));
+        __m128i current_23  = _mm_loadu_si128((const __m128i*)(edges + i + 2));
+        __m128i previous_01 = _mm_set_epi64x(S64(edges[i]), S64((i == 0) ? previous_edge : edges[i - 1]));
+        __m128i previous_23 = _mm_loadu_si128((const __m128i*)(edges + i + 1));
+        __m128i distance_01 = _mm_sub_epi64(current_01, previous_01);
+        __m128i distance_23 = _mm_sub_epi64(current_23, previous_23);
+
+        // Narrow to 32 bits, saturating intervals with any of the upper 33 bits set to the limit
+        __m128i low_words  = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(distance_01), _mm_castsi128_ps(distance_23), _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i high_words = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(distance_01), _mm_castsi128_ps(distance_23), _MM_SHUFFLE(3, 1, 3, 1)));
+        __m128i overflow   = _mm_or_si128(_mm_cmpgt_epi32(high_words, _mm_setzero_si128()), _mm_cmplt_epi32(high_words, _mm_setzero_si128()));
+        overflow           = _mm_or_si128(overflow, _mm_cmplt_epi32(low_words, _mm_setzero_si128()));
+        __m128i distance   = _mm_or_si128(_mm_and_si128(overflow, limit), _mm_andnot_si128(overflow, low_words));
+
+        __m128i below_short = _mm_cmplt_epi32(distance, short_low);
+        __m128i is_short    = _mm_andnot_si128(below_short, _mm_cmplt_epi32(distance, short_high));
+        __m128i is_long     = _mm_andnot_si128(_mm_cmplt_epi32(distance, long_low), _mm_cmplt_epi32(distance, long_high));
+
+        __m128i bits = _mm_or_si128(_mm_and_si128(is_short, _mm_set1_epi32(QiIntervalShort)),
+                                    _mm_or_si128(_mm_and_si128(is_long, _mm_set1_epi32(QiIntervalLong)),
+                                                 _mm_and_si128(below_short, _mm_set1_epi32(QiIntervalBelowShort))));
+        bits     = _mm_packs_epi32(bits, bits);
+        bits     = _mm_packus_epi16(bits, bits);
+
+        U32 packed = U32(_mm_cvtsi128_si32(bits));
+        classes[i]     = U8(packed);
+        classes[i + 1] = U8(packed >> 8);
+        classes[i + 2] = U8(packed >> 16);
+        classes[i + 3] = U8(packed >> 24);
+    }
+
+    if (i < count)
+        QiClassifyIntervalsScalar(edges + i, count - i, (i == 0) ? previous_edge : edges[i - 1], windows, classes + i);
+}
+
+QI_TARGET_AVX2
+static inline void StoreClassesAvx2(__m256i distance, __m256i short_low, __m256i short_high, __m256i long_low,
+                                    __m256i long_high, U8* classes) {
+    // distance has its sign bit flipped, as have the bounds
+    __m256i below_short = _mm256_cmpgt_epi64(short_low, distance);
+    __m256i is_short    = _mm256_andnot_si256(below_short, _mm256_cmpgt_epi64(short_high, distance));
+    __m256i is_long     = _mm256_andnot_si256(_mm256_cmpgt_epi64(long_low, distance), _mm256_cmpgt_epi64(long_high, distance));
+
+    // one bit per interval for each class
+    U32 short_mask = U32(_mm256_movemask_pd(_mm256_castsi256_pd(is_short)));
+    U32 long_mask  = U32(_mm256_movemask_pd(_mm256_castsi256_pd(is_long)));
+    U32 below_mask = U32(_mm256_movemask_pd(_mm256_castsi256_pd(below_short)));
+    for (U32 j = 0; j < 4; j++)
+        classes[j] = U8((((short_mask >> j) & 1) * QiIntervalShort) | (((long_mask >> j) & 1) * QiIntervalLong) |
+                        (((below_mask >> j) & 1) * QiIntervalBelowShort));
+}
+
+QI_TARGET_AVX2
+static void ClassifyIntervalsAvx2(const U64* edges, U64 count, U64 previous_edge, const QiIntervalWindows& windows, U8* classes) {
+    // AVX2 only compares signed 64-bit values; flipping the sign bit of both sides turns that into an unsigned compare
+    const U64     sign       = 1ull << 63;
+    const __m256i flip       = _mm256_set1_epi64x(S64(sign));
+    const __m256i short_low  = _mm256_set1_epi64x(S64(windows.mShortLow ^ sign));
+    const __m256i short_high = _mm256_set1_epi64x(S64((windows.mShortLow + windows.mShortWidth) ^ sign));
+    const __m256i long_low   = _mm256_set1_epi64x(S64(windows.mLongLow ^ sign));
+    const __m256i long_high  = _mm256_set1_epi64x(S64((windows.mLongLow + windows.mLongWidth) ^ sign));
+
+    if (count < 4) {
+        QiClassifyIntervalsScalar(edges, count, previous_edge, windows, classes);
+        return;
+    }
+
+    // The first group takes previous_edge in place of edges[-1]; the others load the edges before them from the array
+    __m256i current  = _mm256_loadu_si256((const __m256i*)edges);
+    __m256i previous = _mm256_set_epi64x(S64(edges[2]), S64(edges[1]), S64(edges[0]), S64(previous_edge));
+    StoreClassesAvx2(_mm256_xor_si256(_mm256_sub_epi64(current, previous), flip), short_low, short_high, long_low, long_high, classes);
+
+    U64 i = 4;
+    for (; i + 4 <= count; i += 4) {
+        current  = _mm256_loadu_si256((const __m256i*)(edges + i));
+        previous = _mm256_loadu_si256((const __m256i*)(edges + i - 1));
+        StoreClassesAvx2(_mm256_xor_si256(_mm256_sub_epi64(current, previous), flip), short_low, short_high, long_low, long_high, classes + i);
+    }
+
+    if (i < count)
+        QiClassifyIntervalsScalar(edges + i, count - i, edges[i - 1], windows, classes + i);
+}
+
+static bool CpuHasAvx2() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuidex(info, 7, 0);
+    if ((info[1] & (1 << 5)) == 0)
+        return false;
+    // the OS must save the AVX registers
+    __cpuid(info, 1);
+    if ((info[2] & (1 << 27)) == 0)
+        return false;
+    return (_xgetbv(0) & 0x6) == 0x6;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+enum Kernel {
+    KernelScalar,
+    KernelSse2,
+    KernelAvx2,
+};
+
+static Kernel SelectKernel() {
+    if (CpuHasAvx2())
+        return KernelAvx2;
+    // SSE2 is part of x86-64; on 32-bit x86 only use it when the compiler already assumes it
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+    return KernelSse2;
+#else
+    return KernelScalar;
+#endif
+}
+
+static const Kernel kKernel = SelectKernel();
+
+void QiClassifyIntervals(const U64* edges, U64 count, U64 previous_edge, const QiIntervalWindows& windows, U8* classes) {
+    if (kKernel == KernelAvx2)
+        ClassifyIntervalsAvx2(edges, count, previous_edge, windows, classes);
+    else if ((kKernel == KernelSse2) && WindowsFitIn32Bits(windows))
+        ClassifyIntervalsSse2(edges, count, previous_edge, windows, classes);
+    else
+        QiClassifyIntervalsScalar(edges, count, previous_edge, windows, classes);
+}
+
+const char* QiIntervalClassifierKernel() {
+    switch (kKernel) {
+    case KernelAvx2:
+        return "avx2";
+    case KernelSse2:
+        return "sse2";
+    default:
+        return "scalar";
+    }
+}
+
+U32 QiGetIntervalClassifierKernels(const char** names, QiIntervalClassifierFunction* functions, U32 max_count) {
+    U32 count = 0;
+    if (count < max_count) {
+        names[count]     = "scalar";
+        functions[count] = QiClassifyIntervalsScalar;
+        count++;
+    }
+    if ((kKernel >= KernelSse2) && (count < max_count)) {
+        names[count]     = "sse2";
+        functions[count] = ClassifyIntervalsSse2;
+        count++;
+    }
+    if ((kKernel >= KernelAvx2) && (count < max_count)) {
+        names[count]     = "avx2";
+        functions[count] = ClassifyIntervalsAvx2;
+        count++;
+    }
+    return count;
+}
+
+#else
+
+void QiClassifyIntervals(const U64* edges, U64 count, U64 previous_edge, const QiIntervalWindows& windows, U8* classes) {
+    QiClassifyIntervalsScalar(edges, count, previous_edge, windows, classes);
+}
+
+const char* QiIntervalClassifierKernel() {
+    return "scalar";
+}
+
+U32 QiGetIntervalClassifierKernels(const char** names, QiIntervalClassifierFunction* functions, U32 max_count) {
+    if (max_count == 0)
+        return 0;
+
+    names[0]     = "scalar";
+    functions[0] = QiClassifyIntervalsScalar;
+    return 1;
+}
+
+#endif
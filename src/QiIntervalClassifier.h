@@ -0,0 +1,51 @@
+#ifndef QI_INTERVAL_CLASSIFIER_H
+#define QI_INTERVAL_CLASSIFIER_H
+
+#include "QiTypes.h"
+
+// Acceptance windows for the intervals between edges, as [low, low + width): an interval d is inside a window if
+// (d - low) < width, in unsigned arithmetic.
+struct QiIntervalWindows {
+    U64 mShortLow;
+    U64 mShortWidth;
+    U64 mLongLow;
+    U64 mLongWidth;
+};
+
+// Class bits of an interval.
+enum QiIntervalClass {
+    QiIntervalShort      = 0x01,    // half a bit
+    QiIntervalLong       = 0x02,    // a whole bit
+    QiIntervalBelowShort = 0x04,    // shorter than the short window, i.e. a glitch
+};
+
+inline U8 QiClassifyInterval(U64 distance, const QiIntervalWindows& windows) {
+    U8 interval_class = 0;
+    if ((distance - windows.mShortLow) < windows.mShortWidth)
+        interval_class |= QiIntervalShort;
+    if ((distance - windows.mLongLow) < windows.mLongWidth)
+        interval_class |= QiIntervalLong;
+    if (distance < windows.mShortLow)
+        interval_class |= QiIntervalBelowShort;
+    return interval_class;
+}
+
+// Classifies the interval before each of `count` edges: classes[i] is the class of edges[i] - edges[i - 1], with
+// previous_edge standing in for edges[-1]. Uses AVX2 or SSE2 when the CPU has them; the result is always identical
+// to calling QiClassifyInterval() for every edge.
+void QiClassifyIntervals(const U64* edges, U64 count, U64 previous_edge, const QiIntervalWindows& windows, U8* classes);
+
+// Name of the kernel that QiClassifyIntervals() uses on this machine: "avx2", "sse2" or "scalar".
+const char* QiIntervalClassifierKernel();
+
+// The portable kernel, for comparison against the vectorized ones.
+void QiClassifyIntervalsScalar(const U64* edges, U64 count, U64 previous_edge, const QiIntervalWindows& windows, U8* classes);
+
+// Every kernel that is compiled in and that this machine can run, the portable one first, for testing them against
+// each other. Stores up to max_count of them and returns their number. "sse2" compares in 32 bits, so it only takes
+// windows that end below 2^31; QiClassifyIntervals() falls back to the portable kernel for others.
+typedef void (*QiIntervalClassifierFunction)(const U64* edges, U64 count, U64 previous_edge, const QiIntervalWindows& windows,
+                                             U8* classes);
+U32 QiGetIntervalClassifierKernels(const char** names, QiIntervalClassifierFunction* functions, U32 max_count);
+
+#endif    // QI_INTERVAL_CLASSIFIER_H
@@ -0,0 +1,354 @@
+#include "QiLiveSource.h"
+
+#include <chrono>
+#include <cstring>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// Bytes taken from the stream per read; a read returns whatever has arrived, so this only bounds a burst.
+static const U32 kReadSize = 64 << 10;
+
+// Waiting on the ring: spin first, since an edge is usually only microseconds away, then yield, then sleep, so that a
+// quiet stream does not keep a core busy.
+static const U32 kSpinCount  = 1000;
+static const U32 kYieldCount = 100;
+static const U32 kSleepUs    = 50;
+
+static void Backoff(U32& count) {
+    if (count < kSpinCount) {
+        count++;
+    } else if (count < kSpinCount + kYieldCount) {
+        count++;
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(kSleepUs));
+    }
+}
+
+U64 QiLiveClockNs() {
+    return U64(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+                   .count());
+}
+
+QiEdgeRing::QiEdgeRing(U32 capacity) : mHead(0), mCachedTail(0), mTail(0), mCachedHead(0), mHighWater(0), mClosed(false) {
+    U64 size = 2;
+    while (size < capacity)
+        size *= 2;
+    mEntries.resize(size);
+    mMask = size - 1;
+}
+
+QiEdgeRing::~QiEdgeRing() {}
+
+U32 QiEdgeRing::Write(const QiLiveEdge* edges, U32 count) {
+    U64 head     = mHead.load(std::memory_order_relaxed);
+    U64 capacity = mMask + 1;
+    if (head - mCachedTail + count > capacity)
+        mCachedTail = mTail.load(std::memory_order_acquire);
+
+    U64 room = capacity - (head - mCachedTail);
+    U32 n    = (count < room) ? count : U32(room);
+    for (U32 i = 0; i < n; i++)
+        mEntries[(head + i) & mMask] = edges[i];
+    mHead.store(head + n, std::memory_order_release);
+    return n;
+}
+
+void QiEdgeRing::Close() {
+    mClosed.store(true, std::memory_order_release);
+}
+
+U32 QiEdgeRing::Read(QiLiveEdge* edges, U32 max_count) {
+    U64 tail = mTail.load(std::memory_order_relaxed);
+    if (tail == mCachedHead) {
+        mCachedHead = mHead.load(std::memory_order_acquire);
+        if (tail == mCachedHead)
+            return 0;
+        if (mCachedHead - tail > mHighWater)
+            mHighWater = U32(mCachedHead - tail);
+    }
+
+    U64 available = mCachedHead - tail;
+    U32 n         = (max_count < available) ? max_count : U32(available);
+    for (U32 i = 0; i < n; i++)
+        edges[i] = mEntries[(tail + i) & mMask];
+    mTail.store(tail + n, std::memory_order_release);
+    return n;
+}
+
+bool QiEdgeRing::IsDone() {
+    // Edges written before Close() are visible once it is
+    if (mClosed.load(std::memory_order_acquire) == false)
+        return false;
+    mCachedHead = mHead.load(std::memory_order_acquire);
+    return (mTail.load(std::memory_order_relaxed) == mCachedHead);
+}
+
+QiLiveReader::QiLiveReader() : mFile(-1), mOwnsFile(false), mFormat(QiEdgeFileText) {}
+
+QiLiveReader::~QiLiveReader() {
+    std::string error;
+    Join(error);
+}
+
+bool QiLiveReader::Open(const char* path, QiEdgeFileFormat format, std::string& error) {
+    if ((format != QiEdgeFileText) && (format != QiEdgeFileBinary)) {
+        error = "only text and binary streams can be decoded live";
+        return false;
+    }
+    mFormat = format;
+
+#ifdef _WIN32
+    error = "live decoding is not available on Windows";
+    return false;
+#else
+    if (strcmp(path, "-") == 0) {
+        mFile     = 0;
+        mOwnsFile = false;
+        return true;
+    }
+
+    struct stat info;
+    if (stat(path, &info) != 0) {
+        error = std::string("cannot open ") + path;
+        return false;
+    }
+
+    if (S_ISSOCK(info.st_mode)) {
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (strlen(path) >= sizeof(address.sun_path)) {
+            error = std::string("socket path too long: ") + path;
+            return false;
+        }
+        strcpy(address.sun_path, path);
+
+        mFile = socket(AF_UNIX, SOCK_STREAM, 0);
+        if ((mFile >= 0) && (connect(mFile, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)) {
+            close(mFile);
+            mFile = -1;
+        }
+    } else {
+        // Opening a FIFO waits for its writer
+        mFile = open(path, O_RDONLY);
+    }
+    if (mFile < 0) {
+        error = std::string("cannot open ") + path;
+        return false;
+    }
+    mOwnsFile = true;
+    return true;
+#endif
+}
+
+void QiLiveReader::Start(QiEdgeRing& ring) {
+    mThread = std::thread(&QiLiveReader::Read, this, &ring);
+}
+
+bool QiLiveReader::Join(std::string& error) {
+    if (mThread.joinable())
+        mThread.join();
+#ifndef _WIN32
+    if (mOwnsFile && (mFile >= 0))
+        close(mFile);
+#endif
+    mFile     = -1;
+    mOwnsFile = false;
+
+    error = mError;
+    return mError.empty();
+}
+
+void QiLiveReader::Push(QiEdgeRing& ring, const QiLiveEdge* edges, U32 count) {
+    U32 wait = 0;
+    while (count > 0) {
+        U32 written = ring.Write(edges, count);
+        edges += written;
+        count -= written;
+        if (written == 0)
+            Backoff(wait);
+        else
+            wait = 0;
+    }
+}
+
+void QiLiveReader::Read(QiEdgeRing* ring) {
+#ifndef _WIN32
+    std::vector<char>       buffer(kReadSize);
+    std::vector<QiLiveEdge> edges(kReadSize / 2 + 1);
+
+    // Parser state carried over from one read to the next: the number or record being read, or a comment
+    U64  value      = 0;
+    bool in_number  = false;
+    bool in_comment = false;
+    U8   record[8];
+    U32  record_size = 0;
+
+    for (;;) {
+        ssize_t size = read(mFile, buffer.data(), buffer.size());
+        if ((size < 0) && (errno == EINTR))
+            continue;
+        if (size < 0) {
+            mError = "cannot read the stream";
+            break;
+        }
+
+        U64 arrival = QiLiveClockNs();
+        U32 count   = 0;
+        if (size == 0) {
+            if (in_number) {
+                edges[count].mLocation  = value;
+                edges[count].mArrivalNs = arrival;
+                count++;
+            }
+            Push(*ring, edges.data(), count);
+            break;
+        }
+
+        for (ssize_t i = 0; i < size; i++) {
+            char c = buffer[i];
+            if (mFormat == QiEdgeFileBinary) {
+                record[record_size++] = U8(c);
+                if (record_size < sizeof(record))
+                    continue;
+                value = 0;
+                for (U32 b = 0; b < sizeof(record); b++)
+                    value |= U64(record[b]) << (8 * b);
+                record_size = 0;
+            } else if (in_comment) {
+                in_comment = (c != '\n');
+                continue;
+            } else if ((c >= '0') && (c <= '9')) {
+                value     = value * 10 + U64(c - '0');
+                in_number = true;
+                continue;
+            } else {
+                in_comment = (c == '#');
+                if (in_number == false)
+                    continue;
+                in_number = false;
+            }
+
+            edges[count].mLocation  = value;
+            edges[count].mArrivalNs = arrival;
+            count++;
+            value = 0;
+        }
+        Push(*ring, edges.data(), count);
+    }
+#endif
+    ring->Close();
+}
+
+QiLiveEdgeSource::QiLiveEdgeSource(QiEdgeRing& ring, U32 sample_rate_hz, U32 slack_us)
+    : mRing(ring)
+    , mSampleRateHz(sample_rate_hz)
+    , mSlackNs(U64(slack_us) * 1000)
+    , mDecoder(nullptr)
+    , mBatchIndex(0)
+    , mBatchCount(0)
+    , mEdgeCount(0) {
+    memset(mHistory, 0, sizeof(mHistory));
+}
+
+QiLiveEdgeSource::~QiLiveEdgeSource() {}
+
+bool QiLiveEdgeSource::Fetch(U64 deadline_ns) {
+    if (mBatchIndex < mBatchCount)
+        return true;
+
+    U32 wait = 0;
+    for (;;) {
+        mBatchCount = mRing.Read(mBatch, kBatchSize);
+        mBatchIndex = 0;
+        if (mBatchCount > 0)
+            return true;
+        if (mRing.IsDone() || ((deadline_ns != 0) && (QiLiveClockNs() >= deadline_ns)))
+            return false;
+        Backoff(wait);
+    }
+}
+
+U64 QiLiveEdgeSource::SamplesToNs(U64 samples) const {
+    double ns    = double(samples) * 1e9 / double(mSampleRateHz);
+    U64    limit = U64(1) << 62;
+    return (ns < double(limit)) ? U64(ns) : limit;
+}
+
+void QiLiveEdgeSource::EndStopBit() {
+    // The decoder would otherwise wait for the next packet's first edge; by the deadline, an edge within the gap would
+    // have arrived
+    const QiLiveEdge& current = mHistory[(mEdgeCount - 1) & (kHistorySize - 1)];
+    U64               gap_end = mDecoder->GetSegmentGap() + 1;
+    if (Fetch(current.mArrivalNs + SamplesToNs(gap_end) + mSlackNs) == false)
+        mDecoder->ProcessSilence(current.mLocation + gap_end);
+}
+
+bool QiLiveEdgeSource::AdvanceToNextEdge() {
+    if ((mBatchIndex == mBatchCount) && (mDecoder != nullptr) && mDecoder->IsStopBitPending())
+        EndStopBit();
+    if (Fetch(0) == false)
+        return false;
+
+    mHistory[mEdgeCount & (kHistorySize - 1)] = mBatch[mBatchIndex++];
+    mEdgeCount++;
+    return true;
+}
+
+U64 QiLiveEdgeSource::GetSampleNumber() {
+    return mHistory[(mEdgeCount - 1) & (kHistorySize - 1)].mLocation;
+}
+
+bool QiLiveEdgeSource::IsNextEdgeWithin(U64 distance) {
+    const QiLiveEdge& current = mHistory[(mEdgeCount - 1) & (kHistorySize - 1)];
+    if ((mBatchIndex == mBatchCount) && (Fetch(current.mArrivalNs + SamplesToNs(distance) + mSlackNs) == false))
+        return false;
+    return (mBatch[mBatchIndex].mLocation - current.mLocation) < distance;
+}
+
+U64 QiLiveEdgeSource::GetArrivalNs(U64 location) const {
+    U64 count = (mEdgeCount < kHistorySize) ? mEdgeCount : kHistorySize;
+    for (U64 i = 1; i <= count; i++) {
+        const QiLiveEdge& edge = mHistory[(mEdgeCount - i) & (kHistorySize - 1)];
+        if (edge.mLocation <= location)
+            return edge.mArrivalNs;
+    }
+    return mHistory[(mEdgeCount - 1) & (kHistorySize - 1)].mArrivalNs;
+}
+
+QiLatencyHistogram::QiLatencyHistogram() : mCount(0), mSumNs(0), mMaxNs(0) {
+    memset(mBins, 0, sizeof(mBins));
+}
+
+void QiLatencyHistogram::Add(U64 latency_ns) {
+    U64 us  = latency_ns / 1000;
+    U32 bin = 0;
+    while ((us >= 2) && (bin + 1 < kQiLatencyBins)) {
+        us >>= 1;
+        bin++;
+    }
+    mBins[bin]++;
+    mCount++;
+    mSumNs += latency_ns;
+    if (mMaxNs < latency_ns)
+        mMaxNs = latency_ns;
+}
+
+U64 QiLatencyHistogram::GetPercentileUs(double fraction) const {
+    U64 target = U64(fraction * double(mCount) + 0.5);
+    U64 sum    = 0;
+    for (U32 bin = 0; bin < kQiLatencyBins; bin++) {
+        sum += mBins[bin];
+        if ((sum >= target) && (sum > 0))
+            return U64(2) << bin;
+    }
+    return 0;
+}
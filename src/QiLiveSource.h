@@ -0,0 +1,168 @@
+#ifndef QI_LIVE_SOURCE_H
+#define QI_LIVE_SOURCE_H
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "QiDecoder.h"
+#include "QiEdgeFile.h"
+
+// Decoding of an edge stream as it is captured, e.g. from an acquisition process that writes edge sample numbers to a
+// pipe or a Unix domain socket (qi-decode -l). A reader thread parses the stream into a QiEdgeRing, and the decoder
+// takes the edges from it through a QiLiveEdgeSource, so that neither waits for the other unless the ring runs empty
+// or full.
+
+// An edge of the stream, with the time that the reader read it (QiLiveClockNs()).
+struct QiLiveEdge {
+    U64 mLocation;
+    U64 mArrivalNs;
+};
+
+// Monotonic clock for the arrival and output times, in nanoseconds.
+U64 QiLiveClockNs();
+
+// Lock-free ring of edges between one producer and one consumer thread. Each side owns one index and only reads the
+// other's when its cached copy of it says that the ring is full or empty, so the two sides share no cache line while
+// edges flow.
+class QiEdgeRing {
+  public:
+    explicit QiEdgeRing(U32 capacity);    // rounded up to a power of two
+    ~QiEdgeRing();
+
+    // Producer side. Write() stores as many of the edges as there is room for and returns their number; Close() marks
+    // the end of the stream after the edges written so far.
+    U32  Write(const QiLiveEdge* edges, U32 count);
+    void Close();
+
+    // Consumer side. Read() takes up to max_count edges and returns their number, 0 if the ring is empty. IsDone() is
+    // true once the ring is closed and every edge has been read.
+    U32  Read(QiLiveEdge* edges, U32 max_count);
+    bool IsDone();
+
+    // Most edges that the consumer found in the ring at once.
+    U32 GetHighWater() const { return mHighWater; }
+
+  private:
+    std::vector<QiLiveEdge> mEntries;
+    U64                     mMask;
+
+    // Producer
+    alignas(64) std::atomic<U64> mHead;    // next entry to write
+    U64 mCachedTail;
+
+    // Consumer
+    alignas(64) std::atomic<U64> mTail;    // next entry to read
+    U64 mCachedHead;
+    U32 mHighWater;
+
+    alignas(64) std::atomic<bool> mClosed;
+};
+
+// Parses a text or binary edge stream (see QiEdgeFile.h) into a QiEdgeRing on its own thread. Each edge is stamped
+// with the time of the read that completed it; the thread closes the ring at the end of the stream.
+class QiLiveReader {
+  public:
+    QiLiveReader();
+    ~QiLiveReader();
+
+    // Opens the stream: "-" for stdin, a Unix domain socket to connect to, or a FIFO or file to read. Not available on
+    // Windows.
+    bool Open(const char* path, QiEdgeFileFormat format, std::string& error);
+
+    void Start(QiEdgeRing& ring);
+
+    // Waits for the end of the stream; returns false if reading it failed.
+    bool Join(std::string& error);
+
+  private:
+    void Read(QiEdgeRing* ring);
+    void Push(QiEdgeRing& ring, const QiLiveEdge* edges, U32 count);
+
+  private:
+    int              mFile;
+    bool             mOwnsFile;
+    QiEdgeFileFormat mFormat;
+    std::thread      mThread;
+    std::string      mError;
+};
+
+// Edge source over a QiEdgeRing, for QiDecoder::Run(). Taking an edge waits until the reader has one.
+//
+// A stream says nothing about the time between its edges until the next one arrives, so IsNextEdgeWithin() does not
+// wait for it: an edge within `distance` of the current one has arrived, give or take the acquisition's jitter, by the
+// time the current edge arrived plus `distance` plus `slack_us`. Without that, the last byte of a packet would wait for
+// the first edge of the next packet to be filtered for glitches.
+//
+// For the same reason, the last stop bit of a packet with an even number of bytes, which only the segment gap after it
+// ends, is ended by the source of the decoder set with SetDecoder() once no edge has arrived for the segment gap plus
+// `slack_us` after the last one (see QiDecoder::ProcessSilence()).
+class QiLiveEdgeSource : public QiEdgeSource {
+  public:
+    QiLiveEdgeSource(QiEdgeRing& ring, U32 sample_rate_hz, U32 slack_us);
+    virtual ~QiLiveEdgeSource();
+
+    void SetDecoder(QiDecoder* decoder) { mDecoder = decoder; }
+
+    virtual bool AdvanceToNextEdge();
+    virtual U64  GetSampleNumber();
+    virtual bool IsNextEdgeWithin(U64 distance);
+
+    // Arrival time of the last edge taken at or before location, among the last kHistorySize edges; that of the current
+    // edge if there is none. For a byte, the edge that completed it, or the last edge before a stop bit that the
+    // segment gap ended.
+    U64 GetArrivalNs(U64 location) const;
+
+    U64 GetEdgeCount() const { return mEdgeCount; }
+
+  private:
+    static const U32 kBatchSize   = 256;
+    static const U32 kHistorySize = 64;    // a power of two, more than the edges of a glitch burst between two bits
+
+    // Fills the batch from the ring, waiting up to deadline_ns (0: as long as it takes); returns false if there is no
+    // edge by then or the stream has ended.
+    bool Fetch(U64 deadline_ns);
+
+    U64  SamplesToNs(U64 samples) const;
+    void EndStopBit();
+
+  private:
+    QiEdgeRing& mRing;
+    U32         mSampleRateHz;
+    U64         mSlackNs;
+    QiDecoder*  mDecoder;
+
+    QiLiveEdge mBatch[kBatchSize];
+    U32        mBatchIndex;
+    U32        mBatchCount;
+
+    QiLiveEdge mHistory[kHistorySize];    // the edges taken, the current one at mEdgeCount - 1
+    U64        mEdgeCount;
+};
+
+// Histogram of latencies in octaves: bin i counts those of [2^i, 2^(i+1)) microseconds, bin 0 also those below 1 us.
+static const U32 kQiLatencyBins = 24;
+
+class QiLatencyHistogram {
+  public:
+    QiLatencyHistogram();
+
+    void Add(U64 latency_ns);
+
+    U64 GetCount() const { return mCount; }
+    U64 GetBin(U32 bin) const { return mBins[bin]; }
+    U64 GetMaxNs() const { return mMaxNs; }
+    U64 GetMeanNs() const { return (mCount > 0) ? mSumNs / mCount : 0; }
+
+    // Upper bound of the bin that holds the given fraction of the latencies, in microseconds.
+    U64 GetPercentileUs(double fraction) const;
+
+  private:
+    U64 mBins[kQiLatencyBins];
+    U64 mCount;
+    U64 mSumNs;
+    U64 mMaxNs;
+};
+
+#endif    // QI_LIVE_SOURCE_H
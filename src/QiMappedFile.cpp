@@ -0,0 +1,151 @@
+#include "QiMappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Size of the mapped window; large enough that remapping is rare, small enough for 32-bit address spaces.
+static const U64 kWindowSize = 64 << 20;
+
+QiMappedFile::QiMappedFile()
+#ifdef _WIN32
+    : mFile(INVALID_HANDLE_VALUE)
+    , mMapping(nullptr)
+#else
+    : mFile(-1)
+#endif
+    , mSize(0)
+    , mGranularity(1)
+    , mWindow(nullptr)
+    , mWindowOffset(0)
+    , mWindowSize(0) {
+}
+
+QiMappedFile::~QiMappedFile() {
+    Close();
+}
+
+bool QiMappedFile::Open(const char* path) {
+    Close();
+
+#ifdef _WIN32
+    mFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (mFile == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(mFile, &size) == FALSE) {
+        Close();
+        return false;
+    }
+    mSize = U64(size.QuadPart);
+
+    // An empty file can not be mapped, but there is nothing to read from it either
+    if (mSize > 0) {
+        mMapping = CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mMapping == nullptr) {
+            Close();
+            return false;
+        }
+    }
+
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    mGranularity = info.dwAllocationGranularity;
+#else
+    mFile = open(path, O_RDONLY);
+    if (mFile < 0)
+        return false;
+
+    struct stat status;
+    if ((fstat(mFile, &status) != 0) || (S_ISREG(status.st_mode) == 0)) {
+        Close();
+        return false;
+    }
+    mSize = U64(status.st_size);
+
+    long page_size = sysconf(_SC_PAGESIZE);
+    mGranularity   = (page_size > 0) ? U64(page_size) : 4096;
+#endif
+
+    return true;
+}
+
+void QiMappedFile::Close() {
+    Unmap();
+
+#ifdef _WIN32
+    if (mMapping != nullptr)
+        CloseHandle(mMapping);
+    if (mFile != INVALID_HANDLE_VALUE)
+        CloseHandle(mFile);
+    mMapping = nullptr;
+    mFile    = INVALID_HANDLE_VALUE;
+#else
+    if (mFile >= 0)
+        close(mFile);
+    mFile = -1;
+#endif
+
+    mSize = 0;
+}
+
+void QiMappedFile::Unmap() {
+    if (mWindow == nullptr)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(mWindow);
+#else
+    munmap((void*)mWindow, size_t(mWindowSize));
+#endif
+    mWindow     = nullptr;
+    mWindowSize = 0;
+}
+
+const U8* QiMappedFile::Map(U64 offset, U64 size, U64* available) {
+    if (offset >= mSize) {
+        *available = 0;
+        return nullptr;
+    }
+
+    if ((mWindow == nullptr) || (offset < mWindowOffset) || (offset + size > mWindowOffset + mWindowSize)) {
+        Unmap();
+
+        U64 start  = offset - offset % mGranularity;
+        U64 length = offset - start + size;
+        if (length < kWindowSize)
+            length = kWindowSize;
+        if (length > mSize - start)
+            length = mSize - start;
+
+#ifdef _WIN32
+        void* window = MapViewOfFile(mMapping, FILE_MAP_READ, DWORD(start >> 32), DWORD(start), SIZE_T(length));
+        if (window == nullptr) {
+            *available = 0;
+            return nullptr;
+        }
+#else
+        void* window = mmap(nullptr, size_t(length), PROT_READ, MAP_PRIVATE, mFile, off_t(start));
+        if (window == MAP_FAILED) {
+            *available = 0;
+            return nullptr;
+        }
+        // The decoders read front to back; let the kernel read ahead and drop the pages behind
+        posix_madvise(window, size_t(length), POSIX_MADV_SEQUENTIAL);
+#endif
+
+        mWindow       = (const U8*)window;
+        mWindowOffset = start;
+        mWindowSize   = length;
+    }
+
+    *available = mWindowOffset + mWindowSize - offset;
+    return mWindow + (offset - mWindowOffset);
+}
@@ -0,0 +1,39 @@
+#ifndef QI_MAPPED_FILE_H
+#define QI_MAPPED_FILE_H
+
+#include "QiTypes.h"
+
+// Read-only memory mapping of a file. Only a window of the file is mapped at a time, so that files larger than RAM (or
+// the address space) are streamed through the page cache without being copied.
+class QiMappedFile {
+  public:
+    QiMappedFile();
+    ~QiMappedFile();
+
+    bool Open(const char* path);
+    void Close();
+
+    U64 GetSize() const { return mSize; }
+
+    // Returns a pointer to the file's contents at `offset`, mapping the window around it if needed. *available is set
+    // to the number of bytes that can be read from the pointer: at least `size`, unless the file ends first. The
+    // pointer is valid until the next call. Returns nullptr if the window can not be mapped.
+    const U8* Map(U64 offset, U64 size, U64* available);
+
+  private:
+    void Unmap();
+
+#ifdef _WIN32
+    void* mFile;       // HANDLE
+    void* mMapping;    // HANDLE
+#else
+    int mFile;
+#endif
+    U64       mSize;
+    U64       mGranularity;    // window offsets must be a multiple of this
+    const U8* mWindow;
+    U64       mWindowOffset;
+    U64       mWindowSize;
+};
+
+#endif    // QI_MAPPED_FILE_H
@@ -0,0 +1,201 @@
+#include "QiMultiChannelDecoder.h"
+
+static const U64 kEndOfTime = ~U64(0);
+
+QiMultiChannelDecoder::ChannelQueue::ChannelQueue() : mLastLocation(0) {}
+
+void QiMultiChannelDecoder::ChannelQueue::OnMarker(U64 location, QiMarkerType marker) {
+    Event event;
+    event.mType     = EventMarker;
+    event.mLocation = location;
+    event.mMarker   = marker;
+    mEvents.push_back(event);
+    mLastLocation = location;
+}
+
+void QiMultiChannelDecoder::ChannelQueue::OnByte(const QiByte& byte) {
+    Event event;
+    event.mType     = EventByte;
+    event.mLocation = byte.mBitEdges[0];
+    event.mByte     = byte;
+    mEvents.push_back(event);
+    mLastLocation = event.mLocation;
+}
+
+void QiMultiChannelDecoder::ChannelQueue::OnSyncLost() {
+    Event event;
+    event.mType     = EventSyncLost;
+    event.mLocation = mLastLocation;
+    mEvents.push_back(event);
+}
+
+QiMultiChannelDecoder::QiMultiChannelDecoder() : mSampleRateHz(0), mTrackingToleranceDivisor(0) {}
+
+QiMultiChannelDecoder::~QiMultiChannelDecoder() {}
+
+void QiMultiChannelDecoder::Reset(U32 sample_rate_hz) {
+    mSampleRateHz = sample_rate_hz;
+    mChannels.clear();
+}
+
+void QiMultiChannelDecoder::SetTrackingTolerance(U32 tolerance_divisor) {
+    mTrackingToleranceDivisor = tolerance_divisor;
+}
+
+bool QiMultiChannelDecoder::AddChannel(QiEdgeSource* source, QiDecoderListener* listener) {
+    if (mChannels.size() >= kQiMaxChannels)
+        return false;
+
+    std::unique_ptr<ChannelState> channel(new ChannelState());
+    channel->mSource   = source;
+    channel->mListener = listener;
+    channel->mDecoder.SetListener(&channel->mQueue);
+    if (mTrackingToleranceDivisor != 0)
+        channel->mDecoder.SetTrackingTolerance(mTrackingToleranceDivisor);
+    channel->mDecoder.Reset(mSampleRateHz);
+
+    channel->mAtEnd      = false;
+    channel->mNextKnown  = false;
+    channel->mPeekFailed = false;
+    channel->mNextEdge   = 0;
+    channel->mQuietUntil = 0;
+    channel->mEarliest   = 0;
+    mChannels.push_back(std::move(channel));
+    return true;
+}
+
+bool QiMultiChannelDecoder::PeekNextEdge(ChannelState& channel) {
+    // A source that could not tell is only asked again once it has been waited on
+    if ((channel.mNextKnown == false) && (channel.mAtEnd == false) && (channel.mPeekFailed == false)) {
+        channel.mNextKnown  = channel.mSource->PeekNextEdge(&channel.mNextEdge);
+        channel.mPeekFailed = (channel.mNextKnown == false);
+    }
+    return channel.mNextKnown;
+}
+
+void QiMultiChannelDecoder::UpdateEarliest(ChannelState& channel) {
+    if (channel.mAtEnd) {
+        // The decoder gets no more edges; once it has ended a packet in progress, it reports nothing more
+        channel.mDecoder.ProcessSilence(kEndOfTime);
+        channel.mEarliest = kEndOfTime;
+        return;
+    }
+
+    U64 next_edge_bound = channel.mNextEdge;
+    if (channel.mNextKnown == false) {
+        // The next edge comes after the current one, and after any data that the source was quiet for
+        next_edge_bound = channel.mSource->GetSampleNumber();
+        if (next_edge_bound < channel.mQuietUntil)
+            next_edge_bound = channel.mQuietUntil;
+        channel.mDecoder.ProcessSilence(next_edge_bound);
+    }
+    channel.mEarliest = channel.mDecoder.GetEarliestPendingEvent(next_edge_bound);
+}
+
+bool QiMultiChannelDecoder::WaitForData() {
+    // Wait a segment gap past every channel, so that a quiet channel ends its packet in progress after one wait
+    U64 target = 0;
+    for (size_t i = 0; i < mChannels.size(); i++) {
+        ChannelState& channel = *mChannels[i];
+        U64           reached = channel.mSource->GetSampleNumber();
+        if (reached < channel.mQuietUntil)
+            reached = channel.mQuietUntil;
+        if (target < reached)
+            target = reached;
+    }
+    if (mChannels.empty() == false)
+        target += mChannels[0]->mDecoder.GetSegmentGap() + 1;
+
+    bool waiting = false;
+    for (size_t i = 0; i < mChannels.size(); i++) {
+        ChannelState& channel = *mChannels[i];
+        if (channel.mAtEnd || channel.mNextKnown)
+            continue;
+
+        bool has_data       = channel.mSource->WaitForData(target);
+        channel.mPeekFailed = false;
+        if (PeekNextEdge(channel)) {
+            waiting = true;
+        } else if (has_data) {
+            channel.mQuietUntil = target;
+            waiting             = true;
+        } else {
+            channel.mAtEnd = true;
+        }
+        UpdateEarliest(channel);
+    }
+    return waiting;
+}
+
+void QiMultiChannelDecoder::ReportEvents(U64 before) {
+    for (;;) {
+        ChannelState* first = nullptr;
+        for (size_t i = 0; i < mChannels.size(); i++) {
+            ChannelState& channel = *mChannels[i];
+            if (channel.mQueue.mEvents.empty() || (channel.mQueue.mEvents.front().mLocation >= before))
+                continue;
+            if ((first == nullptr) || (channel.mQueue.mEvents.front().mLocation < first->mQueue.mEvents.front().mLocation))
+                first = &channel;
+        }
+        if (first == nullptr)
+            return;
+
+        const Event& event = first->mQueue.mEvents.front();
+        switch (event.mType) {
+        case EventMarker:
+            first->mListener->OnMarker(event.mLocation, event.mMarker);
+            break;
+        case EventByte:
+            first->mListener->OnByte(event.mByte);
+            break;
+        case EventSyncLost:
+            first->mListener->OnSyncLost();
+            break;
+        }
+        first->mQueue.mEvents.pop_front();
+    }
+}
+
+U64 QiMultiChannelDecoder::GetEarliestPendingEvent(U64 location) const {
+    U64 earliest = location;
+    for (size_t i = 0; i < mChannels.size(); i++) {
+        const ChannelState& channel = *mChannels[i];
+        if ((channel.mQueue.mEvents.empty() == false) && (earliest > channel.mQueue.mEvents.front().mLocation))
+            earliest = channel.mQueue.mEvents.front().mLocation;
+        if (earliest > channel.mEarliest)
+            earliest = channel.mEarliest;
+    }
+    return earliest;
+}
+
+void QiMultiChannelDecoder::Run() {
+    for (;;) {
+        // Step the channel whose next edge comes first
+        ChannelState* next = nullptr;
+        for (size_t i = 0; i < mChannels.size(); i++) {
+            ChannelState& channel = *mChannels[i];
+            if (PeekNextEdge(channel) && ((next == nullptr) || (channel.mNextEdge < next->mNextEdge)))
+                next = &channel;
+        }
+
+        if (next != nullptr) {
+            next->mNextKnown = false;
+            if (next->mDecoder.Step(*next->mSource) == false)
+                next->mAtEnd = true;
+            else
+                PeekNextEdge(*next);
+            UpdateEarliest(*next);
+        } else if (WaitForData() == false) {
+            break;
+        }
+
+        U64 earliest = kEndOfTime;
+        for (size_t i = 0; i < mChannels.size(); i++) {
+            if (earliest > mChannels[i]->mEarliest)
+                earliest = mChannels[i]->mEarliest;
+        }
+        ReportEvents(earliest);
+    }
+
+    ReportEvents(kEndOfTime);
+}
@@ -0,0 +1,99 @@
+#ifndef QI_MULTI_CHANNEL_DECODER_H
+#define QI_MULTI_CHANNEL_DECODER_H
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "QiDecoder.h"
+
+// Most channels that one QiMultiChannelDecoder decodes, e.g. the coils of a multi-coil transmitter.
+static const U32 kQiMaxChannels = 8;
+
+// Decodes several channels on one thread, each with its own QiDecoder and listener. The edges are taken from the
+// channels in time order, and every channel's events are held back until no other channel can report an earlier one,
+// so that the listeners see the markers and bytes of all channels in order of their location. Events at the same
+// location are reported in channel order.
+//
+// A channel is only stepped when its source can tell where its next edge is without waiting (see
+// QiEdgeSource::PeekNextEdge()); otherwise the decoder waits for data on every channel a little past the others, so
+// that one quiet channel does not hold up the rest.
+class QiMultiChannelDecoder {
+  public:
+    QiMultiChannelDecoder();
+    ~QiMultiChannelDecoder();
+
+    // Removes all channels and computes the bit timing for the sample rate.
+    void Reset(U32 sample_rate_hz);
+
+    // See QiDecoder::SetTrackingTolerance(); applies to the channels added after it.
+    void SetTrackingTolerance(U32 tolerance_divisor);
+
+    // Adds a channel; the source and the listener must outlive Run(). At most kQiMaxChannels channels are decoded.
+    bool AddChannel(QiEdgeSource* source, QiDecoderListener* listener);
+
+    // Decodes the channels until every source has run out of edges.
+    void Run();
+
+    // Earliest location of an event that the listeners can still be given, or `location` if that is earlier; e.g. how
+    // far another stream can be reported without getting ahead of the channels.
+    U64 GetEarliestPendingEvent(U64 location) const;
+
+    U32              GetChannelCount() const { return U32(mChannels.size()); }
+    const QiDecoder& GetDecoder(U32 channel) const { return mChannels[channel]->mDecoder; }
+
+  private:
+    enum EventType {
+        EventMarker,
+        EventByte,
+        EventSyncLost,
+    };
+
+    struct Event {
+        EventType    mType;
+        U64          mLocation;
+        QiMarkerType mMarker;
+        QiByte       mByte;
+    };
+
+    // Queues a channel's decoder events until they can be reported.
+    class ChannelQueue : public QiDecoderListener {
+      public:
+        ChannelQueue();
+
+        virtual void OnMarker(U64 location, QiMarkerType marker);
+        virtual void OnByte(const QiByte& byte);
+        virtual void OnSyncLost();
+
+        std::deque<Event> mEvents;
+        U64               mLastLocation;    // location of the last event, which a sync loss is reported at
+    };
+
+    struct ChannelState {
+        QiEdgeSource*      mSource;
+        QiDecoderListener* mListener;
+        QiDecoder          mDecoder;
+        ChannelQueue       mQueue;
+
+        bool mAtEnd;         // the source has no more edges
+        bool mNextKnown;     // mNextEdge is the source's next edge
+        bool mPeekFailed;    // the source could not tell its next edge since the last wait
+        U64  mNextEdge;
+        U64  mQuietUntil;    // the source has no edge up to this sample
+        U64  mEarliest;      // earliest location of an event that the decoder can still report
+    };
+
+  private:
+    bool PeekNextEdge(ChannelState& channel);
+    void UpdateEarliest(ChannelState& channel);
+    bool WaitForData();
+    void ReportEvents(U64 before);
+
+  private:
+    U32 mSampleRateHz;
+    U32 mTrackingToleranceDivisor;
+
+    std::vector<std::unique_ptr<ChannelState>> mChannels;
+};
+
+#endif    // QI_MULTI_CHANNEL_DECODER_H
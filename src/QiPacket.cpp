@@ -0,0 +1,187 @@
+#include "QiPacket.h"
+
+#include <cstring>
+
+static const QiPacketInfo kPacketTable[] = {
+    { 0x01, 1, "SIG", "Signal Strength" },
+    { 0x02, 1, "EPT", "End Power Transfer" },
+    { 0x03, 1, "CE", "Control Error" },
+    { 0x04, 1, "RP8", "Received Power (8 bit)" },
+    { 0x05, 1, "CHS", "Charge Status" },
+    { 0x06, 1, "PCH", "Power Control Hold-Off" },
+    { 0x07, 1, "GRQ", "General Request" },
+    { 0x09, 1, "NEGO", "Renegotiate" },
+    { 0x15, 1, "DSR", "Data Stream Response" },
+    { 0x16, 1, "ADT/1e", "Aux Data Transport (even)" },
+    { 0x17, 1, "ADT/1o", "Aux Data Transport (odd)" },
+    { 0x18, 1, "PROP/1e", "Proprietary" },
+    { 0x19, 1, "PROP/1o", "Proprietary" },
+    { 0x20, 2, "SRQ", "Specific Request" },
+    { 0x22, 2, "FOD", "FOD Status" },
+    { 0x25, 2, "ADC", "Aux Data Control" },
+    { 0x26, 2, "ADT/2e", "Aux Data Transport (even)" },
+    { 0x27, 2, "ADT/2o", "Aux Data Transport (odd)" },
+    { 0x28, 2, "PROP/2e", "Proprietary" },
+    { 0x29, 2, "PROP/2o", "Proprietary" },
+    { 0x31, 3, "RP", "Received Power (16 bit)" },
+    { 0x36, 3, "ADT/3e", "Aux Data Transport (even)" },
+    { 0x37, 3, "ADT/3o", "Aux Data Transport (odd)" },
+    { 0x38, 3, "PROP/3", "Proprietary" },
+    { 0x46, 4, "ADT/4e", "Aux Data Transport (even)" },
+    { 0x47, 4, "ADT/4o", "Aux Data Transport (odd)" },
+    { 0x48, 4, "PROP/4", "Proprietary" },
+    { 0x51, 5, "CFG", "Configuration" },
+    { 0x54, 5, "WPID/msb", "Wireless Power ID (msb)" },
+    { 0x55, 5, "WPID/lsb", "Wireless Power ID (lsb)" },
+    { 0x56, 5, "ADT/5e", "Aux Data Transport (even)" },
+    { 0x57, 5, "ADT/5o", "Aux Data Transport (odd)" },
+    { 0x58, 5, "PROP/5", "Proprietary" },
+    { 0x66, 6, "ADT/6e", "Aux Data Transport (even)" },
+    { 0x67, 6, "ADT/6o", "Aux Data Transport (odd)" },
+    { 0x68, 6, "PROP/6", "Proprietary" },
+    { 0x71, 7, "ID", "Identification" },
+    { 0x76, 7, "ADT/7e", "Aux Data Transport (even)" },
+    { 0x77, 7, "ADT/7o", "Aux Data Transport (odd)" },
+    { 0x78, 7, "PROP/7", "Proprietary" },
+    { 0x81, 8, "XID", "Extended Identification" },
+    { 0x84, 8, "PROP/8", "Proprietary" },
+    { 0xA4, 12, "PROP/12", "Proprietary" },
+    { 0xC4, 16, "PROP/16", "Proprietary" },
+    { 0xE4, 20, "PROP/20", "Proprietary" },
+};
+
+static const U32 kPacketTableSize = sizeof(kPacketTable) / sizeof(kPacketTable[0]);
+
+// Header -> table entry, so that a lookup is a single load.
+struct PacketLookup {
+    const QiPacketInfo* mInfo[256];
+
+    PacketLookup() {
+        memset(mInfo, 0, sizeof(mInfo));
+        for (U32 i = 0; i < kPacketTableSize; i++)
+            mInfo[kPacketTable[i].mHeader] = &kPacketTable[i];
+    }
+};
+
+static const PacketLookup kPacketLookup;
+
+const QiPacketInfo* QiLookupPacket(U8 header) {
+    return kPacketLookup.mInfo[header];
+}
+
+U8 QiPacketSizeForHeader(U8 header) {
+    if (header < 0x20)
+        return 1;
+    if (header < 0x80)
+        return U8(2 + (header - 0x20) / 16);
+    return U8(8 + (header - 0x80) / 8);
+}
+
+S32 QiControlError(const QiPacket& packet) {
+    // two's complement
+    S32 value = packet.mMessage[0];
+    return (value >= 0x80) ? (value - 0x100) : value;
+}
+
+U32 QiReceivedPower(const QiPacket& packet) {
+    if (packet.mHeader == QiHeaderReceivedPower16)
+        return (U32(packet.mMessage[1]) << 8) | packet.mMessage[2];
+    return packet.mMessage[0];
+}
+
+U8 QiReceivedPowerMode(const QiPacket& packet) {
+    return packet.mMessage[0] & 0x07;
+}
+
+void QiDecodeIdentification(const QiPacket& packet, QiIdentification* identification) {
+    const U8* message = packet.mMessage;
+
+    identification->mVersionMajor = message[0] >> 4;
+    identification->mVersionMinor = message[0] & 0x0F;
+    identification->mManufacturer = U16((U16(message[1]) << 8) | message[2]);
+    identification->mExtended     = (message[3] & 0x80) != 0;
+    identification->mDeviceId =
+        (U32(message[3] & 0x7F) << 24) | (U32(message[4]) << 16) | (U32(message[5]) << 8) | U32(message[6]);
+}
+
+const char* QiEndPowerTransferReason(U8 code) {
+    switch (code) {
+    case 0x00:
+        return "Unknown";
+    case 0x01:
+        return "Charge Complete";
+    case 0x02:
+        return "Internal Fault";
+    case 0x03:
+        return "Over Temperature";
+    case 0x04:
+        return "Over Voltage";
+    case 0x05:
+        return "Over Current";
+    case 0x06:
+        return "Battery Failure";
+    case 0x07:
+        return "Reconfigure";
+    case 0x08:
+        return "No Response";
+    case 0x0A:
+        return "Negotiation Failure";
+    case 0x0B:
+        return "Restart Power Transfer";
+    default:
+        return "Reserved";
+    }
+}
+
+QiPacketAssembler::QiPacketAssembler() : mByteCount(0), mChecksum(0) {
+    memset(&mPacket, 0, sizeof(mPacket));
+}
+
+QiPacketAssembler::~QiPacketAssembler() {}
+
+void QiPacketAssembler::Reset() {
+    mByteCount = 0;
+    mChecksum  = 0;
+}
+
+bool QiPacketAssembler::AddByte(const QiByte& byte) {
+    bool bit_error = (byte.mParityValid == false) || (byte.mStopValid == false);
+
+    if (byte.mPacketByte == 0) {
+        // header; any packet in progress was cut short by a loss of sync
+        mPacket.mStart        = byte.mBitEdges[0];
+        mPacket.mHeader       = byte.mPayload;
+        mPacket.mPreambleBits = byte.mPreambleBits;
+        mPacket.mInfo         = QiLookupPacket(byte.mPayload);
+        mPacket.mSize         = (mPacket.mInfo != nullptr) ? mPacket.mInfo->mSize : QiPacketSizeForHeader(byte.mPayload);
+        mPacket.mBitErrors    = bit_error;
+
+        mChecksum  = byte.mPayload;
+        mByteCount = 1;
+        return false;
+    }
+
+    if ((mByteCount == 0) || (byte.mPacketByte != mByteCount)) {
+        // not part of a packet we saw the start of
+        mByteCount = 0;
+        return false;
+    }
+
+    mPacket.mBitErrors = mPacket.mBitErrors || bit_error;
+
+    if (mByteCount <= mPacket.mSize) {
+        // message
+        mPacket.mMessage[mByteCount - 1] = byte.mPayload;
+        mChecksum ^= byte.mPayload;
+        mByteCount++;
+        return false;
+    }
+
+    // checksum
+    mPacket.mEnd           = byte.mBitEdges[11];
+    mPacket.mChecksum      = byte.mPayload;
+    mPacket.mChecksumValid = (mChecksum == byte.mPayload);
+
+    mByteCount = 0;
+    return true;
+}
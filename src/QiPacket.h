@@ -0,0 +1,87 @@
+#ifndef QI_PACKET_H
+#define QI_PACKET_H
+
+#include "QiDecoder.h"
+
+// Headers of the packets whose fields are decoded.
+enum QiPacketHeader {
+    QiHeaderSignalStrength         = 0x01,
+    QiHeaderEndPowerTransfer       = 0x02,
+    QiHeaderControlError           = 0x03,
+    QiHeaderReceivedPower8         = 0x04,
+    QiHeaderReceivedPower16        = 0x31,
+    QiHeaderConfiguration          = 0x51,
+    QiHeaderIdentification         = 0x71,
+    QiHeaderExtendedIdentification = 0x81,
+};
+
+// Entry of the WPC packet table; mirrors the Packet enum of the Python HLA.
+struct QiPacketInfo {
+    U8          mHeader;
+    U8          mSize;    // number of message bytes between the header and the checksum
+    const char* mMnemonic;
+    const char* mName;
+};
+
+// Largest message size that a header can encode (header 0xFF).
+static const U32 kQiMaxPacketSize = 23;
+
+// Returns the table entry for a header, or nullptr for headers that are not in the table.
+const QiPacketInfo* QiLookupPacket(U8 header);
+
+// Message size encoded in a header, as defined by the WPC specification for all headers.
+U8 QiPacketSizeForHeader(U8 header);
+
+// A complete packet, from its header byte to its checksum byte.
+struct QiPacket {
+    U64                 mStart;    // first sample of the header byte
+    U64                 mEnd;      // last edge of the checksum byte
+    const QiPacketInfo* mInfo;     // nullptr if the header is not in the packet table
+    U8                  mHeader;
+    U8                  mSize;
+    U8                  mPreambleBits;    // preamble 1-bits before the header
+    U8                  mMessage[kQiMaxPacketSize];
+    U8                  mChecksum;
+    bool                mChecksumValid;
+    bool                mBitErrors;    // a byte of the packet had a parity or stop bit error
+};
+
+struct QiIdentification {
+    U8   mVersionMajor;
+    U8   mVersionMinor;
+    U16  mManufacturer;
+    bool mExtended;    // an Extended Identification packet follows
+    U32  mDeviceId;
+};
+
+// Field decoders; each expects a packet with the matching header.
+S32         QiControlError(const QiPacket& packet);
+U32         QiReceivedPower(const QiPacket& packet);    // RP8 or RP16 value
+U8          QiReceivedPowerMode(const QiPacket& packet);    // RP16 only
+void        QiDecodeIdentification(const QiPacket& packet, QiIdentification* identification);
+const char* QiEndPowerTransferReason(U8 code);
+
+// Groups decoded bytes into packets. The decoder restarts the byte count after every preamble, so a packet always
+// begins with byte 0; the header defines how many message bytes precede the checksum.
+class QiPacketAssembler {
+  public:
+    QiPacketAssembler();
+    ~QiPacketAssembler();
+
+    void Reset();
+
+    // Returns true when the byte completes a packet, which is then available from GetPacket().
+    bool AddByte(const QiByte& byte);
+
+    const QiPacket& GetPacket() const { return mPacket; }
+
+    // A header has been seen and the packet is not complete yet.
+    bool IsInPacket() const { return mByteCount > 0; }
+
+  private:
+    QiPacket mPacket;
+    U32      mByteCount;    // bytes of the current packet so far; 0 when no packet is in progress
+    U8       mChecksum;     // running XOR of the header and message bytes
+};
+
+#endif    // QI_PACKET_H
@@ -0,0 +1,224 @@
+#include "QiPacketExport.h"
+#include "QiByteOrder.h"
+#include "QiCheckpointFile.h"
+
+#include <cstring>
+
+static const U32 kWriteBufferSize = 1 << 20;
+static const U32 kMaxRowLength    = 256;
+
+QiPacketCsvWriter::QiPacketCsvWriter()
+    : mFile(nullptr)
+    , mBuffer(kWriteBufferSize)
+    , mBufferUsed(0)
+    , mFileOffset(0)
+    , mFailed(false)
+    , mSampleRateHz(0)
+    , mTriggerSample(0)
+    , mCoilColumn(false)
+    , mSpillFile(nullptr)
+    , mSpillSize(0) {}
+
+QiPacketCsvWriter::~QiPacketCsvWriter() {
+    Close();
+}
+
+bool QiPacketCsvWriter::Open(const char* path, const char* index_path, U32 sample_rate_hz, U64 trigger_sample,
+                             bool coil_column) {
+    Close();
+
+    mFile = fopen(path, "wb");
+    if (mFile == nullptr)
+        return false;
+
+    mBufferUsed    = 0;
+    mFileOffset    = 0;
+    mFailed        = false;
+    mSampleRateHz  = sample_rate_hz;
+    mTriggerSample = trigger_sample;
+    mCoilColumn    = coil_column;
+    mIndexPath     = (index_path != nullptr) ? index_path : "";
+    mSpillPath     = mIndexPath.empty() ? "" : mIndexPath + ".tmp";
+    mSpillSize     = 0;
+
+    const char* columns = coil_column ? "Time [s],Duration [s],Header,Mnemonic,Message,Checksum,Checksum OK,Bit Errors,Coil\n"
+                                      : "Time [s],Duration [s],Header,Mnemonic,Message,Checksum,Checksum OK,Bit Errors\n";
+    Append(columns, U32(strlen(columns)));
+    return true;
+}
+
+bool QiPacketCsvWriter::OpenAt(const char* path, U64 size, U32 sample_rate_hz, U64 trigger_sample, bool coil_column) {
+    Close();
+
+    mFile = QiOpenFileAt(path, size);
+    if (mFile == nullptr)
+        return false;
+
+    mBufferUsed    = 0;
+    mFileOffset    = size;
+    mFailed        = false;
+    mSampleRateHz  = sample_rate_hz;
+    mTriggerSample = trigger_sample;
+    mCoilColumn    = coil_column;
+    mIndexPath.clear();
+    return true;
+}
+
+void QiPacketCsvWriter::Write(const QiPacket& packet, U32 coil) {
+    if (mFile == nullptr)
+        return;
+
+    if (mIndexPath.empty() == false)
+        AddIndexEntry(packet.mHeader, packet.mStart, mFileOffset + mBufferUsed);
+
+    double sample_period = 1.0 / double(mSampleRateHz);
+    double time          = double(S64(packet.mStart - mTriggerSample)) * sample_period;
+    double duration      = double(packet.mEnd - packet.mStart) * sample_period;
+
+    char row[kMaxRowLength];
+    int  length = snprintf(row,
+                          sizeof(row),
+                          "%.9f,%.9f,0x%02X,%s,",
+                          time,
+                          duration,
+                          packet.mHeader,
+                          (packet.mInfo != nullptr) ? packet.mInfo->mMnemonic : "?");
+
+    // message bytes as space-separated hex; at most kQiMaxPacketSize * 3 characters
+    static const char kHexDigits[] = "0123456789ABCDEF";
+    for (U32 i = 0; i < packet.mSize; i++) {
+        if (i > 0)
+            row[length++] = ' ';
+        row[length++] = kHexDigits[packet.mMessage[i] >> 4];
+        row[length++] = kHexDigits[packet.mMessage[i] & 0x0F];
+    }
+
+    length += snprintf(row + length,
+                       sizeof(row) - length,
+                       ",0x%02X,%u,%u",
+                       packet.mChecksum,
+                       packet.mChecksumValid ? 1 : 0,
+                       packet.mBitErrors ? 1 : 0);
+    if (mCoilColumn)
+        length += snprintf(row + length, sizeof(row) - length, ",%u", coil);
+    row[length++] = '\n';
+
+    Append(row, U32(length));
+}
+
+void QiPacketCsvWriter::Append(const char* text, U32 length) {
+    if (mBufferUsed + length > kWriteBufferSize)
+        Flush();
+
+    memcpy(&mBuffer[mBufferUsed], text, length);
+    mBufferUsed += length;
+}
+
+bool QiPacketCsvWriter::Flush() {
+    if (mFile == nullptr)
+        return (mFailed == false);
+
+    if ((mBufferUsed > 0) && (fwrite(&mBuffer[0], 1, mBufferUsed, mFile) != mBufferUsed))
+        mFailed = true;
+    if (fflush(mFile) != 0)
+        mFailed = true;
+    mFileOffset += mBufferUsed;
+    mBufferUsed = 0;
+    return (mFailed == false);
+}
+
+void QiPacketCsvWriter::AddIndexEntry(U8 header, U64 sample, U64 offset) {
+    std::vector<U8>& block = mIndexBlocks[header];
+    if (block.empty())
+        block.reserve(kQiPacketIndexBlockEntries * kQiPacketIndexEntrySize);
+
+    U8 entry[kQiPacketIndexEntrySize];
+    QiPutU64(entry, sample);
+    QiPutU64(entry + 8, offset);
+    block.insert(block.end(), entry, entry + kQiPacketIndexEntrySize);
+    if (block.size() < kQiPacketIndexBlockEntries * kQiPacketIndexEntrySize)
+        return;
+
+    // The block is full; move it to the spill file
+    if (mSpillFile == nullptr)
+        mSpillFile = fopen(mSpillPath.c_str(), "w+b");
+    if ((mSpillFile == nullptr) || (fwrite(&block[0], 1, block.size(), mSpillFile) != block.size())) {
+        mFailed = true;
+    } else {
+        mSpilledBlocks[header].push_back(mSpillSize);
+        mSpillSize += block.size();
+    }
+    block.clear();
+}
+
+bool QiPacketCsvWriter::WriteIndex() {
+    FILE* file = fopen(mIndexPath.c_str(), "wb");
+    if (file == nullptr)
+        return false;
+
+    U64 counts[256];
+    U64 entry_count = 0;
+    for (U32 i = 0; i < 256; i++) {
+        counts[i] = U64(mSpilledBlocks[i].size()) * kQiPacketIndexBlockEntries + mIndexBlocks[i].size() / kQiPacketIndexEntrySize;
+        entry_count += counts[i];
+    }
+
+    std::vector<U8> header(kQiPacketIndexHeaderSize + kQiPacketIndexDirectorySize, 0);
+    memcpy(&header[0], "QIPKTIDX", 8);
+    QiPutU32(&header[8], kQiPacketIndexVersion);
+    QiPutU32(&header[12], mSampleRateHz);
+    QiPutU64(&header[16], mTriggerSample);
+    QiPutU64(&header[24], entry_count);
+
+    U64 first = 0;
+    for (U32 i = 0; i < 256; i++) {
+        U8* directory = &header[kQiPacketIndexHeaderSize + i * 16];
+        QiPutU64(directory, first);
+        QiPutU64(directory + 8, counts[i]);
+        first += counts[i];
+    }
+
+    bool ok = (fwrite(&header[0], 1, header.size(), file) == header.size());
+    if ((mSpillFile != nullptr) && (fflush(mSpillFile) != 0))
+        ok = false;
+
+    // Each header's spilled blocks in the order they were written, then the block that was still being filled
+    std::vector<U8> block(kQiPacketIndexBlockEntries * kQiPacketIndexEntrySize);
+    for (U32 i = 0; (i < 256) && ok; i++) {
+        for (size_t j = 0; (j < mSpilledBlocks[i].size()) && ok; j++) {
+            ok = QiSeekFile(mSpillFile, mSpilledBlocks[i][j], SEEK_SET) &&
+                 (fread(&block[0], 1, block.size(), mSpillFile) == block.size()) &&
+                 (fwrite(&block[0], 1, block.size(), file) == block.size());
+        }
+        if (ok && (mIndexBlocks[i].empty() == false))
+            ok = (fwrite(&mIndexBlocks[i][0], 1, mIndexBlocks[i].size(), file) == mIndexBlocks[i].size());
+    }
+
+    if (fclose(file) != 0)
+        ok = false;
+    return ok;
+}
+
+bool QiPacketCsvWriter::Close() {
+    if (mFile == nullptr)
+        return (mFailed == false);
+
+    Flush();
+    if (fclose(mFile) != 0)
+        mFailed = true;
+    mFile = nullptr;
+
+    if ((mIndexPath.empty() == false) && (WriteIndex() == false))
+        mFailed = true;
+    for (U32 i = 0; i < 256; i++) {
+        mIndexBlocks[i].clear();
+        mSpilledBlocks[i].clear();
+    }
+    if (mSpillFile != nullptr) {
+        fclose(mSpillFile);
+        mSpillFile = nullptr;
+        remove(mSpillPath.c_str());
+    }
+
+    return (mFailed == false);
+}
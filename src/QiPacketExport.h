@@ -0,0 +1,83 @@
+#ifndef QI_PACKET_EXPORT_H
+#define QI_PACKET_EXPORT_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "QiPacket.h"
+
+// Packet-level csv export: one row per packet with its time, duration, header, mnemonic, message bytes, checksum and
+// error status, and for multi-coil captures the coil that carried it.
+//
+// Optionally, a binary seek index is written next to it so that tools can jump to every packet of a given header
+// without scanning the export. All values are little-endian.
+//
+// Index header:
+//   0  char[8]  "QIPKTIDX"
+//   8  U32      format version (kQiPacketIndexVersion)
+//  12  U32      sample rate in Hz
+//  16  U64      trigger sample
+//  24  U64      number of entries
+//
+// Directory, at kQiPacketIndexHeaderSize: 256 x { U64 first entry, U64 number of entries }, one per header value.
+//
+// Entries, at kQiPacketIndexHeaderSize + kQiPacketIndexDirectorySize: grouped by header and in time order within each
+// header; 16 bytes each: { U64 first sample of the packet, U64 offset of the packet's row in the csv file }.
+//
+// Until Close(), the entries of each header are kept in blocks of kQiPacketIndexBlockEntries; full blocks are moved to
+// a temporary file next to the index, so the memory used does not grow with the length of the export.
+static const U32 kQiPacketIndexVersion       = 1;
+static const U32 kQiPacketIndexHeaderSize    = 32;
+static const U32 kQiPacketIndexDirectorySize = 256 * 16;
+static const U32 kQiPacketIndexEntrySize     = 16;
+static const U32 kQiPacketIndexBlockEntries  = 256;
+
+class QiPacketCsvWriter {
+  public:
+    QiPacketCsvWriter();
+    ~QiPacketCsvWriter();
+
+    // Creates the csv file and writes its column headers. If index_path is not nullptr, the seek index is written
+    // there by Close(). With coil_column, every row ends with the coil of the packet.
+    bool Open(const char* path, const char* index_path, U32 sample_rate_hz, U64 trigger_sample, bool coil_column = false);
+
+    // Continues a csv file written earlier, cut back to `size` (see QiOpenFileAt()); there is no seek index.
+    bool OpenAt(const char* path, U64 size, U32 sample_rate_hz, U64 trigger_sample, bool coil_column = false);
+
+    void Write(const QiPacket& packet, U32 coil = 0);
+
+    // Writes out the buffered rows, e.g. before a checkpoint refers to them; returns false if any write failed.
+    bool Flush();
+
+    // Size of the csv file once the buffered rows are written.
+    U64 GetSize() const { return mFileOffset + mBufferUsed; }
+
+    // Flushes the csv file and writes the index; returns false if any write failed.
+    bool Close();
+
+  private:
+    void Append(const char* text, U32 length);
+    void AddIndexEntry(U8 header, U64 sample, U64 offset);
+    bool WriteIndex();
+
+  private:
+    FILE*             mFile;
+    std::vector<char> mBuffer;
+    U32               mBufferUsed;
+    U64               mFileOffset;    // offset of the start of mBuffer in the file
+    bool              mFailed;
+
+    U32  mSampleRateHz;
+    U64  mTriggerSample;
+    bool mCoilColumn;
+
+    std::string      mIndexPath;
+    std::vector<U8>  mIndexBlocks[256];       // by header: the entries of its last block, encoded as in the index
+    std::vector<U64> mSpilledBlocks[256];     // by header: offsets of its full blocks in the spill file
+    std::string      mSpillPath;
+    FILE*            mSpillFile;
+    U64              mSpillSize;
+};
+
+#endif    // QI_PACKET_EXPORT_H
@@ -0,0 +1,179 @@
+#include "QiPacketRepeats.h"
+
+#include <cstring>
+
+static bool HasErrors(const QiPacket& packet) {
+    return (packet.mChecksumValid == false) || packet.mBitErrors;
+}
+
+QiPacketRepeats::QiPacketRepeats() {
+    Reset(0);
+}
+
+QiPacketRepeats::~QiPacketRepeats() {}
+
+void QiPacketRepeats::Reset(U32 control_error_tolerance) {
+    mControlErrorTolerance = control_error_tolerance;
+    memset(mReferences, 0, sizeof(mReferences));
+    mUseCount = 0;
+    ClearRun();
+}
+
+U32 QiPacketRepeats::FindReference(U8 header) const {
+    for (U32 i = 0; i < kQiRepeatReferences; i++) {
+        if (mReferences[i].mValid && (mReferences[i].mPacket.mHeader == header))
+            return i;
+    }
+    return kQiRepeatReferences;
+}
+
+bool QiPacketRepeats::IsRepeat(const QiPacket& packet) const {
+    U32 index = FindReference(packet.mHeader);
+    if ((index == kQiRepeatReferences) || HasErrors(packet))
+        return false;
+
+    const QiPacket& reference = mReferences[index].mPacket;
+    if (packet.mSize != reference.mSize)
+        return false;
+    if ((packet.mHeader == QiHeaderControlError) && (mControlErrorTolerance > 0)) {
+        S32 difference = QiControlError(packet) - QiControlError(reference);
+        return U32((difference < 0) ? -difference : difference) <= mControlErrorTolerance;
+    }
+    return memcmp(packet.mMessage, reference.mMessage, packet.mSize) == 0;
+}
+
+void QiPacketRepeats::AddRepeat(const QiPacket& packet, U64 glitches) {
+    Reference& reference = mReferences[FindReference(packet.mHeader)];
+    reference.mRepeats++;
+    reference.mLastUsed = ++mUseCount;
+
+    if (mRun.mCount == 0)
+        mRun.mStart = packet.mStart;
+    mRun.mEnd = packet.mEnd;
+    mRun.mCount++;
+    mRun.mGlitches += glitches;
+
+    if (packet.mHeader == QiHeaderControlError) {
+        S32 control_error = QiControlError(packet);
+        if ((mRun.mControlErrors == 0) || (control_error < mRun.mControlErrorMin))
+            mRun.mControlErrorMin = control_error;
+        if ((mRun.mControlErrors == 0) || (control_error > mRun.mControlErrorMax))
+            mRun.mControlErrorMax = control_error;
+        mRun.mControlErrors++;
+    }
+}
+
+void QiPacketRepeats::SetReference(const QiPacket& packet) {
+    // The entry of the header, else a free one, else the one used longest ago. A packet with errors only removes it.
+    U32 index = FindReference(packet.mHeader);
+    if (HasErrors(packet)) {
+        if (index != kQiRepeatReferences)
+            mReferences[index].mValid = false;
+        return;
+    }
+    for (U32 i = 0; (index == kQiRepeatReferences) && (i < kQiRepeatReferences); i++) {
+        if (mReferences[i].mValid == false)
+            index = i;
+    }
+    if (index == kQiRepeatReferences) {
+        index = 0;
+        for (U32 i = 1; i < kQiRepeatReferences; i++) {
+            if (mReferences[i].mLastUsed < mReferences[index].mLastUsed)
+                index = i;
+        }
+    }
+
+    Reference& reference = mReferences[index];
+    reference.mPacket    = packet;
+    reference.mValid     = true;
+    reference.mRepeats   = 0;
+    reference.mLastUsed  = ++mUseCount;
+}
+
+void QiPacketRepeats::ClearReferences() {
+    for (U32 i = 0; i < kQiRepeatReferences; i++)
+        mReferences[i].mValid = false;
+}
+
+void QiPacketRepeats::ClearRun() {
+    memset(&mRun, 0, sizeof(mRun));
+    for (U32 i = 0; i < kQiRepeatReferences; i++)
+        mReferences[i].mRepeats = 0;
+}
+
+QiRepeatCollapser::QiRepeatCollapser() {
+    Reset(0, nullptr);
+}
+
+QiRepeatCollapser::~QiRepeatCollapser() {}
+
+void QiRepeatCollapser::Reset(U32 control_error_tolerance, QiCollapsedListener* listener) {
+    mRepeats.Reset(control_error_tolerance);
+    mListener = listener;
+    mMarkers.clear();
+    mBytes.clear();
+    mErrors             = false;
+    mLastPacketEnd      = 0;
+    mLastPacketRepeated = false;
+}
+
+bool QiRepeatCollapser::HoldMarker(U64 location, QiMarkerType marker) {
+    if (location == mLastPacketEnd)
+        return mLastPacketRepeated;
+
+    if (marker != QiMarkerDot)
+        mErrors = true;
+    Marker held = { location, marker };
+    mMarkers.push_back(held);
+    return true;
+}
+
+void QiRepeatCollapser::HoldByte(const QiByte& byte) {
+    Byte held = { byte, U32(mMarkers.size()) };
+    mBytes.push_back(held);
+}
+
+bool QiRepeatCollapser::AddPacket(const QiPacket& packet, U64 glitches, bool show) {
+    mLastPacketEnd      = packet.mEnd;
+    mLastPacketRepeated = false;
+    if ((show == false) && (mErrors == false) && mRepeats.IsRepeat(packet)) {
+        mRepeats.AddRepeat(packet, glitches);
+        mMarkers.clear();
+        mBytes.clear();
+        mLastPacketRepeated = true;
+        return false;
+    }
+
+    Show();
+    mRepeats.SetReference(packet);
+    return true;
+}
+
+void QiRepeatCollapser::ShowPending() {
+    Show();
+    mRepeats.ClearReferences();
+}
+
+void QiRepeatCollapser::EndRun() {
+    if (mRepeats.HasRun() == false)
+        return;
+    mListener->OnRun(mRepeats);
+    mRepeats.ClearRun();
+}
+
+void QiRepeatCollapser::Show() {
+    EndRun();
+
+    size_t marker = 0;
+    for (size_t i = 0; i < mBytes.size(); i++) {
+        for (; marker < mBytes[i].mMarkerCount; marker++)
+            mListener->OnMarker(mMarkers[marker].mLocation, mMarkers[marker].mType);
+        mListener->OnByte(mBytes[i].mByte);
+    }
+    for (; marker < mMarkers.size(); marker++)
+        mListener->OnMarker(mMarkers[marker].mLocation, mMarkers[marker].mType);
+
+    mMarkers.clear();
+    mBytes.clear();
+    mErrors = false;
+}
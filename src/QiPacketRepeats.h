@@ -0,0 +1,145 @@
+#ifndef QI_PACKET_REPEATS_H
+#define QI_PACKET_REPEATS_H
+
+#include <vector>
+
+#include "QiPacket.h"
+
+// Headers whose last packet shown in full is kept as a reference; enough for the Control Error and Received Power
+// packets that alternate during power transfer.
+static const U32 kQiRepeatReferences = 4;
+
+// Consecutive packets that repeat earlier packets, merged into one run. During power transfer a receiver sends the
+// same Control Error and Received Power packets for hours; shown as runs, they cost results in proportion to how
+// often the traffic changes rather than to the length of the capture.
+struct QiPacketRun {
+    U64 mStart;       // first sample of the first repeat
+    U64 mEnd;         // last edge of the last repeat
+    U32 mCount;       // repeats in the run; 0 if there is no run
+    U64 mGlitches;    // edges removed by the glitch filter within the run
+
+    // Control Error packets within the tolerance differ in their value; its range over the run
+    U32 mControlErrors;
+    S32 mControlErrorMin;
+    S32 mControlErrorMax;
+};
+
+// Tells repeats from packets that must be shown in full. A packet repeats the last packet with its header that was
+// shown in full, its reference, if it has the same message, or if both are Control Error packets whose values differ
+// by at most the tolerance. Packets with checksum or bit errors neither repeat nor become a reference.
+class QiPacketRepeats {
+  public:
+    QiPacketRepeats();
+    ~QiPacketRepeats();
+
+    // Forgets the references and the run.
+    void Reset(U32 control_error_tolerance);
+
+    bool IsRepeat(const QiPacket& packet) const;
+    void AddRepeat(const QiPacket& packet, U64 glitches);
+
+    // The packet is shown in full, and the next ones with its header are compared with it. The run before it must
+    // have been taken.
+    void SetReference(const QiPacket& packet);
+
+    // After other detail that was shown in full, e.g. a loss of sync, the next packets are shown in full too.
+    void ClearReferences();
+
+    // Takes the run so far; the references are kept, so the next repeat starts a new run.
+    bool               HasRun() const { return mRun.mCount > 0; }
+    const QiPacketRun& GetRun() const { return mRun; }
+    void               ClearRun();
+
+    // The references, and how many of the run's repeats each one had; unused ones have a count of 0.
+    const QiPacket& GetReference(U32 index) const { return mReferences[index].mPacket; }
+    U32             GetRepeatCount(U32 index) const { return mReferences[index].mRepeats; }
+
+  private:
+    struct Reference {
+        QiPacket mPacket;
+        bool     mValid;
+        U32      mRepeats;     // in the current run
+        U64      mLastUsed;    // order of the last SetReference() or AddRepeat(), to replace the oldest
+    };
+
+    U32 FindReference(U8 header) const;    // kQiRepeatReferences if there is none
+
+  private:
+    U32         mControlErrorTolerance;
+    Reference   mReferences[kQiRepeatReferences];
+    U64         mUseCount;
+    QiPacketRun mRun;
+};
+
+// Receives what a QiRepeatCollapser shows.
+class QiCollapsedListener {
+  public:
+    virtual ~QiCollapsedListener() {}
+
+    // Markers and bytes that were held back and are shown after all, in the order that the decoder reported them.
+    virtual void OnMarker(U64 location, QiMarkerType marker) = 0;
+    virtual void OnByte(const QiByte& byte)                   = 0;
+
+    // The end of a run, before whatever ended it is shown; repeats.GetRun() and the repeat counts of the references
+    // describe it.
+    virtual void OnRun(const QiPacketRepeats& repeats) = 0;
+};
+
+// Repeated packets of one coil collapsed into runs, as the plugin shows them with Repeats set to Collapse. The markers
+// and bytes that the decoder reports after the coil's last packet are held back until it is known whether they are
+// part of a repeat; then they are either dropped or shown.
+class QiRepeatCollapser {
+  public:
+    QiRepeatCollapser();
+    ~QiRepeatCollapser();
+
+    // Forgets the references, the run and whatever is held back.
+    void Reset(U32 control_error_tolerance, QiCollapsedListener* listener);
+
+    // Returns false if the marker is on the last edge of the packet just shown, where the decoder loses sync at the
+    // end of every packet, and is to be shown right away; true if it is held back, or dropped with a repeat. Any other
+    // error marker shows the next packet in full.
+    bool HoldMarker(U64 location, QiMarkerType marker);
+    void HoldByte(const QiByte& byte);
+
+    // Adds the packet that the bytes held back end with. Returns false if it repeats its reference and is added to the
+    // run, dropping its markers and bytes. Otherwise, the run so far and the markers and bytes are shown, and the packet
+    // becomes the reference of its header; `show` forces that, e.g. for timing violations and search matches.
+    bool AddPacket(const QiPacket& packet, U64 glitches, bool show);
+
+    // Shows the run so far and whatever is held back, e.g. the bytes of a packet cut short by a loss of sync or bytes
+    // that are not part of a packet, and shows the next packets in full.
+    void ShowPending();
+    bool HasPendingBytes() const { return mBytes.empty() == false; }
+
+    // Shows the run so far, e.g. before a frame that would end it anyway.
+    void EndRun();
+    bool HasRun() const { return mRepeats.HasRun(); }
+
+    // The next packets are shown in full, e.g. after the end of a session.
+    void ClearReferences() { mRepeats.ClearReferences(); }
+
+  private:
+    struct Marker {
+        U64          mLocation;
+        QiMarkerType mType;
+    };
+    struct Byte {
+        QiByte mByte;
+        U32    mMarkerCount;    // markers reported before it
+    };
+
+    void Show();
+
+  private:
+    QiPacketRepeats      mRepeats;
+    QiCollapsedListener* mListener;
+
+    std::vector<Marker> mMarkers;
+    std::vector<Byte>   mBytes;
+    bool                mErrors;    // an error marker among them
+    U64                 mLastPacketEnd;
+    bool                mLastPacketRepeated;
+};
+
+#endif    // QI_PACKET_REPEATS_H
@@ -0,0 +1,332 @@
+#include "QiPacketSearch.h"
+
+#include <algorithm>
+#include <bitset>
+#include <cstring>
+#include <map>
+
+typedef std::bitset<256> ByteSet;
+
+static const U32 kNone = 0xFFFFFFFF;
+
+// States of the automaton before it is made deterministic: each pattern is a chain of states from the start of a
+// packet, one per byte, in parallel with the search for the next start of a packet.
+struct NfaEdge {
+    ByteSet mBytes;
+    U32     mTarget;
+};
+
+struct NfaState {
+    std::vector<NfaEdge> mEdges;
+    U32                  mEndTarget;    // at the end of the packet, kNone if the path ends
+    U32                  mAccept;       // the pattern that matches in this state, kNone if none
+};
+
+// The start of a packet, and the rest of a packet that no pattern follows
+static const U32 kNfaStart = 0;
+static const U32 kNfaSkip  = 1;
+
+static std::string Trim(const std::string& text) {
+    size_t first = text.find_first_not_of(" \t\r");
+    if (first == std::string::npos)
+        return std::string();
+    size_t last = text.find_last_not_of(" \t\r");
+    return text.substr(first, last - first + 1);
+}
+
+static bool ParseHex(const std::string& text, U32& value) {
+    if ((text.size() < 1) || (text.size() > 2))
+        return false;
+    value = 0;
+    for (size_t i = 0; i < text.size(); i++) {
+        char c = text[i];
+        if ((c >= '0') && (c <= '9'))
+            value = value * 16 + U32(c - '0');
+        else if ((c >= 'a') && (c <= 'f'))
+            value = value * 16 + U32(c - 'a' + 10);
+        else if ((c >= 'A') && (c <= 'F'))
+            value = value * 16 + U32(c - 'A' + 10);
+        else
+            return false;
+    }
+    return true;
+}
+
+static bool ParseByte(const std::string& text, ByteSet& bytes) {
+    bytes.reset();
+    if ((text == "*") || (text == "??")) {
+        bytes.set();
+        return true;
+    }
+
+    U32    first;
+    U32    second;
+    size_t split = text.find_first_of("/-");
+    if (split == std::string::npos) {
+        if (ParseHex(text, first) == false)
+            return false;
+        bytes.set(first);
+        return true;
+    }
+    if ((ParseHex(text.substr(0, split), first) == false) || (ParseHex(text.substr(split + 1), second) == false))
+        return false;
+
+    if (text[split] == '/') {
+        for (U32 value = 0; value < 256; value++) {
+            if (((value ^ first) & second) == 0)
+                bytes.set(value);
+        }
+    } else {
+        if (first > second)
+            return false;
+        for (U32 value = first; value <= second; value++)
+            bytes.set(value);
+    }
+    return true;
+}
+
+static U32 AddState(std::vector<NfaState>& states) {
+    NfaState state;
+    state.mEndTarget = kNone;
+    state.mAccept    = kNone;
+    states.push_back(state);
+    return U32(states.size() - 1);
+}
+
+static void AddEdge(std::vector<NfaState>& states, U32 from, const ByteSet& bytes, U32 to) {
+    NfaEdge edge;
+    edge.mBytes  = bytes;
+    edge.mTarget = to;
+    states[from].mEdges.push_back(edge);
+}
+
+QiSearchPatterns::QiSearchPatterns() {
+    Clear();
+}
+
+QiSearchPatterns::~QiSearchPatterns() {}
+
+void QiSearchPatterns::Clear() {
+    mPatterns.clear();
+    memset(mClasses, 0, sizeof(mClasses));
+    mClassCount = 1;
+    mStateCount = 1;
+
+    // One state that stays where it is
+    mTransitions.assign(mClassCount + 1, 0);
+    mAcceptFirst.assign(2, 0);
+    mAccepts.clear();
+}
+
+bool QiSearchPatterns::Compile(const char* text, std::string& error) {
+    Clear();
+
+    ByteSet any;
+    any.set();
+
+    std::vector<NfaState> nfa;
+    AddState(nfa);
+    AddState(nfa);
+    AddEdge(nfa, kNfaStart, any, kNfaSkip);
+    AddEdge(nfa, kNfaSkip, any, kNfaSkip);
+    nfa[kNfaSkip].mEndTarget = kNfaStart;
+
+    // Parse the patterns into chains of states
+    std::string all(text);
+    size_t      position = 0;
+    while (position <= all.size()) {
+        size_t      next   = all.find_first_of(";\n", position);
+        std::string source = Trim(all.substr(position, next - position));
+        position           = (next == std::string::npos) ? all.size() + 1 : next + 1;
+        if (source.empty())
+            continue;
+
+        Pattern pattern;
+        size_t  colon = source.find(':');
+        pattern.mName = Trim(source.substr(0, (colon == std::string::npos) ? 0 : colon));
+        std::string body = (colon == std::string::npos) ? source : source.substr(colon + 1);
+        if (pattern.mName.empty())
+            pattern.mName = Trim(body);
+        pattern.mPackets = 0;
+
+        U32    index       = U32(mPatterns.size());
+        U32    state       = kNfaStart;
+        size_t packet_head = 0;
+        while (packet_head <= body.size()) {
+            size_t      packet_next = body.find('>', packet_head);
+            std::string packet      = body.substr(packet_head, packet_next - packet_head);
+            packet_head             = (packet_next == std::string::npos) ? body.size() + 1 : packet_next + 1;
+
+            if (++pattern.mPackets > kQiSearchMaxPackets) {
+                error = "pattern '" + pattern.mName + "': more than 8 packets";
+                Clear();
+                return false;
+            }
+            if (pattern.mPackets > 1) {
+                U32 start             = AddState(nfa);
+                nfa[state].mEndTarget = start;
+                state                 = start;
+            }
+
+            U32    bytes = 0;
+            size_t token = packet.find_first_not_of(" \t\r");
+            while (token != std::string::npos) {
+                size_t      token_end = packet.find_first_of(" \t\r", token);
+                std::string byte      = packet.substr(token, token_end - token);
+                ByteSet     set;
+                if (ParseByte(byte, set) == false) {
+                    error = "pattern '" + pattern.mName + "': bad byte '" + byte + "'";
+                    Clear();
+                    return false;
+                }
+                if (++bytes > kQiMaxPacketSize + 1) {
+                    error = "pattern '" + pattern.mName + "': more bytes than a packet has";
+                    Clear();
+                    return false;
+                }
+                U32 target = AddState(nfa);
+                AddEdge(nfa, state, set, target);
+                state = target;
+                token = (token_end == std::string::npos) ? std::string::npos : packet.find_first_not_of(" \t\r", token_end);
+            }
+            if (bytes == 0) {
+                error = "pattern '" + pattern.mName + "': a packet without bytes";
+                Clear();
+                return false;
+            }
+
+            // The message bytes that are not listed
+            AddEdge(nfa, state, any, state);
+        }
+
+        U32 accept            = AddState(nfa);
+        nfa[accept].mAccept   = index;
+        nfa[state].mEndTarget = accept;
+        mPatterns.push_back(pattern);
+    }
+
+    // Byte classes: values that every set of every pattern either contains or not behave the same
+    mClassCount = 1;
+    memset(mClasses, 0, sizeof(mClasses));
+    for (size_t s = 0; s < nfa.size(); s++) {
+        for (size_t e = 0; e < nfa[s].mEdges.size(); e++) {
+            const ByteSet& set = nfa[s].mEdges[e].mBytes;
+            U32            split[512];
+            memset(split, 0xFF, sizeof(split));
+            U32 count = 0;
+            for (U32 value = 0; value < 256; value++) {
+                U32& id = split[mClasses[value] * 2 + (set.test(value) ? 1 : 0)];
+                if (id == kNone)
+                    id = count++;
+                mClasses[value] = id;
+            }
+            mClassCount = count;
+        }
+    }
+
+    std::vector<U32> representatives(mClassCount, kNone);
+    for (U32 value = 0; value < 256; value++) {
+        if (representatives[mClasses[value]] == kNone)
+            representatives[mClasses[value]] = value;
+    }
+
+    // Subset construction; every set holds the start of a packet or the rest of one, so none is empty
+    typedef std::vector<U32> StateSet;
+    std::map<StateSet, U32> ids;
+    std::vector<StateSet>   sets(1, StateSet(1, kNfaStart));
+    ids[sets[0]] = 0;
+    mTransitions.clear();
+    mAcceptFirst.clear();
+    mAccepts.clear();
+
+    for (U32 current = 0; current < sets.size(); current++) {
+        mAcceptFirst.push_back(U32(mAccepts.size()));
+        for (size_t i = 0; i < sets[current].size(); i++) {
+            if (nfa[sets[current][i]].mAccept != kNone)
+                mAccepts.push_back(nfa[sets[current][i]].mAccept);
+        }
+
+        for (U32 symbol = 0; symbol <= mClassCount; symbol++) {
+            StateSet next;
+            for (size_t i = 0; i < sets[current].size(); i++) {
+                const NfaState& state = nfa[sets[current][i]];
+                if (symbol == mClassCount) {
+                    if (state.mEndTarget != kNone)
+                        next.push_back(state.mEndTarget);
+                    continue;
+                }
+                for (size_t e = 0; e < state.mEdges.size(); e++) {
+                    if (state.mEdges[e].mBytes.test(representatives[symbol]))
+                        next.push_back(state.mEdges[e].mTarget);
+                }
+            }
+            std::sort(next.begin(), next.end());
+            next.erase(std::unique(next.begin(), next.end()), next.end());
+
+            std::map<StateSet, U32>::const_iterator found = ids.find(next);
+            if (found != ids.end()) {
+                mTransitions.push_back(found->second);
+                continue;
+            }
+            if (sets.size() == kQiSearchMaxStates) {
+                error = "too many patterns: the search needs more than 4096 states";
+                Clear();
+                return false;
+            }
+            ids[next] = U32(sets.size());
+            mTransitions.push_back(U32(sets.size()));
+            sets.push_back(next);
+        }
+    }
+    mAcceptFirst.push_back(U32(mAccepts.size()));
+    mStateCount = U32(sets.size());
+    return true;
+}
+
+static bool HasErrors(const QiPacket& packet) {
+    return (packet.mChecksumValid == false) || packet.mBitErrors;
+}
+
+QiPacketSearch::QiPacketSearch() {
+    Reset(nullptr);
+}
+
+QiPacketSearch::~QiPacketSearch() {}
+
+void QiPacketSearch::Reset(const QiSearchPatterns* patterns) {
+    mPatterns    = patterns;
+    mState       = 0;
+    mPacketCount = 0;
+    memset(mStarts, 0, sizeof(mStarts));
+}
+
+U32 QiPacketSearch::AddPacket(const QiPacket& packet, QiSearchMatch* matches) {
+    if ((mPatterns == nullptr) || (mPatterns->mPatterns.empty()))
+        return 0;
+    if (HasErrors(packet)) {
+        mState = 0;
+        return 0;
+    }
+
+    mStarts[mPacketCount % kQiSearchMaxPackets] = packet.mStart;
+    mPacketCount++;
+
+    const U32* transitions = mPatterns->mTransitions.data();
+    const U32* classes     = mPatterns->mClasses;
+    U32        symbols     = mPatterns->mClassCount + 1;
+    U32        state       = transitions[mState * symbols + classes[packet.mHeader]];
+    for (U32 i = 0; i < packet.mSize; i++)
+        state = transitions[state * symbols + classes[packet.mMessage[i]]];
+    state  = transitions[state * symbols + mPatterns->mClassCount];
+    mState = state;
+
+    U32 count = 0;
+    for (U32 i = mPatterns->mAcceptFirst[state]; i < mPatterns->mAcceptFirst[state + 1]; i++) {
+        QiSearchMatch& match = matches[count++];
+        match.mPattern       = mPatterns->mAccepts[i];
+        match.mPackets       = mPatterns->mPatterns[match.mPattern].mPackets;
+        match.mStart         = mStarts[(mPacketCount - match.mPackets) % kQiSearchMaxPackets];
+        match.mEnd           = packet.mEnd;
+    }
+    return count;
+}
@@ -0,0 +1,92 @@
+#ifndef QI_PACKET_SEARCH_H
+#define QI_PACKET_SEARCH_H
+
+#include <string>
+#include <vector>
+
+#include "QiPacket.h"
+
+// Search of the decoded packets for a set of patterns, e.g. every End Power Transfer packet with a given reason, or an
+// Identification packet followed by a Configuration packet.
+//
+// Patterns are separated by ';' or by new lines, each with an optional "name:" in front; a pattern without one is
+// named by its text. A pattern is a sequence of packets separated by '>', which must follow each other without
+// another packet or a packet with errors in between. A packet is a list of bytes separated by spaces, its header
+// first, then its message; message bytes beyond those listed match anything. A byte is one of:
+//   03      a value, in hex
+//   * ??    any value
+//   10/F0   a value and a mask: the bits set in the mask must match
+//   14-7F   a range of values, inclusive
+//
+//   ept_reason: 02 08; ce_high: 03 14-7F; id_cfg: 71 > 51
+//
+// The patterns are compiled into one deterministic automaton over the header and message bytes of the packets, with
+// the byte values that no pattern tells apart merged into one class. Searching costs one table lookup per byte and one
+// per packet, however many patterns there are; only the matches produce output.
+static const U32 kQiSearchMaxPackets = 8;       // packets of a pattern
+static const U32 kQiSearchMaxStates  = 4096;    // states of the automaton; more patterns fail to compile
+
+// A set of compiled patterns. It is not changed by searching, so several searches, e.g. one per coil, can share it.
+class QiSearchPatterns {
+  public:
+    QiSearchPatterns();
+    ~QiSearchPatterns();
+
+    // Replaces the patterns; on failure, error says which pattern is wrong and there are no patterns.
+    bool Compile(const char* text, std::string& error);
+
+    U32         GetPatternCount() const { return U32(mPatterns.size()); }
+    const char* GetPatternName(U32 pattern) const { return mPatterns[pattern].mName.c_str(); }
+    U32         GetPatternPackets(U32 pattern) const { return mPatterns[pattern].mPackets; }
+    U32         GetStateCount() const { return mStateCount; }
+
+  private:
+    friend class QiPacketSearch;
+
+    struct Pattern {
+        std::string mName;
+        U32         mPackets;
+    };
+
+    void Clear();
+
+  private:
+    std::vector<Pattern> mPatterns;
+
+    U32 mClasses[256];     // class of each byte value; the end of a packet is class mClassCount
+    U32 mClassCount;
+    U32 mStateCount;
+
+    std::vector<U32> mTransitions;    // next state, mClassCount + 1 per state; state 0 is the start of a packet
+    std::vector<U32> mAcceptFirst;    // for each state, its first entry in mAccepts; one more at the end
+    std::vector<U32> mAccepts;        // patterns that match on entering the state
+};
+
+struct QiSearchMatch {
+    U32 mPattern;
+    U32 mPackets;    // number of packets matched; the last one is the packet just added
+    U64 mStart;      // first sample of the first packet
+    U64 mEnd;        // last edge of the last packet
+};
+
+// The search of one packet stream.
+class QiPacketSearch {
+  public:
+    QiPacketSearch();
+    ~QiPacketSearch();
+
+    // Starts over with the given patterns, which must outlive the search; nullptr matches nothing.
+    void Reset(const QiSearchPatterns* patterns);
+
+    // Adds the next packet and stores the patterns that it completes in matches, which has room for one match per
+    // pattern; returns their number. A packet with checksum or bit errors matches nothing and ends every sequence.
+    U32 AddPacket(const QiPacket& packet, QiSearchMatch* matches);
+
+  private:
+    const QiSearchPatterns* mPatterns;
+    U32                     mState;
+    U64                     mStarts[kQiSearchMaxPackets];    // first samples of the last packets, by packet count
+    U64                     mPacketCount;
+};
+
+#endif    // QI_PACKET_SEARCH_H
@@ -0,0 +1,100 @@
+#include "QiRecordFile.h"
+#include "QiByteOrder.h"
+#include "QiCheckpointFile.h"
+
+#include <cstring>
+
+static const U32 kWriteBufferSize = 1 << 16;
+
+U8 QiGetByteFlags(const QiByte& byte) {
+    U8 flags = 0;
+    if (byte.mParityValid == false)
+        flags |= QiByteParityError;
+    if (byte.mStopValid == false)
+        flags |= QiByteStopError;
+    return flags;
+}
+
+QiRecordWriter::QiRecordWriter() : mFile(nullptr), mBuffer(kWriteBufferSize), mBufferUsed(0), mFileSize(0), mFailed(false) {}
+
+QiRecordWriter::~QiRecordWriter() {
+    Close();
+}
+
+bool QiRecordWriter::Open(const char* path, U32 sample_rate_hz, U64 trigger_sample) {
+    Close();
+
+    mFile = fopen(path, "wb");
+    if (mFile == nullptr)
+        return false;
+    mBufferUsed = 0;
+    mFailed     = false;
+
+    U8 header[kQiRecordHeaderSize];
+    memset(header, 0, sizeof(header));
+    memcpy(header, "QIRECORD", 8);
+    QiPutU32(header + 8, kQiRecordVersion);
+    QiPutU32(header + 12, kQiRecordSize);
+    QiPutU32(header + 16, sample_rate_hz);
+    QiPutU64(header + 24, trigger_sample);
+
+    mFailed   = (fwrite(header, 1, sizeof(header), mFile) != sizeof(header));
+    mFileSize = sizeof(header);
+    return (mFailed == false);
+}
+
+bool QiRecordWriter::OpenAt(const char* path, U64 size) {
+    Close();
+
+    mFile = QiOpenFileAt(path, size);
+    if (mFile == nullptr)
+        return false;
+    mBufferUsed = 0;
+    mFileSize   = size;
+    mFailed     = false;
+    return true;
+}
+
+void QiRecordWriter::Write(U64 sample, U16 packet, U8 payload, U8 packet_byte, U8 flags, U8 coil) {
+    if (mBufferUsed + kQiRecordSize > kWriteBufferSize)
+        Flush();
+
+    U8* record = &mBuffer[mBufferUsed];
+    QiPutU64(record, sample);
+    QiPutU16(record + 8, packet);
+    record[10] = payload;
+    record[11] = packet_byte;
+    record[12] = flags;
+    record[13] = coil;
+    record[14] = 0;
+    record[15] = 0;
+    mBufferUsed += kQiRecordSize;
+}
+
+void QiRecordWriter::Write(const QiByte& byte, U8 coil) {
+    Write(byte.mBitEdges[0], byte.mPacket, byte.mPayload, byte.mPacketByte, QiGetByteFlags(byte), coil);
+}
+
+bool QiRecordWriter::Flush() {
+    if (mFile == nullptr)
+        return (mFailed == false);
+
+    if ((mBufferUsed > 0) && (fwrite(&mBuffer[0], 1, mBufferUsed, mFile) != mBufferUsed))
+        mFailed = true;
+    if (fflush(mFile) != 0)
+        mFailed = true;
+    mFileSize += mBufferUsed;
+    mBufferUsed = 0;
+    return (mFailed == false);
+}
+
+bool QiRecordWriter::Close() {
+    if (mFile == nullptr)
+        return (mFailed == false);
+
+    Flush();
+    if (fclose(mFile) != 0)
+        mFailed = true;
+    mFile = nullptr;
+    return (mFailed == false);
+}
@@ -0,0 +1,71 @@
+#ifndef QI_RECORD_FILE_H
+#define QI_RECORD_FILE_H
+
+#include <cstdio>
+#include <vector>
+
+#include "QiDecoder.h"
+
+// Binary record file of decoded bytes: a fixed-size header followed by one fixed-size record per byte, all
+// little-endian, so that analysis scripts can map the records directly (e.g. numpy.memmap at kQiRecordHeaderSize).
+//
+// Header:
+//   0  char[8]  "QIRECORD"
+//   8  U32      format version (kQiRecordVersion)
+//  12  U32      record size (kQiRecordSize)
+//  16  U32      sample rate in Hz
+//  20  U32      reserved, 0
+//  24  U64      trigger sample
+//
+// Record:
+//   0  U64      first sample of the byte (the start of its start bit)
+//   8  U16      the 11 raw bits, start bit in bit 0
+//  10  U8       payload
+//  11  U8       index of the byte within its packet
+//  12  U8       QiByteFlags
+//  13  U8       coil (input channel) of a multi-coil capture, 0 otherwise
+//  14  U8[2]    reserved, 0
+static const U32 kQiRecordVersion    = 1;
+static const U32 kQiRecordHeaderSize = 32;
+static const U32 kQiRecordSize       = 16;
+
+// Error flags of a byte; also stored in the low bits of the plugin's Frame::mFlags.
+enum QiByteFlags {
+    QiByteParityError = 0x01,
+    QiByteStopError   = 0x02,
+};
+
+U8 QiGetByteFlags(const QiByte& byte);
+
+class QiRecordWriter {
+  public:
+    QiRecordWriter();
+    ~QiRecordWriter();
+
+    // Creates the file and writes the header.
+    bool Open(const char* path, U32 sample_rate_hz, U64 trigger_sample);
+
+    // Continues a file written earlier, cut back to `size` (see QiOpenFileAt()).
+    bool OpenAt(const char* path, U64 size);
+
+    void Write(U64 sample, U16 packet, U8 payload, U8 packet_byte, U8 flags, U8 coil = 0);
+    void Write(const QiByte& byte, U8 coil = 0);
+
+    // Writes out the buffered records, e.g. before a checkpoint refers to them; returns false if any write failed.
+    bool Flush();
+
+    // Size of the file once the buffered records are written.
+    U64 GetSize() const { return mFileSize + mBufferUsed; }
+
+    // Flushes the buffered records; returns false if any write failed.
+    bool Close();
+
+  private:
+    FILE*           mFile;
+    std::vector<U8> mBuffer;
+    U32             mBufferUsed;
+    U64             mFileSize;    // not counting mBuffer
+    bool            mFailed;
+};
+
+#endif    // QI_RECORD_FILE_H
@@ -0,0 +1,196 @@
+#include "QiSaleaeFile.h"
+
+#include <cstring>
+
+static const char kIdentifier[]    = "<SALEAE>";
+static const U32  kIdentifierSize  = 8;
+static const U32  kHeaderSize      = 44;
+static const U32  kTypeDigital     = 0;
+static const U32  kNewestVersion   = 1;
+static const U32  kTransitionSize  = 8;
+
+static U32 ReadU32(const U8* p) {
+    return U32(p[0]) | (U32(p[1]) << 8) | (U32(p[2]) << 16) | (U32(p[3]) << 24);
+}
+
+static U64 ReadU64(const U8* p) {
+    return U64(ReadU32(p)) | (U64(ReadU32(p + 4)) << 32);
+}
+
+static double ReadDouble(const U8* p) {
+    U64    bits = ReadU64(p);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+QiSaleaeEdgeSource::QiSaleaeEdgeSource()
+    : mSampleRateHz(0.0)
+    , mMinPulseWidth(0)
+    , mTimes(nullptr)
+    , mTimesFirst(0)
+    , mTimesCount(0)
+    , mLastReadValid(false)
+    , mLastReadIndex(0)
+    , mLastReadSample(0)
+    , mStarted(false)
+    , mIndex(0)
+    , mSample(0)
+    , mNextFound(false)
+    , mNextIndex(0)
+    , mNextSample(0)
+    , mRejectedEdgeCount(0)
+    , mError(false) {
+    memset(&mHeader, 0, sizeof(mHeader));
+}
+
+QiSaleaeEdgeSource::~QiSaleaeEdgeSource() {}
+
+bool QiSaleaeEdgeSource::Open(const char* path, U32 sample_rate_hz, U64 min_pulse_width, std::string& error) {
+    Close();
+
+    if (mFile.Open(path) == false) {
+        error = std::string("cannot open ") + path;
+        return false;
+    }
+
+    U64       available = 0;
+    const U8* header    = mFile.Map(0, kHeaderSize, &available);
+    if ((header == nullptr) || (available < kHeaderSize) || (memcmp(header, kIdentifier, kIdentifierSize) != 0)) {
+        error = std::string(path) + " is not a Logic 2 binary export";
+        Close();
+        return false;
+    }
+
+    mHeader.mVersion         = ReadU32(header + 8);
+    U32 type                 = ReadU32(header + 12);
+    mHeader.mInitialState    = ReadU32(header + 16);
+    mHeader.mBeginTime       = ReadDouble(header + 20);
+    mHeader.mEndTime         = ReadDouble(header + 28);
+    mHeader.mTransitionCount = ReadU64(header + 36);
+
+    if ((mHeader.mVersion > kNewestVersion) || (type != kTypeDigital)) {
+        error = std::string(path) + " is not a digital channel export (or of an unknown version)";
+        Close();
+        return false;
+    }
+    if (mHeader.mTransitionCount > (mFile.GetSize() - kHeaderSize) / kTransitionSize) {
+        error = std::string(path) + " is truncated";
+        Close();
+        return false;
+    }
+
+    mSampleRateHz  = double(sample_rate_hz);
+    mMinPulseWidth = min_pulse_width;
+    return true;
+}
+
+void QiSaleaeEdgeSource::Close() {
+    mFile.Close();
+    memset(&mHeader, 0, sizeof(mHeader));
+
+    mTimes             = nullptr;
+    mTimesFirst        = 0;
+    mTimesCount        = 0;
+    mLastReadValid     = false;
+    mStarted           = false;
+    mNextFound         = false;
+    mRejectedEdgeCount = 0;
+    mError             = false;
+}
+
+bool QiSaleaeEdgeSource::ReadSample(U64 index, U64* sample) {
+    // Each transition is read twice with the glitch filter on: as the end of one pulse, then as the next edge
+    if (mLastReadValid && (index == mLastReadIndex)) {
+        *sample = mLastReadSample;
+        return true;
+    }
+
+    if (index - mTimesFirst >= mTimesCount) {
+        U64 available = 0;
+        mTimes        = mFile.Map(kHeaderSize + index * kTransitionSize, kTransitionSize, &available);
+        if (mTimes == nullptr) {
+            mError      = true;
+            mTimesCount = 0;
+            return false;
+        }
+        mTimesFirst = index;
+        mTimesCount = available / kTransitionSize;
+    }
+
+    // Times are relative to the trigger; count samples from the start of the capture
+    double seconds = ReadDouble(mTimes + (index - mTimesFirst) * kTransitionSize) - mHeader.mBeginTime;
+    *sample        = (seconds > 0.0) ? U64(seconds * mSampleRateHz + 0.5) : 0;
+
+    mLastReadValid  = true;
+    mLastReadIndex  = index;
+    mLastReadSample = *sample;
+    return true;
+}
+
+bool QiSaleaeEdgeSource::FindNextEdge() {
+    if (mNextFound)
+        return true;
+
+    U64 count = mHeader.mTransitionCount;
+    U64 index = mStarted ? mIndex + 1 : 0;
+    for (;;) {
+        if ((index >= count) || (ReadSample(index, &mNextSample) == false))
+            return false;
+        if ((mMinPulseWidth == 0) || (index + 1 >= count))
+            break;
+
+        // Drop a pulse that is too short together with both of its edges, as QiDeglitchEdges() does
+        U64 end;
+        if (ReadSample(index + 1, &end) == false)
+            return false;
+        if (end - mNextSample >= mMinPulseWidth)
+            break;
+        index += 2;
+        mRejectedEdgeCount += 2;
+    }
+
+    mNextIndex = index;
+    mNextFound = true;
+    return true;
+}
+
+bool QiSaleaeEdgeSource::AdvanceToNextEdge() {
+    if (FindNextEdge() == false)
+        return false;
+
+    mIndex     = mNextIndex;
+    mSample    = mNextSample;
+    mStarted   = true;
+    mNextFound = false;
+    return true;
+}
+
+U64 QiSaleaeEdgeSource::GetSampleNumber() {
+    return mStarted ? mSample : 0;
+}
+
+bool QiSaleaeEdgeSource::IsNextEdgeWithin(U64 distance) {
+    return FindNextEdge() && ((mNextSample - GetSampleNumber()) < distance);
+}
+
+bool QiSaleaeEdgeSource::PeekNextEdge(U64* location) {
+    if (FindNextEdge() == false)
+        return false;
+
+    *location = mNextSample;
+    return true;
+}
+
+bool QiSaleaeEdgeSource::AdvanceToNextIdleEdge(U64 min_interval, bool* skipped) {
+    *skipped = false;
+    if (AdvanceToNextEdge() == false)
+        return false;
+
+    // Stop on the first edge that is not followed by another within min_interval, like QiArrayEdgeSource
+    while (IsNextEdgeWithin(min_interval)) {
+        AdvanceToNextEdge();
+        *skipped = true;
+    }
+    return true;
+}
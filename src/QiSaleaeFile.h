@@ -0,0 +1,86 @@
+#ifndef QI_SALEAE_FILE_H
+#define QI_SALEAE_FILE_H
+
+#include <string>
+
+#include "QiDecoder.h"
+#include "QiMappedFile.h"
+
+// Header of a Logic 2 binary export of one digital channel:
+//
+//   offset  size  field
+//        0     8  identifier "<SALEAE>"
+//        8     4  version (0 or 1)
+//       12     4  type (0: digital)
+//       16     4  initial state (level before the first transition)
+//       20     8  begin time, seconds (double)
+//       28     8  end time, seconds (double)
+//       36     8  number of transitions
+//       44   8*n  time of each transition, seconds (double)
+//
+// All fields are little-endian.
+struct QiSaleaeDigitalHeader {
+    U32    mVersion;
+    U32    mInitialState;
+    double mBeginTime;
+    double mEndTime;
+    U64    mTransitionCount;
+};
+
+// Edge source over a Logic 2 digital binary export. The file is memory-mapped a window at a time and each transition
+// time is converted to a sample number (counted from the begin time) as the decoder reaches it, so captures of any
+// size are decoded without loading them. Logic 2 exports one file per channel.
+//
+// The source can also drop glitches: with a min_pulse_width, it yields the same edges as QiDeglitchEdges() would
+// leave in the capture, including while the decoder skips edges in bulk.
+class QiSaleaeEdgeSource : public QiEdgeSource {
+  public:
+    QiSaleaeEdgeSource();
+    virtual ~QiSaleaeEdgeSource();
+
+    bool Open(const char* path, U32 sample_rate_hz, U64 min_pulse_width, std::string& error);
+    void Close();
+
+    const QiSaleaeDigitalHeader& GetHeader() const { return mHeader; }
+
+    virtual bool AdvanceToNextEdge();
+    virtual U64  GetSampleNumber();
+    virtual bool IsNextEdgeWithin(U64 distance);
+    virtual bool AdvanceToNextIdleEdge(U64 min_interval, bool* skipped);
+    virtual bool PeekNextEdge(U64* location);
+
+    U64 GetRejectedEdgeCount() const { return mRejectedEdgeCount; }
+
+    // The file could not be mapped part way through; the source stopped early.
+    bool HasError() const { return mError; }
+
+  protected:
+    bool ReadSample(U64 index, U64* sample);
+    bool FindNextEdge();
+
+  protected:
+    QiMappedFile          mFile;
+    QiSaleaeDigitalHeader mHeader;
+    double                mSampleRateHz;
+    U64                   mMinPulseWidth;
+
+    const U8* mTimes;         // mapped transition times, starting with transition mTimesFirst
+    U64       mTimesFirst;
+    U64       mTimesCount;
+
+    bool mLastReadValid;
+    U64  mLastReadIndex;
+    U64  mLastReadSample;
+
+    bool mStarted;    // mIndex is valid
+    U64  mIndex;      // transition of the current edge
+    U64  mSample;
+    bool mNextFound;    // the next edge that is not dropped as a glitch is known
+    U64  mNextIndex;
+    U64  mNextSample;
+
+    U64  mRejectedEdgeCount;
+    bool mError;
+};
+
+#endif    // QI_SALEAE_FILE_H
@@ -0,0 +1,273 @@
+#include "QiSegmentDecoder.h"
+
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+// Segments are cut to give each thread this many on average, for load balancing, but no smaller than the minimum
+// segment size.
+static const U64 kSegmentsPerThread = 16;
+
+void QiFindSegments(const U64* edges, U64 count, U64 gap, U64 min_edges, std::vector<U64>& starts) {
+    starts.clear();
+    if (count == 0)
+        return;
+    if (min_edges == 0)
+        min_edges = 1;
+
+    starts.push_back(0);
+    for (U64 i = min_edges; i < count; i++) {
+        if (edges[i] - edges[i - 1] > gap) {
+            starts.push_back(i);
+            i += min_edges - 1;
+        }
+    }
+}
+
+// Records the decoder events of a segment, to be replayed in capture order.
+class SegmentRecorder : public QiDecoderListener {
+  public:
+    enum EventType {
+        EventMarker,
+        EventByte,
+        EventSyncLost,
+    };
+
+    struct Event {
+        EventType    mType;
+        QiMarkerType mMarker;
+        U64          mLocation;
+    };
+
+    virtual void OnMarker(U64 location, QiMarkerType marker) {
+        Event event = { EventMarker, marker, location };
+        mEvents.push_back(event);
+    }
+
+    virtual void OnByte(const QiByte& byte) {
+        Event event = { EventByte, QiMarkerDot, byte.mBitEdges[0] };
+        mEvents.push_back(event);
+        mBytes.push_back(byte);
+    }
+
+    virtual void OnSyncLost() {
+        Event event = { EventSyncLost, QiMarkerDot, 0 };
+        mEvents.push_back(event);
+    }
+
+    void Replay(QiDecoderListener* listener) const {
+        size_t byte_index = 0;
+        for (size_t i = 0; i < mEvents.size(); i++) {
+            const Event& event = mEvents[i];
+            switch (event.mType) {
+            case EventMarker:
+                listener->OnMarker(event.mLocation, event.mMarker);
+                break;
+            case EventByte:
+                listener->OnByte(mBytes[byte_index++]);
+                break;
+            case EventSyncLost:
+                listener->OnSyncLost();
+                break;
+            }
+        }
+    }
+
+    void Clear() {
+        std::vector<Event>().swap(mEvents);
+        std::vector<QiByte>().swap(mBytes);
+    }
+
+  private:
+    std::vector<Event>  mEvents;
+    std::vector<QiByte> mBytes;
+};
+
+// Segments queued for one worker. The owner takes them from the front, in capture order, so that the results can be
+// passed on early; other workers steal from the back.
+class SegmentQueue {
+  public:
+    void Push(U64 segment) { mSegments.push_back(segment); }
+
+    bool PopFront(U64* segment) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mSegments.empty())
+            return false;
+        *segment = mSegments.front();
+        mSegments.pop_front();
+        return true;
+    }
+
+    bool StealBack(U64* segment) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mSegments.empty())
+            return false;
+        *segment = mSegments.back();
+        mSegments.pop_back();
+        return true;
+    }
+
+  private:
+    std::mutex      mMutex;
+    std::deque<U64> mSegments;
+};
+
+// State shared by the workers and the thread that replays the results.
+struct SegmentJob {
+    const U64*              mEdges;
+    U64                     mCount;
+    const std::vector<U64>* mStarts;
+    U32                     mSampleRateHz;
+    U32                     mToleranceDivisor;
+
+    std::vector<SegmentQueue>    mQueues;
+    std::vector<SegmentRecorder> mResults;
+    std::vector<QiDecoderStats>  mStats;
+    std::vector<bool>            mDone;
+    std::mutex                   mDoneMutex;
+    std::condition_variable      mDoneChanged;
+
+    SegmentJob(U64 segment_count, U32 thread_count) : mQueues(thread_count), mResults(segment_count), mStats(segment_count), mDone(segment_count) {}
+};
+
+static void DecodeSegment(SegmentJob& job, U64 segment) {
+    const std::vector<U64>& starts = *job.mStarts;
+
+    // A segment includes the edge after the gap that ends it; the decoder ends any packet in progress on that edge,
+    // and the next segment starts from it
+    U64 start = starts[segment];
+    U64 end   = (segment + 1 < starts.size()) ? starts[segment + 1] + 1 : job.mCount;
+
+    QiDecoder decoder;
+    decoder.SetListener(&job.mResults[segment]);
+    decoder.Reset(job.mSampleRateHz);
+    decoder.SetTrackingTolerance(job.mToleranceDivisor);
+    decoder.Run(job.mEdges + start, end - start);
+    job.mStats[segment] = decoder.GetStats();
+
+    std::lock_guard<std::mutex> lock(job.mDoneMutex);
+    job.mDone[segment] = true;
+    job.mDoneChanged.notify_one();
+}
+
+static void Worker(SegmentJob& job, U32 worker) {
+    U32 thread_count = U32(job.mQueues.size());
+    U64 segment;
+    for (;;) {
+        if (job.mQueues[worker].PopFront(&segment) == false) {
+            // Out of work; steal from the others. All segments are queued up front, so once every queue is empty
+            // there is nothing left to do.
+            bool stolen = false;
+            for (U32 i = 1; (i < thread_count) && (stolen == false); i++)
+                stolen = job.mQueues[(worker + i) % thread_count].StealBack(&segment);
+            if (stolen == false)
+                return;
+        }
+        DecodeSegment(job, segment);
+    }
+}
+
+QiSegmentDecoder::QiSegmentDecoder()
+    : mListener(nullptr)
+    , mSampleRateHz(0)
+    , mToleranceDivisor(4)
+    , mMinSegmentEdges(kQiMinSegmentEdges)
+    , mSegmentCount(0)
+    , mThreadCount(0) {
+    memset(&mStats, 0, sizeof(mStats));
+}
+
+QiSegmentDecoder::~QiSegmentDecoder() {}
+
+void QiSegmentDecoder::SetListener(QiDecoderListener* listener) {
+    mListener = listener;
+}
+
+void QiSegmentDecoder::Reset(U32 sample_rate_hz) {
+    mSampleRateHz = sample_rate_hz;
+}
+
+void QiSegmentDecoder::SetTrackingTolerance(U32 tolerance_divisor) {
+    mToleranceDivisor = tolerance_divisor;
+}
+
+void QiSegmentDecoder::SetMinSegmentEdges(U64 min_edges) {
+    mMinSegmentEdges = min_edges;
+}
+
+void QiSegmentDecoder::Run(const U64* edges, U64 count, U32 thread_count) {
+    if (thread_count == 0)
+        thread_count = std::thread::hardware_concurrency();
+    if (thread_count == 0)
+        thread_count = 1;
+
+    QiDecoder decoder;
+    decoder.SetListener(mListener);
+    decoder.Reset(mSampleRateHz);
+    decoder.SetTrackingTolerance(mToleranceDivisor);
+
+    std::vector<U64> starts;
+    if (thread_count > 1) {
+        U64 min_edges = count / (U64(thread_count) * kSegmentsPerThread);
+        QiFindSegments(edges, count, decoder.GetSegmentGap(), (min_edges > mMinSegmentEdges) ? min_edges : mMinSegmentEdges, starts);
+    }
+
+    mSegmentCount = starts.size();
+    mThreadCount  = (U64(thread_count) > mSegmentCount) ? U32(mSegmentCount) : thread_count;
+    if (mThreadCount <= 1) {
+        // Nothing to split; decode in place without buffering
+        mSegmentCount = 1;
+        mThreadCount  = 1;
+        decoder.Run(edges, count);
+        mStats = decoder.GetStats();
+        return;
+    }
+
+    SegmentJob job(mSegmentCount, mThreadCount);
+    job.mEdges            = edges;
+    job.mCount            = count;
+    job.mStarts           = &starts;
+    job.mSampleRateHz     = mSampleRateHz;
+    job.mToleranceDivisor = mToleranceDivisor;
+
+    // Deal the segments out round-robin, so that the workers progress through the capture together
+    for (U64 i = 0; i < mSegmentCount; i++)
+        job.mQueues[i % mThreadCount].Push(i);
+
+    std::vector<std::thread> workers;
+    for (U32 i = 0; i < mThreadCount; i++)
+        workers.push_back(std::thread(Worker, std::ref(job), i));
+
+    // Pass the results on in capture order as they become available
+    for (U64 i = 0; i < mSegmentCount; i++) {
+        {
+            std::unique_lock<std::mutex> lock(job.mDoneMutex);
+            while (job.mDone[i] == false)
+                job.mDoneChanged.wait(lock);
+        }
+        if (mListener != nullptr)
+            job.mResults[i].Replay(mListener);
+        job.mResults[i].Clear();
+    }
+
+    for (U32 i = 0; i < mThreadCount; i++)
+        workers[i].join();
+
+    memset(&mStats, 0, sizeof(mStats));
+    for (U64 i = 0; i < mSegmentCount; i++) {
+        const QiDecoderStats& stats = job.mStats[i];
+        mStats.mEdges += stats.mEdges;
+        mStats.mIdleSkips += stats.mIdleSkips;
+        mStats.mGlitchEdges += stats.mGlitchEdges;
+        mStats.mSyncAttempts += stats.mSyncAttempts;
+        mStats.mSyncs += stats.mSyncs;
+        mStats.mBytes += stats.mBytes;
+        mStats.mParityErrors += stats.mParityErrors;
+        mStats.mStopErrors += stats.mStopErrors;
+    }
+
+    // Neighbouring segments share the edge after the gap between them
+    mStats.mEdges -= mSegmentCount - 1;
+}
@@ -0,0 +1,53 @@
+#ifndef QI_SEGMENT_DECODER_H
+#define QI_SEGMENT_DECODER_H
+
+#include <vector>
+
+#include "QiDecoder.h"
+
+// Splits an in-memory capture into segments of at least min_edges edges, at intervals longer than `gap` samples.
+// starts receives the index of the first edge of each segment, starting with 0.
+void QiFindSegments(const U64* edges, U64 count, U64 gap, U64 min_edges, std::vector<U64>& starts);
+
+// Default for QiSegmentDecoder::SetMinSegmentEdges(): large enough that the per-segment overhead stays negligible.
+static const U64 kQiMinSegmentEdges = 1 << 16;
+
+// Decodes an in-memory capture on several threads. The decoder restarts after every gap of more than
+// QiDecoder::GetSegmentGap() (see kQiSegmentGapBits), so the segments between such gaps are decoded independently,
+// by worker threads that steal segments from each other's queues when they run out. The events of each segment are
+// buffered and passed on to the listener in capture order, on the calling thread; they are the same as those of
+// QiDecoder::Run() over the whole capture.
+class QiSegmentDecoder {
+  public:
+    QiSegmentDecoder();
+    ~QiSegmentDecoder();
+
+    void SetListener(QiDecoderListener* listener);
+    void Reset(U32 sample_rate_hz);
+    void SetTrackingTolerance(U32 tolerance_divisor);
+
+    // Segments are not cut smaller than this, even for more balance between the threads; tests lower it to split
+    // small captures into many segments.
+    void SetMinSegmentEdges(U64 min_edges);
+
+    // thread_count 0 uses one thread per CPU.
+    void Run(const U64* edges, U64 count, U32 thread_count);
+
+    // Number of segments and worker threads of the last Run().
+    U64 GetSegmentCount() const { return mSegmentCount; }
+    U32 GetThreadCount() const { return mThreadCount; }
+
+    // Decoder counters of the last Run(), summed over the segments; the same as those of a single QiDecoder.
+    const QiDecoderStats& GetStats() const { return mStats; }
+
+  private:
+    QiDecoderListener* mListener;
+    U32                mSampleRateHz;
+    U32                mToleranceDivisor;
+    U64                mMinSegmentEdges;
+    U64                mSegmentCount;
+    U32                mThreadCount;
+    QiDecoderStats     mStats;
+};
+
+#endif    // QI_SEGMENT_DECODER_H
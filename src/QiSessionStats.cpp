@@ -0,0 +1,284 @@
+#include "QiSessionStats.h"
+
+#include <cstring>
+#include <string>
+
+// Time per point of the received power series until it first fills up.
+static const U32 kPowerPointInitialMs = 1000;
+
+static void ClearSummary(QiSessionSummary& summary) {
+    memset(&summary, 0, sizeof(summary));
+    summary.mControlErrorMin  = 127;
+    summary.mControlErrorMax  = -128;
+    summary.mReceivedPowerMin = ~U32(0);
+}
+
+QiSessionStats::QiSessionStats() {
+    Reset(0);
+}
+
+QiSessionStats::~QiSessionStats() {}
+
+void QiSessionStats::Reset(U32 sample_rate_hz) {
+    mSampleRateHz = sample_rate_hz;
+    mSessionGap   = U64(kQiSessionGapMs) * sample_rate_hz / 1000;
+    mLastCeStart  = 0;
+
+    ClearSummary(mSession);
+    mSessions.clear();
+
+    memset(mControlErrorHistogram, 0, sizeof(mControlErrorHistogram));
+    memset(mCeIntervalHistogram, 0, sizeof(mCeIntervalHistogram));
+
+    memset(mPowerSeries, 0, sizeof(mPowerSeries));
+    mPowerPointCount  = 0;
+    mPowerPointWidth  = U64(kPowerPointInitialMs) * sample_rate_hz / 1000;
+    mPowerSeriesStart = 0;
+    if (mPowerPointWidth == 0)
+        mPowerPointWidth = 1;
+}
+
+void QiSessionStats::StartSession(U64 location) {
+    ClearSummary(mSession);
+    mSession.mStart = location;
+    mSession.mEnd   = location;
+    mLastCeStart    = 0;
+}
+
+void QiSessionStats::EndSession() {
+    if (mSession.mPackets > 0)
+        mSessions.push_back(mSession);
+    ClearSummary(mSession);
+}
+
+void QiSessionStats::Finish() {
+    EndSession();
+}
+
+bool QiSessionStats::AddByte(const QiByte& byte) {
+    const U32 bit_count = 11;
+    bool      ended     = false;
+
+    if (mSession.mBytes == 0) {
+        StartSession(byte.mBitEdges[0]);
+    } else if (byte.mBitEdges[0] - mSession.mEnd > mSessionGap) {
+        ended = (mSession.mPackets > 0);
+        EndSession();
+        StartSession(byte.mBitEdges[0]);
+    }
+
+    mSession.mEnd = byte.mBitEdges[bit_count];
+    mSession.mBytes++;
+    if (byte.mParityValid == false)
+        mSession.mParityErrors++;
+    if (byte.mStopValid == false)
+        mSession.mStopErrors++;
+    return ended;
+}
+
+bool QiSessionStats::AddPacket(const QiPacket& packet) {
+    mSession.mPackets++;
+    if (packet.mChecksumValid == false) {
+        mSession.mChecksumErrors++;
+        return false;
+    }
+
+    switch (packet.mHeader) {
+    case QiHeaderControlError: {
+        S32 control_error = QiControlError(packet);
+        mControlErrorHistogram[control_error + 128]++;
+        mSession.mControlErrors++;
+        mSession.mControlErrorSum += control_error;
+        if (mSession.mControlErrorMin > control_error)
+            mSession.mControlErrorMin = control_error;
+        if (mSession.mControlErrorMax < control_error)
+            mSession.mControlErrorMax = control_error;
+
+        if (mLastCeStart != 0) {
+            U64 interval = packet.mStart - mLastCeStart;
+            U64 bin      = interval * 1000 / (U64(mSampleRateHz) * kQiCeIntervalBinMs);
+            mCeIntervalHistogram[(bin < kQiCeIntervalBins) ? bin : kQiCeIntervalBins - 1]++;
+            mSession.mCeIntervals++;
+            mSession.mCeIntervalSum += interval;
+            if (mSession.mCeIntervalMax < interval)
+                mSession.mCeIntervalMax = interval;
+        }
+        mLastCeStart = packet.mStart;
+        break;
+    }
+    case QiHeaderReceivedPower8:
+    case QiHeaderReceivedPower16: {
+        U32 received_power = QiReceivedPower(packet);
+        AddReceivedPower(packet.mStart, received_power);
+        mSession.mReceivedPowers++;
+        mSession.mReceivedPowerSum += received_power;
+        if (mSession.mReceivedPowerMin > received_power)
+            mSession.mReceivedPowerMin = received_power;
+        if (mSession.mReceivedPowerMax < received_power)
+            mSession.mReceivedPowerMax = received_power;
+        break;
+    }
+    case QiHeaderEndPowerTransfer:
+        mSession.mEndPowerTransfer = true;
+        mSession.mEndReason        = packet.mMessage[0];
+        EndSession();
+        return true;
+    default:
+        break;
+    }
+    return false;
+}
+
+void QiSessionStats::AddReceivedPower(U64 location, U32 value) {
+    if (mPowerPointCount == 0)
+        mPowerSeriesStart = location;
+
+    U64 index = (location - mPowerSeriesStart) / mPowerPointWidth;
+    while (index >= kQiPowerSeriesPoints) {
+        // Halve the resolution: merge every pair of points into one
+        for (U32 i = 0; i < kQiPowerSeriesPoints / 2; i++) {
+            QiPowerPoint        merged = mPowerSeries[2 * i];
+            const QiPowerPoint& second = mPowerSeries[2 * i + 1];
+            if (merged.mCount == 0) {
+                merged = second;
+            } else if (second.mCount > 0) {
+                merged.mCount += second.mCount;
+                merged.mSum += second.mSum;
+                merged.mMin = (merged.mMin < second.mMin) ? merged.mMin : second.mMin;
+                merged.mMax = (merged.mMax > second.mMax) ? merged.mMax : second.mMax;
+            }
+            mPowerSeries[i] = merged;
+        }
+        memset(&mPowerSeries[kQiPowerSeriesPoints / 2], 0, sizeof(mPowerSeries) / 2);
+        mPowerPointCount = (mPowerPointCount + 1) / 2;
+        mPowerPointWidth *= 2;
+        index = (location - mPowerSeriesStart) / mPowerPointWidth;
+    }
+
+    QiPowerPoint& point = mPowerSeries[index];
+    if (point.mCount == 0) {
+        point.mMin = value;
+        point.mMax = value;
+    }
+    point.mCount++;
+    point.mSum += value;
+    point.mMin = (point.mMin < value) ? point.mMin : value;
+    point.mMax = (point.mMax > value) ? point.mMax : value;
+    if (mPowerPointCount < index + 1)
+        mPowerPointCount = U32(index + 1);
+}
+
+static void WriteSession(FILE* file, U32 coil, U32 index, const QiSessionSummary& session, U32 sample_rate_hz,
+                         U64 trigger_sample, const char* end) {
+    double sample_period = 1.0 / double(sample_rate_hz);
+    double ms_per_sample = 1000.0 * sample_period;
+
+    fprintf(file,
+            "%u,%u,%.9f,%.6f,%llu,%llu,%llu,%llu,%llu,%.6f,%.6f,",
+            coil,
+            index,
+            double(S64(session.mStart - trigger_sample)) * sample_period,
+            double(session.mEnd - session.mStart) * sample_period,
+            session.mBytes,
+            session.mParityErrors,
+            session.mStopErrors,
+            session.mPackets,
+            session.mChecksumErrors,
+            (session.mBytes > 0) ? double(session.mParityErrors) / double(session.mBytes) : 0.0,
+            (session.mPackets > 0) ? double(session.mChecksumErrors) / double(session.mPackets) : 0.0);
+
+    // Columns without a value are left empty
+    if (session.mControlErrors > 0)
+        fprintf(file,
+                "%llu,%d,%d,%.3f,",
+                session.mControlErrors,
+                session.mControlErrorMin,
+                session.mControlErrorMax,
+                double(session.mControlErrorSum) / double(session.mControlErrors));
+    else
+        fprintf(file, "0,,,,");
+    if (session.mCeIntervals > 0)
+        fprintf(file,
+                "%.3f,%.3f,",
+                double(session.mCeIntervalSum) / double(session.mCeIntervals) * ms_per_sample,
+                double(session.mCeIntervalMax) * ms_per_sample);
+    else
+        fprintf(file, ",,");
+    if (session.mReceivedPowers > 0)
+        fprintf(file,
+                "%llu,%u,%u,%.3f,",
+                session.mReceivedPowers,
+                session.mReceivedPowerMin,
+                session.mReceivedPowerMax,
+                double(session.mReceivedPowerSum) / double(session.mReceivedPowers));
+    else
+        fprintf(file, "0,,,,");
+    fprintf(file, "%s\n", end);
+}
+
+bool QiWriteSessionStats(const char* path, U64 trigger_sample, const QiSessionStats* const* coils, U32 coil_count) {
+    FILE* file = fopen(path, "w");
+    if (file == nullptr)
+        return false;
+
+    fprintf(file,
+            "# sessions\n"
+            "Coil,Session,Time [s],Duration [s],Bytes,Parity Errors,Stop Errors,Packets,Checksum Errors,"
+            "Parity Error Rate,Checksum Error Rate,CE Packets,CE Min,CE Max,CE Mean,CE Interval Mean [ms],"
+            "CE Interval Max [ms],RP Packets,RP Min,RP Max,RP Mean,End\n");
+    for (U32 coil = 0; coil < coil_count; coil++) {
+        const QiSessionStats&                stats    = *coils[coil];
+        const std::vector<QiSessionSummary>& sessions = stats.GetSessions();
+        for (U32 i = 0; i < sessions.size(); i++) {
+            const QiSessionSummary& session = sessions[i];
+            std::string             end     = "Timeout";
+            if (session.mEndPowerTransfer)
+                end = std::string("EPT ") + QiEndPowerTransferReason(session.mEndReason);
+            WriteSession(file, coil, i, session, stats.GetSampleRate(), trigger_sample, end.c_str());
+        }
+        if (stats.GetSession().mPackets > 0)
+            WriteSession(file, coil, U32(sessions.size()), stats.GetSession(), stats.GetSampleRate(), trigger_sample, "Open");
+    }
+
+    fprintf(file, "\n# control_error_histogram\nCoil,Control Error,Count\n");
+    for (U32 coil = 0; coil < coil_count; coil++) {
+        const U64* histogram = coils[coil]->GetControlErrorHistogram();
+        for (U32 i = 0; i < 256; i++) {
+            if (histogram[i] > 0)
+                fprintf(file, "%u,%d,%llu\n", coil, S32(i) - 128, histogram[i]);
+        }
+    }
+
+    fprintf(file, "\n# ce_interval_histogram\nCoil,Interval [ms],Count\n");
+    for (U32 coil = 0; coil < coil_count; coil++) {
+        const U64* histogram = coils[coil]->GetCeIntervalHistogram();
+        for (U32 i = 0; i < kQiCeIntervalBins; i++) {
+            if (histogram[i] > 0)
+                fprintf(file, "%u,%u,%llu\n", coil, i * kQiCeIntervalBinMs, histogram[i]);
+        }
+    }
+
+    fprintf(file, "\n# received_power\nCoil,Time [s],Duration [s],Count,Min,Max,Mean\n");
+    for (U32 coil = 0; coil < coil_count; coil++) {
+        const QiSessionStats& stats         = *coils[coil];
+        const QiPowerPoint*   series        = stats.GetPowerSeries();
+        double                sample_period = 1.0 / double(stats.GetSampleRate());
+        for (U32 i = 0; i < stats.GetPowerPointCount(); i++) {
+            if (series[i].mCount == 0)
+                continue;
+            U64 start = stats.GetPowerSeriesStart() + U64(i) * stats.GetPowerPointWidth();
+            fprintf(file,
+                    "%u,%.6f,%.6f,%llu,%u,%u,%.3f\n",
+                    coil,
+                    double(S64(start - trigger_sample)) * sample_period,
+                    double(stats.GetPowerPointWidth()) * sample_period,
+                    series[i].mCount,
+                    series[i].mMin,
+                    series[i].mMax,
+                    double(series[i].mSum) / double(series[i].mCount));
+        }
+    }
+
+    bool failed = (ferror(file) != 0);
+    return (fclose(file) == 0) && (failed == false);
+}
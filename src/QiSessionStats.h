@@ -0,0 +1,128 @@
+#ifndef QI_SESSION_STATS_H
+#define QI_SESSION_STATS_H
+
+#include <cstdio>
+#include <vector>
+
+#include "QiPacket.h"
+
+// A power transfer session ends with an End Power Transfer packet, or when no packet is received for longer than the
+// transmitter waits for a Control Error packet before it removes power (tTIMEOUT).
+static const U32 kQiSessionGapMs = 1800;
+
+// Control Error intervals are counted in bins of kQiCeIntervalBinMs; the last bin also counts all longer intervals.
+static const U32 kQiCeIntervalBinMs = 2;
+static const U32 kQiCeIntervalBins  = 256;
+
+// Points of the received power series. When the series is full, pairs of points are merged and the time per point
+// doubles, so a capture of any length is summarized by at most this many points.
+static const U32 kQiPowerSeriesPoints = 512;
+
+// Counters of one session. Control Error and Received Power values are taken from packets with a valid checksum only.
+struct QiSessionSummary {
+    U64 mStart;    // first sample of the session's first byte
+    U64 mEnd;      // last edge of its last byte
+
+    U64 mBytes;
+    U64 mParityErrors;
+    U64 mStopErrors;
+    U64 mPackets;
+    U64 mChecksumErrors;
+
+    U64 mControlErrors;    // number of Control Error packets
+    S64 mControlErrorSum;
+    S32 mControlErrorMin;
+    S32 mControlErrorMax;
+
+    U64 mCeIntervals;    // number of intervals between Control Error packets, in samples
+    U64 mCeIntervalSum;
+    U64 mCeIntervalMax;
+
+    U64 mReceivedPowers;    // number of Received Power packets
+    U64 mReceivedPowerSum;
+    U32 mReceivedPowerMin;
+    U32 mReceivedPowerMax;
+
+    bool mEndPowerTransfer;    // ended by an End Power Transfer packet, with this reason code
+    U8   mEndReason;
+};
+
+// One point of the received power series; mCount is 0 if no Received Power packet fell into its time.
+struct QiPowerPoint {
+    U64 mCount;
+    U64 mSum;
+    U32 mMin;
+    U32 mMax;
+};
+
+// Aggregates the decoded bytes and packets of one channel into per-session summaries, a histogram of the Control
+// Error values, a histogram of the intervals between Control Error packets and a downsampled received power series.
+// Apart from one small summary per completed session, the memory used does not grow with the length of the capture.
+class QiSessionStats {
+  public:
+    QiSessionStats();
+    ~QiSessionStats();
+
+    void Reset(U32 sample_rate_hz);
+
+    // Returns true if the byte starts a new session after a gap, which completed the previous one.
+    bool AddByte(const QiByte& byte);
+
+    // Returns true if the packet completed the session.
+    bool AddPacket(const QiPacket& packet);
+
+    // Completes the session in progress, e.g. at the end of the capture.
+    void Finish();
+
+    // The session in progress; mPackets is 0 if there is none.
+    const QiSessionSummary& GetSession() const { return mSession; }
+    // Completed sessions with at least one packet, in order.
+    const std::vector<QiSessionSummary>& GetSessions() const { return mSessions; }
+
+    // Totals over all sessions.
+    const U64* GetControlErrorHistogram() const { return mControlErrorHistogram; }    // by value + 128
+    const U64* GetCeIntervalHistogram() const { return mCeIntervalHistogram; }
+
+    // The received power series: GetPowerPointCount() points of GetPowerPointWidth() samples each, the first one
+    // starting at GetPowerSeriesStart().
+    U32                 GetPowerPointCount() const { return mPowerPointCount; }
+    U64                 GetPowerPointWidth() const { return mPowerPointWidth; }
+    U64                 GetPowerSeriesStart() const { return mPowerSeriesStart; }
+    const QiPowerPoint* GetPowerSeries() const { return mPowerSeries; }
+
+    U32 GetSampleRate() const { return mSampleRateHz; }
+
+  private:
+    void StartSession(U64 location);
+    void EndSession();
+    void AddReceivedPower(U64 location, U32 value);
+
+  private:
+    U32 mSampleRateHz;
+    U64 mSessionGap;    // samples
+    U64 mLastCeStart;   // start of the session's last Control Error packet; 0 before the first
+
+    QiSessionSummary              mSession;
+    std::vector<QiSessionSummary> mSessions;
+
+    U64 mControlErrorHistogram[256];
+    U64 mCeIntervalHistogram[kQiCeIntervalBins];
+
+    QiPowerPoint mPowerSeries[kQiPowerSeriesPoints];
+    U32          mPowerPointCount;
+    U64          mPowerPointWidth;
+    U64          mPowerSeriesStart;
+};
+
+// Writes the aggregates of one or more channels (the coils of a multi-coil capture) as csv: four tables, each after a
+// "# name" line and separated by an empty line.
+//
+//   # sessions                   one row per session, including the one in progress
+//   # control_error_histogram    Control Error value and count, for the values that occurred
+//   # ce_interval_histogram      interval bin in ms and count, for the bins that are not empty
+//   # received_power             one row per point of the series that has a Received Power packet
+//
+// Every row starts with the coil. Times are in seconds from the trigger sample.
+bool QiWriteSessionStats(const char* path, U64 trigger_sample, const QiSessionStats* const* coils, U32 coil_count);
+
+#endif    // QI_SESSION_STATS_H
@@ -1,11 +1,15 @@
 #include "QiSimulationDataGenerator.h"
-#include "QiAnalyzerSettings.h"
 
 #include <AnalyzerHelpers.h>
 
-static const U32 kBitRate = 2000;
+// Short sessions, so that a simulation capture shows every phase of the power transfer
+static const U32 kControlPackets = 20;
+static const U32 kSessionGapMs   = 100;
 
-QiSimulationDataGenerator::QiSimulationDataGenerator() : mSettings(nullptr), mSimulationSampleRateHz(0), mT(0), mSimValue(0) {}
+// Further coils start this much later, so that they do not all carry the same packets at the same time
+static const U32 kCoilOffsetMs = 37;
+
+QiSimulationDataGenerator::QiSimulationDataGenerator() : mSettings(nullptr), mSimulationSampleRateHz(0), mCoilCount(0) {}
 
 QiSimulationDataGenerator::~QiSimulationDataGenerator() {}
 
@@ -13,16 +17,23 @@ void QiSimulationDataGenerator::Initialize(U32 simulation_sample_rate, QiAnalyze
     mSimulationSampleRateHz = simulation_sample_rate;
     mSettings               = settings;
 
-    mQiSimulationData.SetChannel(mSettings->mInputChannel);
-    mQiSimulationData.SetSampleRate(simulation_sample_rate);
-    mQiSimulationData.SetInitialBitState(BIT_LOW);
-
-    double half_period = 1.0 / double(kBitRate * 2);
-    half_period *= 1000000.0;
-    mT        = UsToSamples(half_period);
-    mSimValue = 1;
-
-    mQiSimulationData.Advance(U32(mT * 8));
+    Channel channels[kQiMaxCoils];
+    mCoilCount = mSettings->GetCoilChannels(channels);
+    for (U32 i = 0; i < mCoilCount; i++) {
+        Coil& coil           = mCoils[i];
+        coil.mSimulationData = mSimulationChannels.Add(channels[i], simulation_sample_rate, BIT_LOW);
+
+        QiTrafficSettings traffic;
+        traffic.mSampleRateHz   = simulation_sample_rate;
+        traffic.mSeed           = i + 1;
+        traffic.mControlPackets = kControlPackets;
+        traffic.mSessionGapMs   = kSessionGapMs;
+        coil.mTraffic.Reset(traffic);
+
+        coil.mEdges.clear();
+        coil.mEdgeIndex = 0;
+        coil.mOffset    = U64(i) * kCoilOffsetMs * simulation_sample_rate / 1000;
+    }
 }
 
 U32 QiSimulationDataGenerator::GenerateSimulationData(U64                           largest_sample_requested,
@@ -31,46 +42,21 @@ U32 QiSimulationDataGenerator::GenerateSimulationData(U64
     U64 adjusted_largest_sample_requested =
         AnalyzerHelpers::AdjustSimulationTargetSample(largest_sample_requested, sample_rate, mSimulationSampleRateHz);
 
-    while (mQiSimulationData.GetCurrentSampleNumber() < adjusted_largest_sample_requested) {
-        // preamble of 11-25 1-bits for synchronization
-        for (U32 i = 0; i < 25; ++i)
-            SimWriteBit(1);
-        SimWriteByte(mSimValue++);
-        SimWriteByte(mSimValue++);
-        SimWriteByte(mSimValue++);
-        mQiSimulationData.Advance(U32(mT * 8));
+    for (U32 i = 0; i < mCoilCount; i++) {
+        Coil& coil = mCoils[i];
+        while (coil.mSimulationData->GetCurrentSampleNumber() < adjusted_largest_sample_requested) {
+            if (coil.mEdgeIndex == coil.mEdges.size()) {
+                coil.mEdges.clear();
+                coil.mEdgeIndex = 0;
+                coil.mTraffic.AddNextPacket(coil.mEdges);
+            }
+
+            U64 edge = coil.mEdges[coil.mEdgeIndex++] + coil.mOffset;
+            coil.mSimulationData->Advance(U32(edge - coil.mSimulationData->GetCurrentSampleNumber()));
+            coil.mSimulationData->Transition();
+        }
     }
 
-    *simulation_channel = &mQiSimulationData;
-    return 1;
-}
-
-U64 QiSimulationDataGenerator::UsToSamples(U64 us) {
-    return (mSimulationSampleRateHz * us) / 1000000;
-}
-
-U64 QiSimulationDataGenerator::UsToSamples(double us) {
-    return U64((mSimulationSampleRateHz * us) / 1000000.0);
-}
-
-U64 QiSimulationDataGenerator::SamplesToUs(U64 samples) {
-    return (samples * 1000000) / mSimulationSampleRateHz;
-}
-
-void QiSimulationDataGenerator::SimWriteByte(U64 value) {
-    U32 bits_per_xfer = 11;
-
-    for (U32 i = 0; i < bits_per_xfer; ++i) {
-        SimWriteBit((value >> i) & 0x1);
-    }
-}
-
-void QiSimulationDataGenerator::SimWriteBit(U32 bit) {
-    BitState start_bit_state = mQiSimulationData.GetCurrentBitState();
-    mQiSimulationData.Transition();
-    mQiSimulationData.Advance(U32(mT));
-    if (bit == 1) {
-        mQiSimulationData.Transition();
-    }
-    mQiSimulationData.Advance(U32(mT));
+    *simulation_channel = mSimulationChannels.GetArray();
+    return mSimulationChannels.GetCount();
 }
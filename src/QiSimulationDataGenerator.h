@@ -3,7 +3,10 @@
 
 #include <SimulationChannelDescriptor.h>
 #include <string>
-class QiAnalyzerSettings;
+#include <vector>
+
+#include "QiAnalyzerSettings.h"
+#include "QiTrafficGenerator.h"
 
 class QiSimulationDataGenerator {
   public:
@@ -19,17 +22,19 @@ class QiSimulationDataGenerator {
     QiAnalyzerSettings* mSettings;
     U32                 mSimulationSampleRateHz;
 
-    SimulationChannelDescriptor mQiSimulationData;
+    SimulationChannelDescriptorGroup mSimulationChannels;
 
   protected:
-    U64 UsToSamples(U64 us);
-    U64 UsToSamples(double us);
-    U64 SamplesToUs(U64 samples);
-
-    void SimWriteByte(U64 value);
-    void SimWriteBit(U32 bit);
-
-    U64 mT;
-    U64 mSimValue;
+    // Sessions of well-formed packets on every coil, each with its own seed; the edges of one packet at a time
+    struct Coil {
+        SimulationChannelDescriptor* mSimulationData;
+        QiTrafficGenerator           mTraffic;
+        std::vector<U64>             mEdges;
+        size_t                       mEdgeIndex;
+        U64                          mOffset;    // the coil's sessions start this many samples later
+    };
+
+    Coil mCoils[kQiMaxCoils];
+    U32  mCoilCount;
 };
-#endif    // QI_SIMULATION_DATA_GENERATOR
\ No newline at end of file
+#endif    // QI_SIMULATION_DATA_GENERATOR
@@ -0,0 +1,125 @@
+#include "QiTimingChecker.h"
+
+static const U32 kBitsPerByte = 11;
+
+// WPC limits: 11 to 25 preamble bits; tNEXT = 21 ms; tTERMINATE = 28 ms. The receivers this was written for send
+// Control Error packets at least every 250 ms.
+static const QiTimingRule kRules[kQiTimingRuleCount] = {
+    { "preamble", "Preamble", "bits", 11, 25 },
+    { "ping_to_id", "Ping to ID", "us", 0, 21000 },
+    { "packet_gap", "Packet Gap", "us", 0, 21000 },
+    { "ce_interval", "CE Interval", "us", 0, 250000 },
+    { "ept_to_removal", "EPT to Removal", "us", 0, 28000 },
+};
+
+const QiTimingRule& QiGetTimingRule(U32 rule) {
+    return kRules[rule];
+}
+
+QiTimingChecker::QiTimingChecker() {
+    Reset(0);
+}
+
+QiTimingChecker::~QiTimingChecker() {}
+
+void QiTimingChecker::Reset(U32 sample_rate_hz) {
+    mSampleRateHz = sample_rate_hz;
+    for (U32 i = 0; i < kQiTimingRuleCount; i++) {
+        mMin[i] = kRules[i].mDefaultMin;
+        mMax[i] = kRules[i].mDefaultMax;
+    }
+
+    mPhase       = PhaseNone;
+    mPrevEnd     = 0;
+    mEptEnd      = 0;
+    mLastCeStart = 0;
+    mHasLastCe   = false;
+}
+
+void QiTimingChecker::SetLimits(U32 rule, U32 min, U32 max) {
+    mMin[rule] = min;
+    mMax[rule] = max;
+}
+
+U64 QiTimingChecker::ToMicroseconds(U64 samples) const {
+    return U64(double(samples) * 1e6 / double(mSampleRateHz));
+}
+
+bool QiTimingChecker::Check(U32 rule, U64 value, U64 start, U64 end, QiTimingViolation* violation) const {
+    bool below = (mMin[rule] != 0) && (value < mMin[rule]);
+    bool above = (mMax[rule] != 0) && (value > mMax[rule]);
+    if ((below == false) && (above == false))
+        return false;
+
+    violation->mRule     = rule;
+    violation->mStart    = start;
+    violation->mEnd      = end;
+    violation->mValue    = value;
+    violation->mLimit    = above ? mMax[rule] : mMin[rule];
+    violation->mAboveMax = above;
+    return true;
+}
+
+U32 QiTimingChecker::AddPacket(const QiPacket& packet, QiTimingViolation* violations) {
+    U32 count = 0;
+
+    // The preamble starts its number of bits before the header, at the packet's average bit period
+    U64 bit_period     = (packet.mEnd - packet.mStart) / (kBitsPerByte * (packet.mSize + 2));
+    U64 preamble_start = packet.mStart - packet.mPreambleBits * bit_period;
+    if (Check(QiRulePreamble, packet.mPreambleBits, preamble_start, packet.mStart, &violations[count]))
+        count++;
+
+    U64 gap_start = (mPrevEnd < preamble_start) ? mPrevEnd : preamble_start;
+    U64 gap       = ToMicroseconds(preamble_start - gap_start);
+    mPrevEnd      = packet.mEnd;
+
+    // The header of a packet with a bad checksum can not be trusted to follow the phases
+    if (packet.mChecksumValid == false)
+        return count;
+
+    if (packet.mHeader == QiHeaderSignalStrength) {
+        // A new digital ping
+        mPhase     = PhasePing;
+        mHasLastCe = false;
+        return count;
+    }
+
+    switch (mPhase) {
+    case PhasePing:
+        if (Check(QiRulePingToId, gap, gap_start, preamble_start, &violations[count]))
+            count++;
+        mPhase = PhaseConfig;
+        break;
+    case PhaseConfig:
+        if (Check(QiRulePacketGap, gap, gap_start, preamble_start, &violations[count]))
+            count++;
+        break;
+    case PhaseEnded:
+        // Reported once; the session is over either way
+        if (Check(QiRuleEptToRemoval, ToMicroseconds(preamble_start - mEptEnd), mEptEnd, preamble_start, &violations[count])) {
+            count++;
+            mPhase = PhaseNone;
+        }
+        return count;
+    case PhaseNone:
+        if (packet.mHeader != QiHeaderControlError)
+            mPhase = PhaseConfig;
+        break;
+    case PhaseTransfer:
+        break;
+    }
+
+    if (packet.mHeader == QiHeaderControlError) {
+        if (mHasLastCe &&
+            Check(QiRuleCeInterval, ToMicroseconds(packet.mStart - mLastCeStart), mLastCeStart, packet.mStart, &violations[count]))
+            count++;
+        mPhase       = PhaseTransfer;
+        mLastCeStart = packet.mStart;
+        mHasLastCe   = true;
+    } else if (packet.mHeader == QiHeaderEndPowerTransfer) {
+        mPhase     = PhaseEnded;
+        mEptEnd    = packet.mEnd;
+        mHasLastCe = false;
+    }
+    return count;
+}
@@ -0,0 +1,78 @@
+#ifndef QI_TIMING_CHECKER_H
+#define QI_TIMING_CHECKER_H
+
+#include "QiPacket.h"
+
+// Timing rules of the WPC specification that can be checked on the receiver's packets alone.
+enum QiTimingRuleId {
+    QiRulePreamble,        // preamble 1-bits of every packet; packets with fewer than kQiMinPreambleBits are not decoded
+    QiRulePingToId,        // silence from the end of the Signal Strength packet to the ID packet's preamble (tNEXT)
+    QiRulePacketGap,       // silence between the other packets up to the first Control Error packet (tNEXT)
+    QiRuleCeInterval,      // start to start of consecutive Control Error packets
+    QiRuleEptToRemoval,    // time from an End Power Transfer packet to the next packet other than a Signal Strength
+                           // packet, which the receiver can only send while the transmitter still powers it (tTERMINATE)
+    kQiTimingRuleCount,
+};
+
+// Entry of the rule table. A limit of 0 is not checked.
+struct QiTimingRule {
+    const char* mName;     // as reported in the violations
+    const char* mTitle;    // for settings
+    const char* mUnit;     // "bits" or "us"
+    U32         mDefaultMin;
+    U32         mDefaultMax;
+};
+
+const QiTimingRule& QiGetTimingRule(U32 rule);
+
+// A measurement outside its rule's limits, over [mStart, mEnd).
+struct QiTimingViolation {
+    U32  mRule;
+    U64  mStart;
+    U64  mEnd;
+    U64  mValue;    // in the rule's unit
+    U32  mLimit;
+    bool mAboveMax;
+};
+
+// Applies the timing rules to each packet as it is decoded. Only the state of the current session is kept, so the
+// checker runs in constant memory however long the capture is.
+class QiTimingChecker {
+  public:
+    QiTimingChecker();
+    ~QiTimingChecker();
+
+    // Sets the rule table's default limits and forgets the previous packets.
+    void Reset(U32 sample_rate_hz);
+
+    void SetLimits(U32 rule, U32 min, U32 max);
+
+    // Checks the packet against the rules; fills violations, which must have room for kQiTimingRuleCount entries,
+    // and returns their number.
+    U32 AddPacket(const QiPacket& packet, QiTimingViolation* violations);
+
+  private:
+    enum Phase {
+        PhaseNone,        // no session, or the transmitter may have removed power after an End Power Transfer
+        PhasePing,        // after the Signal Strength packet
+        PhaseConfig,      // identification and configuration
+        PhaseTransfer,    // power transfer, from the first Control Error packet
+        PhaseEnded,       // after an End Power Transfer packet
+    };
+
+    bool Check(U32 rule, U64 value, U64 start, U64 end, QiTimingViolation* violation) const;
+    U64  ToMicroseconds(U64 samples) const;
+
+  private:
+    U32 mSampleRateHz;
+    U32 mMin[kQiTimingRuleCount];
+    U32 mMax[kQiTimingRuleCount];
+
+    Phase mPhase;
+    U64   mPrevEnd;        // last edge of the previous packet
+    U64   mEptEnd;         // last edge of the End Power Transfer packet, in PhaseEnded
+    U64   mLastCeStart;    // start of the last Control Error packet of the power transfer phase
+    bool  mHasLastCe;
+};
+
+#endif    // QI_TIMING_CHECKER_H
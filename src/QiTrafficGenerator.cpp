@@ -0,0 +1,434 @@
+#include "QiTrafficGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static const U32 kBitRate = 2000;
+
+static const U32 kMinPreambleBits = 11;
+static const U32 kMaxPreambleBits = 25;
+
+// Identification and configuration that the generated receivers report: version 1.2, 5 W, window size 8.
+static const U8 kVersion              = 0x12;
+static const U8 kConfiguration[]      = { 0x0A, 0x00, 0x00, 0x40, 0x00 };
+static const U8 kChargeComplete       = 0x01;
+static const S32 kInitialControlError = 20;
+
+// splitmix64 of the seed, so that small seeds give well-mixed states; xorshift needs a non-zero state
+static U64 SeedRandom(U64 seed) {
+    U64 z = seed + 0x9E3779B97F4A7C15ull;
+    z     = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z     = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return (z ^ (z >> 31)) | 1;
+}
+
+// xorshift64*
+static U64 NextRandomOf(U64& state) {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1Dull;
+}
+
+QiTrafficSettings::QiTrafficSettings()
+    : mSampleRateHz(1000000)
+    , mSeed(1)
+    , mPreambleBits(0)
+    , mPeriodError(0.0)
+    , mDrift(0.0)
+    , mDriftPeriodMs(1000)
+    , mJitter(0.0)
+    , mGlitchesPerSecond(0.0)
+    , mGlitchWidthUs(20)
+    , mControlPackets(100)
+    , mReceivedPowerInterval(4)
+    , mPacketGapMs(10)
+    , mControlGapMs(50)
+    , mSessionGapMs(500) {}
+
+QiTrafficGenerator::QiTrafficGenerator()
+    : mRandomState(0)
+    , mNominalPeriod(0.0)
+    , mSessionPeriod(0.0)
+    , mTime(0.0)
+    , mLastEdge(0)
+    , mLevel(false)
+    , mPhase(PhasePing)
+    , mControlCount(0)
+    , mControlError(0)
+    , mManufacturer(0)
+    , mDeviceId(0)
+    , mEdgeCount(0)
+    , mPacketCount(0)
+    , mSessionCount(0) {
+    memset(&mPacket, 0, sizeof(mPacket));
+}
+
+QiTrafficGenerator::~QiTrafficGenerator() {}
+
+void QiTrafficGenerator::Reset(const QiTrafficSettings& settings) {
+    mSettings = settings;
+
+    mRandomState = SeedRandom(settings.mSeed);
+
+    mNominalPeriod = double(settings.mSampleRateHz) / double(kBitRate);
+    mSessionPeriod = mNominalPeriod;
+    mTime          = 0.0;
+    mLastEdge      = 0;
+    mLevel         = false;
+    mPhase         = PhasePing;
+    mControlCount  = 0;
+    mControlError  = 0;
+    mEdgeCount     = 0;
+    mPacketCount   = 0;
+    mSessionCount  = 0;
+}
+
+U64 QiTrafficGenerator::NextRandom() {
+    return NextRandomOf(mRandomState);
+}
+
+double QiTrafficGenerator::NextUniform() {
+    return double(NextRandom() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+U32 QiTrafficGenerator::NextBelow(U32 limit) {
+    return (limit > 0) ? U32(NextRandom() % limit) : 0;
+}
+
+U32 QiTrafficGenerator::NextPacket(U8* header, U8* message) {
+    U32 gap_ms = mSettings.mPacketGapMs;
+
+    switch (mPhase) {
+    case PhasePing:
+        // A new receiver is placed on the pad
+        mSessionCount++;
+        mSessionPeriod = mNominalPeriod * (1.0 + mSettings.mPeriodError * (NextUniform() * 2.0 - 1.0));
+        mManufacturer  = U16(NextBelow(0x10000));
+        mDeviceId      = NextRandom() & 0x7FFFFFFF;
+        mControlError  = kInitialControlError;
+        mControlCount  = 0;
+
+        *header    = QiHeaderSignalStrength;
+        message[0] = U8(0x80 + NextBelow(0x80));
+        gap_ms     = mSettings.mSessionGapMs;
+        mPhase     = PhaseIdentification;
+        break;
+
+    case PhaseIdentification:
+        *header    = QiHeaderIdentification;
+        message[0] = kVersion;
+        message[1] = U8(mManufacturer >> 8);
+        message[2] = U8(mManufacturer);
+        message[3] = U8(mDeviceId >> 24);    // no extended identification
+        message[4] = U8(mDeviceId >> 16);
+        message[5] = U8(mDeviceId >> 8);
+        message[6] = U8(mDeviceId);
+        mPhase     = PhaseConfiguration;
+        break;
+
+    case PhaseConfiguration:
+        *header = QiHeaderConfiguration;
+        memcpy(message, kConfiguration, sizeof(kConfiguration));
+        mPhase = PhaseControlError;
+        break;
+
+    case PhaseControlError:
+        // The control error settles towards zero as the transmitter adjusts its power
+        *header       = QiHeaderControlError;
+        mControlError = std::max(-128, std::min(127, mControlError * 3 / 4 + S32(NextBelow(5)) - 2));
+        message[0]    = U8(mControlError);
+        if (mControlCount > 0)
+            gap_ms = mSettings.mControlGapMs;
+        mControlCount++;
+
+        if ((mSettings.mReceivedPowerInterval > 0) && ((mControlCount % mSettings.mReceivedPowerInterval) == 0))
+            mPhase = PhaseReceivedPower;
+        else if (mControlCount >= mSettings.mControlPackets)
+            mPhase = PhaseEndPowerTransfer;
+        break;
+
+    case PhaseReceivedPower:
+        *header    = QiHeaderReceivedPower8;
+        message[0] = U8(0x40 + NextBelow(0x80));
+        mPhase     = (mControlCount >= mSettings.mControlPackets) ? PhaseEndPowerTransfer : PhaseControlError;
+        break;
+
+    case PhaseEndPowerTransfer:
+        *header    = QiHeaderEndPowerTransfer;
+        message[0] = kChargeComplete;
+        mPhase     = PhasePing;
+        break;
+    }
+
+    return gap_ms;
+}
+
+double QiTrafficGenerator::GetBitPeriod() const {
+    if ((mSettings.mDrift == 0.0) || (mSettings.mDriftPeriodMs == 0))
+        return mSessionPeriod;
+
+    // Triangle wave from -1 to 1; unlike sin(), its result is the same on every platform
+    double cycle    = double(mSettings.mDriftPeriodMs) * double(mSettings.mSampleRateHz) / 1000.0;
+    double phase    = fmod(mTime / cycle, 1.0);
+    double triangle = 4.0 * fabs(phase - 0.5) - 1.0;
+    return mSessionPeriod * (1.0 + mSettings.mDrift * triangle);
+}
+
+void QiTrafficGenerator::AddEdge(double location, std::vector<U64>& edges) {
+    if (mSettings.mJitter > 0.0)
+        location += (NextUniform() * 2.0 - 1.0) * mSettings.mJitter * mNominalPeriod;
+
+    // Jitter must not reorder edges
+    U64 sample = (location > 0.0) ? U64(location + 0.5) : 0;
+    if ((sample <= mLastEdge) && (mEdgeCount > 0))
+        sample = mLastEdge + 1;
+
+    edges.push_back(sample);
+    mLastEdge = sample;
+    mLevel    = !mLevel;
+    mEdgeCount++;
+}
+
+void QiTrafficGenerator::AddBit(U32 value, std::vector<U64>& edges) {
+    // Differential bi-phase: a transition at the start of every bit, and one in the middle of a 1-bit
+    double period = GetBitPeriod();
+    AddEdge(mTime, edges);
+    if (value != 0)
+        AddEdge(mTime + period / 2.0, edges);
+    mTime += period;
+}
+
+void QiTrafficGenerator::AddByte(U8 value, std::vector<U64>& edges) {
+    U32 ones = 0;
+    for (U32 i = 0; i < 8; i++)
+        ones += (value >> i) & 1;
+
+    AddBit(0, edges);
+    for (U32 i = 0; i < 8; i++)
+        AddBit((value >> i) & 1, edges);
+    AddBit((ones & 1) ^ 1, edges);    // odd parity
+    AddBit(1, edges);
+}
+
+void QiTrafficGenerator::AddGlitches(double start, double end, size_t first_edge, std::vector<U64>& edges) {
+    if ((mSettings.mGlitchesPerSecond <= 0.0) || (end <= start))
+        return;
+
+    double expected = mSettings.mGlitchesPerSecond * (end - start) / double(mSettings.mSampleRateHz);
+    U32    count    = U32(expected);
+    if (NextUniform() < expected - double(count))
+        count++;
+    if (count == 0)
+        return;
+
+    U32    max_width  = U32(U64(mSettings.mGlitchWidthUs) * mSettings.mSampleRateHz / 1000000);
+    size_t edge_count = edges.size();
+    for (U32 i = 0; i < count; i++) {
+        U64 location = U64(start + NextUniform() * (end - start));
+        edges.push_back(location);
+        edges.push_back(location + 1 + NextBelow(max_width));
+    }
+
+    // A glitch toggles the level twice, so merging its edges in leaves the level of the signal unchanged. Two edges at
+    // the same sample cancel out.
+    std::sort(edges.begin() + first_edge, edges.end());
+
+    size_t out = first_edge;
+    for (size_t i = first_edge; i < edges.size(); i++) {
+        if ((out > first_edge) && (edges[out - 1] == edges[i]))
+            out--;
+        else
+            edges[out++] = edges[i];
+    }
+    mEdgeCount += out - edge_count;
+    edges.resize(out);
+    mLastEdge = edges.back();
+}
+
+const QiPacket& QiTrafficGenerator::AddNextPacket(std::vector<U64>& edges) {
+    U8  header;
+    U8  message[kQiMaxPacketSize];
+    U32 gap_ms = NextPacket(&header, message);
+    return AddPacket(header, message, gap_ms, edges);
+}
+
+const QiPacket& QiTrafficGenerator::AddPacket(U8 header, const U8* message, U32 gap_ms, std::vector<U64>& edges) {
+    size_t first_edge = edges.size();
+
+    // Glitches may fall anywhere after the edges that have already been returned
+    double gap_start = std::max(mTime, double(mLastEdge + 1));
+    mTime += double(gap_ms) * double(mSettings.mSampleRateHz) / 1000.0;
+
+    U32 preamble_bits = mSettings.mPreambleBits;
+    if (preamble_bits == 0)
+        preamble_bits = kMinPreambleBits + NextBelow(kMaxPreambleBits - kMinPreambleBits + 1);
+    for (U32 i = 0; i < preamble_bits; i++)
+        AddBit(1, edges);
+
+    mPacket.mHeader = header;
+    mPacket.mInfo   = QiLookupPacket(header);
+    mPacket.mSize   = QiPacketSizeForHeader(header);
+
+    size_t header_edge = edges.size();
+    AddByte(header, edges);
+    mPacket.mStart = edges[header_edge];
+
+    U8 checksum = header;
+    for (U32 i = 0; i < mPacket.mSize; i++) {
+        mPacket.mMessage[i] = message[i];
+        checksum ^= message[i];
+        AddByte(message[i], edges);
+    }
+    AddByte(checksum, edges);
+
+    mPacket.mEnd           = U64(mTime + 0.5);
+    mPacket.mChecksum      = checksum;
+    mPacket.mChecksumValid = true;
+    mPacket.mBitErrors     = false;
+
+    // Stop modulating. Every byte has an odd number of transitions, so this only needs an edge after an odd number of
+    // bytes; after an even number the stop bit ends without one.
+    if (mLevel)
+        AddEdge(mTime, edges);
+
+    AddGlitches(gap_start, mTime, first_edge, edges);
+
+    mPacketCount++;
+    return mPacket;
+}
+
+QiCarrierSettings::QiCarrierSettings()
+    : mSampleRateHz(20000000)
+    , mSeed(1)
+    , mCarrierHz(140000)
+    , mDepth(0.01)
+    , mJitter(0.0)
+    , mIdleCycles(2000)
+    , mStepInterval(8)
+    , mStepSize(0.02) {}
+
+QiCarrierGenerator::QiCarrierGenerator()
+    : mRandomState(0)
+    , mPeriod(0.0)
+    , mTime(0.0)
+    , mModulated(false)
+    , mEdgeCount(0)
+    , mMessageCount(0) {
+    memset(&mMessage, 0, sizeof(mMessage));
+}
+
+QiCarrierGenerator::~QiCarrierGenerator() {}
+
+void QiCarrierGenerator::Reset(const QiCarrierSettings& settings) {
+    mSettings     = settings;
+    mRandomState  = SeedRandom(settings.mSeed);
+    mPeriod       = double(settings.mSampleRateHz) / double(settings.mCarrierHz);
+    mTime         = 0.0;
+    mModulated    = false;
+    mEdgeCount    = 0;
+    mMessageCount = 0;
+}
+
+U64 QiCarrierGenerator::NextRandom() {
+    return NextRandomOf(mRandomState);
+}
+
+double QiCarrierGenerator::NextUniform() {
+    return double(NextRandom() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+U32 QiCarrierGenerator::NextBelow(U32 limit) {
+    return (limit > 0) ? U32(NextRandom() % limit) : 0;
+}
+
+void QiCarrierGenerator::AddEdge(std::vector<U64>& edges) {
+    // A quarter of a period of jitter at most keeps the edges in order
+    double location = mTime;
+    if (mSettings.mJitter > 0.0)
+        location += (NextUniform() * 2.0 - 1.0) * std::min(mSettings.mJitter, 0.25) * mPeriod;
+
+    edges.push_back(U64(location + 0.5));
+    mEdgeCount++;
+}
+
+void QiCarrierGenerator::AddCycles(U32 cycles, std::vector<U64>& edges) {
+    double half_period = mPeriod * (mModulated ? 1.0 + mSettings.mDepth : 1.0) / 2.0;
+    for (U32 i = 0; i < 2 * cycles; i++) {
+        AddEdge(edges);
+        mTime += half_period;
+    }
+}
+
+void QiCarrierGenerator::AddIdle(U32 cycles, std::vector<U64>& edges) {
+    mModulated = false;
+    AddCycles(cycles, edges);
+}
+
+void QiCarrierGenerator::AddBit(U32 value, std::vector<U64>& edges) {
+    // Differential bi-phase over the carrier cycles: a change of frequency at the start of every bit, and one in the
+    // middle of a 1-bit
+    mModulated = !mModulated;
+    AddCycles(kQiFskCyclesPerBit / 2, edges);
+    if (value != 0)
+        mModulated = !mModulated;
+    AddCycles(kQiFskCyclesPerBit / 2, edges);
+}
+
+void QiCarrierGenerator::AddByte(U8 value, std::vector<U64>& edges) {
+    U32 ones = 0;
+    for (U32 i = 0; i < 8; i++)
+        ones += (value >> i) & 1;
+
+    AddBit(0, edges);
+    for (U32 i = 0; i < 8; i++)
+        AddBit((value >> i) & 1, edges);
+    AddBit((ones & 1) ^ 1, edges);    // odd parity
+    AddBit(1, edges);
+}
+
+const QiCarrierMessage& QiCarrierGenerator::AddNextMessage(std::vector<U64>& edges) {
+    AddIdle(mSettings.mIdleCycles + NextBelow(mSettings.mIdleCycles + 1), edges);
+    mMessage.mStart = U64(mTime + 0.5);
+    mMessage.mSize  = 0;
+    mMessageCount++;
+
+    if ((mSettings.mStepInterval > 0) && (NextBelow(mSettings.mStepInterval) == 0)) {
+        // At least twice the decoder's threshold; it tells the step from a bit by the missing transitions after it
+        double size = mSettings.mStepSize * (0.5 + 0.5 * NextUniform());
+        mMessage.mType = QiCarrierFrequencyStep;
+        mPeriod *= (NextBelow(2) == 0) ? 1.0 + size : 1.0 / (1.0 + size);
+        return mMessage;
+    }
+
+    if (NextBelow(2) == 0) {
+        static const U8 kPatterns[] = { QiFskResponseAck, QiFskResponseNak, QiFskResponseNotDefined };
+        mMessage.mType    = QiCarrierResponse;
+        mMessage.mPattern = kPatterns[NextBelow(3)];
+
+        // Sent first bit first
+        for (U32 i = 0; i < 8; i++)
+            AddBit((mMessage.mPattern >> (7 - i)) & 1, edges);
+    } else {
+        // A header of the transmitter's short packets, with its message and checksum
+        U8 header   = U8(0x20 * NextBelow(2) + NextBelow(0x20));
+        U8 size     = QiPacketSizeForHeader(header);
+        U8 checksum = header;
+
+        mMessage.mType     = QiCarrierPacket;
+        mMessage.mBytes[0] = header;
+        for (U32 i = 0; i < size; i++) {
+            mMessage.mBytes[1 + i] = U8(NextBelow(0x100));
+            checksum ^= mMessage.mBytes[1 + i];
+        }
+        mMessage.mBytes[1 + size] = checksum;
+        mMessage.mSize            = size + 2U;
+        for (U32 i = 0; i < mMessage.mSize; i++)
+            AddByte(mMessage.mBytes[i], edges);
+    }
+
+    // The modulation ends on the operating frequency
+    mModulated = false;
+    return mMessage;
+}
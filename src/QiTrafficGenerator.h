@@ -0,0 +1,177 @@
+#ifndef QI_TRAFFIC_GENERATOR_H
+#define QI_TRAFFIC_GENERATOR_H
+
+#include <cstddef>
+#include <vector>
+
+#include "QiFskDecoder.h"
+#include "QiPacket.h"
+
+// Timing of the generated signal, and the faults to inject into it.
+struct QiTrafficSettings {
+    U32 mSampleRateHz;
+    U64 mSeed;    // the same seed and settings always give the same edges
+
+    U32 mPreambleBits;    // kQiMinPreambleBits to kQiMaxPreambleBits; 0 picks a random one of 11-25 for every packet
+
+    // Each session's bit period is off by a random fraction within +/- mPeriodError, and wanders by up to +/- mDrift
+    // of it, over mDriftPeriodMs (a triangle wave)
+    double mPeriodError;
+    double mDrift;
+    U32    mDriftPeriodMs;
+
+    double mJitter;              // every edge moves by a random fraction within +/- mJitter of the bit period
+    double mGlitchesPerSecond;    // short pulses added anywhere, packets and gaps alike
+    U32    mGlitchWidthUs;       // the longest glitch
+
+    // Session structure: ping (signal strength), identification, configuration, then mControlPackets control error
+    // packets with a received power packet after every mReceivedPowerInterval of them, and end power transfer.
+    U32 mControlPackets;
+    U32 mReceivedPowerInterval;
+    U32 mPacketGapMs;     // between the packets of the identification and configuration phase, and before RP and EPT
+    U32 mControlGapMs;    // between control error packets
+    U32 mSessionGapMs;    // before the ping of every session
+
+    QiTrafficSettings();
+};
+
+// Generates the edges of realistic Qi sessions, as a receiver's ASK modulation would produce them: packets from the WPC
+// packet table with correct sizes and checksums, preambles, differential bi-phase bits, and a return to the
+// unmodulated level after each packet. It has its own random number generator, so the output only depends on the seed.
+class QiTrafficGenerator {
+  public:
+    QiTrafficGenerator();
+    ~QiTrafficGenerator();
+
+    void Reset(const QiTrafficSettings& settings);
+
+    // Appends the edges of the gap before the next packet (glitches only) and of the packet itself to `edges`, and
+    // returns the packet as it should be decoded.
+    const QiPacket& AddNextPacket(std::vector<U64>& edges);
+
+    // The same for a given packet, e.g. one that the sessions do not have, gap_ms after the previous one; message holds
+    // QiPacketSizeForHeader(header) bytes and the checksum is added. The sessions go on after it as before.
+    const QiPacket& AddPacket(U8 header, const U8* message, U32 gap_ms, std::vector<U64>& edges);
+
+    U64 GetEdgeCount() const { return mEdgeCount; }
+    U64 GetPacketCount() const { return mPacketCount; }
+    U64 GetSessionCount() const { return mSessionCount; }
+
+  private:
+    enum Phase {
+        PhasePing,
+        PhaseIdentification,
+        PhaseConfiguration,
+        PhaseControlError,
+        PhaseReceivedPower,
+        PhaseEndPowerTransfer,
+    };
+
+    U64    NextRandom();
+    double NextUniform();    // [0, 1)
+    U32    NextBelow(U32 limit);
+
+    U32    NextPacket(U8* header, U8* message);
+    double GetBitPeriod() const;
+    void   AddEdge(double location, std::vector<U64>& edges);
+    void   AddBit(U32 value, std::vector<U64>& edges);
+    void   AddByte(U8 value, std::vector<U64>& edges);
+    void   AddGlitches(double start, double end, size_t first_edge, std::vector<U64>& edges);
+
+    QiTrafficSettings mSettings;
+    U64               mRandomState;
+
+    double mNominalPeriod;    // samples
+    double mSessionPeriod;    // the session's receiver clock
+    double mTime;             // samples
+    U64    mLastEdge;
+    bool   mLevel;    // modulated; the signal is unmodulated between packets
+
+    Phase mPhase;
+    U32   mControlCount;
+    S32   mControlError;
+    U16   mManufacturer;
+    U32   mDeviceId;
+
+    QiPacket mPacket;
+    U64      mEdgeCount;
+    U64      mPacketCount;
+    U64      mSessionCount;
+};
+
+// The power carrier as the transmitter modulates it (see QiFskDecoder.h), and the faults to inject into it.
+struct QiCarrierSettings {
+    U32 mSampleRateHz;    // 10 MHz or more, like the captures that QiFskDecoder is meant for
+    U64 mSeed;
+
+    U32    mCarrierHz;    // operating frequency
+    double mDepth;        // the modulation lengthens the carrier period by this fraction
+    double mJitter;       // every edge moves by a random fraction within +/- mJitter of the carrier period; the
+                          // decoder's window averages out about 0.01
+
+    // Each message follows mIdleCycles to twice as many cycles of unmodulated carrier. One in mStepInterval messages
+    // is a step of the operating frequency by up to +/- mStepSize instead of a packet or a response; 0 for none.
+    U32    mIdleCycles;
+    U32    mStepInterval;
+    double mStepSize;
+
+    QiCarrierSettings();
+};
+
+// What the transmitter sends on the carrier.
+enum QiCarrierMessageType {
+    QiCarrierPacket,           // FSK bytes: header, message and checksum
+    QiCarrierResponse,         // an 8-bit response pattern (see QiFskResponse)
+    QiCarrierFrequencyStep,    // a change of the operating frequency that no bit follows
+};
+
+struct QiCarrierMessage {
+    QiCarrierMessageType mType;
+    U64                  mStart;    // first edge at the modulation frequency, or at the new operating frequency
+    U8                   mBytes[kQiMaxPacketSize + 2];
+    U32                  mSize;       // bytes of a packet
+    U8                   mPattern;    // of a response
+};
+
+// Generates the edges of a power carrier with the transmitter's FSK packets and responses, and steps of its
+// operating frequency, with the same random number generator as QiTrafficGenerator.
+class QiCarrierGenerator {
+  public:
+    QiCarrierGenerator();
+    ~QiCarrierGenerator();
+
+    void Reset(const QiCarrierSettings& settings);
+
+    // Appends the edges of the idle carrier before the next message and of the message itself to `edges`, and returns
+    // the message as it should be decoded.
+    const QiCarrierMessage& AddNextMessage(std::vector<U64>& edges);
+
+    // Appends the edges of unmodulated carrier, e.g. to end the last message.
+    void AddIdle(U32 cycles, std::vector<U64>& edges);
+
+    U64 GetEdgeCount() const { return mEdgeCount; }
+    U64 GetMessageCount() const { return mMessageCount; }
+
+  private:
+    U64    NextRandom();
+    double NextUniform();    // [0, 1)
+    U32    NextBelow(U32 limit);
+
+    void AddCycles(U32 cycles, std::vector<U64>& edges);
+    void AddEdge(std::vector<U64>& edges);
+    void AddBit(U32 value, std::vector<U64>& edges);
+    void AddByte(U8 value, std::vector<U64>& edges);
+
+    QiCarrierSettings mSettings;
+    U64               mRandomState;
+
+    double mPeriod;    // of the operating frequency, in samples
+    double mTime;      // samples
+    bool   mModulated;
+
+    QiCarrierMessage mMessage;
+    U64              mEdgeCount;
+    U64              mMessageCount;
+};
+
+#endif    // QI_TRAFFIC_GENERATOR_H
@@ -0,0 +1,13 @@
+#ifndef QI_TYPES_H
+#define QI_TYPES_H
+
+// Integer type names used by the SDK-independent decoder core. They are identical to the typedefs in the Saleae SDK's
+// LogicPublicTypes.h, so the core builds without the SDK and both headers can be included together in the plugin.
+typedef unsigned char      U8;
+typedef unsigned short     U16;
+typedef unsigned int       U32;
+typedef unsigned long long U64;
+typedef int                S32;
+typedef long long          S64;
+
+#endif    // QI_TYPES_H
@@ -0,0 +1,481 @@
+// qi-bench: decodes the fixture captures, checks the output against the golden files, and measures the decoder's
+// throughput and peak memory.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "QiDecoder.h"
+#include "QiDeglitch.h"
+#include "QiEdgeFile.h"
+#include "QiIntervalClassifier.h"
+#include "QiPacket.h"
+#include "QiPacketExport.h"
+#include "QiSegmentDecoder.h"
+
+// Each fixture is decoded repeatedly for at least this long, and the fastest run is reported.
+static const double kDefaultMinTime = 0.5;
+
+// A fixture fails the baseline check when it is decoded this much slower than the baseline.
+static const double kDefaultThreshold = 0.25;
+
+// Threads for the check that a segmented decode gives the same output, and the smallest segment, so that even the
+// fixtures are cut into many segments.
+static const U32 kSegmentThreads  = 4;
+static const U64 kMinSegmentEdges = 256;
+
+static const size_t kMaxLineLength = 128;
+
+// Formats the decoded bytes like `qi-decode -o`, and writes the packets through QiPacketCsvWriter.
+class GoldenWriter : public QiDecoderListener {
+  public:
+    GoldenWriter(U32 sample_rate_hz, QiPacketCsvWriter* packets)
+        : mSampleRateHz(sample_rate_hz), mPackets(packets), mByteCount(0), mPacketCount(0) {
+        mBytes = "Sample,Time [s],Packet,Payload,Packet Byte,Parity,Stop\n";
+    }
+
+    virtual void OnMarker(U64 location, QiMarkerType marker) {}
+
+    virtual void OnByte(const QiByte& byte) {
+        char line[kMaxLineLength];
+        int  length = snprintf(line,
+                              sizeof(line),
+                              "%llu,%.9f,0x%03X,0x%02X,%u,%u,%u\n",
+                              byte.mBitEdges[0],
+                              double(byte.mBitEdges[0]) / double(mSampleRateHz),
+                              byte.mPacket,
+                              byte.mPayload,
+                              byte.mPacketByte,
+                              byte.mParityValid ? 1 : 0,
+                              byte.mStopValid ? 1 : 0);
+        mBytes.append(line, size_t(length));
+        mByteCount++;
+
+        if (mPacketAssembler.AddByte(byte) == true) {
+            mPacketCount++;
+            if (mPackets != nullptr)
+                mPackets->Write(mPacketAssembler.GetPacket());
+        }
+    }
+
+    const std::string& GetBytes() const { return mBytes; }
+    U64                GetByteCount() const { return mByteCount; }
+    U64                GetPacketCount() const { return mPacketCount; }
+
+  private:
+    U32                mSampleRateHz;
+    QiPacketCsvWriter* mPackets;
+    QiPacketAssembler  mPacketAssembler;
+    std::string        mBytes;
+    U64                mByteCount;
+    U64                mPacketCount;
+};
+
+// Counts the decoder's output without formatting it, for the timed runs.
+class CountingListener : public QiDecoderListener {
+  public:
+    CountingListener() : mByteCount(0), mPacketCount(0) {}
+
+    virtual void OnMarker(U64 location, QiMarkerType marker) {}
+
+    virtual void OnByte(const QiByte& byte) {
+        mByteCount++;
+        if (mPacketAssembler.AddByte(byte) == true)
+            mPacketCount++;
+    }
+
+    U64 GetByteCount() const { return mByteCount; }
+
+  private:
+    QiPacketAssembler mPacketAssembler;
+    U64               mByteCount;
+    U64               mPacketCount;
+};
+
+struct Fixture {
+    std::string mName;
+    U32         mSampleRateHz;
+    U32         mGlitchUs;
+    U32         mToleranceDivisor;
+};
+
+struct Options {
+    std::string mDirectory;
+    std::string mOutputDirectory;
+    std::string mBaselinePath;
+    std::string mSaveBaselinePath;
+    double      mMinTime;
+    double      mThreshold;
+    bool        mUpdate;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+static bool ReadFile(const std::string& path, std::string& contents) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+        return false;
+
+    contents.clear();
+    char   buffer[1 << 16];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        contents.append(buffer, read);
+
+    bool ok = (ferror(file) == 0);
+    fclose(file);
+    return ok;
+}
+
+static bool WriteFile(const std::string& path, const std::string& contents) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr)
+        return false;
+
+    bool ok = (fwrite(contents.data(), 1, contents.size(), file) == contents.size());
+    if (fclose(file) != 0)
+        ok = false;
+    return ok;
+}
+
+// Reports the first line where the output differs from the golden file.
+static bool CompareGolden(const std::string& name, const std::string& golden, const std::string& output) {
+    if (golden == output)
+        return true;
+
+    size_t line   = 1;
+    size_t offset = 0;
+    while ((offset < golden.size()) && (offset < output.size()) && (golden[offset] == output[offset])) {
+        if (golden[offset] == '\n')
+            line++;
+        offset++;
+    }
+    fprintf(stderr, "%s: output differs from the golden file at line %llu\n", name.c_str(), (unsigned long long)(line));
+    return false;
+}
+
+// Fixture list: one "name sample_rate_hz glitch_us [tolerance_divisor]" line per fixture; '#' starts a comment.
+static bool ReadFixtures(const std::string& directory, std::vector<Fixture>& fixtures) {
+    std::string manifest;
+    if (ReadFile(directory + "/fixtures.txt", manifest) == false)
+        return false;
+
+    size_t start = 0;
+    while (start < manifest.size()) {
+        size_t      end  = manifest.find('\n', start);
+        std::string line = manifest.substr(start, (end == std::string::npos) ? std::string::npos : end - start);
+        start            = (end == std::string::npos) ? manifest.size() : end + 1;
+
+        char     name[kMaxLineLength];
+        unsigned rate;
+        unsigned glitch_us;
+        unsigned tolerance_divisor = 4;
+        if ((line.empty() == false) && (line[0] != '#') && (line.size() < kMaxLineLength) &&
+            (sscanf(line.c_str(), "%127s %u %u %u", name, &rate, &glitch_us, &tolerance_divisor) >= 3)) {
+            Fixture fixture = { name, U32(rate), U32(glitch_us), U32(tolerance_divisor) };
+            fixtures.push_back(fixture);
+        }
+    }
+    return true;
+}
+
+// Baseline file: one "name,edges_per_second" line per fixture.
+static void ReadBaseline(const std::string& path, std::map<std::string, double>& baseline) {
+    std::string contents;
+    if (ReadFile(path, contents) == false)
+        return;
+
+    size_t start = 0;
+    while (start < contents.size()) {
+        size_t      end   = contents.find('\n', start);
+        std::string line  = contents.substr(start, (end == std::string::npos) ? std::string::npos : end - start);
+        start             = (end == std::string::npos) ? contents.size() : end + 1;
+        size_t      comma = line.find(',');
+        if ((comma != std::string::npos) && (line[0] != '#'))
+            baseline[line.substr(0, comma)] = strtod(line.c_str() + comma + 1, nullptr);
+    }
+}
+
+static U64 GetPeakMemoryBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) == FALSE)
+        return 0;
+    return U64(counters.PeakWorkingSetSize);
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return U64(usage.ru_maxrss);    // bytes
+#else
+    return U64(usage.ru_maxrss) * 1024;    // kilobytes
+#endif
+#endif
+}
+
+// Decodes the fixture the way qi-decode does, writes and checks its output, checks that the streaming and segmented
+// decoders agree, and times the decode. Returns false if any check failed.
+static bool RunFixture(const Options& options, const Fixture& fixture, std::map<std::string, double>& results) {
+    std::string      path = options.mDirectory + "/" + fixture.mName + ".edges";
+    std::vector<U64> capture;
+    std::string      error;
+    if (QiReadEdgeFile(path.c_str(), QiEdgeFileBinary, 0, fixture.mSampleRateHz, capture, error) == false) {
+        fprintf(stderr, "%s: %s\n", fixture.mName.c_str(), error.c_str());
+        return false;
+    }
+    U64 min_pulse_width = U64(fixture.mGlitchUs) * fixture.mSampleRateHz / 1000000;
+
+    // Output, through the exporters
+    std::string       packets_path = options.mOutputDirectory + "/" + fixture.mName + ".packets.csv";
+    QiPacketCsvWriter packets;
+    if (packets.Open(packets_path.c_str(), nullptr, fixture.mSampleRateHz, 0) == false) {
+        fprintf(stderr, "%s: cannot create %s\n", fixture.mName.c_str(), packets_path.c_str());
+        return false;
+    }
+
+    std::vector<U64> edges = capture;
+    QiDeglitchEdges(edges, min_pulse_width);
+
+    GoldenWriter writer(fixture.mSampleRateHz, &packets);
+    QiDecoder    decoder;
+    decoder.SetListener(&writer);
+    decoder.SetTrackingTolerance(fixture.mToleranceDivisor);
+    decoder.Reset(fixture.mSampleRateHz);
+    decoder.Run(edges.data(), edges.size());
+    if (packets.Close() == false) {
+        fprintf(stderr, "%s: error writing %s\n", fixture.mName.c_str(), packets_path.c_str());
+        return false;
+    }
+
+    std::string packets_csv;
+    std::string bytes_path = options.mOutputDirectory + "/" + fixture.mName + ".bytes.csv";
+    if ((ReadFile(packets_path, packets_csv) == false) || (WriteFile(bytes_path, writer.GetBytes()) == false)) {
+        fprintf(stderr, "%s: cannot write the output\n", fixture.mName.c_str());
+        return false;
+    }
+
+    bool        ok            = true;
+    std::string golden_bytes   = options.mDirectory + "/" + fixture.mName + ".bytes.csv";
+    std::string golden_packets = options.mDirectory + "/" + fixture.mName + ".packets.csv";
+    if (options.mUpdate) {
+        if ((WriteFile(golden_bytes, writer.GetBytes()) == false) || (WriteFile(golden_packets, packets_csv) == false)) {
+            fprintf(stderr, "%s: cannot update the golden files\n", fixture.mName.c_str());
+            return false;
+        }
+    } else {
+        std::string golden;
+        if (ReadFile(golden_bytes, golden) == false) {
+            fprintf(stderr, "%s: cannot read %s\n", fixture.mName.c_str(), golden_bytes.c_str());
+            return false;
+        }
+        ok = CompareGolden(fixture.mName + ".bytes.csv", golden, writer.GetBytes()) && ok;
+        if (ReadFile(golden_packets, golden) == false) {
+            fprintf(stderr, "%s: cannot read %s\n", fixture.mName.c_str(), golden_packets.c_str());
+            return false;
+        }
+        ok = CompareGolden(fixture.mName + ".packets.csv", golden, packets_csv) && ok;
+    }
+
+    // The streaming decoder behind the plugin's glitch filter, and the segmented decoder, must give the same bytes
+    GoldenWriter         streamed(fixture.mSampleRateHz, nullptr);
+    QiArrayEdgeSource    array(capture.data(), capture.size());
+    QiDeglitchEdgeSource source(array, min_pulse_width);
+    decoder.SetListener(&streamed);
+    decoder.Reset(fixture.mSampleRateHz);
+    decoder.Run(source);
+    if (streamed.GetBytes() != writer.GetBytes()) {
+        fprintf(stderr, "%s: the streaming decoder's output differs\n", fixture.mName.c_str());
+        ok = false;
+    }
+
+    GoldenWriter     segmented(fixture.mSampleRateHz, nullptr);
+    QiSegmentDecoder segment_decoder;
+    segment_decoder.SetListener(&segmented);
+    segment_decoder.SetTrackingTolerance(fixture.mToleranceDivisor);
+    segment_decoder.SetMinSegmentEdges(kMinSegmentEdges);
+    segment_decoder.Reset(fixture.mSampleRateHz);
+    segment_decoder.Run(edges.data(), edges.size(), kSegmentThreads);
+    if (segment_decoder.GetSegmentCount() <= 1) {
+        fprintf(stderr, "%s: the segmented decoder did not split the capture\n", fixture.mName.c_str());
+        ok = false;
+    }
+    if (segmented.GetBytes() != writer.GetBytes()) {
+        fprintf(stderr, "%s: the segmented decoder's output differs\n", fixture.mName.c_str());
+        ok = false;
+    }
+
+    // Throughput of the glitch filter and decoder, without formatting the output
+    double best       = 0.0;
+    double total      = 0.0;
+    U32    iterations = 0;
+    while ((total < options.mMinTime) || (iterations == 0)) {
+        edges = capture;
+
+        CountingListener counter;
+        decoder.SetListener(&counter);
+        Clock::time_point start = Clock::now();
+        decoder.Reset(fixture.mSampleRateHz);
+        QiDeglitchEdges(edges, min_pulse_width);
+        decoder.Run(edges.data(), edges.size());
+        double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+        if ((iterations == 0) || (elapsed < best))
+            best = elapsed;
+        total += elapsed;
+        iterations++;
+    }
+
+    double edges_per_second = (best > 0.0) ? double(capture.size()) / best : 0.0;
+    double bytes_per_second = (best > 0.0) ? double(writer.GetByteCount()) / best : 0.0;
+    results[fixture.mName]  = edges_per_second;
+
+    fprintf(stderr,
+            "%-10s %9llu edges %7llu bytes %6llu packets  %12.0f edges/s %10.0f bytes/s  %.3f ms (best of %u)  %s\n",
+            fixture.mName.c_str(),
+            (unsigned long long)(capture.size()),
+            writer.GetByteCount(),
+            writer.GetPacketCount(),
+            edges_per_second,
+            bytes_per_second,
+            best * 1000.0,
+            iterations,
+            ok ? (options.mUpdate ? "updated" : "ok") : "FAILED");
+    return ok;
+}
+
+static void PrintUsage() {
+    fprintf(stderr,
+            "usage: qi-bench [-o DIR] [-m SECONDS] [-B BASELINE.csv [-T FRACTION]] [-s BASELINE.csv] [-u] FIXTURES [NAME...]\n"
+            "\n"
+            "Decodes the fixtures listed in FIXTURES/fixtures.txt (or only NAME...), compares the decoded bytes and\n"
+            "packets with the golden files next to them, and reports the throughput and peak memory.\n"
+            "\n"
+            "  -o, --output DIR        write the decoded output to DIR (default: the current directory)\n"
+            "  -m, --min-time SECONDS  time each fixture for at least this long (default 0.5)\n"
+            "  -B, --baseline FILE     fail if a fixture decodes slower than in FILE by more than the threshold\n"
+            "  -T, --threshold F       allowed slowdown against the baseline (default 0.25: 25%%)\n"
+            "  -s, --save FILE         write the measured throughput as a baseline file\n"
+            "  -u, --update            replace the golden files with the current output\n");
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    options.mOutputDirectory = ".";
+    options.mMinTime         = kDefaultMinTime;
+    options.mThreshold       = kDefaultThreshold;
+    options.mUpdate          = false;
+
+    std::vector<std::string> names;
+    for (int i = 1; i < argc; i++) {
+        const char* arg       = argv[i];
+        bool        has_value = (i + 1 < argc);
+
+        if (((strcmp(arg, "-o") == 0) || (strcmp(arg, "--output") == 0)) && has_value) {
+            options.mOutputDirectory = argv[++i];
+        } else if (((strcmp(arg, "-m") == 0) || (strcmp(arg, "--min-time") == 0)) && has_value) {
+            options.mMinTime = strtod(argv[++i], nullptr);
+        } else if (((strcmp(arg, "-B") == 0) || (strcmp(arg, "--baseline") == 0)) && has_value) {
+            options.mBaselinePath = argv[++i];
+        } else if (((strcmp(arg, "-T") == 0) || (strcmp(arg, "--threshold") == 0)) && has_value) {
+            options.mThreshold = strtod(argv[++i], nullptr);
+        } else if (((strcmp(arg, "-s") == 0) || (strcmp(arg, "--save") == 0)) && has_value) {
+            options.mSaveBaselinePath = argv[++i];
+        } else if ((strcmp(arg, "-u") == 0) || (strcmp(arg, "--update") == 0)) {
+            options.mUpdate = true;
+        } else if ((strcmp(arg, "-h") == 0) || (strcmp(arg, "--help") == 0)) {
+            PrintUsage();
+            return 0;
+        } else if (arg[0] == '-') {
+            fprintf(stderr, "qi-bench: unknown option '%s'\n", arg);
+            PrintUsage();
+            return 2;
+        } else if (options.mDirectory.empty()) {
+            options.mDirectory = arg;
+        } else {
+            names.push_back(arg);
+        }
+    }
+
+    if (options.mDirectory.empty()) {
+        PrintUsage();
+        return 2;
+    }
+
+    std::vector<Fixture> fixtures;
+    if (ReadFixtures(options.mDirectory, fixtures) == false) {
+        fprintf(stderr, "qi-bench: cannot read %s/fixtures.txt\n", options.mDirectory.c_str());
+        return 1;
+    }
+
+    int                           result = 0;
+    std::map<std::string, double> measured;
+    for (size_t n = 0; n < names.size(); n++) {
+        bool found = false;
+        for (size_t i = 0; i < fixtures.size(); i++)
+            found = found || (fixtures[i].mName == names[n]);
+        if (found == false) {
+            fprintf(stderr, "qi-bench: no fixture named '%s'\n", names[n].c_str());
+            result = 1;
+        }
+    }
+
+    for (size_t i = 0; i < fixtures.size(); i++) {
+        bool selected = names.empty();
+        for (size_t n = 0; n < names.size(); n++)
+            selected = selected || (fixtures[i].mName == names[n]);
+        if (selected && (RunFixture(options, fixtures[i], measured) == false))
+            result = 1;
+    }
+
+    fprintf(stderr, "peak memory: %.1f MiB\n", double(GetPeakMemoryBytes()) / (1024.0 * 1024.0));
+    fprintf(stderr, "interval classifier: %s\n", QiIntervalClassifierKernel());
+
+    if (options.mBaselinePath.empty() == false) {
+        std::map<std::string, double> baseline;
+        ReadBaseline(options.mBaselinePath, baseline);
+
+        for (std::map<std::string, double>::const_iterator it = measured.begin(); it != measured.end(); ++it) {
+            std::map<std::string, double>::const_iterator base = baseline.find(it->first);
+            if ((base == baseline.end()) || (base->second <= 0.0))
+                continue;
+
+            double ratio = it->second / base->second;
+            if (ratio < 1.0 - options.mThreshold) {
+                fprintf(stderr,
+                        "%s: %.0f edges/s is %.0f%% below the baseline of %.0f edges/s\n",
+                        it->first.c_str(),
+                        it->second,
+                        (1.0 - ratio) * 100.0,
+                        base->second);
+                result = 1;
+            }
+        }
+    }
+
+    if (options.mSaveBaselinePath.empty() == false) {
+        std::string contents = "# fixture,edges per second\n";
+        for (std::map<std::string, double>::const_iterator it = measured.begin(); it != measured.end(); ++it) {
+            char line[kMaxLineLength];
+            snprintf(line, sizeof(line), "%s,%.0f\n", it->first.c_str(), it->second);
+            contents += line;
+        }
+        if (WriteFile(options.mSaveBaselinePath, contents) == false) {
+            fprintf(stderr, "qi-bench: cannot write %s\n", options.mSaveBaselinePath.c_str());
+            result = 1;
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,1916 @@
+// qi-test: unit tests of the decoder core, and tests of qi-decode against golden files in the fixture directory. Runs
+// the tests named on the command line, or all of them, and fails if any of their checks fails.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "QiByteOrder.h"
+#include "QiCheckpointFile.h"
+#include "QiDecoder.h"
+#include "QiDeglitch.h"
+#include "QiEdgeFile.h"
+#include "QiFskDecoder.h"
+#include "QiIntervalClassifier.h"
+#include "QiLiveSource.h"
+#include "QiPacket.h"
+#include "QiPacketRepeats.h"
+#include "QiPacketSearch.h"
+#include "QiSaleaeFile.h"
+#include "QiSegmentDecoder.h"
+#include "QiTimingChecker.h"
+#include "QiTrafficGenerator.h"
+
+static U32 sFailedChecks = 0;
+
+static bool Check(bool condition, const char* text, const char* file, int line) {
+    if (condition == false) {
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, text);
+        sFailedChecks++;
+    }
+    return condition;
+}
+
+// A failed check is reported and counted, and the test goes on, so that one run shows every failure.
+#define QI_CHECK(condition) Check((condition), #condition, __FILE__, __LINE__)
+
+// For the tests that run qi-decode.
+struct Options {
+    std::string mDecoder;     // path of qi-decode
+    std::string mFixtures;    // directory of the fixtures and golden files
+    bool        mUpdate;      // replace the golden files with the current output
+};
+
+static Options sOptions;
+
+static bool ReadFile(const std::string& path, std::string& contents) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+        return false;
+
+    contents.clear();
+    char   buffer[1 << 16];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        contents.append(buffer, length);
+    fclose(file);
+    return true;
+}
+
+static bool WriteFile(const std::string& path, const std::string& contents) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr)
+        return false;
+
+    bool ok = (fwrite(contents.data(), 1, contents.size(), file) == contents.size());
+    return (fclose(file) == 0) && ok;
+}
+
+static std::vector<std::string> SplitLines(const std::string& text) {
+    std::vector<std::string> lines;
+    size_t                   start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        if (end == std::string::npos)
+            end = text.size();
+        lines.push_back(text.substr(start, end - start));
+        start = end + 1;
+    }
+    return lines;
+}
+
+static std::string FixturePath(const std::string& name) {
+    return sOptions.mFixtures + "/" + name;
+}
+
+// Outputs go to the current directory, which is the build directory under ctest.
+static std::string OutputPath(const std::string& name) {
+    return "qi-test-" + name;
+}
+
+static bool RunDecoder(const std::string& arguments) {
+    std::string command = "\"" + sOptions.mDecoder + "\" " + arguments;
+#ifdef _WIN32
+    // cmd.exe drops the outer quotes of a command that starts with one
+    command = "\"" + command + "\"";
+#endif
+    if (system(command.c_str()) != 0) {
+        fprintf(stderr, "  failed: %s\n", command.c_str());
+        return false;
+    }
+    return true;
+}
+
+// xorshift64*, so that every platform runs the same cases.
+class Random {
+  public:
+    explicit Random(U64 seed) : mState(seed * 0x9E3779B97F4A7C15ull | 1) {}
+
+    U64 Next() {
+        mState ^= mState >> 12;
+        mState ^= mState << 25;
+        mState ^= mState >> 27;
+        return mState * 0x2545F4914F6CDD1Dull;
+    }
+
+    U32 Below(U32 limit) { return U32(Next() % limit); }
+
+  private:
+    U64 mState;
+};
+
+// Every decoder event as a line of text, to compare the output of two decoders byte for byte.
+class EventLog : public QiDecoderListener {
+  public:
+    virtual void OnMarker(U64 location, QiMarkerType marker) {
+        char line[64];
+        snprintf(line, sizeof(line), "marker %llu %d\n", (unsigned long long)(location), int(marker));
+        mText += line;
+    }
+
+    virtual void OnByte(const QiByte& byte) {
+        char line[512];
+        int  length = snprintf(line,
+                              sizeof(line),
+                              "byte 0x%03X 0x%02X %u %u %u %u",
+                              byte.mPacket,
+                              byte.mPayload,
+                              byte.mPacketByte,
+                              byte.mPreambleBits,
+                              byte.mParityValid ? 1 : 0,
+                              byte.mStopValid ? 1 : 0);
+        for (U32 i = 0; i < 12; i++)
+            length += snprintf(line + length, sizeof(line) - length, " %llu", (unsigned long long)(byte.mBitEdges[i]));
+        mText.append(line, size_t(length));
+        mText += "\n";
+    }
+
+    virtual void OnSyncLost() { mText += "sync lost\n"; }
+
+    const std::string& GetText() const { return mText; }
+
+  private:
+    std::string mText;
+};
+
+// Reports the first line where two event logs differ.
+static bool CompareLogs(const char* what, const std::string& expected, const std::string& actual) {
+    if (expected == actual)
+        return true;
+
+    size_t line  = 1;
+    size_t first = 0;
+    while ((first < expected.size()) && (first < actual.size()) && (expected[first] == actual[first])) {
+        if (expected[first] == '\n')
+            line++;
+        first++;
+    }
+    size_t start = expected.rfind('\n', (first > 0) ? first - 1 : 0);
+    start        = (start == std::string::npos) ? 0 : start + 1;
+    fprintf(stderr,
+            "  %s: line %llu differs:\n    expected: %s\n    actual:   %s\n",
+            what,
+            (unsigned long long)(line),
+            expected.substr(start, expected.find('\n', start) - start).c_str(),
+            actual.substr(start, actual.find('\n', start) - start).c_str());
+    return false;
+}
+
+// Compares an output with its golden file in the fixture directory, or replaces the golden file with -u.
+static bool CheckGolden(const std::string& name, const std::string& output) {
+    std::string path = FixturePath(name);
+    if (sOptions.mUpdate) {
+        if (WriteFile(path, output))
+            return true;
+        fprintf(stderr, "  cannot write %s\n", path.c_str());
+        return false;
+    }
+
+    std::string golden;
+    if (ReadFile(path, golden) == false) {
+        fprintf(stderr, "  cannot read %s\n", path.c_str());
+        return false;
+    }
+    return CompareLogs(name.c_str(), golden, output);
+}
+
+// Sessions with drift, jitter and glitches, so that there are packets with errors and bursts that are skipped.
+static void GenerateCapture(U64 seed, U32 sessions, std::vector<U64>& edges) {
+    QiTrafficSettings settings;
+    settings.mSampleRateHz      = 1000000;
+    settings.mSeed              = seed;
+    settings.mPeriodError       = 0.05;
+    settings.mDrift             = 0.03;
+    settings.mDriftPeriodMs     = 200;
+    settings.mJitter            = 0.03;
+    settings.mGlitchesPerSecond = 300;
+    settings.mGlitchWidthUs     = 60;
+    settings.mControlPackets    = 40;
+
+    QiTrafficGenerator generator;
+    generator.Reset(settings);
+    edges.clear();
+    while (generator.GetSessionCount() < sessions)
+        generator.AddNextPacket(edges);
+}
+
+//
+// Interval classifier
+//
+
+// Windows like the decoder's for a bit period, or arbitrary ones: empty, overlapping, or too wide for 32 bits.
+static QiIntervalWindows PickWindows(Random& random, bool fit_in_32_bits) {
+    QiIntervalWindows windows;
+    if (random.Below(2) == 0) {
+        U64 period          = 4 + (fit_in_32_bits ? random.Below(1000000) : random.Next() % 0x1FFFFFFFFull);
+        U64 tolerance       = period / (4 + random.Below(5));
+        windows.mShortLow   = period / 2 - tolerance / 2;
+        windows.mShortWidth = tolerance + 1;
+        windows.mLongLow    = period - tolerance;
+        windows.mLongWidth  = 2 * tolerance + 1;
+        return windows;
+    }
+
+    U64 limit           = fit_in_32_bits ? 0x10000000 : 0xFFFFFFFFFFull;
+    windows.mShortLow   = random.Next() % limit;
+    windows.mShortWidth = (random.Below(4) == 0) ? 0 : random.Next() % limit;
+    windows.mLongLow    = random.Next() % limit;
+    windows.mLongWidth  = (random.Below(4) == 0) ? 0 : random.Next() % limit;
+    return windows;
+}
+
+// Intervals on and next to the bounds of the windows and of the 32-bit range, where the kernels could differ.
+static U64 PickInterval(Random& random, const QiIntervalWindows& windows) {
+    const U64 bounds[] = {
+        0,
+        windows.mShortLow,
+        windows.mShortLow + windows.mShortWidth,
+        windows.mLongLow,
+        windows.mLongLow + windows.mLongWidth,
+        0x7FFFFFFFull,
+        0xFFFFFFFFull,
+        1ull << 40,
+        0ull - 1,
+    };
+    return bounds[random.Below(sizeof(bounds) / sizeof(bounds[0]))] + U64(random.Below(5)) - 2;
+}
+
+static void TestIntervalKernels() {
+    const char*                  names[4];
+    QiIntervalClassifierFunction kernels[4];
+    U32                          kernel_count = QiGetIntervalClassifierKernels(names, kernels, 4);
+    for (U32 k = 0; k < kernel_count; k++)
+        fprintf(stderr, "  kernel %s%s\n", names[k], (strcmp(names[k], QiIntervalClassifierKernel()) == 0) ? " (used)" : "");
+
+    Random           random(1);
+    std::vector<U64> edges(64 + 4);
+    std::vector<U8>  expected(64 + 4);
+    std::vector<U8>  classes(64 + 4);
+    for (U32 trial = 0; trial < 20000; trial++) {
+        // Every tail length after the vector groups, from unaligned starts, and the interval from previous_edge
+        U32               count    = trial % 64;
+        U32               offset   = random.Below(4);
+        bool              fit      = (trial % 3) != 0;
+        QiIntervalWindows windows  = PickWindows(random, fit);
+        U64               previous = random.Next();
+        U64               edge     = previous;
+        for (U32 i = 0; i < count; i++) {
+            edge += PickInterval(random, windows);
+            edges[offset + i] = edge;
+        }
+
+        QiClassifyIntervalsScalar(&edges[offset], count, previous, windows, &expected[0]);
+        for (U32 i = 0; i < count; i++) {
+            U64 distance = edges[offset + i] - ((i == 0) ? previous : edges[offset + i - 1]);
+            QI_CHECK(expected[i] == QiClassifyInterval(distance, windows));
+        }
+
+        for (U32 k = 0; k <= kernel_count; k++) {
+            // the 32-bit kernel only takes windows that fit; the last round is the dispatcher
+            if ((k < kernel_count) && (strcmp(names[k], "sse2") == 0) && (fit == false))
+                continue;
+
+            memset(&classes[0], 0xFF, classes.size());
+            if (k < kernel_count)
+                kernels[k](&edges[offset], count, previous, windows, &classes[offset]);
+            else
+                QiClassifyIntervals(&edges[offset], count, previous, windows, &classes[offset]);
+
+            U32 mismatch = 0;
+            while ((mismatch < count) && (classes[offset + mismatch] == expected[mismatch]))
+                mismatch++;
+            if (QI_CHECK(mismatch == count) == false) {
+                fprintf(stderr,
+                        "  %s: trial %u, %u edges: class of edge %u is 0x%02X instead of 0x%02X\n",
+                        (k < kernel_count) ? names[k] : "QiClassifyIntervals",
+                        trial,
+                        count,
+                        mismatch,
+                        classes[offset + mismatch],
+                        expected[mismatch]);
+                return;
+            }
+            QI_CHECK((offset == 0) || (classes[offset - 1] == 0xFF));
+            QI_CHECK(classes[offset + count] == 0xFF);
+        }
+    }
+}
+
+//
+// Segmented decoding
+//
+
+static void TestSegmentDecoder() {
+    std::vector<U64> edges;
+    GenerateCapture(7, 3, edges);
+
+    EventLog  expected;
+    QiDecoder decoder;
+    decoder.SetListener(&expected);
+    decoder.Reset(1000000);
+    decoder.Run(edges.data(), edges.size());
+    QiDecoderStats stats = decoder.GetStats();
+    QI_CHECK(stats.mGlitchEdges > 0);
+
+    // Segments as small as one gap apart, i.e. one per packet, up to a few packets, with more threads than CPUs so
+    // that the workers run out of segments at different times and steal from each other
+    const U64 min_edges[]    = { 1, 64, 1000 };
+    const U32 thread_count[] = { 2, 3, 8, 32 };
+    for (U32 m = 0; m < 3; m++) {
+        for (U32 t = 0; t < 4; t++) {
+            for (U32 run = 0; run < 5; run++) {
+                EventLog         actual;
+                QiSegmentDecoder segment_decoder;
+                segment_decoder.SetListener(&actual);
+                segment_decoder.Reset(1000000);
+                segment_decoder.SetMinSegmentEdges(min_edges[m]);
+                segment_decoder.Run(edges.data(), edges.size(), thread_count[t]);
+
+                char what[64];
+                snprintf(what, sizeof(what), "%llu edges, %u threads", (unsigned long long)(min_edges[m]), thread_count[t]);
+                U64 segments = segment_decoder.GetSegmentCount();
+                QI_CHECK(segments > 8);
+                QI_CHECK(segment_decoder.GetThreadCount() == ((segments < thread_count[t]) ? U32(segments) : thread_count[t]));
+                QI_CHECK(CompareLogs(what, expected.GetText(), actual.GetText()));
+                QI_CHECK(memcmp(&segment_decoder.GetStats(), &stats, sizeof(stats)) == 0);
+            }
+        }
+    }
+
+    // Within one segment, the minimum leaves nothing to split
+    EventLog         single;
+    QiSegmentDecoder segment_decoder;
+    segment_decoder.SetListener(&single);
+    segment_decoder.Reset(1000000);
+    segment_decoder.SetMinSegmentEdges(edges.size());
+    segment_decoder.Run(edges.data(), edges.size(), 4);
+    QI_CHECK(segment_decoder.GetSegmentCount() == 1);
+    QI_CHECK(CompareLogs("one segment", expected.GetText(), single.GetText()));
+}
+
+//
+// Timing rules
+//
+
+// Packets with the bit period of 1 MHz sampling and timing in microseconds: each starts its preamble gap_us after the
+// end of the previous one.
+class TimingScript {
+  public:
+    TimingScript() : mEnd(1000000) { mChecker.Reset(1000000); }
+
+    QiTimingChecker& GetChecker() { return mChecker; }
+
+    // Returns the number of violations; the first one is in GetViolation().
+    U32 AddPacket(U8 header, U64 gap_us, U32 preamble_bits = 16, bool checksum_valid = true) {
+        const U64 bit_period = 500;
+
+        QiPacket packet;
+        memset(&packet, 0, sizeof(packet));
+        packet.mHeader        = header;
+        packet.mInfo          = QiLookupPacket(header);
+        packet.mSize          = QiPacketSizeForHeader(header);
+        packet.mPreambleBits  = U8(preamble_bits);
+        packet.mStart         = mEnd + gap_us + preamble_bits * bit_period;
+        packet.mEnd           = packet.mStart + 11 * (packet.mSize + 2) * bit_period;
+        packet.mChecksumValid = checksum_valid;
+        mEnd                  = packet.mEnd;
+        mPreambleStart        = packet.mStart - preamble_bits * bit_period;
+        return mChecker.AddPacket(packet, mViolations);
+    }
+
+    const QiTimingViolation& GetViolation() const { return mViolations[0]; }
+    U64                      GetPreambleStart() const { return mPreambleStart; }
+
+    // Checks the violation of the last packet.
+    bool IsViolation(U32 count, U32 rule, U64 value, U32 limit, bool above_max) const {
+        return (count == 1) && (mViolations[0].mRule == rule) && (mViolations[0].mValue == value) &&
+               (mViolations[0].mLimit == limit) && (mViolations[0].mAboveMax == above_max);
+    }
+
+  private:
+    QiTimingChecker   mChecker;
+    U64               mEnd;
+    U64               mPreambleStart;
+    QiTimingViolation mViolations[kQiTimingRuleCount];
+};
+
+// Decodes edges into packets, for the preamble lengths that the decoder locks onto.
+class PacketLog : public QiDecoderListener {
+  public:
+    virtual void OnMarker(U64, QiMarkerType) {}
+
+    virtual void OnByte(const QiByte& byte) {
+        if (mAssembler.AddByte(byte))
+            mPackets.push_back(mAssembler.GetPacket());
+    }
+
+    const std::vector<QiPacket>& GetPackets() const { return mPackets; }
+
+  private:
+    QiPacketAssembler     mAssembler;
+    std::vector<QiPacket> mPackets;
+};
+
+// Each rule at its limit, and just past it; then the preambles of generated packets through the decoder.
+static void TestTimingRules() {
+    {
+        TimingScript script;
+        QI_CHECK(script.AddPacket(QiHeaderSignalStrength, 100000, kQiMinPreambleBits) == 0);
+        QI_CHECK(script.AddPacket(QiHeaderSignalStrength, 100000, 25) == 0);
+        QI_CHECK(script.IsViolation(script.AddPacket(QiHeaderSignalStrength, 100000, 26), QiRulePreamble, 26, 25, true));
+        QI_CHECK(script.GetViolation().mStart == script.GetPreambleStart());
+
+        script.GetChecker().SetLimits(QiRulePreamble, 14, 0);
+        QI_CHECK(script.AddPacket(QiHeaderSignalStrength, 100000, 14) == 0);
+        QI_CHECK(script.AddPacket(QiHeaderSignalStrength, 100000, 200) == 0);
+        QI_CHECK(script.IsViolation(script.AddPacket(QiHeaderSignalStrength, 100000, 13), QiRulePreamble, 13, 14, false));
+    }
+    {
+        TimingScript script;
+        QI_CHECK(script.AddPacket(QiHeaderSignalStrength, 100000) == 0);
+        QI_CHECK(script.AddPacket(QiHeaderIdentification, 21000) == 0);
+        QI_CHECK(script.AddPacket(QiHeaderConfiguration, 21000) == 0);
+        QI_CHECK(script.AddPacket(QiHeaderSignalStrength, 100000) == 0);
+        QI_CHECK(script.IsViolation(script.AddPacket(QiHeaderIdentification, 21001), QiRulePingToId, 21001, 21000, true));
+        QI_CHECK(script.IsViolation(script.AddPacket(QiHeaderConfiguration, 30000), QiRulePacketGap, 30000, 21000, true));
+        QI_CHECK(script.GetViolation().mEnd == script.GetPreambleStart());
+
+        // The gaps in the power transfer phase are not limited
+        QI_CHECK(script.AddPacket(QiHeaderControlError, 21000) == 0);
+        QI_CHECK(script.AddPacket(QiHeaderReceivedPower8, 100000) == 0);
+    }
+    {
+        // A packet with a bad checksum breaks no rule but its preamble's, and does not move on to the next phase
+        TimingScript script;
+        QI_CHECK(script.AddPacket(QiHeaderSignalStrength, 100000) == 0);
+        QI_CHECK(script.AddPacket(QiHeaderControlError, 50000, 16, false) == 0);
+        QI_CHECK(script.AddPacket(QiHeaderIdentification, 1000) == 0);
+    }
+    {
+        // Start to start: a Control Error or Received Power packet with its preamble takes 8 + 16.5 ms
+        TimingScript script;
+        QI_CHECK(script.AddPacket(QiHeaderControlError, 100000) == 0);
+        QI_CHECK(script.AddPacket(QiHeaderControlError, 250000 - 24500) == 0);
+        QI_CHECK(script.AddPacket(QiHeaderReceivedPower8, 10000) == 0);
+        U64 interval_us = 250001;
+        QI_CHECK(script.IsViolation(script.AddPacket(QiHeaderControlError, interval_us - 10000 - 2 * 24500),
+                                    QiRuleCeInterval,
+                                    interval_us,
+                                    250000,
+                                    true));
+
+        // A new ping starts over, so its first Control Error packet is not measured
+        QI_CHECK(script.AddPacket(QiHeaderSignalStrength, 300000) == 0);
+        QI_CHECK(script.AddPacket(QiHeaderIdentification, 10000) == 0);
+        QI_CHECK(script.AddPacket(QiHeaderControlError, 10000) == 0);
+    }
+    {
+        TimingScript script;
+        QI_CHECK(script.AddPacket(QiHeaderControlError, 100000) == 0);
+        QI_CHECK(script.AddPacket(QiHeaderEndPowerTransfer, 10000) == 0);
+        QI_CHECK(script.AddPacket(QiHeaderControlError, 28000) == 0);
+
+        // Reported once, after which the packets start a new session; a Signal Strength packet is one at any time
+        QI_CHECK(script.AddPacket(QiHeaderSignalStrength, 100000) == 0);
+        QI_CHECK(script.AddPacket(QiHeaderIdentification, 10000) == 0);
+        QI_CHECK(script.AddPacket(QiHeaderControlError, 10000) == 0);
+        QI_CHECK(script.AddPacket(QiHeaderEndPowerTransfer, 10000) == 0);
+        QI_CHECK(script.IsViolation(script.AddPacket(QiHeaderControlError, 28001), QiRuleEptToRemoval, 28001, 28000, true));
+        QI_CHECK(script.AddPacket(QiHeaderControlError, 10000) == 0);
+        QI_CHECK(script.AddPacket(QiHeaderEndPowerTransfer, 10000) == 0);
+        QI_CHECK(script.AddPacket(QiHeaderSignalStrength, 100) == 0);
+        QI_CHECK(script.AddPacket(QiHeaderIdentification, 10000) == 0);
+    }
+
+    // Preambles from the shortest to far longer than the rules allow are decoded; only the long ones break the rule
+    const U32 preamble_bits[] = { kQiMinPreambleBits, 25, 26, 40 };
+    for (U32 i = 0; i < sizeof(preamble_bits) / sizeof(preamble_bits[0]); i++) {
+        QiTrafficSettings settings;
+        settings.mSampleRateHz   = 1000000;
+        settings.mSeed           = 5;
+        settings.mPreambleBits   = preamble_bits[i];
+        settings.mPeriodError    = 0.05;
+        settings.mJitter         = 0.03;
+        settings.mControlPackets = 10;
+
+        QiTrafficGenerator generator;
+        std::vector<U64>   edges;
+        generator.Reset(settings);
+        while (generator.GetSessionCount() < 2)
+            generator.AddNextPacket(edges);
+
+        PacketLog log;
+        QiDecoder decoder;
+        decoder.SetListener(&log);
+        decoder.Reset(1000000);
+        decoder.Run(edges.data(), edges.size());
+        QI_CHECK(log.GetPackets().size() == generator.GetPacketCount());
+
+        QiTimingChecker   checker;
+        QiTimingViolation violations[kQiTimingRuleCount];
+        U32               preamble_violations = 0;
+        checker.Reset(1000000);
+        for (size_t p = 0; p < log.GetPackets().size(); p++) {
+            const QiPacket& packet = log.GetPackets()[p];
+            QI_CHECK(packet.mPreambleBits == preamble_bits[i]);
+            U32 count = checker.AddPacket(packet, violations);
+            for (U32 v = 0; v < count; v++)
+                preamble_violations += (violations[v].mRule == QiRulePreamble) ? 1 : 0;
+        }
+        QI_CHECK(preamble_violations == ((preamble_bits[i] > 25) ? log.GetPackets().size() : 0));
+    }
+}
+
+//
+// Repeats
+//
+
+// A packet of 1 ms from start, its first message byte value and the others 0.
+static QiPacket MakePacket(U8 header, U8 value, U64 start, bool checksum_valid = true) {
+    QiPacket packet;
+    memset(&packet, 0, sizeof(packet));
+    packet.mHeader        = header;
+    packet.mInfo          = QiLookupPacket(header);
+    packet.mSize          = QiPacketSizeForHeader(header);
+    packet.mMessage[0]    = value;
+    packet.mStart         = start;
+    packet.mEnd           = start + 1000;
+    packet.mChecksumValid = checksum_valid;
+    return packet;
+}
+
+static QiByte MakeByte(U8 payload, U64 start) {
+    QiByte byte;
+    memset(&byte, 0, sizeof(byte));
+    byte.mPayload = payload;
+    for (U32 i = 0; i < 12; i++)
+        byte.mBitEdges[i] = start + i;
+    return byte;
+}
+
+// What a QiRepeatCollapser shows, as lines of text.
+class CollapsedLog : public QiCollapsedListener {
+  public:
+    virtual void OnMarker(U64 location, QiMarkerType marker) {
+        char line[64];
+        snprintf(line, sizeof(line), "marker %llu %d\n", (unsigned long long)(location), int(marker));
+        mText += line;
+    }
+
+    virtual void OnByte(const QiByte& byte) {
+        char line[64];
+        snprintf(line, sizeof(line), "byte 0x%02X\n", byte.mPayload);
+        mText += line;
+    }
+
+    virtual void OnRun(const QiPacketRepeats& repeats) {
+        const QiPacketRun& run = repeats.GetRun();
+        char               line[128];
+        snprintf(line,
+                 sizeof(line),
+                 "run %u %llu %llu %u %d %d\n",
+                 run.mCount,
+                 (unsigned long long)(run.mStart),
+                 (unsigned long long)(run.mEnd),
+                 run.mControlErrors,
+                 run.mControlErrorMin,
+                 run.mControlErrorMax);
+        mText += line;
+    }
+
+    // Returns the text since the last call.
+    std::string Take() {
+        std::string text;
+        text.swap(mText);
+        return text;
+    }
+
+  private:
+    std::string mText;
+};
+
+// The Control Error tolerance, the references of five headers in four entries, packets with errors, and the collapser's
+// markers and bytes around runs broken by errors and by a loss of sync.
+static void TestPacketRepeats() {
+    {
+        // Exact matches without a tolerance; with one, only Control Error values may differ
+        QiPacketRepeats repeats;
+        repeats.Reset(0);
+        QI_CHECK(repeats.IsRepeat(MakePacket(QiHeaderControlError, 5, 0)) == false);
+        repeats.SetReference(MakePacket(QiHeaderControlError, 5, 0));
+        QI_CHECK(repeats.IsRepeat(MakePacket(QiHeaderControlError, 5, 0)));
+        QI_CHECK(repeats.IsRepeat(MakePacket(QiHeaderControlError, 6, 0)) == false);
+
+        repeats.Reset(2);
+        repeats.SetReference(MakePacket(QiHeaderControlError, 0xFF, 0));    // -1
+        repeats.SetReference(MakePacket(QiHeaderReceivedPower8, 100, 0));
+        QI_CHECK(repeats.IsRepeat(MakePacket(QiHeaderControlError, 1, 0)));
+        QI_CHECK(repeats.IsRepeat(MakePacket(QiHeaderControlError, 0xFD, 0)));    // -3
+        QI_CHECK(repeats.IsRepeat(MakePacket(QiHeaderControlError, 2, 0)) == false);
+        QI_CHECK(repeats.IsRepeat(MakePacket(QiHeaderControlError, 0xFC, 0)) == false);
+        QI_CHECK(repeats.IsRepeat(MakePacket(QiHeaderReceivedPower8, 101, 0)) == false);
+
+        repeats.AddRepeat(MakePacket(QiHeaderControlError, 1, 1000), 3);
+        repeats.AddRepeat(MakePacket(QiHeaderReceivedPower8, 100, 3000), 0);
+        repeats.AddRepeat(MakePacket(QiHeaderControlError, 0xFD, 5000), 2);
+        const QiPacketRun& run = repeats.GetRun();
+        QI_CHECK(repeats.HasRun() && (run.mCount == 3) && (run.mStart == 1000) && (run.mEnd == 6000) && (run.mGlitches == 5));
+        QI_CHECK((run.mControlErrors == 2) && (run.mControlErrorMin == -3) && (run.mControlErrorMax == 1));
+        QI_CHECK((repeats.GetRepeatCount(0) == 2) && (repeats.GetRepeatCount(1) == 1));
+        repeats.ClearRun();
+        QI_CHECK((repeats.HasRun() == false) && (repeats.GetRepeatCount(0) == 0) && (repeats.GetRepeatCount(1) == 0));
+
+        // The references are kept past the run, and forgotten by ClearReferences()
+        QI_CHECK(repeats.IsRepeat(MakePacket(QiHeaderReceivedPower8, 100, 0)));
+        repeats.ClearReferences();
+        QI_CHECK(repeats.IsRepeat(MakePacket(QiHeaderReceivedPower8, 100, 0)) == false);
+    }
+    {
+        // Packets with errors neither repeat nor become a reference, and remove the reference of their header
+        QiPacketRepeats repeats;
+        repeats.Reset(0);
+        repeats.SetReference(MakePacket(QiHeaderReceivedPower8, 100, 0, false));
+        QI_CHECK(repeats.IsRepeat(MakePacket(QiHeaderReceivedPower8, 100, 0)) == false);
+        repeats.SetReference(MakePacket(QiHeaderReceivedPower8, 100, 0));
+        QI_CHECK(repeats.IsRepeat(MakePacket(QiHeaderReceivedPower8, 100, 0, false)) == false);
+        QiPacket bit_errors = MakePacket(QiHeaderReceivedPower8, 100, 0);
+        bit_errors.mBitErrors = true;
+        QI_CHECK(repeats.IsRepeat(bit_errors) == false);
+        repeats.SetReference(bit_errors);
+        QI_CHECK(repeats.IsRepeat(MakePacket(QiHeaderReceivedPower8, 100, 0)) == false);
+    }
+    {
+        // Five headers in four entries: a new header replaces the one used longest ago, by a reference or a repeat
+        const U8 headers[] = { QiHeaderSignalStrength, QiHeaderControlError, QiHeaderReceivedPower8, QiHeaderConfiguration };
+        QiPacketRepeats repeats;
+        repeats.Reset(0);
+        for (U32 i = 0; i < kQiRepeatReferences; i++)
+            repeats.SetReference(MakePacket(headers[i], 1, 0));
+        repeats.AddRepeat(MakePacket(QiHeaderSignalStrength, 1, 0), 0);
+        repeats.SetReference(MakePacket(QiHeaderIdentification, 1, 0));
+        QI_CHECK(repeats.IsRepeat(MakePacket(QiHeaderSignalStrength, 1, 0)));
+        QI_CHECK(repeats.IsRepeat(MakePacket(QiHeaderControlError, 1, 0)) == false);
+        QI_CHECK(repeats.IsRepeat(MakePacket(QiHeaderReceivedPower8, 1, 0)));
+        QI_CHECK(repeats.IsRepeat(MakePacket(QiHeaderConfiguration, 1, 0)));
+        QI_CHECK(repeats.IsRepeat(MakePacket(QiHeaderIdentification, 1, 0)));
+
+        // A new packet of a header replaces its own entry
+        repeats.SetReference(MakePacket(QiHeaderConfiguration, 2, 0));
+        repeats.SetReference(MakePacket(QiHeaderEndPowerTransfer, 1, 0));
+        QI_CHECK(repeats.IsRepeat(MakePacket(QiHeaderReceivedPower8, 1, 0)) == false);
+        QI_CHECK(repeats.IsRepeat(MakePacket(QiHeaderConfiguration, 2, 0)));
+        QI_CHECK(repeats.IsRepeat(MakePacket(QiHeaderSignalStrength, 1, 0)));
+        QI_CHECK(repeats.IsRepeat(MakePacket(QiHeaderEndPowerTransfer, 1, 0)));
+    }
+    {
+        // Repeats drop what was held back with them; an error marker shows the next packet in full, after the run
+        CollapsedLog      log;
+        QiRepeatCollapser collapser;
+        collapser.Reset(0, &log);
+        collapser.HoldMarker(100, QiMarkerDot);
+        collapser.HoldByte(MakeByte(0x03, 1000));
+        QI_CHECK(collapser.AddPacket(MakePacket(QiHeaderControlError, 0, 1000), 0, false));
+        QI_CHECK(log.Take() == "marker 100 0\nbyte 0x03\n");
+
+        for (U32 i = 0; i < 3; i++) {
+            QI_CHECK(collapser.HoldMarker(2500 + i * 2000, QiMarkerDot));
+            collapser.HoldByte(MakeByte(0x03, 3000 + i * 2000));
+            QI_CHECK(collapser.AddPacket(MakePacket(QiHeaderControlError, 0, 3000 + i * 2000), 0, false) == false);
+        }
+        QI_CHECK(collapser.HasRun() && (collapser.HasPendingBytes() == false) && log.Take().empty());
+
+        // The decoder's marker on the last edge of a repeat goes with it; on the last edge of a packet shown in full,
+        // it is shown right away
+        QI_CHECK(collapser.HoldMarker(8000, QiMarkerErrorDot));
+        collapser.HoldMarker(8500, QiMarkerDot);
+        collapser.HoldByte(MakeByte(0x03, 9000));
+        collapser.HoldMarker(9500, QiMarkerErrorSquare);
+        collapser.HoldByte(MakeByte(0x00, 10000));
+        collapser.HoldMarker(10500, QiMarkerDot);
+        QI_CHECK(collapser.AddPacket(MakePacket(QiHeaderControlError, 0, 9000), 0, false));
+        QI_CHECK(log.Take() == "run 3 3000 8000 3 0 0\nmarker 8500 0\nbyte 0x03\nmarker 9500 2\nbyte 0x00\nmarker 10500 0\n");
+        QI_CHECK(collapser.HoldMarker(10000, QiMarkerErrorDot) == false);
+        QI_CHECK(log.Take().empty());
+
+        QI_CHECK(collapser.AddPacket(MakePacket(QiHeaderControlError, 0, 11000), 0, false) == false);
+        QI_CHECK(collapser.AddPacket(MakePacket(QiHeaderControlError, 0, 13000), 0, true));
+        QI_CHECK(log.Take() == "run 1 11000 12000 1 0 0\n");
+
+        // A packet with errors ends the run and its reference
+        QI_CHECK(collapser.AddPacket(MakePacket(QiHeaderControlError, 0, 15000), 0, false) == false);
+        QI_CHECK(collapser.AddPacket(MakePacket(QiHeaderControlError, 0, 17000, false), 0, false));
+        QI_CHECK(log.Take() == "run 1 15000 16000 1 0 0\n");
+        QI_CHECK(collapser.AddPacket(MakePacket(QiHeaderControlError, 0, 19000), 0, false));
+        QI_CHECK(collapser.AddPacket(MakePacket(QiHeaderControlError, 0, 21000), 0, false) == false);
+
+        // A loss of sync shows the run and the bytes cut short, and the next packets in full
+        collapser.HoldByte(MakeByte(0x03, 23000));
+        QI_CHECK(collapser.HasPendingBytes());
+        collapser.ShowPending();
+        QI_CHECK(log.Take() == "run 1 21000 22000 1 0 0\nbyte 0x03\n");
+        QI_CHECK(collapser.AddPacket(MakePacket(QiHeaderControlError, 0, 25000), 0, false));
+        QI_CHECK(collapser.AddPacket(MakePacket(QiHeaderControlError, 0, 27000), 0, false) == false);
+        collapser.EndRun();
+        QI_CHECK((collapser.HasRun() == false) && (log.Take() == "run 1 27000 28000 1 0 0\n"));
+    }
+}
+
+//
+// Search
+//
+
+// The matches that a packet completes, as "name packets start end" lines.
+static std::string SearchPacket(QiPacketSearch& search, const QiSearchPatterns& patterns, const QiPacket& packet) {
+    std::vector<QiSearchMatch> matches(patterns.GetPatternCount() + 1);
+    U32                        count = search.AddPacket(packet, matches.data());
+    std::string                text;
+    for (U32 i = 0; i < count; i++) {
+        char line[128];
+        snprintf(line,
+                 sizeof(line),
+                 "%s %u %llu %llu\n",
+                 patterns.GetPatternName(matches[i].mPattern),
+                 matches[i].mPackets,
+                 (unsigned long long)(matches[i].mStart),
+                 (unsigned long long)(matches[i].mEnd));
+        text += line;
+    }
+    return text;
+}
+
+// Each kind of byte, sequences broken by packets with errors or by other packets, patterns that match the same packets,
+// and patterns that do not compile.
+static void TestPacketSearch() {
+    std::string error;
+    {
+        QiSearchPatterns patterns;
+        QI_CHECK(patterns.Compile("low: 03 00-0F; high: 03 F0-FF; mask: 03 80/C0\n any:03 *; rp: 04 ??; 51 * 00", error));
+        QI_CHECK((patterns.GetPatternCount() == 6) && (strcmp(patterns.GetPatternName(5), "51 * 00") == 0));
+
+        QiPacketSearch search;
+        search.Reset(&patterns);
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderControlError, 0x00, 0)) == "low 1 0 1000\nany 1 0 1000\n");
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderControlError, 0x0F, 0)) == "low 1 0 1000\nany 1 0 1000\n");
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderControlError, 0x10, 0)) == "any 1 0 1000\n");
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderControlError, 0x80, 0)) == "mask 1 0 1000\nany 1 0 1000\n");
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderControlError, 0xBF, 0)) == "mask 1 0 1000\nany 1 0 1000\n");
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderControlError, 0xC0, 0)) == "any 1 0 1000\n");
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderControlError, 0xEF, 0)) == "any 1 0 1000\n");
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderControlError, 0xF0, 0)) == "high 1 0 1000\nany 1 0 1000\n");
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderControlError, 0xFF, 0)) == "high 1 0 1000\nany 1 0 1000\n");
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderReceivedPower8, 0x5A, 0)) == "rp 1 0 1000\n");
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderSignalStrength, 0x03, 0)).empty());
+
+        // Message bytes after the ones listed match anything
+        QiPacket configuration = MakePacket(QiHeaderConfiguration, 0x0A, 0);
+        QI_CHECK(SearchPacket(search, patterns, configuration) == "51 * 00 1 0 1000\n");
+        configuration.mMessage[1] = 0x01;
+        QI_CHECK(SearchPacket(search, patterns, configuration).empty());
+        configuration.mMessage[1] = 0x00;
+        configuration.mMessage[4] = 0xFF;
+        QI_CHECK(SearchPacket(search, patterns, configuration) == "51 * 00 1 0 1000\n");
+
+        // Packets with errors match nothing
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderControlError, 0x00, 0, false)).empty());
+        QiPacket bit_errors   = MakePacket(QiHeaderReceivedPower8, 0x00, 0);
+        bit_errors.mBitErrors = true;
+        QI_CHECK(SearchPacket(search, patterns, bit_errors).empty());
+
+        search.Reset(nullptr);
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderControlError, 0x00, 0)).empty());
+    }
+    {
+        // Sequences start at the first sample of their first packet, and only follow packets without errors in between
+        QiSearchPatterns patterns;
+        QI_CHECK(patterns.Compile("id_cfg: 71 > 51; ce3: 03 > 03 > 03", error));
+
+        QiPacketSearch search;
+        search.Reset(&patterns);
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderIdentification, 0, 1000)).empty());
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderConfiguration, 0, 3000)) == "id_cfg 2 1000 4000\n");
+
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderIdentification, 0, 5000)).empty());
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderSignalStrength, 0, 7000)).empty());
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderConfiguration, 0, 9000)).empty());
+
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderIdentification, 0, 11000)).empty());
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderConfiguration, 0, 13000, false)).empty());
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderConfiguration, 0, 15000)).empty());
+
+        // A packet with errors that the pattern would skip over still breaks the sequence
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderControlError, 0, 17000)).empty());
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderControlError, 0, 19000)).empty());
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderControlError, 0, 21000, false)).empty());
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderControlError, 0, 23000)).empty());
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderControlError, 0, 25000)).empty());
+
+        // Sequences that overlap each match
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderControlError, 0, 27000)) == "ce3 3 23000 28000\n");
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderControlError, 0, 29000)) == "ce3 3 25000 30000\n");
+    }
+    {
+        // Patterns that match the same packet are all reported, in the order of the patterns
+        QiSearchPatterns patterns;
+        QI_CHECK(patterns.Compile("ce: 03; ce_high: 03 10-1F; id_ce: 71 > 03; ce_ce: 03 > 03", error));
+
+        QiPacketSearch search;
+        search.Reset(&patterns);
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderIdentification, 0, 1000)).empty());
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderControlError, 0x12, 3000)) ==
+                 "ce 1 3000 4000\nce_high 1 3000 4000\nid_ce 2 1000 4000\n");
+        QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderControlError, 0x02, 5000)) == "ce 1 5000 6000\nce_ce 2 3000 6000\n");
+    }
+    {
+        // The longest sequence, after more packets than the search keeps the starts of
+        QiSearchPatterns patterns;
+        QI_CHECK(patterns.Compile("ping_to_power: 01 > 71 > 81 > 51 > 03 > 03 > 04 > 02", error));
+        QI_CHECK(patterns.GetPatternPackets(0) == kQiSearchMaxPackets);
+
+        const U8 headers[] = { QiHeaderSignalStrength,  QiHeaderIdentification, QiHeaderExtendedIdentification, QiHeaderConfiguration,
+                               QiHeaderControlError,    QiHeaderControlError,   QiHeaderReceivedPower8,         QiHeaderEndPowerTransfer };
+        QiPacketSearch search;
+        search.Reset(&patterns);
+        for (U32 i = 0; i < 11; i++)
+            QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderControlError, 0, i * 2000)).empty());
+        for (U32 i = 0; i < kQiSearchMaxPackets; i++) {
+            std::string matches = SearchPacket(search, patterns, MakePacket(headers[i], 0, 100000 + i * 2000));
+            QI_CHECK(matches == ((i + 1 < kQiSearchMaxPackets) ? "" : "ping_to_power 8 100000 115000\n"));
+        }
+    }
+
+    // Patterns that do not compile leave none
+    const char* const bad_patterns[][2] = {
+        { "ce: 03 1G", "pattern 'ce': bad byte '1G'" },
+        { "03 10-0F", "pattern '03 10-0F': bad byte '10-0F'" },
+        { "ce: 03 100", "pattern 'ce': bad byte '100'" },
+        { "ce: 03 > ", "pattern 'ce': a packet without bytes" },
+        { "long: 01 > 01 > 01 > 01 > 01 > 01 > 01 > 01 > 01", "pattern 'long': more than 8 packets" },
+    };
+    for (U32 i = 0; i < sizeof(bad_patterns) / sizeof(bad_patterns[0]); i++) {
+        QiSearchPatterns patterns;
+        QI_CHECK(patterns.Compile("ok: 03", error));
+        QI_CHECK(patterns.Compile(bad_patterns[i][0], error) == false);
+        QI_CHECK((error == bad_patterns[i][1]) && (patterns.GetPatternCount() == 0));
+    }
+
+    // Each wildcard packet of a sequence doubles the packets that the automaton has to tell apart: one such pattern
+    // compiles, three do not
+    std::string sequence = " > * > * > * > * > * > * > *";
+    std::string three    = "01" + sequence + "; 02" + sequence + "; 03" + sequence;
+    QiSearchPatterns patterns;
+    QI_CHECK(patterns.Compile(("01" + sequence).c_str(), error) && (patterns.GetStateCount() <= kQiSearchMaxStates));
+    QI_CHECK(patterns.Compile(three.c_str(), error) == false);
+    QI_CHECK((error == "too many patterns: the search needs more than 4096 states") && (patterns.GetPatternCount() == 0));
+
+    QiPacketSearch search;
+    search.Reset(&patterns);
+    QI_CHECK(SearchPacket(search, patterns, MakePacket(QiHeaderSignalStrength, 0, 0)).empty());
+}
+
+//
+// FSK
+//
+
+// The transmitter's bytes and responses, as lines of text like QiCarrierMessage.
+class FskLog : public QiFskListener {
+  public:
+    virtual void OnFskByte(const QiByte& byte) {
+        char line[64];
+        snprintf(line,
+                 sizeof(line),
+                 "byte %u 0x%02X %u %u\n",
+                 byte.mPacketByte,
+                 byte.mPayload,
+                 byte.mParityValid ? 1 : 0,
+                 byte.mStopValid ? 1 : 0);
+        mText += line;
+        if (byte.mPacketByte == 0)
+            mStarts.push_back(byte.mBitEdges[0]);
+    }
+
+    virtual void OnFskResponse(U64 start, U64, U8 pattern) {
+        char line[64];
+        snprintf(line, sizeof(line), "response 0x%02X\n", pattern);
+        mText += line;
+        mStarts.push_back(start);
+    }
+
+    const std::string&      GetText() const { return mText; }
+    const std::vector<U64>& GetStarts() const { return mStarts; }
+
+  private:
+    std::string      mText;
+    std::vector<U64> mStarts;
+};
+
+// Generates messages and appends the lines and starts that FskLog should have for them; returns the number of frequency
+// steps.
+static U32 GenerateCarrier(QiCarrierGenerator& generator, U32 messages, std::vector<U64>& edges, std::string& text,
+                           std::vector<U64>& starts) {
+    U32 steps = 0;
+    for (U32 i = 0; i < messages; i++) {
+        const QiCarrierMessage& message = generator.AddNextMessage(edges);
+        char                    line[64];
+        switch (message.mType) {
+        case QiCarrierPacket:
+            for (U32 b = 0; b < message.mSize; b++) {
+                snprintf(line, sizeof(line), "byte %u 0x%02X 1 1\n", b, message.mBytes[b]);
+                text += line;
+            }
+            starts.push_back(message.mStart);
+            break;
+        case QiCarrierResponse:
+            snprintf(line, sizeof(line), "response 0x%02X\n", message.mPattern);
+            text += line;
+            starts.push_back(message.mStart);
+            break;
+        case QiCarrierFrequencyStep:
+            steps++;
+            break;
+        }
+    }
+    return steps;
+}
+
+// Decodes edges in batches of random sizes up to kQiFskBatchSize.
+static void DecodeCarrierEdges(QiFskDecoder& decoder, const std::vector<U64>& edges, Random& random) {
+    size_t position = 0;
+    while (position < edges.size()) {
+        U32 count = U32(std::min<size_t>(1 + random.Below(kQiFskBatchSize), edges.size() - position));
+        decoder.ProcessEdges(&edges[position], count);
+        position += count;
+    }
+}
+
+// Packets, responses and frequency steps over carriers from 110 to 205 kHz, sampled at 10 to 50 MHz.
+static void TestFskDecoder() {
+    struct Case {
+        U32    mSampleRateHz;
+        U32    mCarrierHz;
+        double mDepth;
+        double mJitter;
+    };
+    const Case cases[] = {
+        { 20000000, 140000, 0.01, 0.0 },
+        { 10000000, 110000, 0.01, 0.005 },
+        { 50000000, 205000, 0.005, 0.005 },
+        { 20000000, 175000, 0.02, 0.01 },
+    };
+
+    for (U32 c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        QiCarrierSettings settings;
+        settings.mSampleRateHz = cases[c].mSampleRateHz;
+        settings.mSeed         = 21 + c;
+        settings.mCarrierHz    = cases[c].mCarrierHz;
+        settings.mDepth        = cases[c].mDepth;
+        settings.mJitter       = cases[c].mJitter;
+
+        QiCarrierGenerator generator;
+        std::vector<U64>   edges;
+        std::string        expected;
+        std::vector<U64>   expected_starts;
+        generator.Reset(settings);
+        U32 steps = GenerateCarrier(generator, 60, edges, expected, expected_starts);
+        generator.AddIdle(settings.mIdleCycles, edges);
+
+        FskLog       log;
+        QiFskDecoder decoder;
+        Random       random(c);
+        decoder.SetListener(&log);
+        decoder.Reset(settings.mSampleRateHz);
+        DecodeCarrierEdges(decoder, edges, random);
+        decoder.Flush();
+
+        const QiFskStats& stats = decoder.GetStats();
+        QI_CHECK(steps > 0);
+        QI_CHECK(stats.mFrequencySteps == steps);
+        QI_CHECK(stats.mBitErrors == 0);
+        QI_CHECK(CompareLogs("fsk", expected, log.GetText()));
+
+        // Packets and responses start within the averaging window of their first change of frequency
+        U64 window = U64(kQiFskWindowCycles) * settings.mSampleRateHz / settings.mCarrierHz;
+        if (QI_CHECK(log.GetStarts().size() == expected_starts.size())) {
+            for (size_t i = 0; i < expected_starts.size(); i++)
+                QI_CHECK(log.GetStarts()[i] + window - expected_starts[i] < 2 * window);
+        }
+    }
+
+    // The carrier stops right after the last bit of a response, and only the silence ends it. It comes back later at
+    // another frequency, which is measured anew instead of being taken for a step.
+    QiCarrierSettings settings;
+    settings.mStepInterval = 0;
+    QiCarrierGenerator generator;
+    std::vector<U64>   edges;
+    std::string        expected;
+    std::vector<U64>   expected_starts;
+    generator.Reset(settings);
+    while (GenerateCarrier(generator, 1, edges, expected, expected_starts), expected.compare(0, 8, "response") != 0) {
+        edges.clear();
+        expected.clear();
+        expected_starts.clear();
+    }
+
+    FskLog       log;
+    QiFskDecoder decoder;
+    Random       random(99);
+    decoder.SetListener(&log);
+    decoder.Reset(settings.mSampleRateHz);
+    DecodeCarrierEdges(decoder, edges, random);
+    QI_CHECK(log.GetText().empty());
+    decoder.ProcessSilence(edges.back() + settings.mSampleRateHz / 1000);
+    QI_CHECK(log.GetText().empty());
+    decoder.ProcessSilence(edges.back() + settings.mSampleRateHz / 100);
+    QI_CHECK(CompareLogs("fsk before the carrier stops", expected, log.GetText()));
+
+    settings.mSeed      = 2;
+    settings.mCarrierHz = 150000;
+    std::vector<U64> restarted;
+    generator.Reset(settings);
+    GenerateCarrier(generator, 20, restarted, expected, expected_starts);
+    generator.AddIdle(settings.mIdleCycles, restarted);
+    for (size_t i = 0; i < restarted.size(); i++)
+        restarted[i] += edges.back() + settings.mSampleRateHz / 10;
+    DecodeCarrierEdges(decoder, restarted, random);
+    QI_CHECK(CompareLogs("fsk after the carrier is back", expected, log.GetText()));
+    QI_CHECK(decoder.GetStats().mFrequencySteps == 0);
+    QI_CHECK(decoder.GetStats().mBitErrors == 0);
+}
+
+//
+// Live decoding
+//
+
+// Writes edges 0 to edge_count - 1 into the ring in batches of random sizes, and closes it.
+static void ProduceEdges(QiEdgeRing* ring, U64 edge_count) {
+    Random     random(6);
+    QiLiveEdge edges[100];
+    U64        next = 0;
+    while (next < edge_count) {
+        U32 count = 1 + random.Below(100);
+        if (count > edge_count - next)
+            count = U32(edge_count - next);
+        for (U32 i = 0; i < count; i++) {
+            edges[i].mLocation  = next + i;
+            edges[i].mArrivalNs = 0;
+        }
+        for (U32 stored = 0; stored < count;) {
+            stored += ring->Write(edges + stored, count - stored);
+            if (stored < count)
+                std::this_thread::yield();
+        }
+        next += count;
+    }
+    ring->Close();
+}
+
+// Batches of random sizes through a ring of 8 edges, so that its indices wrap around many times and it runs full and
+// empty; then the same with the producer on another thread.
+static void TestEdgeRing() {
+    Random     random(5);
+    QiEdgeRing ring(5);
+    QiLiveEdge batch[16];
+    U64        written = 0;
+    U64        read    = 0;
+    QI_CHECK(ring.Read(batch, 16) == 0);
+    for (U32 round = 0; round < 2000; round++) {
+        U32 count = 1 + random.Below(12);
+        for (U32 i = 0; i < count; i++) {
+            batch[i].mLocation  = written + i;
+            batch[i].mArrivalNs = 3 * (written + i);
+        }
+        U32 stored = ring.Write(batch, count);
+        QI_CHECK(stored <= count);
+        QI_CHECK(written + stored - read <= 8);
+        QI_CHECK((stored == count) || (written + stored - read == 8));
+        written += stored;
+
+        count     = ring.Read(batch, 1 + random.Below(12));
+        bool same = true;
+        for (U32 i = 0; i < count; i++)
+            same = same && (batch[i].mLocation == read + i) && (batch[i].mArrivalNs == 3 * (read + i));
+        QI_CHECK(same);
+        QI_CHECK((count > 0) || (written == read));
+        read += count;
+        QI_CHECK(ring.IsDone() == false);
+    }
+    QI_CHECK(written > 1000);
+    QI_CHECK((ring.GetHighWater() > 0) && (ring.GetHighWater() <= 8));
+
+    // The edges written before Close() are still read, and only then is the ring done
+    ring.Close();
+    while (written - read > 0) {
+        QI_CHECK(ring.IsDone() == false);
+        U32 count = ring.Read(batch, 3);
+        QI_CHECK((count > 0) && (batch[0].mLocation == read));
+        read += count;
+    }
+    QI_CHECK(ring.IsDone());
+    QI_CHECK(ring.Read(batch, 16) == 0);
+
+    const U64  edge_count = 200000;
+    QiEdgeRing shared(64);
+    std::thread producer(ProduceEdges, &shared, edge_count);
+
+    U64  next  = 0;
+    bool order = true;
+    while (shared.IsDone() == false) {
+        U32 count = shared.Read(batch, 1 + random.Below(16));
+        for (U32 i = 0; i < count; i++)
+            order = order && (batch[i].mLocation == next + i);
+        next += count;
+    }
+    producer.join();
+    QI_CHECK(order);
+    QI_CHECK(next == edge_count);
+    QI_CHECK(shared.GetHighWater() <= 64);
+}
+
+#ifndef _WIN32
+// Writes the stream in chunks of random sizes with pauses between some, so that the reader gets lines and records
+// split across its reads, and closes it.
+static void WriteStream(int file, const std::string& stream, U64 seed) {
+    Random random(seed);
+    size_t position = 0;
+    bool   ok       = true;
+    while (ok && (position < stream.size())) {
+        size_t size = 1 + random.Below(700);
+        if (size > stream.size() - position)
+            size = stream.size() - position;
+        ok = (write(file, stream.data() + position, size) == ssize_t(size));
+        position += size;
+        if (random.Below(4) == 0)
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    close(file);
+}
+
+// Opening either end of a FIFO waits for the other.
+static void WriteFifo(const std::string* path, const std::string* stream) {
+    int file = open(path->c_str(), O_WRONLY);
+    if (file >= 0)
+        WriteStream(file, *stream, 1);
+}
+
+static void WriteSocket(int server, const std::string* stream) {
+    int file = accept(server, nullptr, nullptr);
+    if (file >= 0)
+        WriteStream(file, *stream, 2);
+}
+
+// Decodes the stream from `path` through the reader and a ring smaller than the stream's bursts, and checks it against
+// decoding the same bytes from a file.
+static void DecodeStream(const char* what, const std::string& path, QiEdgeFileFormat format, const std::string& stream) {
+    const U64 min_pulse_width = 40;
+
+    std::string      file_path = OutputPath("live.edges");
+    std::vector<U64> edges;
+    std::string      error;
+    QI_CHECK(WriteFile(file_path, stream) && QiReadEdgeFile(file_path.c_str(), format, 0, 1000000, edges, error));
+    remove(file_path.c_str());
+
+    EventLog             expected;
+    QiArrayEdgeSource    array(edges.data(), edges.size());
+    QiDeglitchEdgeSource array_deglitched(array, min_pulse_width);
+    QiDecoder            decoder;
+    decoder.SetListener(&expected);
+    decoder.Reset(1000000);
+    decoder.Run(array_deglitched);
+    QI_CHECK(expected.GetText().find("byte") != std::string::npos);
+
+    // A slack of a second, so that the pauses of the writer never end a byte early
+    QiLiveReader reader;
+    if (QI_CHECK(reader.Open(path.c_str(), format, error)) == false) {
+        fprintf(stderr, "  %s: %s\n", what, error.c_str());
+        return;
+    }
+    EventLog             actual;
+    QiEdgeRing           ring(256);
+    QiLiveEdgeSource     source(ring, 1000000, 1000000);
+    QiDeglitchEdgeSource deglitched(source, min_pulse_width);
+    decoder.SetListener(&actual);
+    decoder.Reset(1000000);
+    source.SetDecoder(&decoder);
+    reader.Start(ring);
+    decoder.Run(deglitched);
+    QI_CHECK(reader.Join(error));
+    QI_CHECK(ring.IsDone());
+    QI_CHECK(source.GetEdgeCount() == edges.size());
+    QI_CHECK(ring.GetHighWater() <= 256);
+    QI_CHECK(CompareLogs(what, expected.GetText(), actual.GetText()));
+}
+
+// A text stream written to a FIFO up to mPauseAt, which then stays open for three seconds before the rest follows.
+struct PausedStream {
+    std::string      mPath;
+    std::string      mText;
+    size_t           mPauseAt;
+    std::atomic<U64> mResumeNs;
+};
+
+static void WritePausedFifo(PausedStream* stream) {
+    int file = open(stream->mPath.c_str(), O_WRONLY);
+    if (file < 0)
+        return;
+
+    size_t rest = stream->mText.size() - stream->mPauseAt;
+    if (write(file, stream->mText.data(), stream->mPauseAt) == ssize_t(stream->mPauseAt)) {
+        std::this_thread::sleep_for(std::chrono::seconds(3));
+        stream->mResumeNs = QiLiveClockNs();
+        if (write(file, stream->mText.data() + stream->mPauseAt, rest) != ssize_t(rest))
+            fprintf(stderr, "  cannot write the rest of the paused stream\n");
+    }
+    close(file);
+}
+
+// Logs the events, and when the last byte that starts before `location` was decoded.
+class TimedEventLog : public EventLog {
+  public:
+    explicit TimedEventLog(U64 location) : mLocation(location), mLastByteNs(0) {}
+
+    virtual void OnByte(const QiByte& byte) {
+        EventLog::OnByte(byte);
+        if (byte.mBitEdges[0] < mLocation)
+            mLastByteNs = QiLiveClockNs();
+    }
+
+    U64 GetLastByteNs() const { return mLastByteNs; }
+
+  private:
+    U64 mLocation;
+    U64 mLastByteNs;
+};
+
+// An FOD packet, whose 4 bytes leave its last stop bit to the gap after it, followed by a pause of the stream: the
+// packet is decoded during the pause, as it would be at the end of the capture, rather than once the next packet
+// arrives.
+static void DecodePausedStream() {
+    const U64 min_pulse_width = 40;
+
+    QiTrafficSettings settings;
+    settings.mSeed           = 17;
+    settings.mPeriodError    = 0.05;
+    settings.mJitter         = 0.03;
+    settings.mControlPackets = 8;
+
+    QiTrafficGenerator generator;
+    generator.Reset(settings);
+    std::vector<U64> edges;
+    for (U32 i = 0; i < 6; i++)
+        generator.AddNextPacket(edges);
+    const U8 fod[2] = { 0x10, 0x20 };
+    generator.AddPacket(0x22, fod, settings.mPacketGapMs, edges);
+    size_t pause_edge = edges.size();
+    for (U32 i = 0; i < 6; i++)
+        generator.AddNextPacket(edges);
+
+    PausedStream stream;
+    stream.mPath     = OutputPath("paused.fifo");
+    stream.mPauseAt  = 0;
+    stream.mResumeNs = 0;
+    char line[32];
+    for (size_t i = 0; i < edges.size(); i++) {
+        snprintf(line, sizeof(line), "%llu\n", (unsigned long long)(edges[i]));
+        stream.mText += line;
+        if (i + 1 == pause_edge)
+            stream.mPauseAt = stream.mText.size();
+    }
+
+    EventLog             expected;
+    QiArrayEdgeSource    array(edges.data(), edges.size());
+    QiDeglitchEdgeSource array_deglitched(array, min_pulse_width);
+    QiDecoder            decoder;
+    decoder.SetListener(&expected);
+    decoder.Reset(1000000);
+    decoder.Run(array_deglitched);
+
+    remove(stream.mPath.c_str());
+    if (QI_CHECK(mkfifo(stream.mPath.c_str(), 0600) == 0) == false)
+        return;
+    std::thread writer(WritePausedFifo, &stream);
+
+    // The default slack of qi-decode -W
+    QiLiveReader reader;
+    std::string  error;
+    if (QI_CHECK(reader.Open(stream.mPath.c_str(), QiEdgeFileText, error))) {
+        TimedEventLog        actual(edges[pause_edge]);
+        QiEdgeRing           ring(256);
+        QiLiveEdgeSource     source(ring, 1000000, 1000);
+        QiDeglitchEdgeSource deglitched(source, min_pulse_width);
+        decoder.SetListener(&actual);
+        decoder.Reset(1000000);
+        source.SetDecoder(&decoder);
+        reader.Start(ring);
+        decoder.Run(deglitched);
+        QI_CHECK(reader.Join(error));
+        QI_CHECK(CompareLogs("paused stream", expected.GetText(), actual.GetText()));
+        QI_CHECK((actual.GetLastByteNs() != 0) && (actual.GetLastByteNs() < stream.mResumeNs));
+    } else {
+        fprintf(stderr, "  paused stream: %s\n", error.c_str());
+    }
+    writer.join();
+    remove(stream.mPath.c_str());
+}
+#endif
+
+// A generated capture streamed as text through a FIFO and as binary through a Unix domain socket, and a stream that
+// pauses after a packet with an even number of bytes.
+static void TestLiveReader() {
+#ifdef _WIN32
+    fprintf(stderr, "  live decoding is not available on Windows\n");
+#else
+    // A reader that fails must not take the test down with it
+    signal(SIGPIPE, SIG_IGN);
+
+    std::vector<U64> edges;
+    GenerateCapture(13, 2, edges);
+
+    // Comments, CRLF line ends, and a last edge without one
+    std::string text = "# generated capture\n";
+    char        line[64];
+    for (size_t i = 0; i < edges.size(); i++) {
+        const char* end = (i + 1 == edges.size()) ? "" : (i % 7 == 0) ? "\r\n" : (i % 101 == 0) ? " # edge\n" : "\n";
+        snprintf(line, sizeof(line), "%llu%s", (unsigned long long)(edges[i]), end);
+        text += line;
+    }
+    std::string fifo_path = OutputPath("live.fifo");
+    remove(fifo_path.c_str());
+    if (QI_CHECK(mkfifo(fifo_path.c_str(), 0600) == 0)) {
+        std::thread writer(WriteFifo, &fifo_path, &text);
+        DecodeStream("text over a FIFO", fifo_path, QiEdgeFileText, text);
+        writer.join();
+        remove(fifo_path.c_str());
+    }
+
+    std::string binary(edges.size() * 8, '\0');
+    for (size_t i = 0; i < edges.size(); i++)
+        QiPutU64(reinterpret_cast<U8*>(&binary[i * 8]), edges[i]);
+    std::string socket_path = OutputPath("live.sock");
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+    remove(socket_path.c_str());
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (QI_CHECK((server >= 0) && (bind(server, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) &&
+                 (listen(server, 1) == 0))) {
+        std::thread writer(WriteSocket, server, &binary);
+        DecodeStream("binary over a socket", socket_path, QiEdgeFileBinary, binary);
+        writer.join();
+    }
+    if (server >= 0)
+        close(server);
+    remove(socket_path.c_str());
+
+    DecodePausedStream();
+#endif
+}
+
+//
+// qi-decode
+//
+
+// The captures decoded as the coils of one transmitter, against decoding each capture on its own.
+static void TestDecodeCoils() {
+    const char* const fixtures[] = { "clean", "drifting", "noisy" };
+    const U32         coil_count = 3;
+
+    std::string inputs;
+    for (U32 i = 0; i < coil_count; i++)
+        inputs += " \"" + FixturePath(std::string(fixtures[i]) + ".edges") + "\"";
+    std::string bytes_path   = OutputPath("coils.bytes.csv");
+    std::string packets_path = OutputPath("coils.packets.csv");
+    if (QI_CHECK(RunDecoder("-r 1000000 -f binary -c -o " + bytes_path + " -P " + packets_path + inputs)) == false)
+        return;
+
+    std::string bytes;
+    std::string packets;
+    QI_CHECK(ReadFile(bytes_path, bytes) && ReadFile(packets_path, packets));
+    QI_CHECK(CheckGolden("coils.bytes.csv", bytes));
+    QI_CHECK(CheckGolden("coils.packets.csv", packets));
+
+    // Bytes in the order of their first sample, and the rows of each coil the same as from its capture alone
+    std::vector<std::string> lines = SplitLines(bytes);
+    std::vector<std::string> coil_lines[coil_count];
+    U64                      previous_sample = 0;
+    QI_CHECK((lines.empty() == false) && (lines[0] == "Sample,Time [s],Packet,Payload,Packet Byte,Parity,Stop,Coil"));
+    for (size_t i = 1; i < lines.size(); i++) {
+        size_t comma  = lines[i].rfind(',');
+        U64    sample = strtoull(lines[i].c_str(), nullptr, 10);
+        U32    coil   = U32(strtoul(lines[i].c_str() + comma + 1, nullptr, 10));
+        QI_CHECK(sample >= previous_sample);
+        previous_sample = sample;
+        if (QI_CHECK(coil < coil_count))
+            coil_lines[coil].push_back(lines[i].substr(0, comma));
+    }
+
+    for (U32 coil = 0; coil < coil_count; coil++) {
+        std::string single_path = OutputPath("coils.single.csv");
+        std::string single;
+        QI_CHECK(RunDecoder("-r 1000000 -f binary -o " + single_path + " \"" + FixturePath(std::string(fixtures[coil]) + ".edges") + "\""));
+        QI_CHECK(ReadFile(single_path, single));
+
+        std::vector<std::string> single_lines = SplitLines(single);
+        QI_CHECK(coil_lines[coil].empty() == false);
+        QI_CHECK((single_lines.size() == coil_lines[coil].size() + 1) &&
+                 std::equal(coil_lines[coil].begin(), coil_lines[coil].end(), single_lines.begin() + 1));
+        remove(single_path.c_str());
+    }
+
+    // Packets in the order that they end in, each with its coil
+    lines              = SplitLines(packets);
+    double previous_end = 0.0;
+    for (size_t i = 1; i < lines.size(); i++) {
+        char*  field    = nullptr;
+        double time     = strtod(lines[i].c_str(), &field);
+        double duration = strtod(field + 1, nullptr);
+        U32    coil     = U32(strtoul(lines[i].c_str() + lines[i].rfind(',') + 1, nullptr, 10));
+        QI_CHECK(time + duration >= previous_end - 1e-9);
+        QI_CHECK(coil < coil_count);
+        previous_end = time + duration;
+    }
+
+    remove(bytes_path.c_str());
+    remove(packets_path.c_str());
+}
+
+// Sessions far apart, so that the received power series is downsampled, and two of them without their End Power
+// Transfer packet: the second ends at the gap before the third, the last is still open at the end of the capture.
+static void TestDecodeSessions() {
+    const U32 session_count = 4;
+
+    QiTrafficSettings settings;
+    settings.mSampleRateHz   = 1000000;
+    settings.mSeed           = 11;
+    settings.mPeriodError    = 0.03;
+    settings.mJitter         = 0.02;
+    settings.mControlPackets = 60;
+    settings.mSessionGapMs   = 200000;
+
+    QiTrafficGenerator generator;
+    std::vector<U64>   edges;
+    U32                ended_sessions = 0;
+    generator.Reset(settings);
+    while (ended_sessions < session_count) {
+        size_t          first  = edges.size();
+        const QiPacket& packet = generator.AddNextPacket(edges);
+        if (packet.mHeader != QiHeaderEndPowerTransfer)
+            continue;
+        if ((ended_sessions == 1) || (ended_sessions == session_count - 1))
+            edges.resize(first);
+        ended_sessions++;
+    }
+
+    std::string edges_path = OutputPath("sessions.edges");
+    std::string stats_path = OutputPath("sessions.stats.csv");
+    std::string binary(edges.size() * 8, '\0');
+    for (size_t i = 0; i < edges.size(); i++)
+        QiPutU64(reinterpret_cast<U8*>(&binary[i * 8]), edges[i]);
+    if ((QI_CHECK(WriteFile(edges_path, binary)) == false) ||
+        (QI_CHECK(RunDecoder("-r 1000000 -f binary -A " + stats_path + " " + edges_path)) == false))
+        return;
+
+    std::string stats;
+    QI_CHECK(ReadFile(stats_path, stats));
+    QI_CHECK(CheckGolden("sessions.stats.csv", stats));
+
+    // The sessions and how they ended, and points of the series twice as long as at the start
+    std::vector<std::string> lines = SplitLines(stats);
+    std::vector<std::string> ends;
+    std::string              table;
+    U32                      power_points = 0;
+    for (size_t i = 0; i < lines.size(); i++) {
+        if (lines[i].empty())
+            continue;
+        if (lines[i][0] == '#') {
+            table = lines[i];
+            i++;    // the column names
+            continue;
+        }
+        if (table == "# sessions") {
+            ends.push_back(lines[i].substr(lines[i].rfind(',') + 1));
+        } else if (table == "# received_power") {
+            char* field = nullptr;
+            strtod(lines[i].c_str() + 2, &field);
+            QI_CHECK(strtod(field + 1, nullptr) == 2.0);
+            power_points++;
+        }
+    }
+    QI_CHECK(ends.size() == session_count);
+    if (ends.size() == session_count) {
+        QI_CHECK(ends[0].compare(0, 4, "EPT ") == 0);
+        QI_CHECK(ends[1] == "Timeout");
+        QI_CHECK(ends[2].compare(0, 4, "EPT ") == 0);
+        QI_CHECK(ends[3] == "Open");
+    }
+    QI_CHECK(power_points > 0);
+
+    remove(edges_path.c_str());
+    remove(stats_path.c_str());
+}
+
+// The fixtures with repeats collapsed, with and without a Control Error tolerance: every packet is either shown or in a
+// run, and packets with errors are always shown.
+static void TestDecodeCollapsed() {
+    const char* const fixtures[]   = { "clean", "noisy" };
+    const char* const tolerances[] = { "2", "0" };
+
+    for (U32 f = 0; f < 2; f++) {
+        std::string edges_path     = "\"" + FixturePath(std::string(fixtures[f]) + ".edges") + "\"";
+        std::string collapsed_path = OutputPath("collapsed.csv");
+        std::string packets_path   = OutputPath("collapsed.packets.csv");
+        if (QI_CHECK(RunDecoder("-r 1000000 -f binary -E " + std::string(tolerances[f]) + " -Z " + collapsed_path + " -P " +
+                                packets_path + " " + edges_path)) == false)
+            return;
+
+        std::string collapsed;
+        std::string packets;
+        QI_CHECK(ReadFile(collapsed_path, collapsed) && ReadFile(packets_path, packets));
+        QI_CHECK(CheckGolden(std::string(fixtures[f]) + ".collapsed.csv", collapsed));
+
+        std::vector<std::string> lines = SplitLines(collapsed);
+        U32                      shown    = 0;
+        U32                      runs     = 0;
+        U32                      repeated = 0;
+        QI_CHECK((lines.empty() == false) && (lines[0] == "Sample,Time [s],Type,Value,Repeats,Control Error Min,Control Error Max"));
+        for (size_t i = 1; i < lines.size(); i++) {
+            size_t      type_start = lines[i].find(',', lines[i].find(',') + 1) + 1;
+            std::string type       = lines[i].substr(type_start, lines[i].find(',', type_start) - type_start);
+            if (type == "packet") {
+                shown++;
+            } else if (type == "repeat") {
+                size_t count_start = lines[i].find(',', lines[i].find(',', type_start) + 1) + 1;
+                repeated += U32(strtoul(lines[i].c_str() + count_start, nullptr, 10));
+                runs++;
+            }
+        }
+
+        // Every packet with a bad checksum is shown; the packets file has a header row
+        std::vector<std::string> packet_lines = SplitLines(packets);
+        U32                      bad_packets  = 0;
+        for (size_t i = 1; i < packet_lines.size(); i++) {
+            size_t bit_errors = packet_lines[i].rfind(',');
+            bad_packets += ((bit_errors >= 2) && (packet_lines[i].compare(bit_errors - 2, 2, ",0") == 0)) ? 1 : 0;
+        }
+        QI_CHECK((runs > 0) && (shown + repeated + 1 == packet_lines.size()));
+        QI_CHECK(U32(std::count(collapsed.begin(), collapsed.end(), '!')) == bad_packets);
+
+        remove(collapsed_path.c_str());
+        remove(packets_path.c_str());
+    }
+}
+
+// Logic 2 binary export of the edges, with times counted from begin_seconds as after a trigger.
+static bool WriteSaleaeFile(const std::string& path, const std::vector<U64>& edges, U32 sample_rate_hz, double begin_seconds,
+                            U32 version) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr)
+        return false;
+
+    double end_seconds = begin_seconds + (edges.empty() ? 0.0 : double(edges.back()) / double(sample_rate_hz));
+    U64    bits;
+    U8     header[44];
+    memcpy(header, "<SALEAE>", 8);
+    QiPutU32(header + 8, version);
+    QiPutU32(header + 12, 0);    // digital
+    QiPutU32(header + 16, 0);
+    memcpy(&bits, &begin_seconds, sizeof(bits));
+    QiPutU64(header + 20, bits);
+    memcpy(&bits, &end_seconds, sizeof(bits));
+    QiPutU64(header + 28, bits);
+    QiPutU64(header + 36, edges.size());
+    bool written = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+
+    std::vector<U8> times(8 * 4096);
+    for (size_t first = 0; written && (first < edges.size()); first += 4096) {
+        size_t count = std::min<size_t>(4096, edges.size() - first);
+        for (size_t i = 0; i < count; i++) {
+            double seconds = begin_seconds + double(edges[first + i]) / double(sample_rate_hz);
+            memcpy(&bits, &seconds, sizeof(bits));
+            QiPutU64(&times[i * 8], bits);
+        }
+        written = fwrite(times.data(), 8, count, file) == count;
+    }
+    return (fclose(file) == 0) && written;
+}
+
+// Reads every edge of a Logic 2 export; false if it does not open or stops early.
+static bool ReadSaleaeFile(const std::string& path, U64 min_pulse_width, std::vector<U64>& edges, U64* rejected,
+                           std::string& error) {
+    QiSaleaeEdgeSource source;
+    if (source.Open(path.c_str(), 1000000, min_pulse_width, error) == false)
+        return false;
+    edges.clear();
+    while (source.AdvanceToNextEdge())
+        edges.push_back(source.GetSampleNumber());
+    *rejected = source.GetRejectedEdgeCount();
+    return source.HasError() == false;
+}
+
+// Headers that are rejected, the glitch filter of the source against QiDeglitchEdges(), a file larger than the mapped
+// window, and qi-decode -f saleae against the same edges read with -f binary.
+static void TestDecodeSaleae() {
+    std::vector<U64> edges;
+    GenerateCapture(21, 2, edges);
+    std::string path = OutputPath("saleae.bin");
+    if (QI_CHECK(WriteSaleaeFile(path, edges, 1000000, -0.25, 1)) == false)
+        return;
+
+    std::vector<U64> read;
+    std::vector<U64> deglitched = edges;
+    U64              rejected   = 0;
+    std::string      error;
+    U64              expected_rejected = QiDeglitchEdges(deglitched, 80);
+    QI_CHECK(ReadSaleaeFile(path, 0, read, &rejected, error) && (read == edges) && (rejected == 0));
+    QI_CHECK(ReadSaleaeFile(path, 80, read, &rejected, error) && (read == deglitched) && (rejected == expected_rejected));
+    QI_CHECK(expected_rejected > 0);
+
+    // Each field of the header that makes the file unreadable
+    std::string file;
+    QI_CHECK(ReadFile(path, file));
+    const struct {
+        size_t      mOffset;    // byte changed to 0xFF, or the size that the file is cut to if mCut
+        bool        mCut;
+        const char* mError;
+    } bad_files[] = {
+        { 0, false, " is not a Logic 2 binary export" },
+        { 20, true, " is not a Logic 2 binary export" },
+        { 8, false, " is not a digital channel export (or of an unknown version)" },
+        { 12, false, " is not a digital channel export (or of an unknown version)" },
+        { file.size() - 1, true, " is truncated" },
+    };
+    std::string bad_path = OutputPath("saleae.bad.bin");
+    for (size_t i = 0; i < sizeof(bad_files) / sizeof(bad_files[0]); i++) {
+        std::string bad = file;
+        if (bad_files[i].mCut)
+            bad.resize(bad_files[i].mOffset);
+        else
+            bad[bad_files[i].mOffset] = char(0xFF);
+        QiSaleaeEdgeSource source;
+        QI_CHECK(WriteFile(bad_path, bad) && (source.Open(bad_path.c_str(), 1000000, 0, error) == false) &&
+                 (error == bad_path + bad_files[i].mError));
+    }
+    remove(bad_path.c_str());
+
+    // The same outputs as from the edges
+    std::string edges_path = OutputPath("saleae.edges");
+    std::string binary(edges.size() * 8, '\0');
+    for (size_t i = 0; i < edges.size(); i++)
+        QiPutU64(reinterpret_cast<U8*>(&binary[i * 8]), edges[i]);
+    QI_CHECK(WriteFile(edges_path, binary));
+
+    std::string outputs[2][2];    // bytes and packets, from -f binary and -f saleae
+    for (U32 i = 0; i < 2; i++) {
+        std::string input   = (i == 0) ? "-f binary " + edges_path : "-f saleae " + path;
+        std::string bytes   = OutputPath("saleae.bytes.csv");
+        std::string packets = OutputPath("saleae.packets.csv");
+        QI_CHECK(RunDecoder("-r 1000000 -g 80 -o " + bytes + " -P " + packets + " " + input));
+        QI_CHECK(ReadFile(bytes, outputs[i][0]) && ReadFile(packets, outputs[i][1]));
+        remove(bytes.c_str());
+        remove(packets.c_str());
+    }
+    QI_CHECK(SplitLines(outputs[0][1]).size() > 10);
+    QI_CHECK(CompareLogs("saleae bytes", outputs[0][0], outputs[1][0]) && CompareLogs("saleae packets", outputs[0][1], outputs[1][1]));
+    remove(edges_path.c_str());
+
+    // More transitions than the mapped window holds; the one that the window boundary splits is read whole
+    Random random(21);
+    U64    sample = 0;
+    edges.resize((U64(64) << 20) / 8 + 4096);
+    for (size_t i = 0; i < edges.size(); i++) {
+        sample += 1 + random.Below(400);
+        edges[i] = sample;
+    }
+    deglitched        = edges;
+    expected_rejected = QiDeglitchEdges(deglitched, 40);
+    QI_CHECK(WriteSaleaeFile(path, edges, 1000000, 0.0, 0) && ReadSaleaeFile(path, 40, read, &rejected, error) &&
+             (read == deglitched) && (rejected == expected_rejected));
+    remove(path.c_str());
+}
+
+// Outputs of an incremental decode: bytes, records and packets.
+static const U32 kCheckpointOutputCount = 3;
+
+static std::string CheckpointOutputArguments(const std::string& prefix) {
+    return " -o " + OutputPath(prefix + ".bytes.csv") + " -R " + OutputPath(prefix + ".qirec") + " -P " +
+           OutputPath(prefix + ".packets.csv");
+}
+
+static bool ReadCheckpointOutputs(const std::string& prefix, std::string* contents) {
+    return ReadFile(OutputPath(prefix + ".bytes.csv"), contents[0]) && ReadFile(OutputPath(prefix + ".qirec"), contents[1]) &&
+           ReadFile(OutputPath(prefix + ".packets.csv"), contents[2]);
+}
+
+static void RemoveCheckpointOutputs(const std::string& prefix) {
+    remove(OutputPath(prefix + ".bytes.csv").c_str());
+    remove(OutputPath(prefix + ".qirec").c_str());
+    remove(OutputPath(prefix + ".packets.csv").c_str());
+}
+
+static bool CompareCheckpointOutputs(const std::string* expected, const std::string* actual) {
+    static const char* const kNames[kCheckpointOutputCount] = { "bytes", "records", "packets" };
+    bool                     same                          = true;
+    for (U32 i = 0; i < kCheckpointOutputCount; i++)
+        same = CompareLogs(kNames[i], expected[i], actual[i]) && same;
+    return same;
+}
+
+static U32 CountCheckpoints(const std::string& path) {
+    QiCheckpointJournal journal;
+    std::string         error;
+    U32                 count = journal.Open(path.c_str(), error) ? journal.GetCount() : 0;
+    journal.Close();
+    return count;
+}
+
+// A capture that grows in chunks that end within an edge record, decoded with -C after each one; then restarts from
+// an earlier checkpoint (-K), from a journal whose last record was cut short while the outputs had more written after
+// it, and from the start (-K 0). Every time, the outputs must be those of decoding the whole capture at once.
+static void TestDecodeCheckpoints() {
+    std::string capture_path = FixturePath("noisy.edges");
+    std::string capture;
+    if (QI_CHECK(ReadFile(capture_path, capture)) == false)
+        return;
+
+    std::string expected[kCheckpointOutputCount];
+    std::string actual[kCheckpointOutputCount];
+    std::string settings = "-r 1000000 -f binary";
+    if ((QI_CHECK(RunDecoder(settings + CheckpointOutputArguments("checkpoints.once") + " \"" + capture_path + "\"")) == false) ||
+        (QI_CHECK(ReadCheckpointOutputs("checkpoints.once", expected)) == false))
+        return;
+
+    std::string edges_path   = OutputPath("checkpoints.edges");
+    std::string journal_path = OutputPath("checkpoints.ckpt");
+    std::string incremental  = settings + " -C " + journal_path + CheckpointOutputArguments("checkpoints");
+    remove(journal_path.c_str());
+
+    const size_t chunk_ends[] = { capture.size() / 4 + 3, capture.size() / 2 + 5, capture.size() * 3 / 4, capture.size() };
+    U32          count        = 0;
+    for (size_t i = 0; i < sizeof(chunk_ends) / sizeof(chunk_ends[0]); i++) {
+        if ((QI_CHECK(WriteFile(edges_path, capture.substr(0, chunk_ends[i]))) == false) ||
+            (QI_CHECK(RunDecoder(incremental + " " + edges_path)) == false))
+            return;
+        U32 previous = count;
+        count        = CountCheckpoints(journal_path);
+        QI_CHECK(count > previous);
+    }
+    QI_CHECK(ReadCheckpointOutputs("checkpoints", actual) && CompareCheckpointOutputs(expected, actual));
+
+    // From the first checkpoint, dropping the later ones
+    QI_CHECK(RunDecoder(incremental + " -K 1 " + edges_path));
+    QI_CHECK(ReadCheckpointOutputs("checkpoints", actual) && CompareCheckpointOutputs(expected, actual));
+    U32 restarted = CountCheckpoints(journal_path);
+    QI_CHECK((restarted > 1) && (restarted < count));
+
+    // A crash while the last checkpoint was appended: it is dropped, and the outputs are cut back to the one before
+    std::string journal;
+    std::string bytes;
+    count = restarted;
+    QI_CHECK(ReadFile(journal_path, journal) && (journal.size() == kQiCheckpointHeaderSize + count * sizeof(QiCheckpoint)));
+    QI_CHECK(WriteFile(journal_path, journal.substr(0, journal.size() - sizeof(QiCheckpoint) / 2)));
+    QI_CHECK(ReadFile(OutputPath("checkpoints.bytes.csv"), bytes) &&
+             WriteFile(OutputPath("checkpoints.bytes.csv"), bytes + "1,0.000001000,0x00,0x00,0,1,1\n"));
+    QI_CHECK(RunDecoder(incremental + " " + edges_path));
+    QI_CHECK(ReadCheckpointOutputs("checkpoints", actual) && CompareCheckpointOutputs(expected, actual));
+    QI_CHECK(ReadFile(journal_path, journal) && (journal.size() == kQiCheckpointHeaderSize + count * sizeof(QiCheckpoint)));
+
+    QI_CHECK(RunDecoder(incremental + " -K 0 " + edges_path));
+    QI_CHECK(ReadCheckpointOutputs("checkpoints", actual) && CompareCheckpointOutputs(expected, actual));
+    QI_CHECK(CountCheckpoints(journal_path) == 1);
+
+    RemoveCheckpointOutputs("checkpoints.once");
+    RemoveCheckpointOutputs("checkpoints");
+    remove(edges_path.c_str());
+    remove(journal_path.c_str());
+}
+
+struct Test {
+    const char* mName;
+    void (*mRun)();
+    bool mRunsDecoder;    // needs -q and -d
+};
+
+static const Test kTests[] = {
+    { "interval-kernels", TestIntervalKernels, false },
+    { "segment-decoder", TestSegmentDecoder, false },
+    { "timing-rules", TestTimingRules, false },
+    { "packet-repeats", TestPacketRepeats, false },
+    { "packet-search", TestPacketSearch, false },
+    { "fsk-decoder", TestFskDecoder, false },
+    { "edge-ring", TestEdgeRing, false },
+    { "live-reader", TestLiveReader, false },
+    { "decode-coils", TestDecodeCoils, true },
+    { "decode-sessions", TestDecodeSessions, true },
+    { "decode-collapsed", TestDecodeCollapsed, true },
+    { "decode-saleae", TestDecodeSaleae, true },
+    { "decode-checkpoints", TestDecodeCheckpoints, true },
+};
+static const U32 kTestCount = sizeof(kTests) / sizeof(kTests[0]);
+
+static void PrintUsage() {
+    fprintf(stderr,
+            "usage: qi-test [-q QI_DECODE -d FIXTURES [-u]] [NAME...]\n"
+            "\n"
+            "Runs the named tests, or all of them. The tests of qi-decode need:\n"
+            "\n"
+            "  -q, --qi-decode PATH    the qi-decode executable\n"
+            "  -d, --fixtures DIR      the fixture directory, with the golden files\n"
+            "  -u, --update            replace the golden files with the current output\n"
+            "\n"
+            "Tests:\n");
+    for (U32 i = 0; i < kTestCount; i++)
+        fprintf(stderr, "  %s\n", kTests[i].mName);
+}
+
+int main(int argc, char* argv[]) {
+    sOptions.mUpdate = false;
+
+    std::vector<std::string> names;
+    for (int i = 1; i < argc; i++) {
+        const char* arg       = argv[i];
+        bool        has_value = (i + 1 < argc);
+
+        if (((strcmp(arg, "-q") == 0) || (strcmp(arg, "--qi-decode") == 0)) && has_value) {
+            sOptions.mDecoder = argv[++i];
+        } else if (((strcmp(arg, "-d") == 0) || (strcmp(arg, "--fixtures") == 0)) && has_value) {
+            sOptions.mFixtures = argv[++i];
+        } else if ((strcmp(arg, "-u") == 0) || (strcmp(arg, "--update") == 0)) {
+            sOptions.mUpdate = true;
+        } else if ((strcmp(arg, "-h") == 0) || (strcmp(arg, "--help") == 0)) {
+            PrintUsage();
+            return 0;
+        } else if (arg[0] == '-') {
+            fprintf(stderr, "qi-test: unknown option '%s'\n", arg);
+            PrintUsage();
+            return 2;
+        } else {
+            names.push_back(arg);
+        }
+    }
+
+    int result = 0;
+    for (size_t n = 0; n < names.size(); n++) {
+        bool found = false;
+        for (U32 i = 0; i < kTestCount; i++)
+            found = found || (names[n] == kTests[i].mName);
+        if (found == false) {
+            fprintf(stderr, "qi-test: no test named '%s'\n", names[n].c_str());
+            result = 1;
+        }
+    }
+
+    for (U32 i = 0; i < kTestCount; i++) {
+        bool selected = names.empty();
+        for (size_t n = 0; n < names.size(); n++)
+            selected = selected || (names[n] == kTests[i].mName);
+        if (selected == false)
+            continue;
+
+        if (kTests[i].mRunsDecoder && (sOptions.mDecoder.empty() || sOptions.mFixtures.empty())) {
+            fprintf(stderr, "%-24s FAILED: needs -q and -d\n", kTests[i].mName);
+            result = 1;
+            continue;
+        }
+
+        U32 failed_before = sFailedChecks;
+        kTests[i].mRun();
+        bool ok = (sFailedChecks == failed_before);
+        fprintf(stderr, "%-24s %s\n", kTests[i].mName, ok ? (sOptions.mUpdate && kTests[i].mRunsDecoder ? "updated" : "ok") : "FAILED");
+        if (ok == false)
+            result = 1;
+    }
+    return result;
+}
@@ -0,0 +1,1387 @@
+// qi-decode: decodes offline captures of the Qi ASK backchannel, or of the power carrier's FSK, without Logic 2.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "QiCheckpointFile.h"
+#include "QiDecoder.h"
+#include "QiDeglitch.h"
+#include "QiEdgeFile.h"
+#include "QiFskDecoder.h"
+#include "QiLiveSource.h"
+#include "QiMultiChannelDecoder.h"
+#include "QiPacket.h"
+#include "QiPacketExport.h"
+#include "QiPacketRepeats.h"
+#include "QiPacketSearch.h"
+#include "QiRecordFile.h"
+#include "QiSaleaeFile.h"
+#include "QiSegmentDecoder.h"
+#include "QiSessionStats.h"
+#include "QiTimingChecker.h"
+
+// Writes what the Logic 2 plugin shows with Repeats set to Collapse (-Z): the error markers and bytes of the packets
+// shown in full, the packets, and the runs of repeats between them.
+class CollapsedCsvWriter : public QiCollapsedListener {
+  public:
+    CollapsedCsvWriter(FILE* file, U32 sample_rate_hz, S32 coil) : mFile(file), mSampleRateHz(sample_rate_hz), mCoil(coil) {}
+
+    virtual void OnMarker(U64 location, QiMarkerType marker) {
+        static const char* const kNames[] = { "dot", "error_dot", "error_square", "error_x" };
+        if (marker == QiMarkerDot)
+            return;
+        fprintf(mFile, "%llu,%.9f,marker,%s,,,", location, double(location) / double(mSampleRateHz), kNames[marker]);
+        EndRow();
+    }
+
+    virtual void OnByte(const QiByte& byte) {
+        fprintf(mFile, "%llu,%.9f,byte,0x%02X,,,", byte.mBitEdges[0], double(byte.mBitEdges[0]) / double(mSampleRateHz),
+                byte.mPayload);
+        EndRow();
+    }
+
+    virtual void OnRun(const QiPacketRepeats& repeats) {
+        // The packets that the run repeats and how often, e.g. "CE x12 RP8 x3"
+        const QiPacketRun& run = repeats.GetRun();
+        fprintf(mFile, "%llu,%.9f,repeat,", run.mStart, double(run.mStart) / double(mSampleRateHz));
+        const char* separator = "";
+        for (U32 i = 0; i < kQiRepeatReferences; i++) {
+            if (repeats.GetRepeatCount(i) == 0)
+                continue;
+            const QiPacket& packet = repeats.GetReference(i);
+            fprintf(mFile, "%s%s x%u", separator, (packet.mInfo != nullptr) ? packet.mInfo->mMnemonic : "?", repeats.GetRepeatCount(i));
+            separator = " ";
+        }
+        fprintf(mFile, ",%u,", run.mCount);
+        if (run.mControlErrors > 0)
+            fprintf(mFile, "%d,%d", run.mControlErrorMin, run.mControlErrorMax);
+        else
+            fputc(',', mFile);
+        EndRow();
+    }
+
+    void WritePacket(const QiPacket& packet) {
+        fprintf(mFile, "%llu,%.9f,packet,%s", packet.mStart, double(packet.mStart) / double(mSampleRateHz),
+                (packet.mInfo != nullptr) ? packet.mInfo->mMnemonic : "?");
+        for (U32 i = 0; i < packet.mSize; i++)
+            fprintf(mFile, " %02X", packet.mMessage[i]);
+        fputs(packet.mChecksumValid ? ",,," : " !checksum,,,", mFile);
+        EndRow();
+    }
+
+  private:
+    void EndRow() {
+        if (mCoil >= 0)
+            fprintf(mFile, ",%d", mCoil);
+        fputc('\n', mFile);
+    }
+
+  private:
+    FILE* mFile;
+    U32   mSampleRateHz;
+    S32   mCoil;
+};
+
+class CsvWriter : public QiDecoderListener {
+  public:
+    // coil is written to every row of multi-coil captures, and is -1 otherwise; with sessions, the bytes and packets
+    // are also aggregated into GetSessionStats()
+    CsvWriter(FILE* file, QiRecordWriter* records, QiPacketCsvWriter* packets, U32 sample_rate_hz, S32 coil, bool sessions)
+        : mFile(file)
+        , mRecords(records)
+        , mPackets(packets)
+        , mSampleRateHz(sample_rate_hz)
+        , mCoil(coil)
+        , mSessions(sessions)
+        , mByteCount(0)
+        , mPacketCount(0)
+        , mChecksumErrorCount(0)
+        , mViolations(nullptr)
+        , mMatches(nullptr) {
+        mSessionStats.Reset(sample_rate_hz);
+        mTimingChecker.Reset(sample_rate_hz);
+    }
+
+    // Checks the packets' timing and writes the violations to the file
+    void SetViolationFile(FILE* violations, const U32* min, const U32* max) {
+        mViolations = violations;
+        for (U32 i = 0; i < kQiTimingRuleCount; i++)
+            mTimingChecker.SetLimits(i, min[i], max[i]);
+    }
+
+    // Searches the packets for the patterns and writes the matches to the file
+    void SetMatchFile(FILE* matches, const QiSearchPatterns* patterns) {
+        mMatches  = matches;
+        mPatterns = patterns;
+        mSearch.Reset(patterns);
+        mSearchMatches.resize(patterns->GetPatternCount());
+    }
+
+    // Collapses repeated packets as the plugin does and writes what it shows to the file. Like the plugin, this checks
+    // the timing rules and ends the sessions whether or not they are written, as both show packets in full.
+    void SetCollapsedFile(FILE* collapsed, U32 control_error_tolerance, const U32* min, const U32* max) {
+        mCollapsed.reset(new CollapsedCsvWriter(collapsed, mSampleRateHz, mCoil));
+        mCollapser.Reset(control_error_tolerance, mCollapsed.get());
+        for (U32 i = 0; i < kQiTimingRuleCount; i++)
+            mTimingChecker.SetLimits(i, min[i], max[i]);
+    }
+
+    virtual void OnMarker(U64 location, QiMarkerType marker) {
+        if ((mCollapsed != nullptr) && (mCollapser.HoldMarker(location, marker) == false))
+            mCollapsed->OnMarker(location, marker);
+    }
+
+    virtual void OnSyncLost() {
+        if ((mCollapsed != nullptr) && mCollapser.HasPendingBytes())
+            mCollapser.ShowPending();
+    }
+
+    virtual void OnByte(const QiByte& byte) {
+        mByteCount++;
+        U8   coil     = (mCoil >= 0) ? U8(mCoil) : 0;
+        bool sessions = mSessions || (mCollapsed != nullptr);
+        if (mRecords != nullptr)
+            mRecords->Write(byte, coil);
+        if (sessions && mSessionStats.AddByte(byte) && (mCollapsed != nullptr)) {
+            mCollapser.EndRun();
+            mCollapser.ClearReferences();
+        }
+        if (mCollapsed != nullptr)
+            mCollapser.HoldByte(byte);
+        if (mPacketAssembler.AddByte(byte) == true) {
+            const QiPacket& packet = mPacketAssembler.GetPacket();
+            mPacketCount++;
+            if (packet.mChecksumValid == false)
+                mChecksumErrorCount++;
+            if (mPackets != nullptr)
+                mPackets->Write(packet, coil);
+            bool session_ended = sessions && mSessionStats.AddPacket(packet);
+            U32  shown_count   = 0;
+            if ((mViolations != nullptr) || (mCollapsed != nullptr))
+                shown_count += WriteViolations(packet);
+            if (mMatches != nullptr)
+                shown_count += WriteMatches(packet);
+            if ((mCollapsed != nullptr) && mCollapser.AddPacket(packet, 0, (shown_count > 0) || session_ended))
+                mCollapsed->WritePacket(packet);
+            if ((mCollapsed != nullptr) && session_ended)
+                mCollapser.ClearReferences();
+        } else if ((mCollapsed != nullptr) && (mPacketAssembler.IsInPacket() == false)) {
+            // Not part of a packet, so not part of a repeat either
+            mCollapser.ShowPending();
+        }
+        if (mFile == nullptr)
+            return;
+
+        double time = double(byte.mBitEdges[0]) / double(mSampleRateHz);
+        fprintf(mFile,
+                "%llu,%.9f,0x%03X,0x%02X,%u,%u,%u",
+                byte.mBitEdges[0],
+                time,
+                byte.mPacket,
+                byte.mPayload,
+                byte.mPacketByte,
+                byte.mParityValid ? 1 : 0,
+                byte.mStopValid ? 1 : 0);
+        if (mCoil >= 0)
+            fprintf(mFile, ",%d", mCoil);
+        fputc('\n', mFile);
+    }
+
+    // Continues the counts of a checkpoint
+    void RestoreCounts(U64 byte_count, U64 packet_count, U64 checksum_error_count) {
+        mByteCount          = byte_count;
+        mPacketCount        = packet_count;
+        mChecksumErrorCount = checksum_error_count;
+    }
+
+    // Writes the run of repeats that the capture ends with.
+    void Finish() {
+        if (mCollapsed != nullptr)
+            mCollapser.EndRun();
+    }
+
+    U64 GetByteCount() const { return mByteCount; }
+    U64 GetPacketCount() const { return mPacketCount; }
+    U64 GetChecksumErrorCount() const { return mChecksumErrorCount; }
+
+    const QiSessionStats& GetSessionStats() const { return mSessionStats; }
+
+  private:
+    // Both return the number of violations or matches, also of those that are not written
+    U32 WriteViolations(const QiPacket& packet) {
+        QiTimingViolation violations[kQiTimingRuleCount];
+        U32               count = mTimingChecker.AddPacket(packet, violations);
+        for (U32 i = 0; (mViolations != nullptr) && (i < count); i++) {
+            const QiTimingRule& rule = QiGetTimingRule(violations[i].mRule);
+            fprintf(mViolations,
+                    "%.9f,%.9f,%s,%llu,%s,%s,%u",
+                    double(violations[i].mStart) / double(mSampleRateHz),
+                    double(violations[i].mEnd - violations[i].mStart) / double(mSampleRateHz),
+                    rule.mName,
+                    violations[i].mValue,
+                    rule.mUnit,
+                    violations[i].mAboveMax ? "max" : "min",
+                    violations[i].mLimit);
+            if (mCoil >= 0)
+                fprintf(mViolations, ",%d", mCoil);
+            fputc('\n', mViolations);
+        }
+        return count;
+    }
+
+    U32 WriteMatches(const QiPacket& packet) {
+        U32 count = mSearch.AddPacket(packet, mSearchMatches.data());
+        for (U32 i = 0; i < count; i++) {
+            const QiSearchMatch& match = mSearchMatches[i];
+            fprintf(mMatches,
+                    "%.9f,%.9f,%s,%u,0x%02X,",
+                    double(match.mStart) / double(mSampleRateHz),
+                    double(match.mEnd - match.mStart) / double(mSampleRateHz),
+                    mPatterns->GetPatternName(match.mPattern),
+                    match.mPackets,
+                    packet.mHeader);
+            for (U32 b = 0; b < packet.mSize; b++)
+                fprintf(mMatches, "%02X", packet.mMessage[b]);
+            if (mCoil >= 0)
+                fprintf(mMatches, ",%d", mCoil);
+            fputc('\n', mMatches);
+        }
+        return count;
+    }
+
+  private:
+    FILE*              mFile;
+    QiRecordWriter*    mRecords;
+    QiPacketCsvWriter* mPackets;
+    QiPacketAssembler  mPacketAssembler;
+    U32                mSampleRateHz;
+    S32                mCoil;
+    bool               mSessions;
+    QiSessionStats     mSessionStats;
+    U64                mByteCount;
+    U64                mPacketCount;
+    U64                mChecksumErrorCount;
+    QiTimingChecker    mTimingChecker;
+    FILE*              mViolations;
+
+    FILE*                      mMatches;
+    const QiSearchPatterns*    mPatterns;
+    QiPacketSearch             mSearch;
+    std::vector<QiSearchMatch> mSearchMatches;
+
+    std::unique_ptr<CollapsedCsvWriter> mCollapsed;    // null unless -Z
+    QiRepeatCollapser                   mCollapser;
+};
+
+// Writes the transmitter's bytes and responses of a carrier capture (-k).
+class FskCsvWriter : public QiFskListener {
+  public:
+    FskCsvWriter(FILE* file, U32 sample_rate_hz) : mFile(file), mSampleRateHz(sample_rate_hz) {}
+
+    virtual void OnFskByte(const QiByte& byte) {
+        if (mFile == nullptr)
+            return;
+        fprintf(mFile,
+                "%llu,%.9f,byte,0x%02X,%u,%u,%u\n",
+                byte.mBitEdges[0],
+                double(byte.mBitEdges[0]) / double(mSampleRateHz),
+                byte.mPayload,
+                byte.mPacketByte,
+                byte.mParityValid ? 1 : 0,
+                byte.mStopValid ? 1 : 0);
+    }
+
+    virtual void OnFskResponse(U64 start, U64 /*end*/, U8 pattern) {
+        if (mFile == nullptr)
+            return;
+        const char* name = QiFskResponseName(pattern);
+        fprintf(mFile, "%llu,%.9f,%s,0x%02X,,,\n", start, double(start) / double(mSampleRateHz),
+                (name != nullptr) ? name : "response", pattern);
+    }
+
+  private:
+    FILE* mFile;
+    U32   mSampleRateHz;
+};
+
+// Outputs of a live decode, which are flushed after every byte.
+struct LiveOutputs {
+    FILE*              mBytes;
+    QiRecordWriter*    mRecords;
+    QiPacketCsvWriter* mPackets;
+    FILE*              mViolations;
+    FILE*              mMatches;
+};
+
+// Passes the bytes of a live stream (-l) on to a CsvWriter, flushes the outputs after each one, and measures the time
+// from the arrival of the edge that completed a byte or packet to its output.
+class LiveWriter : public QiDecoderListener {
+  public:
+    LiveWriter(CsvWriter& writer, QiLiveEdgeSource& source, const LiveOutputs& outputs)
+        : mWriter(writer), mSource(source), mOutputs(outputs) {}
+
+    virtual void OnMarker(U64 /*location*/, QiMarkerType /*marker*/) {}
+
+    virtual void OnByte(const QiByte& byte) {
+        U64 packet_count = mWriter.GetPacketCount();
+        mWriter.OnByte(byte);
+
+        if (mOutputs.mBytes != nullptr)
+            fflush(mOutputs.mBytes);
+        if (mOutputs.mRecords != nullptr)
+            mOutputs.mRecords->Flush();
+        if (mOutputs.mPackets != nullptr)
+            mOutputs.mPackets->Flush();
+        if (mOutputs.mViolations != nullptr)
+            fflush(mOutputs.mViolations);
+        if (mOutputs.mMatches != nullptr)
+            fflush(mOutputs.mMatches);
+
+        U64 latency = QiLiveClockNs() - mSource.GetArrivalNs(byte.mBitEdges[11]);
+        mByteLatency.Add(latency);
+        if (mWriter.GetPacketCount() != packet_count)
+            mPacketLatency.Add(latency);
+    }
+
+    const QiLatencyHistogram& GetByteLatency() const { return mByteLatency; }
+    const QiLatencyHistogram& GetPacketLatency() const { return mPacketLatency; }
+
+  private:
+    CsvWriter&         mWriter;
+    QiLiveEdgeSource&  mSource;
+    LiveOutputs        mOutputs;
+    QiLatencyHistogram mByteLatency;
+    QiLatencyHistogram mPacketLatency;
+};
+
+struct DecodeStats {
+    U64    mEdgeCount;
+    U64    mRejectedEdgeCount;
+    double mCaptureSeconds;
+    double mElapsed;
+    U64    mSegmentCount;
+    U32    mThreadCount;
+
+    QiDecoderStats mDecoder;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+// Capture time between the checkpoints that an incremental decode stores while it runs; the last packet boundary is
+// always stored at the end.
+static const U32 kCheckpointIntervalS = 60;
+
+// Edges that the ring of a live decode holds (1 MiB): a third of a second of a 100 kHz carrier coupling into the
+// signal, should the decoder fall behind.
+static const U32 kLiveRingSize = 1 << 16;
+
+// Default of -W.
+static const U32 kLiveSlackUs = 1000;
+
+// Loads the capture, removes its glitches, and decodes it on thread_count threads.
+static bool DecodeInMemory(const char*       path,
+                           QiEdgeFileFormat  format,
+                           U32               sample_bit,
+                           U32               sample_rate_hz,
+                           U32               tolerance,
+                           U64               min_pulse_width,
+                           U32               thread_count,
+                           QiDecoderListener& listener,
+                           DecodeStats&      stats,
+                           std::string&      error) {
+    std::vector<U64> edges;
+    if (QiReadEdgeFile(path, format, sample_bit, sample_rate_hz, edges, error) == false)
+        return false;
+
+    QiSegmentDecoder decoder;
+    decoder.SetListener(&listener);
+    decoder.Reset(sample_rate_hz);
+    decoder.SetTrackingTolerance(tolerance);
+
+    stats.mEdgeCount      = edges.size();
+    stats.mCaptureSeconds = edges.empty() ? 0.0 : double(edges.back()) / double(sample_rate_hz);
+
+    Clock::time_point start = Clock::now();
+    stats.mRejectedEdgeCount = QiDeglitchEdges(edges, min_pulse_width);
+    decoder.Run(edges.data(), edges.size(), thread_count);
+    stats.mElapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    stats.mSegmentCount = decoder.GetSegmentCount();
+    stats.mThreadCount  = decoder.GetThreadCount();
+    stats.mDecoder      = decoder.GetStats();
+    return true;
+}
+
+// Decodes a Logic 2 export straight from its memory mapping. The source drops glitches the same way as
+// QiDeglitchEdges(), so the result is the same as DecodeInMemory().
+static bool DecodeMapped(const char*       path,
+                         U32               sample_rate_hz,
+                         U32               tolerance,
+                         U64               min_pulse_width,
+                         QiDecoderListener& listener,
+                         DecodeStats&      stats,
+                         std::string&      error) {
+    QiSaleaeEdgeSource source;
+    if (source.Open(path, sample_rate_hz, min_pulse_width, error) == false)
+        return false;
+
+    QiDecoder decoder;
+    decoder.SetListener(&listener);
+    decoder.Reset(sample_rate_hz);
+    decoder.SetTrackingTolerance(tolerance);
+
+    Clock::time_point start = Clock::now();
+    decoder.Run(source);
+    stats.mElapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    if (source.HasError()) {
+        error = std::string("cannot read ") + path;
+        return false;
+    }
+
+    const QiSaleaeDigitalHeader& header = source.GetHeader();
+    stats.mEdgeCount         = header.mTransitionCount;
+    stats.mRejectedEdgeCount = source.GetRejectedEdgeCount();
+    stats.mCaptureSeconds    = header.mEndTime - header.mBeginTime;
+    stats.mSegmentCount      = 1;
+    stats.mThreadCount       = 1;
+    stats.mDecoder           = decoder.GetStats();
+    return true;
+}
+
+// Decodes a live stream until it ends. The reader thread fills the ring while this thread decodes from it.
+static bool DecodeLive(const char*         path,
+                       QiEdgeFileFormat    format,
+                       U32                 sample_rate_hz,
+                       U32                 tolerance,
+                       U64                 min_pulse_width,
+                       U32                 slack_us,
+                       CsvWriter&          writer,
+                       const LiveOutputs&  outputs,
+                       QiLatencyHistogram* byte_latency,
+                       QiLatencyHistogram* packet_latency,
+                       DecodeStats&        stats,
+                       std::string&        error) {
+    QiLiveReader reader;
+    if (reader.Open(path, format, error) == false)
+        return false;
+
+    QiEdgeRing           ring(kLiveRingSize);
+    QiLiveEdgeSource     source(ring, sample_rate_hz, slack_us);
+    QiDeglitchEdgeSource deglitched(source, min_pulse_width);
+    LiveWriter           live_writer(writer, source, outputs);
+
+    QiDecoder decoder;
+    decoder.SetListener(&live_writer);
+    decoder.Reset(sample_rate_hz);
+    decoder.SetTrackingTolerance(tolerance);
+    source.SetDecoder(&decoder);
+
+    Clock::time_point start = Clock::now();
+    reader.Start(ring);
+    decoder.Run(deglitched);
+    bool read = reader.Join(error);
+    stats.mElapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    stats.mEdgeCount         = source.GetEdgeCount();
+    stats.mRejectedEdgeCount = deglitched.GetRejectedEdgeCount();
+    stats.mCaptureSeconds    = (stats.mEdgeCount > 0) ? double(source.GetSampleNumber()) / double(sample_rate_hz) : 0.0;
+    stats.mSegmentCount      = 1;
+    stats.mThreadCount       = 1;
+    stats.mDecoder           = decoder.GetStats();
+
+    *byte_latency   = live_writer.GetByteLatency();
+    *packet_latency = live_writer.GetPacketLatency();
+    fprintf(stderr, "%s: the ring held up to %u of %u edges\n", path, ring.GetHighWater(), kLiveRingSize);
+    return read;
+}
+
+static void PrintLatency(const char* name, const QiLatencyHistogram& latency) {
+    if (latency.GetCount() == 0)
+        return;
+
+    fprintf(stderr,
+            "%s latency: %llu, mean %.1f us, p50 < %llu us, p99 < %llu us, max %.1f us\n",
+            name,
+            latency.GetCount(),
+            double(latency.GetMeanNs()) / 1000.0,
+            latency.GetPercentileUs(0.5),
+            latency.GetPercentileUs(0.99),
+            double(latency.GetMaxNs()) / 1000.0);
+    for (U32 bin = 0; bin < kQiLatencyBins; bin++) {
+        if (latency.GetBin(bin) > 0)
+            fprintf(stderr, "  < %8llu us: %llu\n", U64(2) << bin, latency.GetBin(bin));
+    }
+}
+
+static void AddDecoderStats(QiDecoderStats& total, const QiDecoderStats& stats) {
+    total.mEdges += stats.mEdges;
+    total.mIdleSkips += stats.mIdleSkips;
+    total.mGlitchEdges += stats.mGlitchEdges;
+    total.mSyncAttempts += stats.mSyncAttempts;
+    total.mSyncs += stats.mSyncs;
+    total.mBytes += stats.mBytes;
+    total.mParityErrors += stats.mParityErrors;
+    total.mStopErrors += stats.mStopErrors;
+}
+
+// Decodes the captures together as the coils of one transmitter, on one thread and in time order as the Logic 2
+// plugin does; the events of paths[i] go to listeners[i].
+static bool DecodeCoils(const std::vector<const char*>&   paths,
+                        QiEdgeFileFormat                  format,
+                        U32                               sample_bit,
+                        U32                               sample_rate_hz,
+                        U32                               tolerance,
+                        U64                               min_pulse_width,
+                        std::vector<QiDecoderListener*>& listeners,
+                        DecodeStats&                      stats,
+                        std::string&                      error) {
+    std::vector<std::vector<U64>> edges(paths.size());
+    stats.mEdgeCount      = 0;
+    stats.mCaptureSeconds = 0.0;
+    for (size_t i = 0; i < paths.size(); i++) {
+        if (QiReadEdgeFile(paths[i], format, sample_bit, sample_rate_hz, edges[i], error) == false)
+            return false;
+        stats.mEdgeCount += edges[i].size();
+        if ((edges[i].empty() == false) && (double(edges[i].back()) / double(sample_rate_hz) > stats.mCaptureSeconds))
+            stats.mCaptureSeconds = double(edges[i].back()) / double(sample_rate_hz);
+    }
+
+    QiMultiChannelDecoder decoder;
+    decoder.Reset(sample_rate_hz);
+    decoder.SetTrackingTolerance(tolerance);
+
+    Clock::time_point start = Clock::now();
+    stats.mRejectedEdgeCount = 0;
+    std::vector<std::unique_ptr<QiArrayEdgeSource>> sources;
+    for (size_t i = 0; i < paths.size(); i++) {
+        stats.mRejectedEdgeCount += QiDeglitchEdges(edges[i], min_pulse_width);
+        sources.emplace_back(new QiArrayEdgeSource(edges[i].data(), edges[i].size()));
+        decoder.AddChannel(sources.back().get(), listeners[i]);
+    }
+    decoder.Run();
+    stats.mElapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    stats.mSegmentCount = 1;
+    stats.mThreadCount  = 1;
+    memset(&stats.mDecoder, 0, sizeof(stats.mDecoder));
+    for (U32 i = 0; i < decoder.GetChannelCount(); i++)
+        AddDecoderStats(stats.mDecoder, decoder.GetDecoder(i).GetStats());
+    return true;
+}
+
+// Demodulates a capture of the power carrier, in batches of kQiFskBatchSize edges as the Logic 2 plugin reads them.
+static bool DecodeCarrier(const char*      path,
+                          QiEdgeFileFormat format,
+                          U32              sample_bit,
+                          U32              sample_rate_hz,
+                          QiFskListener&   listener,
+                          QiFskStats&      fsk_stats,
+                          DecodeStats&     stats,
+                          std::string&     error) {
+    std::vector<U64> edges;
+    if (QiReadEdgeFile(path, format, sample_bit, sample_rate_hz, edges, error) == false)
+        return false;
+
+    QiFskDecoder decoder;
+    decoder.SetListener(&listener);
+    decoder.Reset(sample_rate_hz);
+
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < edges.size(); i += kQiFskBatchSize)
+        decoder.ProcessEdges(&edges[i], U32(std::min<size_t>(kQiFskBatchSize, edges.size() - i)));
+    decoder.Flush();
+    stats.mElapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    stats.mEdgeCount         = edges.size();
+    stats.mRejectedEdgeCount = 0;
+    stats.mCaptureSeconds    = edges.empty() ? 0.0 : double(edges.back()) / double(sample_rate_hz);
+    fsk_stats                = decoder.GetStats();
+    return true;
+}
+
+// Outputs of an incremental decode, whose sizes the checkpoints record.
+struct IncrementalOutputs {
+    FILE*              mBytes;
+    QiRecordWriter*    mRecords;
+    QiPacketCsvWriter* mPackets;
+};
+
+static bool AppendCheckpoint(QiCheckpointJournal& journal, const QiCheckpoint& checkpoint, IncrementalOutputs& outputs) {
+    // The outputs up to the checkpoint's sizes must be on disk before the journal refers to them
+    bool flushed = ((outputs.mBytes == nullptr) || (fflush(outputs.mBytes) == 0)) &&
+                   ((outputs.mRecords == nullptr) || outputs.mRecords->Flush()) &&
+                   ((outputs.mPackets == nullptr) || outputs.mPackets->Flush());
+    return flushed && journal.Append(checkpoint);
+}
+
+// Decodes what was added to the capture since `checkpoint` (or all of it if the checkpoint is new), storing
+// checkpoints at packet boundaries in the journal as it goes.
+static bool DecodeIncremental(const char*          path,
+                              U32                  tolerance,
+                              QiCheckpointJournal& journal,
+                              const QiCheckpoint&  checkpoint,
+                              bool                 resume,
+                              CsvWriter&           writer,
+                              IncrementalOutputs&  outputs,
+                              DecodeStats&         stats,
+                              std::string&         error) {
+    std::vector<U64> edges;
+    std::vector<U64> ends;
+    QiEdgeFileFormat format = QiEdgeFileFormat(checkpoint.mFormat);
+    if (QiReadEdgeFileTail(path, format, checkpoint.mInputOffset, edges, ends, error) == false)
+        return false;
+
+    QiDecoder decoder;
+    decoder.SetListener(&writer);
+    decoder.Reset(checkpoint.mSampleRateHz);
+    decoder.SetTrackingTolerance(tolerance);
+    if (resume && (decoder.RestoreCheckpoint(checkpoint.mDecoder) == false)) {
+        error = "the checkpoint was taken with another bit tolerance";
+        return false;
+    }
+
+    stats.mEdgeCount      = edges.size();
+    stats.mCaptureSeconds = edges.empty() ? 0.0 : double(edges.back() - edges.front()) / double(checkpoint.mSampleRateHz);
+
+    Clock::time_point start  = Clock::now();
+    stats.mRejectedEdgeCount = QiDeglitchEdges(edges, checkpoint.mMinPulseWidth, &ends);
+    U64 checkpoint_interval  = U64(kCheckpointIntervalS) * checkpoint.mSampleRateHz;
+    U64 next_checkpoint      = (resume ? checkpoint.mDecoder.mPrevEdge : 0) + checkpoint_interval;
+    U64 packet_count         = writer.GetPacketCount();
+
+    QiArrayEdgeSource source(edges.data(), edges.size());
+    QiCheckpoint      pending     = checkpoint;
+    bool              has_pending = false;
+    while (decoder.Step(source)) {
+        if (writer.GetPacketCount() == packet_count)
+            continue;
+        packet_count = writer.GetPacketCount();
+
+        // The edge after the packet's last one decides how that one is filtered and skipped, so it has to be in the
+        // capture already
+        U64 index = source.GetIndex();
+        if (index >= edges.size())
+            break;
+
+        pending.mInputOffset                      = ends[index - 1];
+        pending.mOutputSizes[QiCheckpointBytes]   = (outputs.mBytes != nullptr) ? QiTellFile(outputs.mBytes) : 0;
+        pending.mOutputSizes[QiCheckpointRecords] = (outputs.mRecords != nullptr) ? outputs.mRecords->GetSize() : 0;
+        pending.mOutputSizes[QiCheckpointPackets] = (outputs.mPackets != nullptr) ? outputs.mPackets->GetSize() : 0;
+        pending.mByteCount                        = writer.GetByteCount();
+        pending.mPacketCount                      = writer.GetPacketCount();
+        pending.mChecksumErrorCount               = writer.GetChecksumErrorCount();
+        decoder.SaveCheckpoint(&pending.mDecoder);
+        has_pending = true;
+
+        if (edges[index - 1] >= next_checkpoint) {
+            if (AppendCheckpoint(journal, pending, outputs) == false) {
+                error = "cannot write the checkpoint";
+                return false;
+            }
+            has_pending     = false;
+            next_checkpoint = edges[index - 1] + checkpoint_interval;
+        }
+    }
+    if (has_pending && (AppendCheckpoint(journal, pending, outputs) == false)) {
+        error = "cannot write the checkpoint";
+        return false;
+    }
+    stats.mElapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    stats.mSegmentCount = 1;
+    stats.mThreadCount  = 1;
+    stats.mDecoder      = decoder.GetStats();
+    return true;
+}
+
+// One row per capture of the -S summary.
+static void WriteStatsRow(FILE* file, const char* capture, const DecodeStats& stats, U64 packet_count,
+                          U64 checksum_error_count) {
+    const QiDecoderStats& decoder = stats.mDecoder;
+    fprintf(file,
+            "%s,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%.3f,%.6f,%.1f\n",
+            capture,
+            stats.mEdgeCount,
+            stats.mRejectedEdgeCount,
+            decoder.mIdleSkips,
+            decoder.mGlitchEdges,
+            decoder.mSyncAttempts,
+            decoder.mSyncs,
+            decoder.mBytes,
+            decoder.mParityErrors,
+            decoder.mStopErrors,
+            packet_count,
+            checksum_error_count,
+            stats.mCaptureSeconds,
+            stats.mElapsed,
+            (stats.mEdgeCount > 0) ? stats.mElapsed * 1e9 / double(stats.mEdgeCount) : 0.0);
+}
+
+static void PrintSummary(const char* capture, const DecodeStats& stats, U64 byte_count) {
+    char threads[64] = "";
+    if (stats.mThreadCount > 1)
+        snprintf(threads, sizeof(threads), ", %llu segments on %u threads", stats.mSegmentCount, stats.mThreadCount);
+
+    fprintf(stderr,
+            "%s: %llu edges (%llu rejected as glitches), %llu bytes, %.3f s of capture decoded in %.3f s (%.0f bytes/s, "
+            "%.0f edges/s%s)\n",
+            capture,
+            stats.mEdgeCount,
+            stats.mRejectedEdgeCount,
+            byte_count,
+            stats.mCaptureSeconds,
+            stats.mElapsed,
+            (stats.mElapsed > 0.0) ? double(byte_count) / stats.mElapsed : 0.0,
+            (stats.mElapsed > 0.0) ? double(stats.mEdgeCount) / stats.mElapsed : 0.0,
+            threads);
+}
+
+static void PrintUsage() {
+    std::string rules;
+    for (U32 i = 0; i < kQiTimingRuleCount; i++) {
+        const QiTimingRule& rule = QiGetTimingRule(i);
+        char                text[64];
+        snprintf(text, sizeof(text), "                       %s=%u:%u (%s)\n", rule.mName, rule.mDefaultMin,
+                 rule.mDefaultMax, rule.mUnit);
+        rules += text;
+    }
+
+    fprintf(stderr,
+            "usage: qi-decode -r RATE [-f text|binary|samples|saleae] [-b BIT] [-t DIVISOR] [-g US] [-j THREADS] [-c]\n"
+            "                 [-o OUTPUT.csv] [-R OUTPUT.qirec] [-P PACKETS.csv [-I]] [-S STATS.csv] [-A SESSIONS.csv]\n"
+            "                 [-V VIOLATIONS.csv [-L RULE=MIN:MAX]...] [-Q PATTERNS -M MATCHES.csv] [-Z COLLAPSED.csv [-E N]]\n"
+            "                 CAPTURE...\n"
+            "       qi-decode -k -r RATE [-f text|binary|samples|saleae] [-b BIT] [-o OUTPUT.csv] CARRIER...\n"
+            "       qi-decode -C JOURNAL [-K N] -r RATE [-f text|binary] [-t DIVISOR] [-g US] [-o OUTPUT.csv]\n"
+            "                 [-R OUTPUT.qirec] [-P PACKETS.csv] [-S STATS.csv] CAPTURE\n"
+            "       qi-decode -l -r RATE [-f text|binary] [-t DIVISOR] [-g US] [-W US] [-o OUTPUT.csv] [-R OUTPUT.qirec]\n"
+            "                 [-P PACKETS.csv [-I]] [-S STATS.csv] [-A SESSIONS.csv] [-V VIOLATIONS.csv]\n"
+            "                 [-Q PATTERNS -M MATCHES.csv] STREAM\n"
+            "\n"
+            "  -r, --rate RATE      sample rate of the captures in Hz\n"
+            "  -f, --format FORMAT  text: one edge sample number per line (default)\n"
+            "                       binary: little-endian 64-bit edge sample numbers\n"
+            "                       samples: raw samples, one byte per sample\n"
+            "                       saleae: Logic 2 binary export of a digital channel, one file per channel\n"
+            "  -b, --bit BIT        bit of each sample that holds the Qi signal (samples format, default 0)\n"
+            "  -t, --tolerance DIV  accept bits within 1/DIV of the tracked bit period (default 4: +/- 25%%)\n"
+            "  -g, --glitch US      remove pulses shorter than US microseconds (default 40, 0 disables)\n"
+            "  -j, --jobs THREADS   decode each capture on THREADS threads, split at the gaps between packets\n"
+            "                       (default 1, 0: one per CPU); the output is the same\n"
+            "  -k, --fsk            the captures are of the power carrier: decode the transmitter's FSK bytes and\n"
+            "                       responses instead (sample at 10 MHz or more); -o writes them as csv\n"
+            "  -c, --coils          decode the captures together as the coils of one multi-coil transmitter (at most\n"
+            "                       %u), in time order; every output row gets the index of its capture as the coil\n"
+            "  -o, --output FILE    write the decoded bytes as csv ('-' for stdout); only valid with one capture or -c\n"
+            "  -R, --records FILE   write the decoded bytes as binary records (see QiRecordFile.h); only valid with\n"
+            "                       one capture or -c\n"
+            "  -P, --packets FILE   write one csv row per packet; only valid with one capture or -c\n"
+            "  -I, --index          also write a seek index of the packets to FILE.idx (see QiPacketExport.h)\n"
+            "  -S, --stats FILE     write the decoder's counters and timing as csv, one row per capture\n"
+            "  -A, --sessions FILE  write only the aggregates of the power transfer sessions: a summary per session,\n"
+            "                       the Control Error histograms and the received power series (see QiSessionStats.h);\n"
+            "                       only valid with one capture or -c\n"
+            "  -V, --violations FILE\n"
+            "                       check the WPC timing rules (see QiTimingChecker.h) and write every violation as\n"
+            "                       csv; only valid with one capture or -c\n"
+            "  -Q, --search PATTERNS\n"
+            "                       packets to search for, separated by ';' or new lines, e.g.\n"
+            "                       'ept: 02 08; ce_high: 03 14-7F; id_cfg: 71 > 51' (see QiPacketSearch.h);\n"
+            "                       @FILE reads them from FILE\n"
+            "  -M, --matches FILE   write every match of the -Q patterns as csv; only valid with one capture or -c\n"
+            "  -Z, --collapsed FILE write what the Logic 2 plugin shows with repeated packets collapsed as csv: the\n"
+            "                       error markers, bytes and packets shown in full, and a row per run of repeats in\n"
+            "                       between (see QiPacketRepeats.h); only valid with one capture or -c\n"
+            "  -E, --ce-tolerance N Control Error packets within N of the one shown in full are repeats (default 0)\n"
+            "  -C, --checkpoint FILE\n"
+            "                       decode incrementally, for a capture that is still being written: continue from\n"
+            "                       the last checkpoint in the journal FILE (created if missing), and store a new one\n"
+            "                       every %u s of capture and at the last packet; the outputs end up the same as from\n"
+            "                       decoding the whole capture at once\n"
+            "  -K, --restart N      continue from checkpoint N of the journal instead (0: from the start), dropping\n"
+            "                       the later ones\n"
+            "  -l, --live           decode STREAM as it is written: '-' for stdin, a Unix domain socket to connect to,\n"
+            "                       or a FIFO; each byte and packet is written and flushed as soon as it is decoded,\n"
+            "                       and the latency from the arrival of its last edge is reported at the end\n"
+            "  -W, --slack US       delivery jitter of the stream's edges (default %u); an edge that has not arrived\n"
+            "                       this long after it would have been due is taken to not exist\n"
+            "  -L, --limit RULE=MIN:MAX\n"
+            "                       limits of a timing rule for -V, 0 is not checked; the rules and their defaults:\n"
+            "%s",
+            kQiMaxChannels,
+            kCheckpointIntervalS,
+            kLiveSlackUs,
+            rules.c_str());
+}
+
+// Parses RULE=MIN:MAX into the limits of the named rule.
+static bool ParseTimingLimit(const char* text, U32* min, U32* max) {
+    const char* equals = strchr(text, '=');
+    if (equals == nullptr)
+        return false;
+
+    for (U32 i = 0; i < kQiTimingRuleCount; i++) {
+        const char* name = QiGetTimingRule(i).mName;
+        if ((strlen(name) != size_t(equals - text)) || (strncmp(name, text, strlen(name)) != 0))
+            continue;
+
+        char* end;
+        U32   rule_min = U32(strtoul(equals + 1, &end, 10));
+        if (*end != ':')
+            return false;
+        U32 rule_max = U32(strtoul(end + 1, &end, 10));
+        if (*end != '\0')
+            return false;
+        min[i] = rule_min;
+        max[i] = rule_max;
+        return true;
+    }
+    return false;
+}
+
+// Reads the search patterns of -Q @FILE.
+static bool ReadTextFile(const char* path, std::string& text) {
+    FILE* file = fopen(path, "r");
+    if (file == nullptr)
+        return false;
+
+    char   buffer[4096];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        text.append(buffer, size);
+    bool failed = (ferror(file) != 0);
+    fclose(file);
+    return failed == false;
+}
+
+// The -k mode: decodes each capture as the power carrier.
+static int DecodeCarriers(const std::vector<const char*>& inputs,
+                          QiEdgeFileFormat                format,
+                          U32                             sample_bit,
+                          U32                             sample_rate_hz,
+                          const char*                     output_path) {
+    FILE* output = nullptr;
+    if (output_path != nullptr) {
+        output = (strcmp(output_path, "-") == 0) ? stdout : fopen(output_path, "w");
+        if (output == nullptr) {
+            fprintf(stderr, "qi-decode: cannot create %s\n", output_path);
+            return 1;
+        }
+        fprintf(output, "Sample,Time [s],Type,Value,Packet Byte,Parity,Stop\n");
+    }
+
+    int result = 0;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        FskCsvWriter writer(output, sample_rate_hz);
+        QiFskStats   fsk_stats;
+        DecodeStats  stats;
+        std::string  error;
+        if (DecodeCarrier(inputs[i], format, sample_bit, sample_rate_hz, writer, fsk_stats, stats, error) == false) {
+            fprintf(stderr, "qi-decode: %s\n", error.c_str());
+            result = 1;
+            continue;
+        }
+
+        fprintf(stderr,
+                "%s: %llu carrier edges, %llu transitions, %llu frequency steps, %llu bit errors, %llu bytes, "
+                "%llu responses, %.3f s of capture decoded in %.3f s (%.0f edges/s)\n",
+                inputs[i],
+                stats.mEdgeCount,
+                fsk_stats.mTransitions,
+                fsk_stats.mFrequencySteps,
+                fsk_stats.mBitErrors,
+                fsk_stats.mBytes,
+                fsk_stats.mResponses,
+                stats.mCaptureSeconds,
+                stats.mElapsed,
+                (stats.mElapsed > 0.0) ? double(stats.mEdgeCount) / stats.mElapsed : 0.0);
+    }
+
+    if ((output != nullptr) && (output != stdout) && (fclose(output) != 0)) {
+        fprintf(stderr, "qi-decode: error writing %s\n", output_path);
+        result = 1;
+    }
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    U32                      sample_rate_hz  = 0;
+    QiEdgeFileFormat         format          = QiEdgeFileText;
+    U32                      sample_bit      = 0;
+    U32                      tolerance       = 4;
+    U32                      glitch_us       = 40;
+    U32                      thread_count    = 1;
+    const char*              output_path     = nullptr;
+    const char*              records_path    = nullptr;
+    const char*              packets_path    = nullptr;
+    const char*              stats_path      = nullptr;
+    const char*              sessions_path   = nullptr;
+    const char*              violations_path = nullptr;
+    const char*              search_text     = nullptr;
+    const char*              matches_path    = nullptr;
+    const char*              collapsed_path  = nullptr;
+    U32                      ce_tolerance    = 0;
+    const char*              checkpoint_path = nullptr;
+    S64                      restart         = -1;
+    U32                      slack_us        = kLiveSlackUs;
+    bool                     live            = false;
+    bool                     packet_index    = false;
+    bool                     coils           = false;
+    bool                     fsk             = false;
+    std::vector<const char*> inputs;
+
+    U32 timing_min[kQiTimingRuleCount];
+    U32 timing_max[kQiTimingRuleCount];
+    for (U32 i = 0; i < kQiTimingRuleCount; i++) {
+        timing_min[i] = QiGetTimingRule(i).mDefaultMin;
+        timing_max[i] = QiGetTimingRule(i).mDefaultMax;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg       = argv[i];
+        bool        has_value = (i + 1 < argc);
+
+        if (((strcmp(arg, "-r") == 0) || (strcmp(arg, "--rate") == 0)) && has_value) {
+            sample_rate_hz = U32(strtoul(argv[++i], nullptr, 10));
+        } else if (((strcmp(arg, "-f") == 0) || (strcmp(arg, "--format") == 0)) && has_value) {
+            if (QiParseEdgeFileFormat(argv[++i], &format) == false) {
+                fprintf(stderr, "qi-decode: unknown format '%s'\n", argv[i]);
+                return 2;
+            }
+        } else if (((strcmp(arg, "-b") == 0) || (strcmp(arg, "--bit") == 0)) && has_value) {
+            sample_bit = U32(strtoul(argv[++i], nullptr, 10));
+        } else if (((strcmp(arg, "-t") == 0) || (strcmp(arg, "--tolerance") == 0)) && has_value) {
+            tolerance = U32(strtoul(argv[++i], nullptr, 10));
+        } else if (((strcmp(arg, "-g") == 0) || (strcmp(arg, "--glitch") == 0)) && has_value) {
+            glitch_us = U32(strtoul(argv[++i], nullptr, 10));
+        } else if (((strcmp(arg, "-j") == 0) || (strcmp(arg, "--jobs") == 0)) && has_value) {
+            thread_count = U32(strtoul(argv[++i], nullptr, 10));
+        } else if (((strcmp(arg, "-o") == 0) || (strcmp(arg, "--output") == 0)) && has_value) {
+            output_path = argv[++i];
+        } else if (((strcmp(arg, "-R") == 0) || (strcmp(arg, "--records") == 0)) && has_value) {
+            records_path = argv[++i];
+        } else if (((strcmp(arg, "-P") == 0) || (strcmp(arg, "--packets") == 0)) && has_value) {
+            packets_path = argv[++i];
+        } else if (((strcmp(arg, "-S") == 0) || (strcmp(arg, "--stats") == 0)) && has_value) {
+            stats_path = argv[++i];
+        } else if (((strcmp(arg, "-A") == 0) || (strcmp(arg, "--sessions") == 0)) && has_value) {
+            sessions_path = argv[++i];
+        } else if (((strcmp(arg, "-V") == 0) || (strcmp(arg, "--violations") == 0)) && has_value) {
+            violations_path = argv[++i];
+        } else if (((strcmp(arg, "-Q") == 0) || (strcmp(arg, "--search") == 0)) && has_value) {
+            search_text = argv[++i];
+        } else if (((strcmp(arg, "-M") == 0) || (strcmp(arg, "--matches") == 0)) && has_value) {
+            matches_path = argv[++i];
+        } else if (((strcmp(arg, "-Z") == 0) || (strcmp(arg, "--collapsed") == 0)) && has_value) {
+            collapsed_path = argv[++i];
+        } else if (((strcmp(arg, "-E") == 0) || (strcmp(arg, "--ce-tolerance") == 0)) && has_value) {
+            ce_tolerance = U32(strtoul(argv[++i], nullptr, 10));
+        } else if (((strcmp(arg, "-C") == 0) || (strcmp(arg, "--checkpoint") == 0)) && has_value) {
+            checkpoint_path = argv[++i];
+        } else if (((strcmp(arg, "-K") == 0) || (strcmp(arg, "--restart") == 0)) && has_value) {
+            restart = S64(strtoul(argv[++i], nullptr, 10));
+        } else if (((strcmp(arg, "-W") == 0) || (strcmp(arg, "--slack") == 0)) && has_value) {
+            slack_us = U32(strtoul(argv[++i], nullptr, 10));
+        } else if (((strcmp(arg, "-L") == 0) || (strcmp(arg, "--limit") == 0)) && has_value) {
+            if (ParseTimingLimit(argv[++i], timing_min, timing_max) == false) {
+                fprintf(stderr, "qi-decode: invalid timing limit '%s'\n", argv[i]);
+                return 2;
+            }
+        } else if ((strcmp(arg, "-I") == 0) || (strcmp(arg, "--index") == 0)) {
+            packet_index = true;
+        } else if ((strcmp(arg, "-c") == 0) || (strcmp(arg, "--coils") == 0)) {
+            coils = true;
+        } else if ((strcmp(arg, "-k") == 0) || (strcmp(arg, "--fsk") == 0)) {
+            fsk = true;
+        } else if ((strcmp(arg, "-l") == 0) || (strcmp(arg, "--live") == 0)) {
+            live = true;
+        } else if ((strcmp(arg, "-h") == 0) || (strcmp(arg, "--help") == 0)) {
+            PrintUsage();
+            return 0;
+        } else if ((arg[0] == '-') && (arg[1] != '\0')) {
+            fprintf(stderr, "qi-decode: unknown option '%s'\n", arg);
+            PrintUsage();
+            return 2;
+        } else {
+            inputs.push_back(arg);
+        }
+    }
+
+    bool single_output = (output_path != nullptr) || (records_path != nullptr) || (packets_path != nullptr) ||
+                         (sessions_path != nullptr) || (violations_path != nullptr) || (matches_path != nullptr) ||
+                         (collapsed_path != nullptr);
+    bool too_many = coils ? (inputs.size() > kQiMaxChannels) : (single_output && (inputs.size() != 1));
+    if ((sample_rate_hz == 0) || inputs.empty() || too_many || ((search_text != nullptr) != (matches_path != nullptr))) {
+        PrintUsage();
+        return 2;
+    }
+    if (fsk) {
+        // Only the bytes of the carrier are written; the other outputs are of the receiver's packets
+        if (coils || (records_path != nullptr) || (packets_path != nullptr) || (stats_path != nullptr) ||
+            (sessions_path != nullptr) || (violations_path != nullptr) || (matches_path != nullptr) ||
+            (collapsed_path != nullptr)) {
+            PrintUsage();
+            return 2;
+        }
+        return DecodeCarriers(inputs, format, sample_bit, sample_rate_hz, output_path);
+    }
+
+    U64 min_pulse_width = U64(glitch_us) * sample_rate_hz / 1000000;
+
+    // A live stream is a single capture that is read once, from a pipe or socket rather than a file
+    if (live && (coils || (inputs.size() != 1) || (thread_count != 1) || (checkpoint_path != nullptr) || (collapsed_path != nullptr) ||
+                 ((format != QiEdgeFileText) && (format != QiEdgeFileBinary)))) {
+        PrintUsage();
+        return 2;
+    }
+
+    // An incremental decode continues the outputs where its checkpoint left them, so it is limited to one capture that
+    // is read from the start, and to the outputs that are written in order
+    QiCheckpointJournal journal;
+    QiCheckpoint        checkpoint;
+    bool                resume = false;
+    memset(&checkpoint, 0, sizeof(checkpoint));
+    if (checkpoint_path != nullptr) {
+        if (coils || (inputs.size() != 1) || (thread_count != 1) || packet_index || (sessions_path != nullptr) ||
+            (violations_path != nullptr) || (matches_path != nullptr) || (collapsed_path != nullptr) ||
+            ((format != QiEdgeFileText) && (format != QiEdgeFileBinary)) ||
+            ((output_path != nullptr) && (strcmp(output_path, "-") == 0))) {
+            PrintUsage();
+            return 2;
+        }
+
+        std::string error;
+        if (journal.Open(checkpoint_path, error) == false) {
+            fprintf(stderr, "qi-decode: %s\n", error.c_str());
+            return 1;
+        }
+        if ((restart > S64(journal.GetCount())) || ((restart >= 0) && (journal.Truncate(U32(restart)) == false))) {
+            fprintf(stderr, "qi-decode: cannot restart from checkpoint %lld of %u\n", restart, journal.GetCount());
+            return 1;
+        }
+
+        checkpoint.mFormat        = U32(format);
+        checkpoint.mSampleRateHz  = sample_rate_hz;
+        checkpoint.mMinPulseWidth = min_pulse_width;
+        if (journal.GetCount() > 0) {
+            const QiCheckpoint& last = journal.Get(journal.GetCount() - 1);
+            bool same_outputs = ((last.mOutputSizes[QiCheckpointBytes] != 0) == (output_path != nullptr)) &&
+                                ((last.mOutputSizes[QiCheckpointRecords] != 0) == (records_path != nullptr)) &&
+                                ((last.mOutputSizes[QiCheckpointPackets] != 0) == (packets_path != nullptr));
+            if ((last.mFormat != checkpoint.mFormat) || (last.mSampleRateHz != sample_rate_hz) ||
+                (last.mMinPulseWidth != min_pulse_width) || (same_outputs == false)) {
+                fprintf(stderr, "qi-decode: %s was written with other settings or outputs\n", checkpoint_path);
+                return 1;
+            }
+            checkpoint = last;
+            resume     = true;
+        }
+    }
+
+    FILE* output = nullptr;
+    if (output_path != nullptr) {
+        if (resume)
+            output = QiOpenFileAt(output_path, checkpoint.mOutputSizes[QiCheckpointBytes]);
+        else
+            output = (strcmp(output_path, "-") == 0) ? stdout : fopen(output_path, "w");
+        if (output == nullptr) {
+            fprintf(stderr, "qi-decode: cannot %s %s\n", resume ? "continue" : "create", output_path);
+            return 1;
+        }
+        static char output_buffer[1 << 16];
+        setvbuf(output, output_buffer, _IOFBF, sizeof(output_buffer));
+        if (resume == false)
+            fprintf(output, coils ? "Sample,Time [s],Packet,Payload,Packet Byte,Parity,Stop,Coil\n"
+                                  : "Sample,Time [s],Packet,Payload,Packet Byte,Parity,Stop\n");
+    }
+
+    QiRecordWriter records;
+    if ((records_path != nullptr) &&
+        ((resume ? records.OpenAt(records_path, checkpoint.mOutputSizes[QiCheckpointRecords])
+                 : records.Open(records_path, sample_rate_hz, 0)) == false)) {
+        fprintf(stderr, "qi-decode: cannot %s %s\n", resume ? "continue" : "create", records_path);
+        return 1;
+    }
+
+    QiPacketCsvWriter packets;
+    std::string       index_path = (packets_path != nullptr) ? std::string(packets_path) + ".idx" : std::string();
+    if ((packets_path != nullptr) &&
+        ((resume ? packets.OpenAt(packets_path, checkpoint.mOutputSizes[QiCheckpointPackets], sample_rate_hz, 0)
+                 : packets.Open(packets_path, packet_index ? index_path.c_str() : nullptr, sample_rate_hz, 0, coils)) ==
+         false)) {
+        fprintf(stderr, "qi-decode: cannot %s %s\n", resume ? "continue" : "create", packets_path);
+        return 1;
+    }
+
+    FILE* stats_file = nullptr;
+    if (stats_path != nullptr) {
+        stats_file = (strcmp(stats_path, "-") == 0) ? stdout : fopen(stats_path, "w");
+        if (stats_file == nullptr) {
+            fprintf(stderr, "qi-decode: cannot create %s\n", stats_path);
+            return 1;
+        }
+        fprintf(stats_file,
+                "Capture,Edges,Glitches Filtered,Idle Skips,Glitch Edges,Sync Attempts,Syncs,Bytes,Parity Errors,"
+                "Stop Errors,Packets,Checksum Errors,Capture [s],Decode [s],Decode [ns/edge]\n");
+    }
+
+    FILE* violations = nullptr;
+    if (violations_path != nullptr) {
+        violations = (strcmp(violations_path, "-") == 0) ? stdout : fopen(violations_path, "w");
+        if (violations == nullptr) {
+            fprintf(stderr, "qi-decode: cannot create %s\n", violations_path);
+            return 1;
+        }
+        fprintf(violations, coils ? "Time [s],Duration [s],Rule,Value,Unit,Limit Type,Limit,Coil\n"
+                                  : "Time [s],Duration [s],Rule,Value,Unit,Limit Type,Limit\n");
+    }
+
+    QiSearchPatterns patterns;
+    FILE*            matches = nullptr;
+    if (matches_path != nullptr) {
+        std::string text;
+        std::string error;
+        if ((search_text[0] == '@') && (ReadTextFile(search_text + 1, text) == false)) {
+            fprintf(stderr, "qi-decode: cannot read %s\n", search_text + 1);
+            return 1;
+        }
+        if (patterns.Compile((search_text[0] == '@') ? text.c_str() : search_text, error) == false) {
+            fprintf(stderr, "qi-decode: %s\n", error.c_str());
+            return 2;
+        }
+
+        matches = (strcmp(matches_path, "-") == 0) ? stdout : fopen(matches_path, "w");
+        if (matches == nullptr) {
+            fprintf(stderr, "qi-decode: cannot create %s\n", matches_path);
+            return 1;
+        }
+        fprintf(matches, coils ? "Time [s],Duration [s],Pattern,Packets,Header,Message,Coil\n"
+                               : "Time [s],Duration [s],Pattern,Packets,Header,Message\n");
+    }
+
+    FILE* collapsed = nullptr;
+    if (collapsed_path != nullptr) {
+        collapsed = (strcmp(collapsed_path, "-") == 0) ? stdout : fopen(collapsed_path, "w");
+        if (collapsed == nullptr) {
+            fprintf(stderr, "qi-decode: cannot create %s\n", collapsed_path);
+            return 1;
+        }
+        fprintf(collapsed, coils ? "Sample,Time [s],Type,Value,Repeats,Control Error Min,Control Error Max,Coil\n"
+                                 : "Sample,Time [s],Type,Value,Repeats,Control Error Min,Control Error Max\n");
+    }
+
+    int    result         = 0;
+    U64    total_edges    = 0;
+    U64    total_rejected = 0;
+    U64    total_bytes    = 0;
+    double total_time     = 0.0;
+
+    if (checkpoint_path != nullptr) {
+        CsvWriter writer(output,
+                         (records_path != nullptr) ? &records : nullptr,
+                         (packets_path != nullptr) ? &packets : nullptr,
+                         sample_rate_hz,
+                         -1,
+                         false);
+        if (resume)
+            writer.RestoreCounts(checkpoint.mByteCount, checkpoint.mPacketCount, checkpoint.mChecksumErrorCount);
+
+        IncrementalOutputs outputs = { output,
+                                       (records_path != nullptr) ? &records : nullptr,
+                                       (packets_path != nullptr) ? &packets : nullptr };
+        DecodeStats        stats;
+        std::string        error;
+        if (DecodeIncremental(inputs[0], tolerance, journal, checkpoint, resume, writer, outputs, stats, error) == false) {
+            fprintf(stderr, "qi-decode: %s\n", error.c_str());
+            result = 1;
+        } else {
+            PrintSummary(inputs[0], stats, writer.GetByteCount());
+            if (stats_file != nullptr)
+                WriteStatsRow(stats_file, inputs[0], stats, writer.GetPacketCount(), writer.GetChecksumErrorCount());
+        }
+        if (journal.Close() == false) {
+            fprintf(stderr, "qi-decode: error writing %s\n", checkpoint_path);
+            result = 1;
+        }
+    } else if (live) {
+        CsvWriter writer(output,
+                         (records_path != nullptr) ? &records : nullptr,
+                         (packets_path != nullptr) ? &packets : nullptr,
+                         sample_rate_hz,
+                         -1,
+                         sessions_path != nullptr);
+        if (violations != nullptr)
+            writer.SetViolationFile(violations, timing_min, timing_max);
+        if (matches != nullptr)
+            writer.SetMatchFile(matches, &patterns);
+
+        LiveOutputs        outputs = { output,
+                                       (records_path != nullptr) ? &records : nullptr,
+                                       (packets_path != nullptr) ? &packets : nullptr,
+                                       violations,
+                                       matches };
+        QiLatencyHistogram byte_latency;
+        QiLatencyHistogram packet_latency;
+        DecodeStats        stats = DecodeStats();
+        std::string        error;
+        bool               decoded = DecodeLive(inputs[0], format, sample_rate_hz, tolerance, min_pulse_width, slack_us,
+                                                writer, outputs, &byte_latency, &packet_latency, stats, error);
+        if (decoded == false) {
+            fprintf(stderr, "qi-decode: %s\n", error.c_str());
+            result = 1;
+        }
+
+        // Whatever was decoded before a read error is reported too
+        if (decoded || (stats.mEdgeCount > 0))
+            PrintSummary(inputs[0], stats, writer.GetByteCount());
+        PrintLatency("byte", byte_latency);
+        PrintLatency("packet", packet_latency);
+        if (stats_file != nullptr)
+            WriteStatsRow(stats_file, inputs[0], stats, writer.GetPacketCount(), writer.GetChecksumErrorCount());
+
+        const QiSessionStats* sessions = &writer.GetSessionStats();
+        if ((sessions_path != nullptr) && (QiWriteSessionStats(sessions_path, 0, &sessions, 1) == false)) {
+            fprintf(stderr, "qi-decode: error writing %s\n", sessions_path);
+            result = 1;
+        }
+    } else if (coils) {
+        std::vector<std::unique_ptr<CsvWriter>> writers;
+        std::vector<QiDecoderListener*>         listeners;
+        for (size_t i = 0; i < inputs.size(); i++) {
+            writers.emplace_back(new CsvWriter(output,
+                                               (records_path != nullptr) ? &records : nullptr,
+                                               (packets_path != nullptr) ? &packets : nullptr,
+                                               sample_rate_hz,
+                                               S32(i),
+                                               sessions_path != nullptr));
+            if (violations != nullptr)
+                writers.back()->SetViolationFile(violations, timing_min, timing_max);
+            if (matches != nullptr)
+                writers.back()->SetMatchFile(matches, &patterns);
+            if (collapsed != nullptr)
+                writers.back()->SetCollapsedFile(collapsed, ce_tolerance, timing_min, timing_max);
+            listeners.push_back(writers.back().get());
+        }
+
+        DecodeStats stats;
+        std::string error;
+        if (DecodeCoils(inputs, format, sample_bit, sample_rate_hz, tolerance, min_pulse_width, listeners, stats, error) ==
+            false) {
+            fprintf(stderr, "qi-decode: %s\n", error.c_str());
+            result = 1;
+        } else {
+            U64 packet_count         = 0;
+            U64 checksum_error_count = 0;
+            for (size_t i = 0; i < writers.size(); i++) {
+                writers[i]->Finish();
+                total_bytes += writers[i]->GetByteCount();
+                packet_count += writers[i]->GetPacketCount();
+                checksum_error_count += writers[i]->GetChecksumErrorCount();
+            }
+            PrintSummary("coils", stats, total_bytes);
+            if (stats_file != nullptr)
+                WriteStatsRow(stats_file, "coils", stats, packet_count, checksum_error_count);
+
+            std::vector<const QiSessionStats*> sessions;
+            for (size_t i = 0; i < writers.size(); i++)
+                sessions.push_back(&writers[i]->GetSessionStats());
+            if ((sessions_path != nullptr) && (QiWriteSessionStats(sessions_path, 0, &sessions[0], U32(sessions.size())) == false)) {
+                fprintf(stderr, "qi-decode: error writing %s\n", sessions_path);
+                result = 1;
+            }
+        }
+    } else {
+        for (size_t i = 0; i < inputs.size(); i++) {
+            CsvWriter writer(output,
+                             (records_path != nullptr) ? &records : nullptr,
+                             (packets_path != nullptr) ? &packets : nullptr,
+                             sample_rate_hz,
+                             -1,
+                             sessions_path != nullptr);
+            if (violations != nullptr)
+                writer.SetViolationFile(violations, timing_min, timing_max);
+            if (matches != nullptr)
+                writer.SetMatchFile(matches, &patterns);
+            if (collapsed != nullptr)
+                writer.SetCollapsedFile(collapsed, ce_tolerance, timing_min, timing_max);
+
+            // Logic 2 exports are streamed from a memory mapping unless they are split over several threads
+            DecodeStats stats;
+            std::string error;
+            bool        decoded = ((format == QiEdgeFileSaleae) && (thread_count == 1))
+                                      ? DecodeMapped(inputs[i], sample_rate_hz, tolerance, min_pulse_width, writer, stats, error)
+                                      : DecodeInMemory(inputs[i], format, sample_bit, sample_rate_hz, tolerance,
+                                                       min_pulse_width, thread_count, writer, stats, error);
+            if (decoded == false) {
+                fprintf(stderr, "qi-decode: %s\n", error.c_str());
+                result = 1;
+                continue;
+            }
+
+            writer.Finish();
+            PrintSummary(inputs[i], stats, writer.GetByteCount());
+            if (stats_file != nullptr)
+                WriteStatsRow(stats_file, inputs[i], stats, writer.GetPacketCount(), writer.GetChecksumErrorCount());
+
+            const QiSessionStats* sessions = &writer.GetSessionStats();
+            if ((sessions_path != nullptr) && (QiWriteSessionStats(sessions_path, 0, &sessions, 1) == false)) {
+                fprintf(stderr, "qi-decode: error writing %s\n", sessions_path);
+                result = 1;
+            }
+
+            total_edges += stats.mEdgeCount;
+            total_rejected += stats.mRejectedEdgeCount;
+            total_bytes += writer.GetByteCount();
+            total_time += stats.mElapsed;
+        }
+    }
+
+    if ((coils == false) && (inputs.size() > 1)) {
+        fprintf(stderr,
+                "total: %llu edges (%llu rejected as glitches), %llu bytes decoded in %.3f s (%.0f bytes/s, %.0f edges/s)\n",
+                total_edges,
+                total_rejected,
+                total_bytes,
+                total_time,
+                (total_time > 0.0) ? double(total_bytes) / total_time : 0.0,
+                (total_time > 0.0) ? double(total_edges) / total_time : 0.0);
+    }
+
+    if ((output != nullptr) && (output != stdout) && (fclose(output) != 0)) {
+        fprintf(stderr, "qi-decode: error writing %s\n", output_path);
+        result = 1;
+    }
+    if ((violations != nullptr) && (violations != stdout) && (fclose(violations) != 0)) {
+        fprintf(stderr, "qi-decode: error writing %s\n", violations_path);
+        result = 1;
+    }
+    if ((matches != nullptr) && (matches != stdout) && (fclose(matches) != 0)) {
+        fprintf(stderr, "qi-decode: error writing %s\n", matches_path);
+        result = 1;
+    }
+    if ((collapsed != nullptr) && (collapsed != stdout) && (fclose(collapsed) != 0)) {
+        fprintf(stderr, "qi-decode: error writing %s\n", collapsed_path);
+        result = 1;
+    }
+    if ((stats_file != nullptr) && (stats_file != stdout) && (fclose(stats_file) != 0)) {
+        fprintf(stderr, "qi-decode: error writing %s\n", stats_path);
+        result = 1;
+    }
+    if ((records_path != nullptr) && (records.Close() == false)) {
+        fprintf(stderr, "qi-decode: error writing %s\n", records_path);
+        result = 1;
+    }
+    if ((packets_path != nullptr) && (packets.Close() == false)) {
+        fprintf(stderr, "qi-decode: error writing %s\n", packets_path);
+        result = 1;
+    }
+
+    return result;
+}
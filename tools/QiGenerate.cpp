@@ -0,0 +1,261 @@
+// qi-generate: writes edge files of generated Qi sessions, to test the decoder with realistic traffic at any size.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "QiEdgeFile.h"
+#include "QiPacket.h"
+#include "QiPacketExport.h"
+#include "QiTrafficGenerator.h"
+
+// Edges are written out whenever this many have been generated.
+static const size_t kFlushEdgeCount = 1 << 20;
+
+typedef std::chrono::steady_clock Clock;
+
+static void PrintUsage() {
+    fprintf(stderr,
+            "usage: qi-generate [-r RATE] [-f text|binary] [-n SESSIONS] [-c PACKETS] [-s SEED] [-p BITS]\n"
+            "                   [-e FRACTION] [-d FRACTION] [-D MS] [-J FRACTION] [-G PER_SECOND] [-w US]\n"
+            "                   [-a PACKET] [-P TRUTH.csv] -o OUTPUT\n"
+            "       qi-generate -k MESSAGES [-r RATE] [-f text|binary] [-s SEED] [-F HZ] [-m FRACTION] [-J FRACTION] -o OUTPUT\n"
+            "\n"
+            "  -r, --rate RATE       sample rate in Hz (default 1000000)\n"
+            "  -f, --format FORMAT   text: one edge sample number per line\n"
+            "                        binary: little-endian 64-bit edge sample numbers (default)\n"
+            "  -o, --output FILE     edge file to write ('-' for stdout)\n"
+            "  -n, --sessions N      number of power transfer sessions (default 1)\n"
+            "  -c, --control N       control error packets per session (default 100)\n"
+            "  -s, --seed SEED       random seed (default 1); the output only depends on the seed and the options\n"
+            "  -p, --preamble BITS   preamble length, 11-255 (default: random within 11-25 for every packet)\n"
+            "  -e, --period-error F  each session's bit rate is off by up to +/- F (e.g. 0.05)\n"
+            "  -d, --drift F         the bit rate wanders by up to +/- F within a session\n"
+            "  -D, --drift-period MS period of the drift (default 1000)\n"
+            "  -J, --jitter F        every edge moves by up to +/- F of the bit period\n"
+            "  -G, --glitches N      add N glitches per second, in packets and gaps alike\n"
+            "  -w, --glitch-width US longest glitch (default 20)\n"
+            "  -a, --append PACKET   end with this packet after the last session: its header and message bytes in\n"
+            "                        hex, e.g. '22 10 20'; the checksum is added\n"
+            "  -P, --packets FILE    write the generated packets as qi-decode -P would decode them\n"
+            "  -k, --carrier N       write N transmitter messages on the power carrier instead, for qi-decode -k: FSK\n"
+            "                        packets, ACK/NAK/ND responses and steps of the operating frequency; the rate\n"
+            "                        defaults to 20000000 and -J is a fraction of the carrier period\n"
+            "  -F, --carrier-frequency HZ\n"
+            "                        operating frequency of the carrier (default 140000)\n"
+            "  -m, --depth F         the modulation lengthens the carrier period by F (default 0.01)\n");
+}
+
+// Parses the header and message bytes of a packet, in hex and separated by spaces; false if they are not a whole packet.
+static bool ParsePacket(const char* text, U8* header, U8* message) {
+    U32         count = 0;
+    const char* p     = text;
+    for (;;) {
+        while (*p == ' ')
+            p++;
+        if (*p == '\0')
+            break;
+
+        char*         end   = nullptr;
+        unsigned long value = strtoul(p, &end, 16);
+        if ((end == p) || ((*end != ' ') && (*end != '\0')) || (value > 0xFF) || (count > kQiMaxPacketSize))
+            return false;
+        if (count == 0)
+            *header = U8(value);
+        else
+            message[count - 1] = U8(value);
+        count++;
+        p = end;
+    }
+    return (count > 0) && (count == 1U + QiPacketSizeForHeader(*header));
+}
+
+// Writes the messages of a transmitter on the power carrier, each after a stretch of idle carrier and the last one
+// followed by one, so that its last bit ends.
+static int GenerateCarrier(const QiCarrierSettings& settings, U64 message_count, QiEdgeFileWriter& output, const char* output_path) {
+    QiCarrierGenerator generator;
+    generator.Reset(settings);
+
+    std::vector<U64> edges;
+    edges.reserve(kFlushEdgeCount + 65536);
+
+    Clock::time_point start = Clock::now();
+    while (generator.GetMessageCount() < message_count) {
+        generator.AddNextMessage(edges);
+        if (edges.size() >= kFlushEdgeCount) {
+            output.Write(edges.data(), edges.size());
+            edges.clear();
+        }
+    }
+    generator.AddIdle(settings.mIdleCycles, edges);
+    U64 end = edges.empty() ? 0 : edges.back();
+    output.Write(edges.data(), edges.size());
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    int result = 0;
+    if (output.Close() == false) {
+        fprintf(stderr, "qi-generate: error writing %s\n", output_path);
+        result = 1;
+    }
+    fprintf(stderr,
+            "%llu edges, %llu carrier messages, %.3f s of capture generated in %.3f s\n",
+            generator.GetEdgeCount(),
+            generator.GetMessageCount(),
+            double(end) / double(settings.mSampleRateHz),
+            elapsed);
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    QiTrafficSettings settings;
+    QiEdgeFileFormat  format        = QiEdgeFileBinary;
+    U64               session_count = 1;
+    const char*       output_path   = nullptr;
+    const char*       packets_path  = nullptr;
+    QiCarrierSettings carrier;
+    U64               carrier_count = 0;
+    bool              rate_set      = false;
+    const char*       append        = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg       = argv[i];
+        bool        has_value = (i + 1 < argc);
+
+        if (((strcmp(arg, "-r") == 0) || (strcmp(arg, "--rate") == 0)) && has_value) {
+            settings.mSampleRateHz = U32(strtoul(argv[++i], nullptr, 10));
+            rate_set               = true;
+        } else if (((strcmp(arg, "-f") == 0) || (strcmp(arg, "--format") == 0)) && has_value) {
+            if ((QiParseEdgeFileFormat(argv[++i], &format) == false) ||
+                ((format != QiEdgeFileText) && (format != QiEdgeFileBinary))) {
+                fprintf(stderr, "qi-generate: unsupported format '%s'\n", argv[i]);
+                return 2;
+            }
+        } else if (((strcmp(arg, "-o") == 0) || (strcmp(arg, "--output") == 0)) && has_value) {
+            output_path = argv[++i];
+        } else if (((strcmp(arg, "-n") == 0) || (strcmp(arg, "--sessions") == 0)) && has_value) {
+            session_count = strtoull(argv[++i], nullptr, 10);
+        } else if (((strcmp(arg, "-c") == 0) || (strcmp(arg, "--control") == 0)) && has_value) {
+            settings.mControlPackets = U32(strtoul(argv[++i], nullptr, 10));
+        } else if (((strcmp(arg, "-s") == 0) || (strcmp(arg, "--seed") == 0)) && has_value) {
+            settings.mSeed = strtoull(argv[++i], nullptr, 10);
+        } else if (((strcmp(arg, "-p") == 0) || (strcmp(arg, "--preamble") == 0)) && has_value) {
+            settings.mPreambleBits = U32(strtoul(argv[++i], nullptr, 10));
+        } else if (((strcmp(arg, "-e") == 0) || (strcmp(arg, "--period-error") == 0)) && has_value) {
+            settings.mPeriodError = strtod(argv[++i], nullptr);
+        } else if (((strcmp(arg, "-d") == 0) || (strcmp(arg, "--drift") == 0)) && has_value) {
+            settings.mDrift = strtod(argv[++i], nullptr);
+        } else if (((strcmp(arg, "-D") == 0) || (strcmp(arg, "--drift-period") == 0)) && has_value) {
+            settings.mDriftPeriodMs = U32(strtoul(argv[++i], nullptr, 10));
+        } else if (((strcmp(arg, "-J") == 0) || (strcmp(arg, "--jitter") == 0)) && has_value) {
+            settings.mJitter = strtod(argv[++i], nullptr);
+        } else if (((strcmp(arg, "-G") == 0) || (strcmp(arg, "--glitches") == 0)) && has_value) {
+            settings.mGlitchesPerSecond = strtod(argv[++i], nullptr);
+        } else if (((strcmp(arg, "-w") == 0) || (strcmp(arg, "--glitch-width") == 0)) && has_value) {
+            settings.mGlitchWidthUs = U32(strtoul(argv[++i], nullptr, 10));
+        } else if (((strcmp(arg, "-a") == 0) || (strcmp(arg, "--append") == 0)) && has_value) {
+            append = argv[++i];
+        } else if (((strcmp(arg, "-P") == 0) || (strcmp(arg, "--packets") == 0)) && has_value) {
+            packets_path = argv[++i];
+        } else if (((strcmp(arg, "-k") == 0) || (strcmp(arg, "--carrier") == 0)) && has_value) {
+            carrier_count = strtoull(argv[++i], nullptr, 10);
+        } else if (((strcmp(arg, "-F") == 0) || (strcmp(arg, "--carrier-frequency") == 0)) && has_value) {
+            carrier.mCarrierHz = U32(strtoul(argv[++i], nullptr, 10));
+        } else if (((strcmp(arg, "-m") == 0) || (strcmp(arg, "--depth") == 0)) && has_value) {
+            carrier.mDepth = strtod(argv[++i], nullptr);
+        } else if ((strcmp(arg, "-h") == 0) || (strcmp(arg, "--help") == 0)) {
+            PrintUsage();
+            return 0;
+        } else {
+            fprintf(stderr, "qi-generate: unknown option '%s'\n", arg);
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    bool preamble_valid = (settings.mPreambleBits == 0) ||
+                          ((settings.mPreambleBits >= kQiMinPreambleBits) && (settings.mPreambleBits <= kQiMaxPreambleBits));
+    if (carrier_count > 0) {
+        if (rate_set)
+            carrier.mSampleRateHz = settings.mSampleRateHz;
+        carrier.mSeed   = settings.mSeed;
+        carrier.mJitter = settings.mJitter;
+    }
+    bool carrier_valid = (carrier_count == 0) || ((packets_path == nullptr) && (append == nullptr) && (carrier.mCarrierHz > 0) &&
+                                                  (carrier.mSampleRateHz / carrier.mCarrierHz >= 8) && (carrier.mDepth > 0.0));
+    U8   append_header = 0;
+    U8   append_message[kQiMaxPacketSize];
+    bool append_valid  = (append == nullptr) || ParsePacket(append, &append_header, append_message);
+    if ((output_path == nullptr) || (settings.mSampleRateHz == 0) || (preamble_valid == false) || (carrier_valid == false) ||
+        (append_valid == false)) {
+        PrintUsage();
+        return 2;
+    }
+
+    QiEdgeFileWriter output;
+    if (output.Open(output_path, format) == false) {
+        fprintf(stderr, "qi-generate: cannot create %s\n", output_path);
+        return 1;
+    }
+    if (carrier_count > 0)
+        return GenerateCarrier(carrier, carrier_count, output, output_path);
+
+    QiPacketCsvWriter packets;
+    if ((packets_path != nullptr) && (packets.Open(packets_path, nullptr, settings.mSampleRateHz, 0) == false)) {
+        fprintf(stderr, "qi-generate: cannot create %s\n", packets_path);
+        return 1;
+    }
+
+    QiTrafficGenerator generator;
+    generator.Reset(settings);
+
+    std::vector<U64> edges;
+    edges.reserve(kFlushEdgeCount + 4096);
+
+    Clock::time_point start = Clock::now();
+    U64               end   = 0;
+    while (session_count > 0) {
+        const QiPacket& packet = generator.AddNextPacket(edges);
+        if (packets_path != nullptr)
+            packets.Write(packet);
+        end = packet.mEnd;
+
+        if (edges.size() >= kFlushEdgeCount) {
+            output.Write(edges.data(), edges.size());
+            edges.clear();
+        }
+        if ((packet.mHeader == QiHeaderEndPowerTransfer) && (generator.GetSessionCount() == session_count))
+            break;
+    }
+    if (append != nullptr) {
+        const QiPacket& packet = generator.AddPacket(append_header, append_message, settings.mPacketGapMs, edges);
+        if (packets_path != nullptr)
+            packets.Write(packet);
+        end = packet.mEnd;
+    }
+    output.Write(edges.data(), edges.size());
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    int result = 0;
+    if (output.Close() == false) {
+        fprintf(stderr, "qi-generate: error writing %s\n", output_path);
+        result = 1;
+    }
+    if ((packets_path != nullptr) && (packets.Close() == false)) {
+        fprintf(stderr, "qi-generate: error writing %s\n", packets_path);
+        result = 1;
+    }
+
+    fprintf(stderr,
+            "%llu edges, %llu packets in %llu sessions, %.3f s of capture generated in %.3f s (%.0f edges/s)\n",
+            generator.GetEdgeCount(),
+            generator.GetPacketCount(),
+            generator.GetSessionCount(),
+            double(end) / double(settings.mSampleRateHz),
+            elapsed,
+            (elapsed > 0.0) ? double(generator.GetEdgeCount()) / elapsed : 0.0);
+
+    return result;
+}